@@ -130,11 +130,12 @@ loadAttribute_Code(ClassFile *cf,
         logError("Assertion error: Exception table length is negative!\r\n");
         return -1;
     }
-    loadAttributes_code(cf, input, data,
+    info->data = data;
+    if (loadAttributes_code(cf, input, data,
             &(data->attributes_count),
-            &(data->attributes));
+            &(data->attributes)) < 0)
+        return -1;
 
-    info->data = data;
     return 0;
 }
 
@@ -1907,6 +1908,19 @@ loadAttribute_code(ClassFile *cf, struct BufferIO *input, attr_info *info)
     return skipAttribute(input, attribute_name_length, attribute_name, info);
 }
 
+/*
+ * Keeps the attributes loaded before entry `loaded` failed,
+ * the failed entry may be half filled and is dropped
+ */
+static int
+truncateAttributes(u2 *attributes_count, attr_info *attributes, u2 loaded)
+{
+    logError("Fail to load attribute #%u of %u!\r\n", loaded, *attributes_count);
+    memset(&(attributes[loaded]), 0, sizeof (attr_info));
+    *attributes_count = loaded;
+    return -1;
+}
+
 extern int
 loadAttributes_class(ClassFile *cf, struct BufferIO *input, u2 *attributes_count, attr_info **attributes)
 {
@@ -1916,9 +1930,11 @@ loadAttributes_class(ClassFile *cf, struct BufferIO *input, u2 *attributes_count
         return -1;
     if (ru2(attributes_count, input) < 0)
         return -1;
-    *attributes = (attr_info *) malloc(*attributes_count * sizeof (attr_info));
+    *attributes = (attr_info *) allocMemory(*attributes_count, sizeof (attr_info));
+    if (!*attributes) return -1;
     for (i = 0u; i < *attributes_count; i++)
-        loadAttribute_class(cf, input, &((*attributes)[i]));
+        if (loadAttribute_class(cf, input, &((*attributes)[i])) < 0)
+            return truncateAttributes(attributes_count, *attributes, i);
     return 0;
 }
 
@@ -2024,11 +2040,11 @@ loadAttributes_field(ClassFile *cf,
         return -1;
     if (ru2(attributes_count, input) < 0)
         return -1;
-    //*attributes = (attr_info *) malloc(*attributes_count * sizeof (attr_info));
     *attributes = (attr_info *) allocMemory(*attributes_count, sizeof (attr_info));
     if (!*attributes) return -1;
     for (i = 0u; i < *attributes_count; i++)
-        loadAttribute_field(cf, input, field, &((*attributes)[i]));
+        if (loadAttribute_field(cf, input, field, &((*attributes)[i])) < 0)
+            return truncateAttributes(attributes_count, *attributes, i);
     return 0;
 }
 
@@ -2094,9 +2110,11 @@ loadAttributes_method(ClassFile *cf,
         return -1;
     if (ru2(attributes_count, input) < 0)
         return -1;
-    *attributes = (attr_info *) malloc(*attributes_count * sizeof (attr_info));
+    *attributes = (attr_info *) allocMemory(*attributes_count, sizeof (attr_info));
+    if (!*attributes) return -1;
     for (i = 0u; i < *attributes_count; i++)
-        loadAttribute_method(cf, input, method, &((*attributes)[i]));
+        if (loadAttribute_method(cf, input, method, &((*attributes)[i])) < 0)
+            return truncateAttributes(attributes_count, *attributes, i);
 
     return 0;
 }
@@ -2155,9 +2173,11 @@ loadAttributes_code(ClassFile *cf,
         return -1;
     if (ru2(attributes_count, input) < 0)
         return -1;
-    *attributes = (attr_info *) malloc(*attributes_count * sizeof (attr_info));
+    *attributes = (attr_info *) allocMemory(*attributes_count, sizeof (attr_info));
+    if (!*attributes) return -1;
     for (i = 0u; i < *attributes_count; i++)
-        loadAttribute_code(cf, input, &((*attributes)[i]));
+        if (loadAttribute_code(cf, input, &((*attributes)[i])) < 0)
+            return truncateAttributes(attributes_count, *attributes, i);
     return 0;
 }
 
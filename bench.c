@@ -0,0 +1,427 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "java.h"
+#include "input.h"
+#include "vrf.h"
+#include "rt.h"
+#include "bytecode.h"
+#include "cfg.h"
+#include "ir.h"
+#include "expr.h"
+#include "bench.h"
+#include "log.h"
+#include "memory.h"
+
+/*
+ * Benchmarks
+ *
+ * Each one times a piece of the class file pipeline on its own
+ * and reports through logInfo, which is muted while timing.
+ */
+
+#define BENCH_ROUNDS                    5
+#define BENCH_STATEMENT_SIZE            4096
+
+// stages of the method analysis, in the order they run
+#define STAGE_CFG                       0
+#define STAGE_DOMINATORS                1
+#define STAGE_POST_DOMINATORS           2
+#define STAGE_LOOPS                     3
+#define STAGE_IR                        4
+#define STAGE_EXPRESSIONS               5
+#define STAGES_COUNT                    6
+
+static const char *stage_names[STAGES_COUNT] =
+{
+    "control flow graph",
+    "dominators",
+    "post-dominators",
+    "loops",
+    "SSA form",
+    "expressions",
+};
+
+// storage of every stage, reused across methods
+struct AnalysisBench
+{
+    struct CodeMap  map;
+    struct ControlFlowGraph cfg;
+    struct DominatorTree dominators;
+    struct DominatorTree post_dominators;
+    struct LoopForest loops;
+    struct IrMethod ir;
+    u4              classes;
+    u4              methods;
+    // methods failing checkCodeStructure, which no stage can take
+    u4              invalid;
+    // methods some stage rejected, later stages are skipped
+    u4              failures;
+    u8              blocks;
+    u8              loops_count;
+    u8              nodes;
+    u8              statements;
+    double          seconds[STAGES_COUNT];
+    // statements of every method are printed here when set
+    FILE *          listing;
+    char            statement[BENCH_STATEMENT_SIZE];
+};
+
+static double
+getElapsedTime(struct timespec *start)
+{
+    struct timespec end;
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    return (end.tv_sec - start->tv_sec)
+        + (end.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+/*
+ * Class of `count` native methods named m0, m1... sharing one
+ * descriptor, so every pair has to be told apart by its name
+ */
+static int
+createMemberClass(ClassFile *cf, u2 count)
+{
+    struct Symbol *sym;
+    char name[8];
+    u2 i;
+    int len;
+
+    memset(cf, 0, sizeof (ClassFile));
+    cf->major_version = 52;
+    cf->access_flags = ACC_PUBLIC;
+    cf->constant_pool_count = count + 2;
+    cf->constant_pool = (cp_info *)
+        allocMemory(cf->constant_pool_count, sizeof (cp_info));
+    cf->methods = (method_info *) allocMemory(count, sizeof (method_info));
+    if (!cf->constant_pool || !cf->methods)
+        return -1;
+    sym = symbol_intern(3, (u1 *) "()V");
+    if (!sym)
+        return -1;
+    cf->constant_pool[1].tag = CONSTANT_Utf8;
+    cf->constant_pool[1].info.cud.length = sym->length;
+    cf->constant_pool[1].info.cud.bytes = sym->bytes;
+    for (i = 0; i < count; i++)
+    {
+        len = sprintf(name, "m%u", i);
+        sym = symbol_intern((u2) len, (u1 *) name);
+        if (!sym)
+            return -1;
+        cf->constant_pool[i + 2].tag = CONSTANT_Utf8;
+        cf->constant_pool[i + 2].info.cud.length = sym->length;
+        cf->constant_pool[i + 2].info.cud.bytes = sym->bytes;
+        cf->methods[i].access_flags = ACC_PUBLIC | ACC_NATIVE;
+        cf->methods[i].name_index = i + 2;
+        cf->methods[i].descriptor_index = 1;
+    }
+    cf->methods_count = count;
+    return 0;
+}
+
+// the pairwise check validateMethods used to run
+static int
+checkMembersPairwise(ClassFile *cf)
+{
+    const_Utf8_data *name, *descriptor, *name1, *descriptor1;
+    u2 i, j;
+
+    for (i = 0; i < cf->methods_count; i++)
+    {
+        name = getConstant_Utf8(cf, cf->methods[i].name_index);
+        descriptor = getConstant_Utf8(cf, cf->methods[i].descriptor_index);
+        if (!name || !descriptor)
+            return -1;
+        for (j = i + 1; j < cf->methods_count; j++)
+        {
+            name1 = getConstant_Utf8(cf, cf->methods[j].name_index);
+            descriptor1 = getConstant_Utf8(cf,
+                    cf->methods[j].descriptor_index);
+            if (!name1 || !descriptor1)
+                return -1;
+            if (name->length == name1->length
+                    && !memcmp(name->bytes, name1->bytes, name->length)
+                    && descriptor->length == descriptor1->length
+                    && !memcmp(descriptor->bytes, descriptor1->bytes,
+                        descriptor->length))
+                return -1;
+        }
+    }
+    return 0;
+}
+
+extern int
+benchMembers(u2 count)
+{
+    ClassFile cf;
+    struct timespec start;
+    double hashed, pairwise;
+    int i, res;
+
+    res = createMemberClass(&cf, count);
+    hashed = pairwise = 0;
+    // validateMethods reports every descriptor
+    enableInfo(0);
+    for (i = 0; res == 0 && i < BENCH_ROUNDS; i++)
+    {
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        res = validateMethods(&cf);
+        hashed += getElapsedTime(&start);
+        if (res < 0)
+            break;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        res = checkMembersPairwise(&cf);
+        pairwise += getElapsedTime(&start);
+    }
+    enableInfo(1);
+    if (res == 0)
+        logInfo("%u methods, %i rounds: validateMethods %.3f ms, "
+                "pairwise check %.3f ms per round.\r\n",
+                count, BENCH_ROUNDS,
+                hashed * 1e3 / BENCH_ROUNDS,
+                pairwise * 1e3 / BENCH_ROUNDS);
+    else
+        logError("Member benchmark failed!\r\n");
+    freeMemory(cf.constant_pool);
+    freeMemory(cf.methods);
+    return res;
+}
+
+static attr_Code_info *
+findCode(method_info *method)
+{
+    u2 i;
+
+    for (i = 0; i < method->attributes_count; i++)
+        if (method->attributes[i].tag == TAG_ATTR_CODE)
+            return (attr_Code_info *) method->attributes[i].data;
+    return (attr_Code_info *) 0;
+}
+
+static int
+writeStatements(struct AnalysisBench *bench, ClassFile *cf,
+        method_info *method)
+{
+    struct ExpressionWriter writer;
+    struct IrNode *node;
+    u4 i;
+    int length;
+
+    if (initExpressionWriter(&writer, cf, method, &(bench->ir)) < 0)
+        return -1;
+    for (i = 0; i < bench->ir.blocks_count; i++)
+        for (node = bench->ir.blocks[i].first; node; node = node->next)
+        {
+            length = writeStatement(&writer, node, bench->statement,
+                    BENCH_STATEMENT_SIZE);
+            if (length < 0)
+                return -1;
+            if (length > 0)
+                ++bench->statements;
+            if (length > 0 && bench->listing)
+                fprintf(bench->listing, "    %s\n", bench->statement);
+        }
+    return 0;
+}
+
+static int
+runStage(struct AnalysisBench *bench, int stage, ClassFile *cf,
+        method_info *method, attr_Code_info *code)
+{
+    struct timespec start;
+    int res;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    switch (stage)
+    {
+        case STAGE_CFG:
+            res = buildControlFlowGraph(&(bench->cfg), code);
+            break;
+        case STAGE_DOMINATORS:
+            res = computeDominators(&(bench->cfg), &(bench->dominators));
+            break;
+        case STAGE_POST_DOMINATORS:
+            res = computePostDominators(&(bench->cfg),
+                    &(bench->post_dominators));
+            break;
+        case STAGE_LOOPS:
+            res = findLoops(&(bench->cfg), &(bench->dominators),
+                    &(bench->loops));
+            break;
+        case STAGE_IR:
+            res = buildIrMethod(&(bench->ir), cf, method, code,
+                    &(bench->cfg));
+            break;
+        default:
+            res = writeStatements(bench, cf, method);
+            break;
+    }
+    bench->seconds[stage] += getElapsedTime(&start);
+    return res;
+}
+
+static void
+listMethod(FILE *listing, ClassFile *cf, method_info *method)
+{
+    const_Class_data *owner;
+    const_Utf8_data *class_name, *name, *descriptor;
+
+    owner = getConstant_Class(cf, cf->this_class);
+    class_name = owner ? getConstant_Utf8(cf, owner->name_index)
+        : (const_Utf8_data *) 0;
+    name = getConstant_Utf8(cf, method->name_index);
+    descriptor = getConstant_Utf8(cf, method->descriptor_index);
+    if (!class_name || !name || !descriptor)
+        return;
+    fprintf(listing, "%.*s.%.*s%.*s\n",
+            class_name->length, class_name->bytes,
+            name->length, name->bytes,
+            descriptor->length, descriptor->bytes);
+}
+
+static void
+analyzeMethod(struct AnalysisBench *bench, ClassFile *cf,
+        method_info *method)
+{
+    struct VerifyError error;
+    attr_Code_info *code;
+    int stage;
+
+    code = findCode(method);
+    if (!code)
+        return;
+    if (bench->listing)
+        listMethod(bench->listing, cf, method);
+    // the classes aren't verified, the stages expect sound code
+    if (checkCodeStructure(cf, code, &(bench->map), &error) < 0)
+    {
+        ++bench->invalid;
+        if (bench->listing)
+            fprintf(bench->listing, "    invalid @ pc %u: %s\n",
+                    error.pc, error.reason);
+        return;
+    }
+    ++bench->methods;
+    for (stage = 0; stage < STAGES_COUNT; stage++)
+        if (runStage(bench, stage, cf, method, code) < 0)
+        {
+            ++bench->failures;
+            if (bench->listing)
+                fprintf(bench->listing, "    rejected by %s\n",
+                        stage_names[stage]);
+            return;
+        }
+    bench->blocks += bench->cfg.blocks_count;
+    bench->loops_count += bench->loops.loops_count;
+    bench->nodes += bench->ir.nodes_count;
+}
+
+static int
+analyzeClass(void *arg, rt_Class *rtc, ClassFile *cf, const char *name)
+{
+    struct AnalysisBench *bench;
+    u2 i;
+
+    (void) rtc;
+    (void) name;
+    bench = (struct AnalysisBench *) arg;
+    ++bench->classes;
+    for (i = 0; i < cf->methods_count; i++)
+        analyzeMethod(bench, cf, &(cf->methods[i]));
+    return 0;
+}
+
+static struct AnalysisBench *
+createAnalysisBench()
+{
+    struct AnalysisBench *bench;
+
+    bench = (struct AnalysisBench *)
+        allocMemory(1, sizeof (struct AnalysisBench));
+    if (!bench)
+        return bench;
+    initCodeMap(&(bench->map));
+    initControlFlowGraph(&(bench->cfg));
+    initDominatorTree(&(bench->dominators));
+    initDominatorTree(&(bench->post_dominators));
+    initLoopForest(&(bench->loops));
+    initIrMethod(&(bench->ir));
+    return bench;
+}
+
+static void
+deleteAnalysisBench(struct AnalysisBench *bench)
+{
+    releaseIrMethod(&(bench->ir));
+    releaseLoopForest(&(bench->loops));
+    releaseDominatorTree(&(bench->post_dominators));
+    releaseDominatorTree(&(bench->dominators));
+    releaseControlFlowGraph(&(bench->cfg));
+    releaseCodeMap(&(bench->map));
+    freeMemory(bench);
+}
+
+static void
+analyzePaths(struct AnalysisBench *bench, int count, char **paths)
+{
+    int i;
+
+    // decoding reports every constant and attribute
+    enableInfo(0);
+    for (i = 0; i < count; i++)
+        if (rt_loadClasses(paths[i], analyzeClass, bench) < 0)
+            logError("Fail to read '%s'!\r\n", paths[i]);
+    enableInfo(1);
+}
+
+extern int
+benchAnalysis(int count, char **paths)
+{
+    struct AnalysisBench *bench;
+    double total;
+    int i;
+
+    bench = createAnalysisBench();
+    if (!bench)
+        return -1;
+    analyzePaths(bench, count, paths);
+
+    logInfo("%u classes, %u methods with code, %u invalid, %u rejected, "
+            "%llu blocks, %llu loops, %llu nodes, %llu statements.\r\n",
+            bench->classes, bench->methods, bench->invalid, bench->failures,
+            (unsigned long long) bench->blocks,
+            (unsigned long long) bench->loops_count,
+            (unsigned long long) bench->nodes,
+            (unsigned long long) bench->statements);
+    total = 0;
+    for (i = 0; i < STAGES_COUNT; i++)
+    {
+        total += bench->seconds[i];
+        logInfo("%-20s %10.3f ms, %8.3f us per method\r\n",
+                stage_names[i], bench->seconds[i] * 1e3,
+                bench->methods ? bench->seconds[i] * 1e6 / bench->methods
+                    : 0.0);
+    }
+    logInfo("%-20s %10.3f ms\r\n", "total", total * 1e3);
+
+    deleteAnalysisBench(bench);
+    return 0;
+}
+
+extern int
+listStatements(int count, char **paths)
+{
+    struct AnalysisBench *bench;
+
+    bench = createAnalysisBench();
+    if (!bench)
+        return -1;
+    bench->listing = stdout;
+    analyzePaths(bench, count, paths);
+    deleteAnalysisBench(bench);
+    return 0;
+}
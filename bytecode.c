@@ -0,0 +1,678 @@
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+
+#include "java.h"
+#include "opcode.h"
+#include "bytecode.h"
+#include "log.h"
+#include "memory.h"
+
+/*
+ * Opcode table and instruction decoder
+ *
+ * Every consumer of bytecode walks it with nextInstruction,
+ * which decodes operands once as described by the opcode table.
+ */
+const struct OpcodeInfo opcode_table[256] = {
+    { "nop",             1, OPK_NONE,       0, 0, 0,            0,            FLOW_NEXT    },  // 0x00
+    { "aconst_null",     1, OPK_NONE,       0, 0, 0,            1,            FLOW_NEXT    },  // 0x01
+    { "iconst_m1",       1, OPK_NONE,       0, 0, 0,            1,            FLOW_NEXT    },  // 0x02
+    { "iconst_0",        1, OPK_NONE,       0, 0, 0,            1,            FLOW_NEXT    },  // 0x03
+    { "iconst_1",        1, OPK_NONE,       0, 0, 0,            1,            FLOW_NEXT    },  // 0x04
+    { "iconst_2",        1, OPK_NONE,       0, 0, 0,            1,            FLOW_NEXT    },  // 0x05
+    { "iconst_3",        1, OPK_NONE,       0, 0, 0,            1,            FLOW_NEXT    },  // 0x06
+    { "iconst_4",        1, OPK_NONE,       0, 0, 0,            1,            FLOW_NEXT    },  // 0x07
+    { "iconst_5",        1, OPK_NONE,       0, 0, 0,            1,            FLOW_NEXT    },  // 0x08
+    { "lconst_0",        1, OPK_NONE,       0, 0, 0,            2,            FLOW_NEXT    },  // 0x09
+    { "lconst_1",        1, OPK_NONE,       0, 0, 0,            2,            FLOW_NEXT    },  // 0x0a
+    { "fconst_0",        1, OPK_NONE,       0, 0, 0,            1,            FLOW_NEXT    },  // 0x0b
+    { "fconst_1",        1, OPK_NONE,       0, 0, 0,            1,            FLOW_NEXT    },  // 0x0c
+    { "fconst_2",        1, OPK_NONE,       0, 0, 0,            1,            FLOW_NEXT    },  // 0x0d
+    { "dconst_0",        1, OPK_NONE,       0, 0, 0,            2,            FLOW_NEXT    },  // 0x0e
+    { "dconst_1",        1, OPK_NONE,       0, 0, 0,            2,            FLOW_NEXT    },  // 0x0f
+    { "bipush",          2, OPK_NONE,       0, 0, 0,            1,            FLOW_NEXT    },  // 0x10
+    { "sipush",          3, OPK_NONE,       0, 0, 0,            1,            FLOW_NEXT    },  // 0x11
+    { "ldc",             2, OPK_CONSTANT,   0, 0, 0,            1,            FLOW_NEXT    },  // 0x12
+    { "ldc_w",           3, OPK_CONSTANT_W, 0, 0, 0,            1,            FLOW_NEXT    },  // 0x13
+    { "ldc2_w",          3, OPK_CONSTANT_W, 0, 0, 0,            2,            FLOW_NEXT    },  // 0x14
+    { "iload",           2, OPK_LOCAL,      0, 1, 0,            1,            FLOW_NEXT    },  // 0x15
+    { "lload",           2, OPK_LOCAL,      0, 2, 0,            2,            FLOW_NEXT    },  // 0x16
+    { "fload",           2, OPK_LOCAL,      0, 1, 0,            1,            FLOW_NEXT    },  // 0x17
+    { "dload",           2, OPK_LOCAL,      0, 2, 0,            2,            FLOW_NEXT    },  // 0x18
+    { "aload",           2, OPK_LOCAL,      0, 1, 0,            1,            FLOW_NEXT    },  // 0x19
+    { "iload_0",         1, OPK_LOCAL_N,    0, 1, 0,            1,            FLOW_NEXT    },  // 0x1a
+    { "iload_1",         1, OPK_LOCAL_N,    1, 1, 0,            1,            FLOW_NEXT    },  // 0x1b
+    { "iload_2",         1, OPK_LOCAL_N,    2, 1, 0,            1,            FLOW_NEXT    },  // 0x1c
+    { "iload_3",         1, OPK_LOCAL_N,    3, 1, 0,            1,            FLOW_NEXT    },  // 0x1d
+    { "lload_0",         1, OPK_LOCAL_N,    0, 2, 0,            2,            FLOW_NEXT    },  // 0x1e
+    { "lload_1",         1, OPK_LOCAL_N,    1, 2, 0,            2,            FLOW_NEXT    },  // 0x1f
+    { "lload_2",         1, OPK_LOCAL_N,    2, 2, 0,            2,            FLOW_NEXT    },  // 0x20
+    { "lload_3",         1, OPK_LOCAL_N,    3, 2, 0,            2,            FLOW_NEXT    },  // 0x21
+    { "fload_0",         1, OPK_LOCAL_N,    0, 1, 0,            1,            FLOW_NEXT    },  // 0x22
+    { "fload_1",         1, OPK_LOCAL_N,    1, 1, 0,            1,            FLOW_NEXT    },  // 0x23
+    { "fload_2",         1, OPK_LOCAL_N,    2, 1, 0,            1,            FLOW_NEXT    },  // 0x24
+    { "fload_3",         1, OPK_LOCAL_N,    3, 1, 0,            1,            FLOW_NEXT    },  // 0x25
+    { "dload_0",         1, OPK_LOCAL_N,    0, 2, 0,            2,            FLOW_NEXT    },  // 0x26
+    { "dload_1",         1, OPK_LOCAL_N,    1, 2, 0,            2,            FLOW_NEXT    },  // 0x27
+    { "dload_2",         1, OPK_LOCAL_N,    2, 2, 0,            2,            FLOW_NEXT    },  // 0x28
+    { "dload_3",         1, OPK_LOCAL_N,    3, 2, 0,            2,            FLOW_NEXT    },  // 0x29
+    { "aload_0",         1, OPK_LOCAL_N,    0, 1, 0,            1,            FLOW_NEXT    },  // 0x2a
+    { "aload_1",         1, OPK_LOCAL_N,    1, 1, 0,            1,            FLOW_NEXT    },  // 0x2b
+    { "aload_2",         1, OPK_LOCAL_N,    2, 1, 0,            1,            FLOW_NEXT    },  // 0x2c
+    { "aload_3",         1, OPK_LOCAL_N,    3, 1, 0,            1,            FLOW_NEXT    },  // 0x2d
+    { "iaload",          1, OPK_NONE,       0, 0, 2,            1,            FLOW_NEXT    },  // 0x2e
+    { "laload",          1, OPK_NONE,       0, 0, 2,            2,            FLOW_NEXT    },  // 0x2f
+    { "faload",          1, OPK_NONE,       0, 0, 2,            1,            FLOW_NEXT    },  // 0x30
+    { "daload",          1, OPK_NONE,       0, 0, 2,            2,            FLOW_NEXT    },  // 0x31
+    { "aaload",          1, OPK_NONE,       0, 0, 2,            1,            FLOW_NEXT    },  // 0x32
+    { "baload",          1, OPK_NONE,       0, 0, 2,            1,            FLOW_NEXT    },  // 0x33
+    { "caload",          1, OPK_NONE,       0, 0, 2,            1,            FLOW_NEXT    },  // 0x34
+    { "saload",          1, OPK_NONE,       0, 0, 2,            1,            FLOW_NEXT    },  // 0x35
+    { "istore",          2, OPK_LOCAL,      0, 1, 1,            0,            FLOW_NEXT    },  // 0x36
+    { "lstore",          2, OPK_LOCAL,      0, 2, 2,            0,            FLOW_NEXT    },  // 0x37
+    { "fstore",          2, OPK_LOCAL,      0, 1, 1,            0,            FLOW_NEXT    },  // 0x38
+    { "dstore",          2, OPK_LOCAL,      0, 2, 2,            0,            FLOW_NEXT    },  // 0x39
+    { "astore",          2, OPK_LOCAL,      0, 1, 1,            0,            FLOW_NEXT    },  // 0x3a
+    { "istore_0",        1, OPK_LOCAL_N,    0, 1, 1,            0,            FLOW_NEXT    },  // 0x3b
+    { "istore_1",        1, OPK_LOCAL_N,    1, 1, 1,            0,            FLOW_NEXT    },  // 0x3c
+    { "istore_2",        1, OPK_LOCAL_N,    2, 1, 1,            0,            FLOW_NEXT    },  // 0x3d
+    { "istore_3",        1, OPK_LOCAL_N,    3, 1, 1,            0,            FLOW_NEXT    },  // 0x3e
+    { "lstore_0",        1, OPK_LOCAL_N,    0, 2, 2,            0,            FLOW_NEXT    },  // 0x3f
+    { "lstore_1",        1, OPK_LOCAL_N,    1, 2, 2,            0,            FLOW_NEXT    },  // 0x40
+    { "lstore_2",        1, OPK_LOCAL_N,    2, 2, 2,            0,            FLOW_NEXT    },  // 0x41
+    { "lstore_3",        1, OPK_LOCAL_N,    3, 2, 2,            0,            FLOW_NEXT    },  // 0x42
+    { "fstore_0",        1, OPK_LOCAL_N,    0, 1, 1,            0,            FLOW_NEXT    },  // 0x43
+    { "fstore_1",        1, OPK_LOCAL_N,    1, 1, 1,            0,            FLOW_NEXT    },  // 0x44
+    { "fstore_2",        1, OPK_LOCAL_N,    2, 1, 1,            0,            FLOW_NEXT    },  // 0x45
+    { "fstore_3",        1, OPK_LOCAL_N,    3, 1, 1,            0,            FLOW_NEXT    },  // 0x46
+    { "dstore_0",        1, OPK_LOCAL_N,    0, 2, 2,            0,            FLOW_NEXT    },  // 0x47
+    { "dstore_1",        1, OPK_LOCAL_N,    1, 2, 2,            0,            FLOW_NEXT    },  // 0x48
+    { "dstore_2",        1, OPK_LOCAL_N,    2, 2, 2,            0,            FLOW_NEXT    },  // 0x49
+    { "dstore_3",        1, OPK_LOCAL_N,    3, 2, 2,            0,            FLOW_NEXT    },  // 0x4a
+    { "astore_0",        1, OPK_LOCAL_N,    0, 1, 1,            0,            FLOW_NEXT    },  // 0x4b
+    { "astore_1",        1, OPK_LOCAL_N,    1, 1, 1,            0,            FLOW_NEXT    },  // 0x4c
+    { "astore_2",        1, OPK_LOCAL_N,    2, 1, 1,            0,            FLOW_NEXT    },  // 0x4d
+    { "astore_3",        1, OPK_LOCAL_N,    3, 1, 1,            0,            FLOW_NEXT    },  // 0x4e
+    { "iastore",         1, OPK_NONE,       0, 0, 3,            0,            FLOW_NEXT    },  // 0x4f
+    { "lastore",         1, OPK_NONE,       0, 0, 4,            0,            FLOW_NEXT    },  // 0x50
+    { "fastore",         1, OPK_NONE,       0, 0, 3,            0,            FLOW_NEXT    },  // 0x51
+    { "dastore",         1, OPK_NONE,       0, 0, 4,            0,            FLOW_NEXT    },  // 0x52
+    { "aastore",         1, OPK_NONE,       0, 0, 3,            0,            FLOW_NEXT    },  // 0x53
+    { "bastore",         1, OPK_NONE,       0, 0, 3,            0,            FLOW_NEXT    },  // 0x54
+    { "castore",         1, OPK_NONE,       0, 0, 3,            0,            FLOW_NEXT    },  // 0x55
+    { "sastore",         1, OPK_NONE,       0, 0, 3,            0,            FLOW_NEXT    },  // 0x56
+    { "pop",             1, OPK_NONE,       0, 0, 1,            0,            FLOW_NEXT    },  // 0x57
+    { "pop2",            1, OPK_NONE,       0, 0, 2,            0,            FLOW_NEXT    },  // 0x58
+    { "dup",             1, OPK_NONE,       0, 0, 1,            2,            FLOW_NEXT    },  // 0x59
+    { "dup_x1",          1, OPK_NONE,       0, 0, 2,            3,            FLOW_NEXT    },  // 0x5a
+    { "dup_x2",          1, OPK_NONE,       0, 0, 3,            4,            FLOW_NEXT    },  // 0x5b
+    { "dup2",            1, OPK_NONE,       0, 0, 2,            4,            FLOW_NEXT    },  // 0x5c
+    { "dup2_x1",         1, OPK_NONE,       0, 0, 3,            5,            FLOW_NEXT    },  // 0x5d
+    { "dup2_x2",         1, OPK_NONE,       0, 0, 4,            6,            FLOW_NEXT    },  // 0x5e
+    { "swap",            1, OPK_NONE,       0, 0, 2,            2,            FLOW_NEXT    },  // 0x5f
+    { "iadd",            1, OPK_NONE,       0, 0, 2,            1,            FLOW_NEXT    },  // 0x60
+    { "ladd",            1, OPK_NONE,       0, 0, 4,            2,            FLOW_NEXT    },  // 0x61
+    { "fadd",            1, OPK_NONE,       0, 0, 2,            1,            FLOW_NEXT    },  // 0x62
+    { "dadd",            1, OPK_NONE,       0, 0, 4,            2,            FLOW_NEXT    },  // 0x63
+    { "isub",            1, OPK_NONE,       0, 0, 2,            1,            FLOW_NEXT    },  // 0x64
+    { "lsub",            1, OPK_NONE,       0, 0, 4,            2,            FLOW_NEXT    },  // 0x65
+    { "fsub",            1, OPK_NONE,       0, 0, 2,            1,            FLOW_NEXT    },  // 0x66
+    { "dsub",            1, OPK_NONE,       0, 0, 4,            2,            FLOW_NEXT    },  // 0x67
+    { "imul",            1, OPK_NONE,       0, 0, 2,            1,            FLOW_NEXT    },  // 0x68
+    { "lmul",            1, OPK_NONE,       0, 0, 4,            2,            FLOW_NEXT    },  // 0x69
+    { "fmul",            1, OPK_NONE,       0, 0, 2,            1,            FLOW_NEXT    },  // 0x6a
+    { "dmul",            1, OPK_NONE,       0, 0, 4,            2,            FLOW_NEXT    },  // 0x6b
+    { "idiv",            1, OPK_NONE,       0, 0, 2,            1,            FLOW_NEXT    },  // 0x6c
+    { "ldiv",            1, OPK_NONE,       0, 0, 4,            2,            FLOW_NEXT    },  // 0x6d
+    { "fdiv",            1, OPK_NONE,       0, 0, 2,            1,            FLOW_NEXT    },  // 0x6e
+    { "ddiv",            1, OPK_NONE,       0, 0, 4,            2,            FLOW_NEXT    },  // 0x6f
+    { "irem",            1, OPK_NONE,       0, 0, 2,            1,            FLOW_NEXT    },  // 0x70
+    { "lrem",            1, OPK_NONE,       0, 0, 4,            2,            FLOW_NEXT    },  // 0x71
+    { "frem",            1, OPK_NONE,       0, 0, 2,            1,            FLOW_NEXT    },  // 0x72
+    { "drem",            1, OPK_NONE,       0, 0, 4,            2,            FLOW_NEXT    },  // 0x73
+    { "ineg",            1, OPK_NONE,       0, 0, 1,            1,            FLOW_NEXT    },  // 0x74
+    { "lneg",            1, OPK_NONE,       0, 0, 2,            2,            FLOW_NEXT    },  // 0x75
+    { "fneg",            1, OPK_NONE,       0, 0, 1,            1,            FLOW_NEXT    },  // 0x76
+    { "dneg",            1, OPK_NONE,       0, 0, 2,            2,            FLOW_NEXT    },  // 0x77
+    { "ishl",            1, OPK_NONE,       0, 0, 2,            1,            FLOW_NEXT    },  // 0x78
+    { "lshl",            1, OPK_NONE,       0, 0, 3,            2,            FLOW_NEXT    },  // 0x79
+    { "ishr",            1, OPK_NONE,       0, 0, 2,            1,            FLOW_NEXT    },  // 0x7a
+    { "lshr",            1, OPK_NONE,       0, 0, 3,            2,            FLOW_NEXT    },  // 0x7b
+    { "iushr",           1, OPK_NONE,       0, 0, 2,            1,            FLOW_NEXT    },  // 0x7c
+    { "lushr",           1, OPK_NONE,       0, 0, 3,            2,            FLOW_NEXT    },  // 0x7d
+    { "iand",            1, OPK_NONE,       0, 0, 2,            1,            FLOW_NEXT    },  // 0x7e
+    { "land",            1, OPK_NONE,       0, 0, 4,            2,            FLOW_NEXT    },  // 0x7f
+    { "ior",             1, OPK_NONE,       0, 0, 2,            1,            FLOW_NEXT    },  // 0x80
+    { "lor",             1, OPK_NONE,       0, 0, 4,            2,            FLOW_NEXT    },  // 0x81
+    { "ixor",            1, OPK_NONE,       0, 0, 2,            1,            FLOW_NEXT    },  // 0x82
+    { "lxor",            1, OPK_NONE,       0, 0, 4,            2,            FLOW_NEXT    },  // 0x83
+    { "iinc",            3, OPK_LOCAL,      0, 1, 0,            0,            FLOW_NEXT    },  // 0x84
+    { "i2l",             1, OPK_NONE,       0, 0, 1,            2,            FLOW_NEXT    },  // 0x85
+    { "i2f",             1, OPK_NONE,       0, 0, 1,            1,            FLOW_NEXT    },  // 0x86
+    { "i2d",             1, OPK_NONE,       0, 0, 1,            2,            FLOW_NEXT    },  // 0x87
+    { "l2i",             1, OPK_NONE,       0, 0, 2,            1,            FLOW_NEXT    },  // 0x88
+    { "l2f",             1, OPK_NONE,       0, 0, 2,            1,            FLOW_NEXT    },  // 0x89
+    { "l2d",             1, OPK_NONE,       0, 0, 2,            2,            FLOW_NEXT    },  // 0x8a
+    { "f2i",             1, OPK_NONE,       0, 0, 1,            1,            FLOW_NEXT    },  // 0x8b
+    { "f2l",             1, OPK_NONE,       0, 0, 1,            2,            FLOW_NEXT    },  // 0x8c
+    { "f2d",             1, OPK_NONE,       0, 0, 1,            2,            FLOW_NEXT    },  // 0x8d
+    { "d2i",             1, OPK_NONE,       0, 0, 2,            1,            FLOW_NEXT    },  // 0x8e
+    { "d2l",             1, OPK_NONE,       0, 0, 2,            2,            FLOW_NEXT    },  // 0x8f
+    { "d2f",             1, OPK_NONE,       0, 0, 2,            1,            FLOW_NEXT    },  // 0x90
+    { "i2b",             1, OPK_NONE,       0, 0, 1,            1,            FLOW_NEXT    },  // 0x91
+    { "i2c",             1, OPK_NONE,       0, 0, 1,            1,            FLOW_NEXT    },  // 0x92
+    { "i2s",             1, OPK_NONE,       0, 0, 1,            1,            FLOW_NEXT    },  // 0x93
+    { "lcmp",            1, OPK_NONE,       0, 0, 4,            1,            FLOW_NEXT    },  // 0x94
+    { "fcmpl",           1, OPK_NONE,       0, 0, 2,            1,            FLOW_NEXT    },  // 0x95
+    { "fcmpg",           1, OPK_NONE,       0, 0, 2,            1,            FLOW_NEXT    },  // 0x96
+    { "dcmpl",           1, OPK_NONE,       0, 0, 4,            1,            FLOW_NEXT    },  // 0x97
+    { "dcmpg",           1, OPK_NONE,       0, 0, 4,            1,            FLOW_NEXT    },  // 0x98
+    { "ifeq",            3, OPK_BRANCH,     0, 0, 1,            0,            FLOW_BRANCH  },  // 0x99
+    { "ifne",            3, OPK_BRANCH,     0, 0, 1,            0,            FLOW_BRANCH  },  // 0x9a
+    { "iflt",            3, OPK_BRANCH,     0, 0, 1,            0,            FLOW_BRANCH  },  // 0x9b
+    { "ifge",            3, OPK_BRANCH,     0, 0, 1,            0,            FLOW_BRANCH  },  // 0x9c
+    { "ifgt",            3, OPK_BRANCH,     0, 0, 1,            0,            FLOW_BRANCH  },  // 0x9d
+    { "ifle",            3, OPK_BRANCH,     0, 0, 1,            0,            FLOW_BRANCH  },  // 0x9e
+    { "if_icmpeq",       3, OPK_BRANCH,     0, 0, 2,            0,            FLOW_BRANCH  },  // 0x9f
+    { "if_icmpne",       3, OPK_BRANCH,     0, 0, 2,            0,            FLOW_BRANCH  },  // 0xa0
+    { "if_icmplt",       3, OPK_BRANCH,     0, 0, 2,            0,            FLOW_BRANCH  },  // 0xa1
+    { "if_icmpge",       3, OPK_BRANCH,     0, 0, 2,            0,            FLOW_BRANCH  },  // 0xa2
+    { "if_icmpgt",       3, OPK_BRANCH,     0, 0, 2,            0,            FLOW_BRANCH  },  // 0xa3
+    { "if_icmple",       3, OPK_BRANCH,     0, 0, 2,            0,            FLOW_BRANCH  },  // 0xa4
+    { "if_acmpeq",       3, OPK_BRANCH,     0, 0, 2,            0,            FLOW_BRANCH  },  // 0xa5
+    { "if_acmpne",       3, OPK_BRANCH,     0, 0, 2,            0,            FLOW_BRANCH  },  // 0xa6
+    { "goto",            3, OPK_BRANCH,     0, 0, 0,            0,            FLOW_GOTO    },  // 0xa7
+    { "jsr",             3, OPK_BRANCH,     0, 0, 0,            1,            FLOW_JSR     },  // 0xa8
+    { "ret",             2, OPK_LOCAL,      0, 1, 0,            0,            FLOW_RET     },  // 0xa9
+    { "tableswitch",     0, OPK_SWITCH,     0, 0, 1,            0,            FLOW_SWITCH  },  // 0xaa
+    { "lookupswitch",    0, OPK_SWITCH,     0, 0, 1,            0,            FLOW_SWITCH  },  // 0xab
+    { "ireturn",         1, OPK_NONE,       0, 0, 1,            0,            FLOW_RETURN  },  // 0xac
+    { "lreturn",         1, OPK_NONE,       0, 0, 2,            0,            FLOW_RETURN  },  // 0xad
+    { "freturn",         1, OPK_NONE,       0, 0, 1,            0,            FLOW_RETURN  },  // 0xae
+    { "dreturn",         1, OPK_NONE,       0, 0, 2,            0,            FLOW_RETURN  },  // 0xaf
+    { "areturn",         1, OPK_NONE,       0, 0, 1,            0,            FLOW_RETURN  },  // 0xb0
+    { "return",          1, OPK_NONE,       0, 0, 0,            0,            FLOW_RETURN  },  // 0xb1
+    { "getstatic",       3, OPK_CONSTANT_W, 0, 0, STACK_VARIES, STACK_VARIES, FLOW_NEXT    },  // 0xb2
+    { "putstatic",       3, OPK_CONSTANT_W, 0, 0, STACK_VARIES, STACK_VARIES, FLOW_NEXT    },  // 0xb3
+    { "getfield",        3, OPK_CONSTANT_W, 0, 0, STACK_VARIES, STACK_VARIES, FLOW_NEXT    },  // 0xb4
+    { "putfield",        3, OPK_CONSTANT_W, 0, 0, STACK_VARIES, STACK_VARIES, FLOW_NEXT    },  // 0xb5
+    { "invokevirtual",   3, OPK_CONSTANT_W, 0, 0, STACK_VARIES, STACK_VARIES, FLOW_NEXT    },  // 0xb6
+    { "invokespecial",   3, OPK_CONSTANT_W, 0, 0, STACK_VARIES, STACK_VARIES, FLOW_NEXT    },  // 0xb7
+    { "invokestatic",    3, OPK_CONSTANT_W, 0, 0, STACK_VARIES, STACK_VARIES, FLOW_NEXT    },  // 0xb8
+    { "invokeinterface", 5, OPK_CONSTANT_W, 0, 0, STACK_VARIES, STACK_VARIES, FLOW_NEXT    },  // 0xb9
+    { "invokedynamic",   5, OPK_CONSTANT_W, 0, 0, STACK_VARIES, STACK_VARIES, FLOW_NEXT    },  // 0xba
+    { "new",             3, OPK_CONSTANT_W, 0, 0, 0,            1,            FLOW_NEXT    },  // 0xbb
+    { "newarray",        2, OPK_NONE,       0, 0, 1,            1,            FLOW_NEXT    },  // 0xbc
+    { "anewarray",       3, OPK_CONSTANT_W, 0, 0, 1,            1,            FLOW_NEXT    },  // 0xbd
+    { "arraylength",     1, OPK_NONE,       0, 0, 1,            1,            FLOW_NEXT    },  // 0xbe
+    { "athrow",          1, OPK_NONE,       0, 0, 1,            0,            FLOW_THROW   },  // 0xbf
+    { "checkcast",       3, OPK_CONSTANT_W, 0, 0, 1,            1,            FLOW_NEXT    },  // 0xc0
+    { "instanceof",      3, OPK_CONSTANT_W, 0, 0, 1,            1,            FLOW_NEXT    },  // 0xc1
+    { "monitorenter",    1, OPK_NONE,       0, 0, 1,            0,            FLOW_NEXT    },  // 0xc2
+    { "monitorexit",     1, OPK_NONE,       0, 0, 1,            0,            FLOW_NEXT    },  // 0xc3
+    { "wide",            0, OPK_WIDE,       0, 0, STACK_VARIES, STACK_VARIES, FLOW_NEXT    },  // 0xc4
+    { "multianewarray",  4, OPK_CONSTANT_W, 0, 0, STACK_VARIES, STACK_VARIES, FLOW_NEXT    },  // 0xc5
+    { "ifnull",          3, OPK_BRANCH,     0, 0, 1,            0,            FLOW_BRANCH  },  // 0xc6
+    { "ifnonnull",       3, OPK_BRANCH,     0, 0, 1,            0,            FLOW_BRANCH  },  // 0xc7
+    { "goto_w",          5, OPK_BRANCH_W,   0, 0, 0,            0,            FLOW_GOTO    },  // 0xc8
+    { "jsr_w",           5, OPK_BRANCH_W,   0, 0, 0,            1,            FLOW_JSR     },  // 0xc9
+    { (const char *) 0,  0, OPK_INVALID,    0, 0, 0,            0,            FLOW_NEXT    },  // 0xca breakpoint
+    { (const char *) 0,  0, OPK_INVALID,    0, 0, 0,            0,            FLOW_NEXT    },  // 0xcb reserved
+    { (const char *) 0,  0, OPK_INVALID,    0, 0, 0,            0,            FLOW_NEXT    },  // 0xcc reserved
+    { (const char *) 0,  0, OPK_INVALID,    0, 0, 0,            0,            FLOW_NEXT    },  // 0xcd reserved
+    { (const char *) 0,  0, OPK_INVALID,    0, 0, 0,            0,            FLOW_NEXT    },  // 0xce reserved
+    { (const char *) 0,  0, OPK_INVALID,    0, 0, 0,            0,            FLOW_NEXT    },  // 0xcf reserved
+    { (const char *) 0,  0, OPK_INVALID,    0, 0, 0,            0,            FLOW_NEXT    },  // 0xd0 reserved
+    { (const char *) 0,  0, OPK_INVALID,    0, 0, 0,            0,            FLOW_NEXT    },  // 0xd1 reserved
+    { (const char *) 0,  0, OPK_INVALID,    0, 0, 0,            0,            FLOW_NEXT    },  // 0xd2 reserved
+    { (const char *) 0,  0, OPK_INVALID,    0, 0, 0,            0,            FLOW_NEXT    },  // 0xd3 reserved
+    { (const char *) 0,  0, OPK_INVALID,    0, 0, 0,            0,            FLOW_NEXT    },  // 0xd4 reserved
+    { (const char *) 0,  0, OPK_INVALID,    0, 0, 0,            0,            FLOW_NEXT    },  // 0xd5 reserved
+    { (const char *) 0,  0, OPK_INVALID,    0, 0, 0,            0,            FLOW_NEXT    },  // 0xd6 reserved
+    { (const char *) 0,  0, OPK_INVALID,    0, 0, 0,            0,            FLOW_NEXT    },  // 0xd7 reserved
+    { (const char *) 0,  0, OPK_INVALID,    0, 0, 0,            0,            FLOW_NEXT    },  // 0xd8 reserved
+    { (const char *) 0,  0, OPK_INVALID,    0, 0, 0,            0,            FLOW_NEXT    },  // 0xd9 reserved
+    { (const char *) 0,  0, OPK_INVALID,    0, 0, 0,            0,            FLOW_NEXT    },  // 0xda reserved
+    { (const char *) 0,  0, OPK_INVALID,    0, 0, 0,            0,            FLOW_NEXT    },  // 0xdb reserved
+    { (const char *) 0,  0, OPK_INVALID,    0, 0, 0,            0,            FLOW_NEXT    },  // 0xdc reserved
+    { (const char *) 0,  0, OPK_INVALID,    0, 0, 0,            0,            FLOW_NEXT    },  // 0xdd reserved
+    { (const char *) 0,  0, OPK_INVALID,    0, 0, 0,            0,            FLOW_NEXT    },  // 0xde reserved
+    { (const char *) 0,  0, OPK_INVALID,    0, 0, 0,            0,            FLOW_NEXT    },  // 0xdf reserved
+    { (const char *) 0,  0, OPK_INVALID,    0, 0, 0,            0,            FLOW_NEXT    },  // 0xe0 reserved
+    { (const char *) 0,  0, OPK_INVALID,    0, 0, 0,            0,            FLOW_NEXT    },  // 0xe1 reserved
+    { (const char *) 0,  0, OPK_INVALID,    0, 0, 0,            0,            FLOW_NEXT    },  // 0xe2 reserved
+    { (const char *) 0,  0, OPK_INVALID,    0, 0, 0,            0,            FLOW_NEXT    },  // 0xe3 reserved
+    { (const char *) 0,  0, OPK_INVALID,    0, 0, 0,            0,            FLOW_NEXT    },  // 0xe4 reserved
+    { (const char *) 0,  0, OPK_INVALID,    0, 0, 0,            0,            FLOW_NEXT    },  // 0xe5 reserved
+    { (const char *) 0,  0, OPK_INVALID,    0, 0, 0,            0,            FLOW_NEXT    },  // 0xe6 reserved
+    { (const char *) 0,  0, OPK_INVALID,    0, 0, 0,            0,            FLOW_NEXT    },  // 0xe7 reserved
+    { (const char *) 0,  0, OPK_INVALID,    0, 0, 0,            0,            FLOW_NEXT    },  // 0xe8 reserved
+    { (const char *) 0,  0, OPK_INVALID,    0, 0, 0,            0,            FLOW_NEXT    },  // 0xe9 reserved
+    { (const char *) 0,  0, OPK_INVALID,    0, 0, 0,            0,            FLOW_NEXT    },  // 0xea reserved
+    { (const char *) 0,  0, OPK_INVALID,    0, 0, 0,            0,            FLOW_NEXT    },  // 0xeb reserved
+    { (const char *) 0,  0, OPK_INVALID,    0, 0, 0,            0,            FLOW_NEXT    },  // 0xec reserved
+    { (const char *) 0,  0, OPK_INVALID,    0, 0, 0,            0,            FLOW_NEXT    },  // 0xed reserved
+    { (const char *) 0,  0, OPK_INVALID,    0, 0, 0,            0,            FLOW_NEXT    },  // 0xee reserved
+    { (const char *) 0,  0, OPK_INVALID,    0, 0, 0,            0,            FLOW_NEXT    },  // 0xef reserved
+    { (const char *) 0,  0, OPK_INVALID,    0, 0, 0,            0,            FLOW_NEXT    },  // 0xf0 reserved
+    { (const char *) 0,  0, OPK_INVALID,    0, 0, 0,            0,            FLOW_NEXT    },  // 0xf1 reserved
+    { (const char *) 0,  0, OPK_INVALID,    0, 0, 0,            0,            FLOW_NEXT    },  // 0xf2 reserved
+    { (const char *) 0,  0, OPK_INVALID,    0, 0, 0,            0,            FLOW_NEXT    },  // 0xf3 reserved
+    { (const char *) 0,  0, OPK_INVALID,    0, 0, 0,            0,            FLOW_NEXT    },  // 0xf4 reserved
+    { (const char *) 0,  0, OPK_INVALID,    0, 0, 0,            0,            FLOW_NEXT    },  // 0xf5 reserved
+    { (const char *) 0,  0, OPK_INVALID,    0, 0, 0,            0,            FLOW_NEXT    },  // 0xf6 reserved
+    { (const char *) 0,  0, OPK_INVALID,    0, 0, 0,            0,            FLOW_NEXT    },  // 0xf7 reserved
+    { (const char *) 0,  0, OPK_INVALID,    0, 0, 0,            0,            FLOW_NEXT    },  // 0xf8 reserved
+    { (const char *) 0,  0, OPK_INVALID,    0, 0, 0,            0,            FLOW_NEXT    },  // 0xf9 reserved
+    { (const char *) 0,  0, OPK_INVALID,    0, 0, 0,            0,            FLOW_NEXT    },  // 0xfa reserved
+    { (const char *) 0,  0, OPK_INVALID,    0, 0, 0,            0,            FLOW_NEXT    },  // 0xfb reserved
+    { (const char *) 0,  0, OPK_INVALID,    0, 0, 0,            0,            FLOW_NEXT    },  // 0xfc reserved
+    { (const char *) 0,  0, OPK_INVALID,    0, 0, 0,            0,            FLOW_NEXT    },  // 0xfd reserved
+    { (const char *) 0,  0, OPK_INVALID,    0, 0, 0,            0,            FLOW_NEXT    },  // 0xfe impdep1
+    { (const char *) 0,  0, OPK_INVALID,    0, 0, 0,            0,            FLOW_NEXT    },  // 0xff impdep2
+};
+
+static int
+fail(struct VerifyError *error, u4 pc, const char *format, ...)
+{
+    va_list args;
+
+    error->pc = pc;
+    va_start(args, format);
+    vsnprintf(error->reason, sizeof (error->reason), format, args);
+    va_end(args);
+    return -1;
+}
+
+static inline void
+setBit(u8 *bits, u4 pc)
+{
+    bits[pc >> 6] |= (u8) 1 << (pc & 63);
+}
+
+extern void
+initCodeMap(struct CodeMap *map)
+{
+    memset(map, 0, sizeof (struct CodeMap));
+}
+
+extern void
+releaseCodeMap(struct CodeMap *map)
+{
+    freeMemory(map->bits);
+    initCodeMap(map);
+}
+
+/*
+ * Stores the offset of the instruction following the one at `pc`
+ * in `next`, fails if the instruction is invalid or truncated.
+ */
+extern int
+getInstructionLength(u1 *code, u4 pc, u4 length, u4 *next)
+{
+    u8 end;
+    u4 base;
+    int32_t low, high, npairs;
+
+    switch (code[pc])
+    {
+        case OPCODE_tableswitch:
+            base = (pc + 4) & ~3u;
+            if ((u8) base + 12 > length)
+                return -1;
+            low = readS4(code + base + 4);
+            high = readS4(code + base + 8);
+            if (low > high)
+                return -1;
+            end = (u8) base + 12 + ((u8) ((int64_t) high - low) + 1) * 4;
+            break;
+        case OPCODE_lookupswitch:
+            base = (pc + 4) & ~3u;
+            if ((u8) base + 8 > length)
+                return -1;
+            npairs = readS4(code + base + 4);
+            if (npairs < 0)
+                return -1;
+            end = (u8) base + 8 + (u8) npairs * 8;
+            break;
+        case OPCODE_wide:
+            if (pc + 1 >= length)
+                return -1;
+            end = (u8) pc + (code[pc + 1] == OPCODE_iinc ? 6 : 4);
+            break;
+        default:
+            if (!opcode_table[code[pc]].length)
+                return -1;
+            end = (u8) pc + opcode_table[code[pc]].length;
+            break;
+    }
+    if (end > length)
+        return -1;
+    *next = (u4) end;
+    return 0;
+}
+
+/*
+ * Whether the instruction may complete abruptly with an exception,
+ * linkage errors of constant resolution included.
+ */
+extern int
+canThrow(u1 opcode)
+{
+    if (opcode >= OPCODE_iaload && opcode <= OPCODE_saload)
+        return 1;
+    if (opcode >= OPCODE_iastore && opcode <= OPCODE_sastore)
+        return 1;
+    // returns of synchronized methods release the monitor
+    if (opcode >= OPCODE_ireturn && opcode <= OPCODE_multianewarray)
+        return opcode != OPCODE_wide;
+    switch (opcode)
+    {
+        case OPCODE_ldc:case OPCODE_ldc_w:case OPCODE_ldc2_w:
+        case OPCODE_idiv:case OPCODE_ldiv:
+        case OPCODE_irem:case OPCODE_lrem:
+            return 1;
+        default:
+            return 0;
+    }
+}
+
+extern void
+initInstructionIterator(struct InstructionIterator *it,
+        u1 *code, u4 length)
+{
+    it->code = code;
+    it->length = length;
+    it->pc = 0;
+}
+
+/*
+ * Decodes the instruction at the iterator into `insn` and advances,
+ * return 1, or 0 at the end of code, or -1 if the instruction
+ * is invalid or truncated, leaving its pc and opcode in `insn`.
+ */
+extern int
+nextInstruction(struct InstructionIterator *it, struct Instruction *insn)
+{
+    const struct OpcodeInfo *info;
+    u1 *bytes;
+    u4 next, base;
+
+    if (it->pc >= it->length)
+        return 0;
+    bytes = it->code + it->pc;
+    info = &(opcode_table[bytes[0]]);
+    memset(insn, 0, sizeof (struct Instruction));
+    insn->pc = it->pc;
+    insn->opcode = bytes[0];
+    insn->info = info;
+    if (getInstructionLength(it->code, it->pc, it->length, &next) < 0)
+        return -1;
+    insn->length = next - it->pc;
+
+    switch (info->kind)
+    {
+        case OPK_LOCAL:
+            insn->index = bytes[1];
+            if (bytes[0] == OPCODE_iinc)
+                insn->value = (int8_t) bytes[2];
+            break;
+        case OPK_LOCAL_N:
+            insn->index = info->local;
+            break;
+        case OPK_BRANCH:
+            insn->offset = (int16_t) readU2(bytes + 1);
+            break;
+        case OPK_BRANCH_W:
+            insn->offset = readS4(bytes + 1);
+            break;
+        case OPK_SWITCH:
+            base = (it->pc + 4) & ~3u;
+            insn->offset = readS4(it->code + base);
+            if (bytes[0] == OPCODE_tableswitch)
+            {
+                insn->low = readS4(it->code + base + 4);
+                insn->cases = (u4) ((int64_t) readS4(it->code + base + 8)
+                        - insn->low + 1);
+                insn->table = it->code + base + 12;
+            }
+            else
+            {
+                insn->cases = (u4) readS4(it->code + base + 4);
+                insn->table = it->code + base + 8;
+            }
+            break;
+        case OPK_WIDE:
+            insn->wide = 1;
+            insn->opcode = bytes[1];
+            insn->info = &(opcode_table[bytes[1]]);
+            insn->index = readU2(bytes + 2);
+            if (bytes[1] == OPCODE_iinc)
+                insn->value = (int16_t) readU2(bytes + 4);
+            break;
+        case OPK_CONSTANT:
+            insn->index = bytes[1];
+            break;
+        case OPK_CONSTANT_W:
+            insn->index = readU2(bytes + 1);
+            break;
+    }
+    switch (bytes[0])
+    {
+        case OPCODE_bipush:
+            insn->value = (int8_t) bytes[1];
+            break;
+        case OPCODE_sipush:
+            insn->value = (int16_t) readU2(bytes + 1);
+            break;
+        case OPCODE_newarray:
+            insn->value = bytes[1];
+            break;
+        case OPCODE_invokeinterface:
+        case OPCODE_multianewarray:
+            insn->value = bytes[3];
+            break;
+    }
+    it->pc = next;
+    return 1;
+}
+
+/*
+ * Structural checks of bytecode (JVMS 4.9.1)
+ *
+ * One scan over the code marks where every instruction starts and
+ * every jump target, checking operands as described by the opcode
+ * table. Targets and exception table offsets are then checked
+ * against the instruction starts, one bitmap word at a time.
+ */
+static int
+markTarget(attr_Code_info *code, u8 *targets, u4 pc, int64_t offset,
+        struct VerifyError *error)
+{
+    int64_t target;
+
+    target = (int64_t) pc + offset;
+    if (target < 0 || target >= code->code_length)
+        return fail(error, pc, "branch target %lli out of code",
+                (long long) target);
+    setBit(targets, (u4) target);
+    return 0;
+}
+
+static int
+markSwitchTargets(attr_Code_info *code, u8 *targets,
+        struct Instruction *insn, struct VerifyError *error)
+{
+    u4 i;
+
+    if (markTarget(code, targets, insn->pc, insn->offset, error) < 0)
+        return -1;
+    for (i = 0; i < insn->cases; i++)
+    {
+        // match keys must be sorted in increasing order
+        if (insn->opcode == OPCODE_lookupswitch && i > 0
+                && getSwitchKey(insn, i) <= getSwitchKey(insn, i - 1))
+            return fail(error, insn->pc, "lookupswitch keys aren't sorted");
+        if (markTarget(code, targets, insn->pc,
+                    getSwitchOffset(insn, i), error) < 0)
+            return -1;
+    }
+    return 0;
+}
+
+static int
+checkLocal(attr_Code_info *code, u4 pc, u4 index, u1 slots,
+        struct VerifyError *error)
+{
+    if (index + slots > code->max_locals)
+        return fail(error, pc, "local variable %u exceeds "
+                "max_locals %u", index, code->max_locals);
+    return 0;
+}
+
+static int
+checkConstant(ClassFile *cf, u4 pc, u2 index,
+        struct VerifyError *error)
+{
+    if (index == 0 || index >= cf->constant_pool_count)
+        return fail(error, pc, "constant #%u out of constant pool", index);
+    return 0;
+}
+
+static int
+checkInstruction(ClassFile *cf, attr_Code_info *code, u8 *targets,
+        struct Instruction *insn, struct VerifyError *error)
+{
+    u4 pc;
+
+    pc = insn->pc;
+    if (insn->wide)
+    {
+        if (insn->info->kind != OPK_LOCAL)
+            return fail(error, pc, "wide can't modify opcode 0x%X",
+                    insn->opcode);
+        return checkLocal(code, pc, insn->index, insn->info->slots, error);
+    }
+    switch (insn->info->kind)
+    {
+        case OPK_LOCAL:
+        case OPK_LOCAL_N:
+            if (checkLocal(code, pc, insn->index, insn->info->slots,
+                        error) < 0)
+                return -1;
+            break;
+        case OPK_BRANCH:
+        case OPK_BRANCH_W:
+            if (markTarget(code, targets, pc, insn->offset, error) < 0)
+                return -1;
+            break;
+        case OPK_SWITCH:
+            if (markSwitchTargets(code, targets, insn, error) < 0)
+                return -1;
+            break;
+        case OPK_CONSTANT:
+        case OPK_CONSTANT_W:
+            if (checkConstant(cf, pc, insn->index, error) < 0)
+                return -1;
+            break;
+    }
+    switch (insn->opcode)
+    {
+        case OPCODE_newarray:
+            if (insn->value < 4 || insn->value > 11)
+                return fail(error, pc, "invalid newarray type %u",
+                        insn->value);
+            break;
+        case OPCODE_invokeinterface:
+            if (insn->value == 0 || code->code[pc + 4] != 0)
+                return fail(error, pc, "invalid invokeinterface operands");
+            break;
+        case OPCODE_invokedynamic:
+            if (code->code[pc + 3] != 0 || code->code[pc + 4] != 0)
+                return fail(error, pc, "invalid invokedynamic operands");
+            break;
+        case OPCODE_multianewarray:
+            if (insn->value == 0)
+                return fail(error, pc, "multianewarray of 0 dimensions");
+            break;
+    }
+    return 0;
+}
+
+extern int
+checkCodeStructure(ClassFile *cf, attr_Code_info *code,
+        struct CodeMap *map, struct VerifyError *error)
+{
+    struct exception_table_entry *entry;
+    struct InstructionIterator it;
+    struct Instruction insn;
+    u8 *starts, *targets, *bits, word;
+    u4 length, words, count, i;
+    int result;
+
+    error->pc = 0;
+    error->reason[0] = '\0';
+    length = code->code_length;
+    if (length == 0 || length > 0xffff)
+        return fail(error, 0, "code_length %u out of range", length);
+    words = (length + 63) / 64;
+    if (2 * words > map->words_capacity)
+    {
+        bits = (u8 *) allocMemory(2 * words, sizeof (u8));
+        if (!bits)
+            return fail(error, 0, "fail to allocate instruction map");
+        freeMemory(map->bits);
+        map->bits = bits;
+        map->words_capacity = 2 * words;
+    }
+    starts = map->bits;
+    targets = starts + words;
+    memset(starts, 0, 2 * words * sizeof (u8));
+    map->code_length = 0;
+    map->instructions_count = 0;
+
+    count = 0;
+    initInstructionIterator(&it, code->code, length);
+    while ((result = nextInstruction(&it, &insn)) > 0)
+    {
+        setBit(starts, insn.pc);
+        ++count;
+        if (checkInstruction(cf, code, targets, &insn, error) < 0)
+            return -1;
+    }
+    if (result < 0)
+        return fail(error, insn.pc, "truncated or invalid instruction 0x%X",
+                code->code[insn.pc]);
+
+    // every jump target must start an instruction
+    for (i = 0; i < words; i++)
+    {
+        word = targets[i] & ~starts[i];
+        if (word)
+            return fail(error, i * 64 + __builtin_ctzll(word),
+                    "branch target isn't an instruction");
+    }
+    map->code_length = length;
+    map->instructions_count = count;
+
+    for (i = 0; i < code->exception_table_length; i++)
+    {
+        entry = &(code->exception_table[i]);
+        if (!isInstructionStart(map, entry->start_pc)
+                || entry->end_pc != length
+                    && !isInstructionStart(map, entry->end_pc)
+                || entry->start_pc >= entry->end_pc)
+            return fail(error, entry->start_pc, "invalid range "
+                    "[%u, %u) of exception handler %u",
+                    entry->start_pc, entry->end_pc, i);
+        if (!isInstructionStart(map, entry->handler_pc))
+            return fail(error, entry->handler_pc, "exception handler %u "
+                    "isn't an instruction", i);
+        if (entry->catch_type
+                && checkConstant(cf, entry->handler_pc,
+                    entry->catch_type, error) < 0)
+            return -1;
+    }
+    return 0;
+}
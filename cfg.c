@@ -0,0 +1,833 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "java.h"
+#include "opcode.h"
+#include "bytecode.h"
+#include "cfg.h"
+#include "log.h"
+#include "memory.h"
+
+/*
+ * Control flow graph builder
+ *
+ * Expects code that passed checkCodeStructure, so every jump target
+ * and exception table pc starts an instruction.
+ * One pass marks the leaders, a second collects the edges,
+ * which are then bucketed by source and by target.
+ * The build is linear in code length plus edges.
+ */
+
+static inline void
+setLeader(struct ControlFlowGraph *cfg, u4 pc)
+{
+    cfg->leaders[pc >> 6] |= (u8) 1 << (pc & 63);
+}
+
+static inline int
+isLeader(struct ControlFlowGraph *cfg, u4 pc)
+{
+    return cfg->leaders[pc >> 6] >> (pc & 63) & 1;
+}
+
+static inline void
+addEdge(struct ControlFlowGraph *cfg, u4 *count,
+        u4 from, u4 to, u4 kind)
+{
+    cfg->predecessors[*count].block = to;
+    cfg->predecessors[*count].kind = kind;
+    cfg->sources[(*count)++] = from;
+}
+
+extern void
+initControlFlowGraph(struct ControlFlowGraph *cfg)
+{
+    memset(cfg, 0, sizeof (struct ControlFlowGraph));
+}
+
+extern void
+releaseControlFlowGraph(struct ControlFlowGraph *cfg)
+{
+    freeMemory(cfg->blocks);
+    freeMemory(cfg->marks);
+    freeMemory(cfg->edges);
+    freeMemory(cfg->predecessors);
+    freeMemory(cfg->sources);
+    freeMemory(cfg->leaders);
+    freeMemory(cfg->ranks);
+    initControlFlowGraph(cfg);
+}
+
+static int
+reserveWords(struct ControlFlowGraph *cfg, u4 words)
+{
+    if (words <= cfg->words_capacity)
+        return 0;
+    freeMemory(cfg->leaders);
+    freeMemory(cfg->ranks);
+    cfg->leaders = (u8 *) allocMemory(words, sizeof (u8));
+    cfg->ranks = (u4 *) allocMemory(words, sizeof (u4));
+    cfg->words_capacity = words;
+    if (!cfg->leaders || !cfg->ranks)
+    {
+        cfg->words_capacity = 0;
+        return -1;
+    }
+    return 0;
+}
+
+static int
+reserveBlocks(struct ControlFlowGraph *cfg, u4 blocks)
+{
+    if (blocks <= cfg->blocks_capacity)
+        return 0;
+    freeMemory(cfg->blocks);
+    freeMemory(cfg->marks);
+    cfg->blocks = (struct BasicBlock *)
+        allocMemory(blocks, sizeof (struct BasicBlock));
+    cfg->marks = (u4 *) allocMemory(blocks, sizeof (u4));
+    cfg->blocks_capacity = blocks;
+    if (!cfg->blocks || !cfg->marks)
+    {
+        cfg->blocks_capacity = 0;
+        return -1;
+    }
+    return 0;
+}
+
+static int
+reserveEdges(struct ControlFlowGraph *cfg, u4 edges)
+{
+    if (edges <= cfg->edges_capacity)
+        return 0;
+    freeMemory(cfg->edges);
+    freeMemory(cfg->predecessors);
+    freeMemory(cfg->sources);
+    cfg->edges = (struct ControlEdge *)
+        allocMemory(edges, sizeof (struct ControlEdge));
+    cfg->predecessors = (struct ControlEdge *)
+        allocMemory(edges, sizeof (struct ControlEdge));
+    cfg->sources = (u4 *) allocMemory(edges, sizeof (u4));
+    cfg->edges_capacity = edges;
+    if (!cfg->edges || !cfg->predecessors || !cfg->sources)
+    {
+        cfg->edges_capacity = 0;
+        return -1;
+    }
+    return 0;
+}
+
+// fails if the target lies outside the code
+static int
+markTarget(struct ControlFlowGraph *cfg, u4 pc, int32_t offset)
+{
+    int64_t target;
+
+    target = (int64_t) pc + offset;
+    if (target < 0 || target >= cfg->code_length)
+    {
+        logError("Jump target %lli @ pc %u is out of range!\r\n",
+                (long long) target, pc);
+        return -1;
+    }
+    setLeader(cfg, (u4) target);
+    return 0;
+}
+
+static int
+markLeaders(struct ControlFlowGraph *cfg, attr_Code_info *code)
+{
+    struct InstructionIterator it;
+    struct Instruction insn;
+    struct exception_table_entry *entry;
+    u4 length, next, i;
+    int result;
+
+    length = code->code_length;
+    setLeader(cfg, 0);
+    initInstructionIterator(&it, code->code, length);
+    while ((result = nextInstruction(&it, &insn)) > 0)
+    {
+        switch (insn.info->flow)
+        {
+            case FLOW_NEXT:
+                continue;
+            case FLOW_BRANCH:
+            case FLOW_GOTO:
+            case FLOW_JSR:
+                if (markTarget(cfg, insn.pc, insn.offset) < 0)
+                    return -1;
+                break;
+            case FLOW_SWITCH:
+                if (markTarget(cfg, insn.pc, insn.offset) < 0)
+                    return -1;
+                for (i = 0; i < insn.cases; i++)
+                    if (markTarget(cfg, insn.pc,
+                                getSwitchOffset(&insn, i)) < 0)
+                        return -1;
+                break;
+        }
+        next = insn.pc + insn.length;
+        if (next < length)
+            setLeader(cfg, next);
+    }
+    if (result < 0)
+    {
+        logError("Invalid instruction 0x%X @ pc %u!\r\n",
+                code->code[insn.pc], insn.pc);
+        return -1;
+    }
+
+    for (i = 0; i < code->exception_table_length; i++)
+    {
+        entry = &(code->exception_table[i]);
+        if (entry->start_pc >= entry->end_pc
+                || entry->end_pc > length
+                || entry->handler_pc >= length)
+        {
+            logError("Invalid exception_table[%u]!\r\n", i);
+            return -1;
+        }
+        setLeader(cfg, entry->start_pc);
+        setLeader(cfg, entry->handler_pc);
+        if (entry->end_pc < length)
+            setLeader(cfg, entry->end_pc);
+    }
+    return 0;
+}
+
+static void
+collectEdges(struct ControlFlowGraph *cfg, attr_Code_info *code,
+        u4 *count)
+{
+    struct InstructionIterator it;
+    struct Instruction insn;
+    struct exception_table_entry *entry;
+    u4 length, next, block, first, last, i;
+    u1 flow;
+
+    length = code->code_length;
+    initInstructionIterator(&it, code->code, length);
+    while (nextInstruction(&it, &insn) > 0)
+    {
+        next = insn.pc + insn.length;
+        flow = insn.info->flow;
+        if (flow == FLOW_NEXT && next < length && !isLeader(cfg, next))
+            continue;
+        block = getBlockAt(cfg, insn.pc);
+        if (flow == FLOW_BRANCH || flow == FLOW_GOTO || flow == FLOW_JSR
+                || flow == FLOW_SWITCH)
+            addEdge(cfg, count, block,
+                    getBlockAt(cfg, insn.pc + insn.offset), EDGE_NORMAL);
+        if (flow == FLOW_SWITCH)
+            for (i = 0; i < insn.cases; i++)
+                addEdge(cfg, count, block,
+                        getBlockAt(cfg, insn.pc + getSwitchOffset(&insn, i)),
+                        EDGE_NORMAL);
+        // a subroutine is assumed to return after its jsr
+        if ((flow == FLOW_NEXT || flow == FLOW_BRANCH || flow == FLOW_JSR)
+                && next < length)
+            addEdge(cfg, count, block, block + 1, EDGE_NORMAL);
+    }
+
+    for (i = 0; i < code->exception_table_length; i++)
+    {
+        entry = &(code->exception_table[i]);
+        first = getBlockAt(cfg, entry->start_pc);
+        last = getBlockAt(cfg, entry->end_pc - 1);
+        for (block = first; block <= last; block++)
+            addEdge(cfg, count, block,
+                    getBlockAt(cfg, entry->handler_pc), EDGE_EXCEPTION);
+    }
+}
+
+/*
+ * Buckets the collected edges by source, merging parallel ones,
+ * then by target.
+ */
+static void
+sortEdges(struct ControlFlowGraph *cfg, u4 count)
+{
+    struct BasicBlock *block, *target;
+    struct ControlEdge *edge;
+    u4 offset, first, i, j;
+
+    for (i = 0; i < cfg->blocks_count; i++)
+    {
+        cfg->blocks[i].edges_count = 0;
+        cfg->blocks[i].predecessors_count = 0;
+        cfg->marks[i] = 0;
+    }
+    for (i = 0; i < count; i++)
+        ++cfg->blocks[cfg->sources[i]].edges_count;
+    offset = 0;
+    for (i = 0; i < cfg->blocks_count; i++)
+    {
+        block = &(cfg->blocks[i]);
+        block->first_edge = offset;
+        offset += block->edges_count;
+        block->edges_count = 0;
+    }
+    // stable, so normal edges come first in every bucket
+    for (i = 0; i < count; i++)
+    {
+        block = &(cfg->blocks[cfg->sources[i]]);
+        cfg->edges[block->first_edge + block->edges_count++]
+            = cfg->predecessors[i];
+    }
+
+    offset = 0;
+    for (i = 0; i < cfg->blocks_count; i++)
+    {
+        block = &(cfg->blocks[i]);
+        first = block->first_edge;
+        block->first_edge = offset;
+        for (j = first; j < first + block->edges_count; j++)
+        {
+            edge = &(cfg->edges[j]);
+            if (cfg->marks[edge->block] == i + 1)
+                continue;
+            cfg->marks[edge->block] = i + 1;
+            cfg->edges[offset++] = *edge;
+            ++cfg->blocks[edge->block].predecessors_count;
+        }
+        block->edges_count = offset - block->first_edge;
+    }
+    cfg->edges_count = offset;
+
+    offset = 0;
+    for (i = 0; i < cfg->blocks_count; i++)
+    {
+        block = &(cfg->blocks[i]);
+        block->first_predecessor = offset;
+        offset += block->predecessors_count;
+        block->predecessors_count = 0;
+    }
+    for (i = 0; i < cfg->blocks_count; i++)
+    {
+        block = &(cfg->blocks[i]);
+        for (j = 0; j < block->edges_count; j++)
+        {
+            edge = &(cfg->edges[block->first_edge + j]);
+            target = &(cfg->blocks[edge->block]);
+            edge = &(cfg->predecessors[target->first_predecessor
+                    + target->predecessors_count++]);
+            edge->block = i;
+            edge->kind = cfg->edges[block->first_edge + j].kind;
+        }
+    }
+}
+
+extern int
+buildControlFlowGraph(struct ControlFlowGraph *cfg, attr_Code_info *code)
+{
+    struct exception_table_entry *entry;
+    struct BasicBlock *block;
+    u8 word, edges;
+    u4 length, words, count, pc, i;
+
+    cfg->code_length = 0;
+    cfg->blocks_count = 0;
+    cfg->edges_count = 0;
+    length = code->code_length;
+    if (length == 0 || length > 0xffff)
+    {
+        logError("code_length %u out of range!\r\n", length);
+        return -1;
+    }
+    words = (length + 63) / 64;
+    if (reserveWords(cfg, words) < 0)
+    {
+        logError("Fail to allocate leaders of %u bytes of code!\r\n", length);
+        return -1;
+    }
+    memset(cfg->leaders, 0, words * sizeof (u8));
+    cfg->code_length = length;
+    if (markLeaders(cfg, code) < 0)
+    {
+        cfg->code_length = 0;
+        return -1;
+    }
+
+    count = 0;
+    for (i = 0; i < words; i++)
+    {
+        cfg->ranks[i] = count;
+        count += __builtin_popcountll(cfg->leaders[i]);
+    }
+    if (reserveBlocks(cfg, count) < 0)
+    {
+        logError("Fail to allocate %u basic blocks!\r\n", count);
+        cfg->code_length = 0;
+        return -1;
+    }
+    cfg->blocks_count = count;
+    block = cfg->blocks;
+    for (i = 0; i < words; i++)
+        for (word = cfg->leaders[i]; word; word &= word - 1)
+        {
+            pc = i * 64 + __builtin_ctzll(word);
+            if (block > cfg->blocks)
+                block[-1].end_pc = pc;
+            block->start_pc = pc;
+            ++block;
+        }
+    block[-1].end_pc = length;
+
+    // every switch case takes 4 bytes, so the code length
+    // bounds normal edges together with one fall through per block
+    edges = (u8) length + 2 * count;
+    for (i = 0; i < code->exception_table_length; i++)
+    {
+        entry = &(code->exception_table[i]);
+        edges += getBlockAt(cfg, entry->end_pc - 1)
+            - getBlockAt(cfg, entry->start_pc) + 1;
+    }
+    if (edges > 0xffffffffu || reserveEdges(cfg, (u4) edges) < 0)
+    {
+        logError("Fail to allocate %llu control flow edges!\r\n",
+                (unsigned long long) edges);
+        cfg->code_length = 0;
+        cfg->blocks_count = 0;
+        return -1;
+    }
+
+    count = 0;
+    collectEdges(cfg, code, &count);
+    sortEdges(cfg, count);
+    return 0;
+}
+
+/*
+ * Dominators (Cooper, Harvey and Kennedy, "A Simple, Fast
+ * Dominance Algorithm")
+ *
+ * Iterates over the nodes in reverse postorder until no immediate
+ * dominator changes, usually twice on bytecode. Post-dominators
+ * walk the same arrays with edges reversed.
+ */
+
+// arrays carved out of `storage`
+#define DOM_IDOM                0
+#define DOM_PREORDER            1
+#define DOM_ENTER               2
+#define DOM_LEAVE               3
+#define DOM_NUMBER              4
+#define DOM_ORDER               5
+#define DOM_STACK_NODE          6
+#define DOM_STACK_EDGE          7
+#define DOM_FIRST_CHILD         8
+#define DOM_CHILDREN            9
+#define DOM_EXITS               10
+#define DOM_ARRAYS              11
+
+extern void
+initDominatorTree(struct DominatorTree *tree)
+{
+    memset(tree, 0, sizeof (struct DominatorTree));
+}
+
+extern void
+releaseDominatorTree(struct DominatorTree *tree)
+{
+    freeMemory(tree->storage);
+    initDominatorTree(tree);
+}
+
+static inline u4 *
+getDominatorArray(struct DominatorTree *tree, int which)
+{
+    return tree->storage + which * tree->nodes_capacity;
+}
+
+static int
+reserveDominatorTree(struct DominatorTree *tree, u4 nodes)
+{
+    // one more for the end of the last child list
+    ++nodes;
+    if (nodes > tree->nodes_capacity)
+    {
+        freeMemory(tree->storage);
+        tree->storage = (u4 *) allocMemory((size_t) nodes * DOM_ARRAYS,
+                sizeof (u4));
+        tree->nodes_capacity = tree->storage ? nodes : 0;
+        if (!tree->storage)
+            return -1;
+    }
+    tree->idom = getDominatorArray(tree, DOM_IDOM);
+    tree->preorder = getDominatorArray(tree, DOM_PREORDER);
+    tree->enter = getDominatorArray(tree, DOM_ENTER);
+    tree->leave = getDominatorArray(tree, DOM_LEAVE);
+    return 0;
+}
+
+static inline u4
+countSuccessors(struct ControlFlowGraph *cfg,
+        struct DominatorTree *tree, u4 node)
+{
+    if (!tree->post)
+        return cfg->blocks[node].edges_count;
+    if (node == cfg->blocks_count)
+        return tree->exits_count;
+    return cfg->blocks[node].predecessors_count;
+}
+
+static inline u4
+getSuccessor(struct ControlFlowGraph *cfg,
+        struct DominatorTree *tree, u4 node, u4 i)
+{
+    if (!tree->post)
+        return cfg->edges[cfg->blocks[node].first_edge + i].block;
+    if (node == cfg->blocks_count)
+        return getDominatorArray(tree, DOM_EXITS)[i];
+    return cfg->predecessors[cfg->blocks[node].first_predecessor + i].block;
+}
+
+static inline u4
+countPredecessors(struct ControlFlowGraph *cfg,
+        struct DominatorTree *tree, u4 node)
+{
+    if (!tree->post)
+        return cfg->blocks[node].predecessors_count;
+    if (cfg->blocks[node].edges_count == 0)
+        return 1;
+    return cfg->blocks[node].edges_count;
+}
+
+static inline u4
+getPredecessor(struct ControlFlowGraph *cfg,
+        struct DominatorTree *tree, u4 node, u4 i)
+{
+    if (!tree->post)
+        return cfg->predecessors[cfg->blocks[node].first_predecessor + i]
+            .block;
+    if (cfg->blocks[node].edges_count == 0)
+        return cfg->blocks_count;
+    return cfg->edges[cfg->blocks[node].first_edge + i].block;
+}
+
+static inline u4
+intersect(u4 *idom, u4 *number, u4 a, u4 b)
+{
+    while (a != b)
+    {
+        while (number[a] < number[b])
+            a = idom[a];
+        while (number[b] < number[a])
+            b = idom[b];
+    }
+    return a;
+}
+
+// numbers the reached nodes in postorder, returns how many
+static u4
+numberNodes(struct ControlFlowGraph *cfg, struct DominatorTree *tree)
+{
+    u4 *number, *order, *stack_node, *stack_edge;
+    u4 count, top, node, next;
+
+    number = getDominatorArray(tree, DOM_NUMBER);
+    order = getDominatorArray(tree, DOM_ORDER);
+    stack_node = getDominatorArray(tree, DOM_STACK_NODE);
+    stack_edge = getDominatorArray(tree, DOM_STACK_EDGE);
+    for (node = 0; node < tree->nodes_count; node++)
+        number[node] = NO_BLOCK;
+
+    count = 0;
+    // the root is marked reached with a number it gives back later
+    number[tree->root] = 0;
+    stack_node[0] = tree->root;
+    stack_edge[0] = 0;
+    top = 1;
+    while (top > 0)
+    {
+        node = stack_node[top - 1];
+        if (stack_edge[top - 1] < countSuccessors(cfg, tree, node))
+        {
+            next = getSuccessor(cfg, tree, node, stack_edge[top - 1]++);
+            if (number[next] != NO_BLOCK)
+                continue;
+            number[next] = 0;
+            stack_node[top] = next;
+            stack_edge[top] = 0;
+            ++top;
+            continue;
+        }
+        number[node] = count;
+        order[count++] = node;
+        --top;
+    }
+    return count;
+}
+
+// preorder intervals of the tree, for isDominator
+static void
+numberTree(struct DominatorTree *tree)
+{
+    u4 *first_child, *children, *stack_node, *stack_edge;
+    u4 count, top, node, child, i;
+
+    first_child = getDominatorArray(tree, DOM_FIRST_CHILD);
+    children = getDominatorArray(tree, DOM_CHILDREN);
+    stack_node = getDominatorArray(tree, DOM_STACK_NODE);
+    stack_edge = getDominatorArray(tree, DOM_STACK_EDGE);
+
+    memset(first_child, 0, (tree->nodes_count + 1) * sizeof (u4));
+    for (node = 0; node < tree->nodes_count; node++)
+    {
+        tree->enter[node] = NO_BLOCK;
+        tree->leave[node] = 0;
+        if (tree->idom[node] != NO_BLOCK && node != tree->root)
+            ++first_child[tree->idom[node] + 1];
+    }
+    for (i = 0; i < tree->nodes_count; i++)
+        first_child[i + 1] += first_child[i];
+    // stack_edge counts children placed so far
+    memset(stack_edge, 0, tree->nodes_count * sizeof (u4));
+    for (node = 0; node < tree->nodes_count; node++)
+        if (tree->idom[node] != NO_BLOCK && node != tree->root)
+        {
+            i = tree->idom[node];
+            children[first_child[i] + stack_edge[i]++] = node;
+        }
+
+    count = 0;
+    tree->enter[tree->root] = count;
+    tree->preorder[count++] = tree->root;
+    stack_node[0] = tree->root;
+    stack_edge[0] = first_child[tree->root];
+    top = 1;
+    while (top > 0)
+    {
+        node = stack_node[top - 1];
+        if (stack_edge[top - 1] < first_child[node + 1])
+        {
+            child = children[stack_edge[top - 1]++];
+            tree->enter[child] = count;
+            tree->preorder[count++] = child;
+            stack_node[top] = child;
+            stack_edge[top] = first_child[child];
+            ++top;
+            continue;
+        }
+        tree->leave[node] = count - 1;
+        --top;
+    }
+    tree->reached_count = count;
+}
+
+static int
+computeTree(struct ControlFlowGraph *cfg, struct DominatorTree *tree)
+{
+    u4 *number, *order, *exits;
+    u4 count, node, pred, idom, i, k;
+    int changed;
+
+    if (reserveDominatorTree(tree, tree->nodes_count) < 0)
+    {
+        logError("Fail to allocate dominators of %u blocks!\r\n",
+                cfg->blocks_count);
+        return -1;
+    }
+    tree->exits_count = 0;
+    if (tree->post)
+    {
+        exits = getDominatorArray(tree, DOM_EXITS);
+        for (node = 0; node < cfg->blocks_count; node++)
+            if (cfg->blocks[node].edges_count == 0)
+                exits[tree->exits_count++] = node;
+    }
+    count = numberNodes(cfg, tree);
+    number = getDominatorArray(tree, DOM_NUMBER);
+    order = getDominatorArray(tree, DOM_ORDER);
+
+    for (node = 0; node < tree->nodes_count; node++)
+        tree->idom[node] = NO_BLOCK;
+    tree->idom[tree->root] = tree->root;
+    do
+    {
+        changed = 0;
+        // the root comes last in postorder
+        for (k = count - 1; k-- > 0; )
+        {
+            node = order[k];
+            idom = NO_BLOCK;
+            for (i = 0; i < countPredecessors(cfg, tree, node); i++)
+            {
+                pred = getPredecessor(cfg, tree, node, i);
+                if (tree->idom[pred] == NO_BLOCK)
+                    continue;
+                idom = idom == NO_BLOCK
+                    ? pred : intersect(tree->idom, number, pred, idom);
+            }
+            if (tree->idom[node] != idom)
+            {
+                tree->idom[node] = idom;
+                changed = 1;
+            }
+        }
+    } while (changed);
+
+    numberTree(tree);
+    return 0;
+}
+
+extern int
+computeDominators(struct ControlFlowGraph *cfg, struct DominatorTree *tree)
+{
+    tree->post = 0;
+    tree->root = 0;
+    tree->nodes_count = cfg->blocks_count;
+    return computeTree(cfg, tree);
+}
+
+extern int
+computePostDominators(struct ControlFlowGraph *cfg,
+        struct DominatorTree *tree)
+{
+    tree->post = 1;
+    tree->root = cfg->blocks_count;
+    tree->nodes_count = cfg->blocks_count + 1;
+    return computeTree(cfg, tree);
+}
+
+/*
+ * Natural loops
+ *
+ * A back edge goes to a block dominating its source. Headers are
+ * visited in reverse preorder of the dominator tree, so inner loops
+ * are found first and later collapsed into their headers while
+ * the enclosing loop's body is walked backwards from its back edges.
+ */
+
+extern void
+initLoopForest(struct LoopForest *forest)
+{
+    memset(forest, 0, sizeof (struct LoopForest));
+}
+
+extern void
+releaseLoopForest(struct LoopForest *forest)
+{
+    freeMemory(forest->loops);
+    freeMemory(forest->loop_of);
+    freeMemory(forest->worklist);
+    initLoopForest(forest);
+}
+
+static int
+reserveLoopForest(struct LoopForest *forest, u4 blocks)
+{
+    if (blocks <= forest->blocks_capacity)
+        return 0;
+    freeMemory(forest->loops);
+    freeMemory(forest->loop_of);
+    freeMemory(forest->worklist);
+    forest->loops = (struct Loop *) allocMemory(blocks, sizeof (struct Loop));
+    forest->loop_of = (u4 *) allocMemory(blocks, sizeof (u4));
+    // every block is pushed at most once per loop it joins as a header
+    forest->worklist = (u4 *) allocMemory(blocks, sizeof (u4));
+    forest->blocks_capacity = blocks;
+    if (!forest->loops || !forest->loop_of || !forest->worklist)
+    {
+        forest->blocks_capacity = 0;
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ * Adds `block` or the outermost loop around it to `loop`,
+ * returns the block whose predecessors still have to be walked.
+ */
+static u4
+joinLoop(struct LoopForest *forest, u4 loop, u4 block)
+{
+    u4 inner;
+
+    inner = forest->loop_of[block];
+    if (inner == NO_LOOP)
+    {
+        forest->loop_of[block] = loop;
+        ++forest->loops[loop].blocks_count;
+        return block;
+    }
+    while (forest->loops[inner].parent != NO_LOOP)
+        inner = forest->loops[inner].parent;
+    if (inner == loop)
+        return NO_BLOCK;
+    forest->loops[inner].parent = loop;
+    forest->loops[loop].blocks_count += forest->loops[inner].blocks_count;
+    return forest->loops[inner].header;
+}
+
+extern int
+findLoops(struct ControlFlowGraph *cfg, struct DominatorTree *tree,
+        struct LoopForest *forest)
+{
+    struct BasicBlock *block;
+    struct Loop *loop;
+    u4 top, header, node, pred, i, k;
+
+    forest->loops_count = 0;
+    if (tree->post)
+    {
+        logError("Loops need dominators, not post-dominators!\r\n");
+        return -1;
+    }
+    if (reserveLoopForest(forest, cfg->blocks_count) < 0)
+    {
+        logError("Fail to allocate loops of %u blocks!\r\n",
+                cfg->blocks_count);
+        return -1;
+    }
+    for (i = 0; i < cfg->blocks_count; i++)
+        forest->loop_of[i] = NO_LOOP;
+
+    for (k = tree->reached_count; k-- > 0; )
+    {
+        header = tree->preorder[k];
+        block = &(cfg->blocks[header]);
+        top = 0;
+        for (i = 0; i < block->predecessors_count; i++)
+        {
+            pred = cfg->predecessors[block->first_predecessor + i].block;
+            if (!isDominator(tree, header, pred))
+                continue;
+            if (top == 0)
+            {
+                loop = &(forest->loops[forest->loops_count]);
+                loop->header = header;
+                loop->parent = NO_LOOP;
+                loop->depth = 0;
+                loop->blocks_count = 1;
+                forest->loop_of[header] = forest->loops_count++;
+            }
+            node = joinLoop(forest, forest->loops_count - 1, pred);
+            if (node != NO_BLOCK)
+                forest->worklist[top++] = node;
+        }
+        while (top > 0)
+        {
+            block = &(cfg->blocks[forest->worklist[--top]]);
+            for (i = 0; i < block->predecessors_count; i++)
+            {
+                pred = cfg->predecessors[block->first_predecessor + i].block;
+                if (!isDominator(tree, header, pred))
+                    continue;
+                node = joinLoop(forest, forest->loops_count - 1, pred);
+                if (node != NO_BLOCK)
+                    forest->worklist[top++] = node;
+            }
+        }
+    }
+
+    // parents are numbered after their children
+    for (i = forest->loops_count; i-- > 0; )
+    {
+        loop = &(forest->loops[i]);
+        loop->depth = loop->parent == NO_LOOP
+            ? 1 : forest->loops[loop->parent].depth + 1;
+    }
+    return 0;
+}
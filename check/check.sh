@@ -0,0 +1,50 @@
+#!/bin/sh
+#
+# Runs cruise over the classes of classes.py and compares what it
+# prints with the *.expected files next to this script.
+#
+#     sh check/check.sh <cruise> <work directory>
+
+cruise=$1
+work=$2
+dir=`dirname $0`
+failed=0
+
+if [ ! -x "$cruise" ] || [ -z "$work" ]
+then
+    echo "Usage: $0 <cruise> <work directory>"
+    exit 1
+fi
+mkdir -p $work
+python3 $dir/classes.py $work || exit 1
+
+compare()
+{
+    if diff -u $dir/$1.expected $work/$1.out
+    then
+        echo "PASS $1"
+    else
+        echo "FAIL $1"
+        failed=1
+    fi
+}
+
+# type checker and structural checker reject paths
+for variant in ok midbranch badlocal badexc noinit badframe noframe \
+    uninit float midnew
+do
+    echo "TC_$variant"
+    $cruise --verify=full $work/TC_$variant.class 2>&1 | grep '^\[Error'
+done > $work/verify.out
+compare verify
+
+# statements of the expression writer
+$cruise --bench=statements:$work/Expr.class > $work/statements.out
+compare statements
+
+# line tables and SMAP ranges
+$cruise --symbolize=$work/K.class < $dir/symbolize.in \
+    > $work/symbolize.out 2> /dev/null
+compare symbolize
+
+exit $failed
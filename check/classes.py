@@ -0,0 +1,271 @@
+#!/usr/bin/env python3
+#
+# Hand-assembled class files for the checks
+#
+#     python3 check/classes.py <dir>
+#
+# Each class pins one behaviour, see check.sh for what runs on it.
+
+import os
+import struct
+import sys
+
+ACC_PUBLIC = 0x0001
+ACC_STATIC = 0x0008
+ACC_SUPER = 0x0020
+
+ACC_PS = ACC_PUBLIC | ACC_STATIC
+
+
+class ConstantPool:
+    def __init__(self):
+        self.entries = []
+        self.indexes = {}
+
+    def add(self, key, raw, wide=False):
+        if key in self.indexes:
+            return self.indexes[key]
+        self.entries.append(raw)
+        index = len(self.entries)
+        # long and double take two slots
+        if wide:
+            self.entries.append(b'')
+        self.indexes[key] = index
+        return index
+
+    def utf8(self, text):
+        data = text.encode()
+        return self.add(('Utf8', text), struct.pack('>BH', 1, len(data)) + data)
+
+    def integer(self, value):
+        return self.add(('Integer', value), struct.pack('>Bi', 3, value))
+
+    def float(self, value):
+        return self.add(('Float', value), struct.pack('>Bf', 4, value))
+
+    def long(self, value):
+        return self.add(('Long', value), struct.pack('>Bq', 5, value), True)
+
+    def cls(self, name):
+        return self.add(('Class', name), struct.pack('>BH', 7, self.utf8(name)))
+
+    def string(self, text):
+        return self.add(('String', text), struct.pack('>BH', 8, self.utf8(text)))
+
+    def name_and_type(self, name, descriptor):
+        return self.add(('NameAndType', name, descriptor),
+                struct.pack('>BHH', 12, self.utf8(name), self.utf8(descriptor)))
+
+    def method(self, owner, name, descriptor):
+        return self.add(('Methodref', owner, name, descriptor),
+                struct.pack('>BHH', 10, self.cls(owner),
+                    self.name_and_type(name, descriptor)))
+
+    def bytes(self):
+        return struct.pack('>H', len(self.entries) + 1) + b''.join(self.entries)
+
+
+def u2(value):
+    return [value >> 8, value & 0xff]
+
+
+def attribute(cp, name, body):
+    return struct.pack('>HI', cp.utf8(name), len(body)) + body
+
+
+def code(cp, max_stack, max_locals, bc, handlers=(), attributes=()):
+    body = struct.pack('>HHI', max_stack, max_locals, len(bc)) + bytes(bc)
+    body += struct.pack('>H', len(handlers))
+    body += b''.join(struct.pack('>HHHH', *h) for h in handlers)
+    body += struct.pack('>H', len(attributes)) + b''.join(attributes)
+    return attribute(cp, 'Code', body)
+
+
+def line_numbers(cp, rows):
+    return attribute(cp, 'LineNumberTable', struct.pack('>H', len(rows))
+            + b''.join(struct.pack('>HH', *row) for row in rows))
+
+
+def stack_map(cp, frames):
+    return attribute(cp, 'StackMapTable', struct.pack('>H', len(frames))
+            + b''.join(bytes(frame) for frame in frames))
+
+
+def method(cp, flags, name, descriptor, attributes=()):
+    return struct.pack('>HHHH', flags, cp.utf8(name), cp.utf8(descriptor),
+            len(attributes)) + b''.join(attributes)
+
+
+def class_file(cp, name, methods, attributes=(), major=52):
+    this = cp.cls(name)
+    body = struct.pack('>HHHH', ACC_PUBLIC | ACC_SUPER, this,
+            cp.cls('java/lang/Object'), 0)
+    body += struct.pack('>H', 0)
+    body += struct.pack('>H', len(methods)) + b''.join(methods)
+    body += struct.pack('>H', len(attributes)) + b''.join(attributes)
+    return struct.pack('>IHH', 0xCAFEBABE, 0, major) + cp.bytes() + body
+
+
+def verifier_class(variant):
+    """
+    Sound methods, one of them broken by `variant`; TC_ok is the
+    control, every other variant has to be rejected.
+    """
+    name = 'TC_' + variant
+    cp = ConstantPool()
+    this = cp.cls(name)
+    object_init = cp.method('java/lang/Object', '<init>', '()V')
+    init = cp.method(name, '<init>', '()V')
+    throwable = cp.cls('java/lang/Throwable')
+    hi = cp.string('hi')
+    two = cp.long(2)
+    methods = []
+
+    bc = [0x2a, 0xb7] + u2(object_init) + [0xb1]
+    if variant == 'noinit':
+        bc = [0xb1]
+    methods.append(method(cp, ACC_PUBLIC, '<init>', '()V',
+        [code(cp, 1, 1, bc)]))
+
+    # static int loop(int n) { int s = 0; for (int i = 0; i < n; i++) s += i; return s; }
+    bc = [0x03, 0x3c, 0x03, 0x3d, 0x1c, 0x1a, 0xa2, 0x00, 0x0d,
+          0x1b, 0x1c, 0x60, 0x3c, 0x84, 0x02, 0x01, 0xa7, 0xff, 0xf4,
+          0x1b, 0xac]
+    frames = [[253, 0, 4, 1, 1], [250, 0, 14]]
+    if variant == 'badframe':
+        frames = [[253, 0, 4, 1, 1], [250, 0, 12]]
+    if variant == 'noframe':
+        frames = [[253, 0, 4, 1, 1]]
+    if variant == 'midbranch':
+        bc[8] = 0x0c
+    if variant == 'badlocal':
+        bc[4] = 0x1d
+    methods.append(method(cp, ACC_PS, 'loop', '(I)I',
+        [code(cp, 2, 3, bc, attributes=[stack_map(cp, frames)])]))
+
+    # int sw(int k) { try { switch (k) { case 1: return 10; case 2: return 20; } return 0; }
+    #                 catch (Throwable t) { return -1; } }
+    bc = [0x1b, 0xaa, 0, 0] + list(struct.pack('>iiiii', 29, 1, 2, 23, 26))
+    bc += [0x10, 10, 0xac, 0x10, 20, 0xac, 0x03, 0xac, 0x4d, 0x02, 0xac]
+    frames = [[24], [2], [2], [65, 7] + u2(throwable)]
+    end = 28 if variant == 'badexc' else 32
+    methods.append(method(cp, ACC_PUBLIC, 'sw', '(I)I',
+        [code(cp, 1, 3, bc, [(0, end, 32, throwable)],
+            [stack_map(cp, frames)])]))
+
+    # static Object mk() { return new TC_x(); }
+    bc = [0xbb] + u2(this) + [0x59, 0xb7] + u2(init) + [0xb0]
+    if variant == 'uninit':
+        bc = [0xbb] + u2(this) + [0x59, 0x57, 0xb0, 0, 0]
+    methods.append(method(cp, ACC_PS, 'mk', '()Ljava/lang/Object;',
+        [code(cp, 2, 0, bc)]))
+
+    # static long lng(long a, double d, String[] x) { long r = a * 2; x[0] = "hi"; return r + (long) d; }
+    bc = [0x1e, 0x14] + u2(two) + [0x69, 0xc4, 0x37, 0, 5,
+          0x19, 4, 0x03, 0x12, hi, 0x53, 0xc4, 0x16, 0, 5,
+          0x28, 0x8f, 0x61, 0x5c, 0x58, 0xad]
+    if variant == 'float':
+        bc[-1] = 0xae
+    methods.append(method(cp, ACC_PS, 'lng', '(JD[Ljava/lang/String;)J',
+        [code(cp, 6, 7, bc)]))
+    return name, class_file(cp, name, methods)
+
+
+def uninitialized_class():
+    """
+    Frame at 5 claims Uninitialized(2), but pc 2 is the operand of
+    sipush, the new instruction there is never executed.
+    """
+    name = 'TC_midnew'
+    cp = ConstantPool()
+    object_init = cp.method('java/lang/Object', '<init>', '()V')
+    bc = [0x11, 0x00, 0xbb, 0x57, 0xb1, 0x59, 0xb7] + u2(object_init) + [0xb1]
+    frames = [[64 + 5, 8, 0, 2]]
+    methods = [method(cp, ACC_PS, 'u', '()V',
+        [code(cp, 2, 0, bc, attributes=[stack_map(cp, frames)])])]
+    return name, class_file(cp, name, methods)
+
+
+def expression_class():
+    """
+    Operators the writer has to parenthesize, negative constants,
+    float comparisons with their NaN results and a super call.
+    """
+    name = 'Expr'
+    cp = ConstantPool()
+    hash_code = cp.method('java/lang/Object', 'hashCode', '()I')
+    big = cp.integer(-100000)
+    negative = cp.float(-2.5)
+    monitors = cp.cls('[[[I')
+    methods = []
+
+    def add(flags, method_name, descriptor, max_stack, max_locals, bc):
+        methods.append(method(cp, flags, method_name, descriptor,
+            [code(cp, max_stack, max_locals, bc)]))
+
+    # -(-a), -(-100000), -(-1), -(-2.5F)
+    add(ACC_PS, 'neg', '(I)I', 1, 1, [0x1a, 0x74, 0x74, 0xac])
+    add(ACC_PS, 'negLdc', '()I', 1, 0, [0x12, big, 0x74, 0xac])
+    add(ACC_PS, 'negConst', '()I', 1, 0, [0x02, 0x74, 0xac])
+    add(ACC_PS, 'negFloat', '()F', 1, 0, [0x12, negative, 0x76, 0xae])
+    # (a + b) * c, a - (b - c), a - b - c
+    add(ACC_PS, 'mul', '(III)I', 2, 3, [0x1a, 0x1b, 0x60, 0x1c, 0x68, 0xac])
+    add(ACC_PS, 'subRight', '(III)I', 3, 3,
+        [0x1a, 0x1b, 0x1c, 0x64, 0x64, 0xac])
+    add(ACC_PS, 'subLeft', '(III)I', 2, 3,
+        [0x1a, 0x1b, 0x64, 0x1c, 0x64, 0xac])
+    # <cmp>; <if>; iconst_0; ireturn; iconst_1; ireturn
+    for method_name, compare, branch in [
+            ('fcmpgIfge', 0x96, 0x9c), ('fcmplIfge', 0x95, 0x9c),
+            ('fcmplIflt', 0x95, 0x9b), ('fcmpgIflt', 0x96, 0x9b),
+            ('fcmplIfne', 0x95, 0x9a), ('dcmpgIfle', 0x98, 0x9e)]:
+        if compare < 0x97:
+            load, descriptor = [0x22, 0x23], '(FF)Z'
+        else:
+            load, descriptor = [0x26, 0x28], '(DD)Z'
+        add(ACC_PS, method_name, descriptor, 4, 4,
+            load + [compare, branch, 0, 5, 0x03, 0xac, 0x04, 0xac])
+    add(ACC_PUBLIC, 'hash', '()I', 1, 1, [0x2a, 0xb7] + u2(hash_code) + [0xac])
+    # a / b is kept for the exception, synchronized (o) {}, new int[a][b][]
+    add(ACC_PS, 'effects', '(IILjava/lang/Object;)I', 3, 4,
+        [0x1a, 0x1b, 0x6c, 0x57, 0x2c, 0xc2, 0x2c, 0xc3,
+         0x1a, 0x1b, 0xc5] + u2(monitors) + [2, 0x4e, 0x2d, 0xbe, 0xac])
+    return name, class_file(cp, name, methods, major=49)
+
+
+def smap_class():
+    """
+    Kotlin style SMAP: lines 50..59 come from Inl.kt two output lines
+    per input line, line 150 maps back to K.kt:200, the rest is 1:1.
+    """
+    name = 'K'
+    cp = ConstantPool()
+    smap = (b'SMAP\nK.kt\nKotlin\n*S Kotlin\n*F\n+ 1 K.kt\nK.kt\n'
+            b'+ 2 Inl.kt\nInl.kt\n*L\n1#1,100:1\n10#2,5:50,2\n200#1:150,0\n*E\n')
+    methods = [
+        method(cp, ACC_PS, 'm', '()V',
+            [code(cp, 0, 0, [0xb1], attributes=[line_numbers(cp, [(0, 55)])])]),
+        method(cp, ACC_PS, 'n', '()V',
+            [code(cp, 0, 0, [0, 0, 0, 0, 0xb1],
+                attributes=[line_numbers(cp, [(0, 5), (3, 7)])])]),
+    ]
+    attributes = [
+        attribute(cp, 'SourceFile', struct.pack('>H', cp.utf8('K.kt'))),
+        attribute(cp, 'SourceDebugExtension', smap),
+    ]
+    return name, class_file(cp, name, methods, attributes, major=49)
+
+
+def main():
+    directory = sys.argv[1]
+    classes = [verifier_class(variant) for variant in
+            ['ok', 'midbranch', 'badlocal', 'badexc', 'noinit',
+             'badframe', 'noframe', 'uninit', 'float']]
+    classes += [uninitialized_class(), expression_class(), smap_class()]
+    for name, data in classes:
+        with open(os.path.join(directory, name + '.class'), 'wb') as out:
+            out.write(data)
+
+
+if __name__ == '__main__':
+    main()
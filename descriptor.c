@@ -0,0 +1,453 @@
+#include <string.h>
+
+#include "java.h"
+#include "descriptor.h"
+
+/*
+ * Descriptor and signature scanner
+ *
+ * Every byte is mapped to a character class and drives one
+ * transition of the automaton below. Types may nest inside type
+ * arguments and bounds, so a transition can push the state to
+ * resume at once the nested part is done. Tokens are emitted when
+ * a type started at the outermost level completes.
+ */
+
+// character classes
+#define K_ILLEGAL               0
+#define K_NAME                  1   // any other identifier character
+#define K_OPEN                  2   // (
+#define K_CLOSE                 3   // )
+#define K_ARRAY                 4   // [
+#define K_BASE                  5   // B C D F I J S Z
+#define K_VOID                  6   // V
+#define K_CLASS                 7   // L
+#define K_SEMI                  8   // ;
+#define K_SLASH                 9   // /
+// meaningful in signatures only
+#define K_VAR                   10  // T
+#define K_DOT                   11  // .
+#define K_LT                    12  // <
+#define K_GT                    13  // >
+#define K_COLON                 14  // :
+#define K_STAR                  15  // *
+#define K_WILD                  16  // + -
+#define K_CARET                 17  // ^
+#define K_COUNT                 18
+
+// states
+#define S_ERROR                 0
+#define S_FIELD                 1
+#define S_FIELD_END             2
+#define S_REFERENCE             3
+#define S_TYPE                  4   // after '['
+#define S_CLASS_FIRST           5
+#define S_CLASS_NAME            6
+#define S_INNER_FIRST           7
+#define S_INNER_NAME            8
+#define S_CLASS_ARGS            9   // after type arguments
+#define S_VAR_FIRST             10
+#define S_VAR_NAME              11
+#define S_ARGS_FIRST            12
+#define S_ARGS                  13
+#define S_BOUND                 14  // after wildcard indicator
+#define S_METHOD                15
+#define S_METHOD_OPEN           16
+#define S_PARAMS                17
+#define S_RETURN                18
+#define S_METHOD_END            19
+#define S_THROW                 20
+#define S_THROWS                21
+#define S_CLASS_SIG             22
+#define S_SUPER                 23
+#define S_INTERFACES            24
+#define S_TPARAM_FIRST          25
+#define S_TPARAM_NAME           26
+#define S_CLASS_BOUND           27
+#define S_INTERFACE_BOUND       28
+#define S_TPARAM_NEXT           29
+#define S_COUNT                 30
+// return to the state on top of the stack
+#define S_POP                   0x3f
+
+// transition flags
+#define T_STATE                 0x3f
+#define T_TYPE                  0x40    // push `after` of the current state
+#define T_SECTION               0x80    // push `resume` of the current state
+
+// deepest nesting of type arguments and bounds
+#define SCAN_MAX_DEPTH          32
+
+struct ScanState
+{
+    // where to go once a type started here completes
+    u1              after;
+    // where to go once type arguments or parameters started here end
+    u1              resume;
+    // role of the tokens completed when returning here
+    u1              role;
+    u1              accept;
+};
+
+static const struct ScanState scan_states[S_COUNT] = {
+    { 0,                    0,              0,                  0 },  // S_ERROR
+    { S_FIELD_END,          0,              0,                  0 },  // S_FIELD
+    { 0,                    0,              TOKEN_FIELD,        1 },  // S_FIELD_END
+    { S_FIELD_END,          0,              0,                  0 },  // S_REFERENCE
+    { 0,                    0,              0,                  0 },  // S_TYPE
+    { 0,                    0,              0,                  0 },  // S_CLASS_FIRST
+    { 0,                    S_CLASS_ARGS,   0,                  0 },  // S_CLASS_NAME
+    { 0,                    0,              0,                  0 },  // S_INNER_FIRST
+    { 0,                    S_CLASS_ARGS,   0,                  0 },  // S_INNER_NAME
+    { 0,                    0,              0,                  0 },  // S_CLASS_ARGS
+    { 0,                    0,              0,                  0 },  // S_VAR_FIRST
+    { 0,                    0,              0,                  0 },  // S_VAR_NAME
+    { S_ARGS,               0,              0,                  0 },  // S_ARGS_FIRST
+    { S_ARGS,               0,              0,                  0 },  // S_ARGS
+    { S_ARGS,               0,              0,                  0 },  // S_BOUND
+    { 0,                    S_METHOD_OPEN,  0,                  0 },  // S_METHOD
+    { 0,                    0,              0,                  0 },  // S_METHOD_OPEN
+    { S_PARAMS,             0,              TOKEN_PARAMETER,    0 },  // S_PARAMS
+    { S_METHOD_END,         0,              0,                  0 },  // S_RETURN
+    { 0,                    0,              TOKEN_RETURN,       1 },  // S_METHOD_END
+    { S_THROWS,             0,              0,                  0 },  // S_THROW
+    { 0,                    0,              TOKEN_THROWS,       1 },  // S_THROWS
+    { S_INTERFACES,         S_SUPER,        0,                  0 },  // S_CLASS_SIG
+    { S_INTERFACES,         0,              0,                  0 },  // S_SUPER
+    { S_INTERFACES,         0,              TOKEN_SUPERTYPE,    1 },  // S_INTERFACES
+    { 0,                    0,              0,                  0 },  // S_TPARAM_FIRST
+    { 0,                    0,              0,                  0 },  // S_TPARAM_NAME
+    { S_TPARAM_NEXT,        0,              0,                  0 },  // S_CLASS_BOUND
+    { S_TPARAM_NEXT,        0,              0,                  0 },  // S_INTERFACE_BOUND
+    { 0,                    0,              0,                  0 },  // S_TPARAM_NEXT
+};
+
+// initial state of each SCAN_* kind
+static const u1 scan_start[] = {
+    S_FIELD,
+    S_METHOD,
+    S_REFERENCE,
+    S_CLASS_SIG,
+    S_METHOD,
+};
+
+// bytes from 0x80 on belong to multibyte characters, K_NAME
+static const u1 char_class[128] = {
+    K_ILLEGAL,  K_NAME,     K_NAME,     K_NAME,     K_NAME,     K_NAME,     K_NAME,     K_NAME,     // 0x00
+    K_NAME,     K_NAME,     K_NAME,     K_NAME,     K_NAME,     K_NAME,     K_NAME,     K_NAME,     // 0x08
+    K_NAME,     K_NAME,     K_NAME,     K_NAME,     K_NAME,     K_NAME,     K_NAME,     K_NAME,     // 0x10
+    K_NAME,     K_NAME,     K_NAME,     K_NAME,     K_NAME,     K_NAME,     K_NAME,     K_NAME,     // 0x18
+    K_NAME,     K_NAME,     K_NAME,     K_NAME,     K_NAME,     K_NAME,     K_NAME,     K_NAME,     // 0x20
+    K_OPEN,     K_CLOSE,    K_STAR,     K_WILD,     K_NAME,     K_WILD,     K_DOT,      K_SLASH,    // 0x28
+    K_NAME,     K_NAME,     K_NAME,     K_NAME,     K_NAME,     K_NAME,     K_NAME,     K_NAME,     // 0x30
+    K_NAME,     K_NAME,     K_COLON,    K_SEMI,     K_LT,       K_NAME,     K_GT,       K_NAME,     // 0x38
+    K_NAME,     K_NAME,     K_BASE,     K_BASE,     K_BASE,     K_NAME,     K_BASE,     K_NAME,     // 0x40
+    K_NAME,     K_BASE,     K_BASE,     K_NAME,     K_CLASS,    K_NAME,     K_NAME,     K_NAME,     // 0x48
+    K_NAME,     K_NAME,     K_NAME,     K_BASE,     K_VAR,      K_NAME,     K_VOID,     K_NAME,     // 0x50
+    K_NAME,     K_NAME,     K_BASE,     K_ARRAY,    K_NAME,     K_NAME,     K_CARET,    K_NAME,     // 0x58
+    K_NAME,     K_NAME,     K_NAME,     K_NAME,     K_NAME,     K_NAME,     K_NAME,     K_NAME,     // 0x60
+    K_NAME,     K_NAME,     K_NAME,     K_NAME,     K_NAME,     K_NAME,     K_NAME,     K_NAME,     // 0x68
+    K_NAME,     K_NAME,     K_NAME,     K_NAME,     K_NAME,     K_NAME,     K_NAME,     K_NAME,     // 0x70
+    K_NAME,     K_NAME,     K_NAME,     K_NAME,     K_NAME,     K_NAME,     K_NAME,     K_NAME,     // 0x78
+};
+
+#define X                       0
+#define P                       T_TYPE
+#define R                       T_SECTION
+
+/*
+ * Columns in K_* order:
+ * ILLEGAL  NAME     OPEN     CLOSE    ARRAY
+ * BASE     VOID     CLASS    SEMI     SLASH
+ * VAR      DOT      LT       GT
+ * COLON    STAR     WILD     CARET
+ */
+static const u1 transitions[S_COUNT][K_COUNT] = {
+    // S_ERROR
+    {
+        X,                 X,                 X,                 X,                 X,
+        X,                 X,                 X,                 X,                 X,
+        X,                 X,                 X,                 X,
+        X,                 X,                 X,                 X,
+    },
+    // S_FIELD
+    {
+        X,                 X,                 X,                 X,                 S_TYPE|P,
+        S_POP|P,           X,                 S_CLASS_FIRST|P,   X,                 X,
+        X,                 X,                 X,                 X,
+        X,                 X,                 X,                 X,
+    },
+    // S_FIELD_END
+    {
+        X,                 X,                 X,                 X,                 X,
+        X,                 X,                 X,                 X,                 X,
+        X,                 X,                 X,                 X,
+        X,                 X,                 X,                 X,
+    },
+    // S_REFERENCE
+    {
+        X,                 X,                 X,                 X,                 S_TYPE|P,
+        X,                 X,                 S_CLASS_FIRST|P,   X,                 X,
+        S_VAR_FIRST|P,     X,                 X,                 X,
+        X,                 X,                 X,                 X,
+    },
+    // S_TYPE
+    {
+        X,                 X,                 X,                 X,                 S_TYPE,
+        S_POP,             X,                 S_CLASS_FIRST,     X,                 X,
+        S_VAR_FIRST,       X,                 X,                 X,
+        X,                 X,                 X,                 X,
+    },
+    // S_CLASS_FIRST
+    {
+        X,                 S_CLASS_NAME,      S_CLASS_NAME,      S_CLASS_NAME,      X,
+        S_CLASS_NAME,      S_CLASS_NAME,      S_CLASS_NAME,      X,                 X,
+        S_CLASS_NAME,      X,                 X,                 X,
+        X,                 S_CLASS_NAME,      S_CLASS_NAME,      S_CLASS_NAME,
+    },
+    // S_CLASS_NAME
+    {
+        X,                 S_CLASS_NAME,      S_CLASS_NAME,      S_CLASS_NAME,      X,
+        S_CLASS_NAME,      S_CLASS_NAME,      S_CLASS_NAME,      S_POP,             S_CLASS_FIRST,
+        S_CLASS_NAME,      S_INNER_FIRST,     S_ARGS_FIRST|R,    X,
+        X,                 S_CLASS_NAME,      S_CLASS_NAME,      S_CLASS_NAME,
+    },
+    // S_INNER_FIRST
+    {
+        X,                 S_INNER_NAME,      S_INNER_NAME,      S_INNER_NAME,      X,
+        S_INNER_NAME,      S_INNER_NAME,      S_INNER_NAME,      X,                 X,
+        S_INNER_NAME,      X,                 X,                 X,
+        X,                 S_INNER_NAME,      S_INNER_NAME,      S_INNER_NAME,
+    },
+    // S_INNER_NAME
+    {
+        X,                 S_INNER_NAME,      S_INNER_NAME,      S_INNER_NAME,      X,
+        S_INNER_NAME,      S_INNER_NAME,      S_INNER_NAME,      S_POP,             X,
+        S_INNER_NAME,      S_INNER_FIRST,     S_ARGS_FIRST|R,    X,
+        X,                 S_INNER_NAME,      S_INNER_NAME,      S_INNER_NAME,
+    },
+    // S_CLASS_ARGS
+    {
+        X,                 X,                 X,                 X,                 X,
+        X,                 X,                 X,                 S_POP,             X,
+        X,                 S_INNER_FIRST,     X,                 X,
+        X,                 X,                 X,                 X,
+    },
+    // S_VAR_FIRST
+    {
+        X,                 S_VAR_NAME,        S_VAR_NAME,        S_VAR_NAME,        X,
+        S_VAR_NAME,        S_VAR_NAME,        S_VAR_NAME,        X,                 X,
+        S_VAR_NAME,        X,                 X,                 X,
+        X,                 S_VAR_NAME,        S_VAR_NAME,        S_VAR_NAME,
+    },
+    // S_VAR_NAME
+    {
+        X,                 S_VAR_NAME,        S_VAR_NAME,        S_VAR_NAME,        X,
+        S_VAR_NAME,        S_VAR_NAME,        S_VAR_NAME,        S_POP,             X,
+        S_VAR_NAME,        X,                 X,                 X,
+        X,                 S_VAR_NAME,        S_VAR_NAME,        S_VAR_NAME,
+    },
+    // S_ARGS_FIRST
+    {
+        X,                 X,                 X,                 X,                 S_TYPE|P,
+        X,                 X,                 S_CLASS_FIRST|P,   X,                 X,
+        S_VAR_FIRST|P,     X,                 X,                 X,
+        X,                 S_ARGS,            S_BOUND,           X,
+    },
+    // S_ARGS
+    {
+        X,                 X,                 X,                 X,                 S_TYPE|P,
+        X,                 X,                 S_CLASS_FIRST|P,   X,                 X,
+        S_VAR_FIRST|P,     X,                 X,                 S_POP,
+        X,                 S_ARGS,            S_BOUND,           X,
+    },
+    // S_BOUND
+    {
+        X,                 X,                 X,                 X,                 S_TYPE|P,
+        X,                 X,                 S_CLASS_FIRST|P,   X,                 X,
+        S_VAR_FIRST|P,     X,                 X,                 X,
+        X,                 X,                 X,                 X,
+    },
+    // S_METHOD
+    {
+        X,                 X,                 S_PARAMS,          X,                 X,
+        X,                 X,                 X,                 X,                 X,
+        X,                 X,                 S_TPARAM_FIRST|R,  X,
+        X,                 X,                 X,                 X,
+    },
+    // S_METHOD_OPEN
+    {
+        X,                 X,                 S_PARAMS,          X,                 X,
+        X,                 X,                 X,                 X,                 X,
+        X,                 X,                 X,                 X,
+        X,                 X,                 X,                 X,
+    },
+    // S_PARAMS
+    {
+        X,                 X,                 X,                 S_RETURN,          S_TYPE|P,
+        S_POP|P,           X,                 S_CLASS_FIRST|P,   X,                 X,
+        S_VAR_FIRST|P,     X,                 X,                 X,
+        X,                 X,                 X,                 X,
+    },
+    // S_RETURN
+    {
+        X,                 X,                 X,                 X,                 S_TYPE|P,
+        S_POP|P,           S_POP|P,           S_CLASS_FIRST|P,   X,                 X,
+        S_VAR_FIRST|P,     X,                 X,                 X,
+        X,                 X,                 X,                 X,
+    },
+    // S_METHOD_END
+    {
+        X,                 X,                 X,                 X,                 X,
+        X,                 X,                 X,                 X,                 X,
+        X,                 X,                 X,                 X,
+        X,                 X,                 X,                 S_THROW,
+    },
+    // S_THROW
+    {
+        X,                 X,                 X,                 X,                 X,
+        X,                 X,                 S_CLASS_FIRST|P,   X,                 X,
+        S_VAR_FIRST|P,     X,                 X,                 X,
+        X,                 X,                 X,                 X,
+    },
+    // S_THROWS
+    {
+        X,                 X,                 X,                 X,                 X,
+        X,                 X,                 X,                 X,                 X,
+        X,                 X,                 X,                 X,
+        X,                 X,                 X,                 S_THROW,
+    },
+    // S_CLASS_SIG
+    {
+        X,                 X,                 X,                 X,                 X,
+        X,                 X,                 S_CLASS_FIRST|P,   X,                 X,
+        X,                 X,                 S_TPARAM_FIRST|R,  X,
+        X,                 X,                 X,                 X,
+    },
+    // S_SUPER
+    {
+        X,                 X,                 X,                 X,                 X,
+        X,                 X,                 S_CLASS_FIRST|P,   X,                 X,
+        X,                 X,                 X,                 X,
+        X,                 X,                 X,                 X,
+    },
+    // S_INTERFACES
+    {
+        X,                 X,                 X,                 X,                 X,
+        X,                 X,                 S_CLASS_FIRST|P,   X,                 X,
+        X,                 X,                 X,                 X,
+        X,                 X,                 X,                 X,
+    },
+    // S_TPARAM_FIRST
+    {
+        X,                 S_TPARAM_NAME,     S_TPARAM_NAME,     S_TPARAM_NAME,     X,
+        S_TPARAM_NAME,     S_TPARAM_NAME,     S_TPARAM_NAME,     X,                 X,
+        S_TPARAM_NAME,     X,                 X,                 X,
+        X,                 S_TPARAM_NAME,     S_TPARAM_NAME,     S_TPARAM_NAME,
+    },
+    // S_TPARAM_NAME
+    {
+        X,                 S_TPARAM_NAME,     S_TPARAM_NAME,     S_TPARAM_NAME,     X,
+        S_TPARAM_NAME,     S_TPARAM_NAME,     S_TPARAM_NAME,     X,                 X,
+        S_TPARAM_NAME,     X,                 X,                 X,
+        S_CLASS_BOUND,     S_TPARAM_NAME,     S_TPARAM_NAME,     S_TPARAM_NAME,
+    },
+    // S_CLASS_BOUND
+    {
+        X,                 S_TPARAM_NAME,     S_TPARAM_NAME,     S_TPARAM_NAME,     S_TYPE|P,
+        S_TPARAM_NAME,     S_TPARAM_NAME,     S_CLASS_FIRST|P,   X,                 X,
+        S_VAR_FIRST|P,     X,                 X,                 S_POP,
+        S_INTERFACE_BOUND, S_TPARAM_NAME,     S_TPARAM_NAME,     S_TPARAM_NAME,
+    },
+    // S_INTERFACE_BOUND
+    {
+        X,                 X,                 X,                 X,                 S_TYPE|P,
+        X,                 X,                 S_CLASS_FIRST|P,   X,                 X,
+        S_VAR_FIRST|P,     X,                 X,                 X,
+        X,                 X,                 X,                 X,
+    },
+    // S_TPARAM_NEXT
+    {
+        X,                 S_TPARAM_NAME,     S_TPARAM_NAME,     S_TPARAM_NAME,     X,
+        S_TPARAM_NAME,     S_TPARAM_NAME,     S_TPARAM_NAME,     X,                 X,
+        S_TPARAM_NAME,     X,                 X,                 S_POP,
+        S_INTERFACE_BOUND, S_TPARAM_NAME,     S_TPARAM_NAME,     S_TPARAM_NAME,
+    },
+};
+
+#undef X
+#undef P
+#undef R
+
+/*
+ * Scan `str` as a descriptor or signature of the given kind,
+ * storing at most `capacity` tokens.
+ * Return the number of tokens, or -1 if it is malformed.
+ */
+extern int
+scanDescriptor(int kind, u2 len, u1 *str,
+        struct DescriptorToken *tokens, int capacity)
+{
+    u1 stack[SCAN_MAX_DEPTH];
+    struct DescriptorToken *token;
+    u1 state, entry, cls;
+    u2 i, start, run;
+    int depth, count, signature;
+
+    if (kind < SCAN_FIELD_DESCRIPTOR || kind > SCAN_METHOD_SIGNATURE)
+        return -1;
+    signature = kind >= SCAN_FIELD_SIGNATURE;
+    state = scan_start[kind];
+    depth = count = 0;
+    start = run = 0;
+    for (i = 0; i < len; i++)
+    {
+        cls = str[i] < 0x80 ? char_class[str[i]] : K_NAME;
+        // descriptors never contain generic syntax
+        if (!signature && cls >= K_VAR)
+            cls = cls == K_DOT ? K_ILLEGAL : K_NAME;
+        // at most 255 array dimensions
+        if (cls != K_ARRAY)
+            run = 0;
+        else if (++run > 255)
+            return -1;
+
+        entry = transitions[state][cls];
+        if (entry == 0)
+            return -1;
+        if (entry & (T_TYPE | T_SECTION))
+        {
+            if (depth == SCAN_MAX_DEPTH)
+                return -1;
+            if (depth == 0)
+                start = i;
+            stack[depth++] = (entry & T_TYPE)
+                ? scan_states[state].after
+                : scan_states[state].resume;
+        }
+        state = entry & T_STATE;
+        if (state != S_POP)
+            continue;
+
+        state = stack[--depth];
+        if (depth > 0 || !scan_states[state].role)
+            continue;
+        if (count < capacity)
+        {
+            token = &(tokens[count]);
+            token->role = scan_states[state].role;
+            token->offset = start;
+            token->length = i + 1 - start;
+            for (run = 0; str[start + run] == '['; run++)
+                continue;
+            token->dimensions = (u1) run;
+            token->type = str[start + run];
+            run = 0;
+        }
+        ++count;
+    }
+    if (depth > 0 || !scan_states[state].accept)
+        return -1;
+
+    return count;
+}
@@ -0,0 +1,1003 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <math.h>
+
+#include "java.h"
+#include "opcode.h"
+#include "bytecode.h"
+#include "descriptor.h"
+#include "ir.h"
+#include "expr.h"
+#include "log.h"
+#include "memory.h"
+
+/*
+ * Java source writer
+ *
+ * Inlining is decided once per method: blocks are walked backwards
+ * so every user is settled before its operands. A value that reads
+ * or writes memory is only inlined if nothing between it and its
+ * user has a side effect outside of the same statement, which
+ * keeps Java's left-to-right evaluation order. Anything that may
+ * throw counts as a side effect, so is never dropped or moved.
+ */
+
+// operator precedence, higher binds tighter
+#define PREC_OR                 5
+#define PREC_XOR                6
+#define PREC_AND                7
+#define PREC_EQUALITY           8
+#define PREC_RELATIONAL         9
+#define PREC_SHIFT              10
+#define PREC_ADDITIVE           11
+#define PREC_MULTIPLICATIVE     12
+#define PREC_UNARY              14
+#define PREC_PRIMARY            16
+
+static void writeExpression(struct ExpressionWriter *, struct IrNode *);
+
+static void
+append(struct ExpressionWriter *w, const char *format, ...)
+{
+    va_list args;
+    int n;
+
+    va_start(args, format);
+    if (w->length < w->size)
+        n = vsnprintf(w->out + w->length, w->size - w->length, format, args);
+    else
+        n = vsnprintf((char *) 0, 0, format, args);
+    va_end(args);
+    if (n > 0)
+        w->length += n;
+}
+
+// class or interface name in source form, '/' becomes '.'
+static void
+appendClassName(struct ExpressionWriter *w, u2 len, u1 *str)
+{
+    u2 i;
+
+    for (i = 0; i < len; i++)
+        append(w, "%c", str[i] == '/' ? '.' : str[i]);
+}
+
+// type of a descriptor token without its array brackets
+static void
+appendElement(struct ExpressionWriter *w, u1 *str,
+        struct DescriptorToken *token)
+{
+    u1 *name;
+
+    switch (token->type)
+    {
+        case 'B': append(w, "byte"); break;
+        case 'C': append(w, "char"); break;
+        case 'D': append(w, "double"); break;
+        case 'F': append(w, "float"); break;
+        case 'I': append(w, "int"); break;
+        case 'J': append(w, "long"); break;
+        case 'S': append(w, "short"); break;
+        case 'Z': append(w, "boolean"); break;
+        case 'V': append(w, "void"); break;
+        default:
+            // skip '[' and 'L', drop ';'
+            name = str + token->offset + token->dimensions + 1;
+            appendClassName(w, token->length - token->dimensions - 2, name);
+            break;
+    }
+}
+
+static void
+appendToken(struct ExpressionWriter *w, u1 *str,
+        struct DescriptorToken *token)
+{
+    u1 i;
+
+    appendElement(w, str, token);
+    for (i = 0; i < token->dimensions; i++)
+        append(w, "[]");
+}
+
+/*
+ * Name of the class at `index`, or the element type if it is
+ * an array, returns the dimensions left to write
+ */
+static u1
+appendElementClass(struct ExpressionWriter *w, u2 index)
+{
+    struct DescriptorToken token;
+    const_Class_data *info;
+    const_Utf8_data *name;
+
+    info = getConstant_Class(w->cf, index);
+    name = info ? getConstant_Utf8(w->cf, info->name_index)
+        : (const_Utf8_data *) 0;
+    if (!name)
+    {
+        append(w, "/* #%u */", index);
+        return 0;
+    }
+    if (name->length > 0 && name->bytes[0] == '['
+            && scanDescriptor(SCAN_FIELD_DESCRIPTOR, name->length,
+                name->bytes, &token, 1) == 1)
+    {
+        appendElement(w, name->bytes, &token);
+        return token.dimensions;
+    }
+    appendClassName(w, name->length, name->bytes);
+    return 0;
+}
+
+// name of the class at `index`, arrays are written as types
+static void
+appendClass(struct ExpressionWriter *w, u2 index)
+{
+    u1 dimensions;
+
+    for (dimensions = appendElementClass(w, index); dimensions > 0;
+            dimensions--)
+        append(w, "[]");
+}
+
+/*
+ * Resolves the owner, name and descriptor of a field, method
+ * or call site reference, the last has no owner.
+ */
+static int
+getMember(ClassFile *cf, u2 index, u2 *owner,
+        const_Utf8_data **name, const_Utf8_data **descriptor)
+{
+    cp_info *info;
+    u2 name_and_type_index;
+
+    info = getConstant(cf, index);
+    if (!info)
+        return -1;
+    if (info->tag == CONSTANT_InvokeDynamic)
+    {
+        *owner = 0;
+        name_and_type_index = info->info.cidd.name_and_type_index;
+    }
+    else
+    {
+        *owner = info->info.cfd.class_index;
+        name_and_type_index = info->info.cfd.name_and_type_index;
+    }
+    info = getConstant(cf, name_and_type_index);
+    if (!info || info->tag != CONSTANT_NameAndType)
+        return -1;
+    *name = getConstant_Utf8(cf, info->info.cnd.name_index);
+    *descriptor = getConstant_Utf8(cf, info->info.cnd.descriptor_index);
+    return *name && *descriptor ? 0 : -1;
+}
+
+static int
+isInvoke(u2 op)
+{
+    return op >= OPCODE_invokevirtual && op <= OPCODE_invokedynamic;
+}
+
+/*
+ * Whether a value can be computed anywhere without changing behavior,
+ * anything that may throw is a side effect, so are constants
+ * resolved at run time
+ */
+static int
+isPure(struct ExpressionWriter *w, struct IrNode *node)
+{
+    cp_info *info;
+
+    switch (node->op)
+    {
+        case IR_CONSTANT:
+        case OPCODE_iinc:
+            return 1;
+        case OPCODE_ldc:case OPCODE_ldc_w:case OPCODE_ldc2_w:
+            info = getConstant(w->cf, node->index);
+            return info && (info->tag == CONSTANT_Integer
+                    || info->tag == CONSTANT_Float
+                    || info->tag == CONSTANT_Long
+                    || info->tag == CONSTANT_Double
+                    || info->tag == CONSTANT_String);
+    }
+    return node->op >= OPCODE_iadd && node->op <= OPCODE_dcmpg
+        && !canThrow((u1) node->op);
+}
+
+// values with a name of their own
+static int
+isVariable(struct IrNode *node)
+{
+    return node->op == IR_PHI || node->op == IR_PARAMETER
+        || node->op == IR_CATCH;
+}
+
+static int
+isConstructorCall(struct IrNode *node)
+{
+    return node->op == OPCODE_invokespecial && node->operands_count > 0
+        && node->operands[0]->op == OPCODE_new;
+}
+
+// whether a constant is written with a leading minus sign
+static int
+isNegativeConstant(struct ExpressionWriter *w, struct IrNode *node)
+{
+    cp_info *info;
+
+    if (node->op == IR_CONSTANT)
+        return node->constant < 0;
+    if (node->op != OPCODE_ldc && node->op != OPCODE_ldc_w
+            && node->op != OPCODE_ldc2_w)
+        return 0;
+    info = getConstant(w->cf, node->index);
+    switch (info ? info->tag : 0)
+    {
+        case CONSTANT_Integer:
+            return (int32_t) info->info.cid.bytes < 0;
+        case CONSTANT_Long:
+            return info->info.cld.long_value < 0;
+        // infinities are written by name
+        case CONSTANT_Float:
+            return isfinite(info->info.cid.float_value)
+                && signbit(info->info.cid.float_value);
+        case CONSTANT_Double:
+            return isfinite(info->info.cld.double_value)
+                && signbit(info->info.cld.double_value);
+        default:
+            return 0;
+    }
+}
+
+static int
+getPrecedence(struct ExpressionWriter *w, struct IrNode *node)
+{
+    if (!w->inlined[node->id])
+        return PREC_PRIMARY;
+    switch (node->op)
+    {
+        case OPCODE_ishl:case OPCODE_lshl:
+        case OPCODE_ishr:case OPCODE_lshr:
+        case OPCODE_iushr:case OPCODE_lushr:
+            return PREC_SHIFT;
+        case OPCODE_iand:case OPCODE_land:
+            return PREC_AND;
+        case OPCODE_ior:case OPCODE_lor:
+            return PREC_OR;
+        case OPCODE_ixor:case OPCODE_lxor:
+            return PREC_XOR;
+        case OPCODE_instanceof:
+            return PREC_RELATIONAL;
+        case OPCODE_iinc:
+            return PREC_ADDITIVE;
+        case IR_CONSTANT:
+        case OPCODE_ldc:case OPCODE_ldc_w:case OPCODE_ldc2_w:
+            return isNegativeConstant(w, node) ? PREC_UNARY : PREC_PRIMARY;
+    }
+    if (node->op >= OPCODE_iadd && node->op <= OPCODE_dsub)
+        return PREC_ADDITIVE;
+    if (node->op >= OPCODE_imul && node->op <= OPCODE_drem)
+        return PREC_MULTIPLICATIVE;
+    if ((node->op >= OPCODE_ineg && node->op <= OPCODE_dneg)
+            || (node->op >= OPCODE_i2l && node->op <= OPCODE_i2s)
+            || node->op == OPCODE_checkcast)
+        return PREC_UNARY;
+    return PREC_PRIMARY;
+}
+
+static void
+writeOperand(struct ExpressionWriter *w, struct IrNode *node, int precedence)
+{
+    if (getPrecedence(w, node) < precedence)
+    {
+        append(w, "(");
+        writeExpression(w, node);
+        append(w, ")");
+    }
+    else
+        writeExpression(w, node);
+}
+
+static void
+writeName(struct ExpressionWriter *w, struct IrNode *node)
+{
+    if (node->op == IR_PARAMETER && node->index == 0 && !w->is_static)
+        append(w, "this");
+    else
+        append(w, "v%u", node->id);
+}
+
+static void
+writeString(struct ExpressionWriter *w, u2 len, u1 *str)
+{
+    u2 i;
+
+    append(w, "\"");
+    for (i = 0; i < len; i++)
+    {
+        switch (str[i])
+        {
+            case '"': append(w, "\\\""); break;
+            case '\\': append(w, "\\\\"); break;
+            case '\n': append(w, "\\n"); break;
+            case '\r': append(w, "\\r"); break;
+            case '\t': append(w, "\\t"); break;
+            default:
+                if (str[i] < 0x20)
+                    append(w, "\\u%04x", str[i]);
+                else
+                    append(w, "%c", str[i]);
+                break;
+        }
+    }
+    append(w, "\"");
+}
+
+// shortest form that reads back as the same value
+static void
+writeFloatingPoint(struct ExpressionWriter *w, double value, int is_float)
+{
+    const char *type;
+    char buf[32];
+    int digits;
+
+    type = is_float ? "Float" : "Double";
+    if (value != value)
+    {
+        append(w, "%s.NaN", type);
+        return;
+    }
+    if (isinf(value))
+    {
+        append(w, "%s.%s_INFINITY", type,
+                value > 0 ? "POSITIVE" : "NEGATIVE");
+        return;
+    }
+    for (digits = 1; digits < 17; digits++)
+    {
+        snprintf(buf, sizeof (buf), "%.*g", digits, value);
+        if (is_float ? (float) strtod(buf, 0) == (float) value
+                : strtod(buf, 0) == value)
+            break;
+    }
+    snprintf(buf, sizeof (buf), "%.*g", digits, value);
+    append(w, "%s", buf);
+    if (is_float)
+        append(w, "F");
+    else if (!strpbrk(buf, ".e"))
+        append(w, ".0");
+}
+
+static void
+writeConstant(struct ExpressionWriter *w, struct IrNode *node)
+{
+    cp_info *info;
+    const_Utf8_data *utf8;
+
+    if (node->op == IR_CONSTANT)
+    {
+        switch (node->type)
+        {
+            case IR_REFERENCE: append(w, "null"); break;
+            case IR_LONG: append(w, "%lldL", (long long) node->constant); break;
+            case IR_FLOAT: append(w, "%lld.0F", (long long) node->constant); break;
+            case IR_DOUBLE: append(w, "%lld.0", (long long) node->constant); break;
+            default: append(w, "%lld", (long long) node->constant); break;
+        }
+        return;
+    }
+    info = getConstant(w->cf, node->index);
+    switch (info ? info->tag : 0)
+    {
+        case CONSTANT_Integer:
+            append(w, "%d", (int32_t) info->info.cid.bytes);
+            break;
+        case CONSTANT_Float:
+            writeFloatingPoint(w, info->info.cid.float_value, 1);
+            break;
+        case CONSTANT_Long:
+            append(w, "%lldL", (long long) info->info.cld.long_value);
+            break;
+        case CONSTANT_Double:
+            writeFloatingPoint(w, info->info.cld.double_value, 0);
+            break;
+        case CONSTANT_String:
+            utf8 = getConstant_Utf8(w->cf, info->info.csd.string_index);
+            if (utf8)
+                writeString(w, utf8->length, utf8->bytes);
+            break;
+        case CONSTANT_Class:
+            appendClass(w, node->index);
+            append(w, ".class");
+            break;
+        default:
+            append(w, "/* ldc #%u */", node->index);
+            break;
+    }
+}
+
+static void
+writeArguments(struct ExpressionWriter *w, struct IrNode *node, u4 first)
+{
+    u4 i;
+
+    append(w, "(");
+    for (i = first; i < node->operands_count; i++)
+    {
+        if (i > first)
+            append(w, ", ");
+        writeExpression(w, node->operands[i]);
+    }
+    append(w, ")");
+}
+
+static void
+writeMember(struct ExpressionWriter *w, struct IrNode *node)
+{
+    const_Utf8_data *name, *descriptor;
+    u2 owner;
+    u4 first;
+
+    if (getMember(w->cf, node->index, &owner, &name, &descriptor) < 0)
+    {
+        append(w, "/* #%u */", node->index);
+        return;
+    }
+    first = 0;
+    switch (node->op)
+    {
+        case OPCODE_getstatic:case OPCODE_putstatic:
+        case OPCODE_invokestatic:
+            appendClass(w, owner);
+            append(w, ".");
+            break;
+        case OPCODE_invokedynamic:
+            break;
+        case OPCODE_invokespecial:
+            first = 1;
+            if (name->length == 6 && !memcmp(name->bytes, "<init>", 6))
+            {
+                if (isConstructorCall(node))
+                {
+                    append(w, "new ");
+                    appendClass(w, owner);
+                }
+                else
+                    append(w, owner == w->cf->this_class ? "this" : "super");
+                writeArguments(w, node, first);
+                return;
+            }
+            // other classes are the superclass or a superinterface
+            if (owner == w->cf->this_class)
+                writeOperand(w, node->operands[0], PREC_PRIMARY);
+            else if (owner == w->cf->super_class)
+                append(w, "super");
+            else
+            {
+                appendClass(w, owner);
+                append(w, ".super");
+            }
+            append(w, ".");
+            break;
+        default:
+            first = 1;
+            writeOperand(w, node->operands[0], PREC_PRIMARY);
+            append(w, ".");
+            break;
+    }
+    append(w, "%.*s", name->length, name->bytes);
+    if (isInvoke(node->op))
+        writeArguments(w, node, first);
+}
+
+static const char *
+getOperator(u2 op)
+{
+    static const char *arithmetic[] = { "+", "-", "*", "/", "%" };
+    static const char *shift[] = { "<<", ">>", ">>>" };
+    static const char *bitwise[] = { "&", "|", "^" };
+
+    if (op >= OPCODE_iadd && op <= OPCODE_drem)
+        return arithmetic[(op - OPCODE_iadd) / 4];
+    if (op >= OPCODE_ishl && op <= OPCODE_lushr)
+        return shift[(op - OPCODE_ishl) / 2];
+    if (op >= OPCODE_iand && op <= OPCODE_lxor)
+        return bitwise[(op - OPCODE_iand) / 2];
+    return (const char *) 0;
+}
+
+static int
+getOperatorPrecedence(u2 op)
+{
+    if (op >= OPCODE_iadd && op <= OPCODE_dsub)
+        return PREC_ADDITIVE;
+    if (op >= OPCODE_imul && op <= OPCODE_drem)
+        return PREC_MULTIPLICATIVE;
+    if (op >= OPCODE_ishl && op <= OPCODE_lushr)
+        return PREC_SHIFT;
+    if (op == OPCODE_iand || op == OPCODE_land)
+        return PREC_AND;
+    if (op == OPCODE_ior || op == OPCODE_lor)
+        return PREC_OR;
+    return PREC_XOR;
+}
+
+static void
+writeExpression(struct ExpressionWriter *w, struct IrNode *node)
+{
+    static const char *casts[] = {
+        "long", "float", "double", "int", "float", "double",
+        "int", "long", "double", "int", "long", "float",
+        "byte", "char", "short"
+    };
+    static const char *primitives[] = {
+        "boolean", "char", "float", "double", "byte", "short", "int", "long"
+    };
+    struct IrNode *operand;
+    const char *operator_;
+    int precedence;
+    u4 i;
+    u1 dimensions;
+
+    if (!w->inlined[node->id] && node != w->roots[node->id])
+    {
+        writeName(w, node);
+        return;
+    }
+    if (isVariable(node))
+    {
+        writeName(w, node);
+        return;
+    }
+    operator_ = getOperator(node->op);
+    if (operator_)
+    {
+        precedence = getOperatorPrecedence(node->op);
+        writeOperand(w, node->operands[0], precedence);
+        append(w, " %s ", operator_);
+        writeOperand(w, node->operands[1], precedence + 1);
+        return;
+    }
+    if (node->op >= OPCODE_ineg && node->op <= OPCODE_dneg)
+    {
+        operand = node->operands[0];
+        append(w, "-");
+        // "--" would read as a decrement
+        if (w->inlined[operand->id] && ((operand->op >= OPCODE_ineg
+                        && operand->op <= OPCODE_dneg)
+                    || isNegativeConstant(w, operand)))
+            writeOperand(w, operand, PREC_PRIMARY);
+        else
+            writeOperand(w, operand, PREC_UNARY);
+        return;
+    }
+    if (node->op >= OPCODE_i2l && node->op <= OPCODE_i2s)
+    {
+        append(w, "(%s) ", casts[node->op - OPCODE_i2l]);
+        writeOperand(w, node->operands[0], PREC_UNARY);
+        return;
+    }
+    if (node->op >= OPCODE_iaload && node->op <= OPCODE_saload)
+    {
+        writeOperand(w, node->operands[0], PREC_PRIMARY);
+        append(w, "[");
+        writeExpression(w, node->operands[1]);
+        append(w, "]");
+        return;
+    }
+    if (node->op >= OPCODE_getstatic && node->op <= OPCODE_invokedynamic)
+    {
+        writeMember(w, node);
+        return;
+    }
+    switch (node->op)
+    {
+        case IR_CONSTANT:
+        case OPCODE_ldc:case OPCODE_ldc_w:case OPCODE_ldc2_w:
+            writeConstant(w, node);
+            break;
+        case OPCODE_iinc:
+            writeOperand(w, node->operands[0], PREC_ADDITIVE);
+            if (node->constant < 0)
+                append(w, " - %lld", -(long long) node->constant);
+            else
+                append(w, " + %lld", (long long) node->constant);
+            break;
+        case OPCODE_lcmp:
+            append(w, "Long.compare");
+            writeArguments(w, node, 0);
+            break;
+        case OPCODE_fcmpl:case OPCODE_fcmpg:
+            append(w, "Float.compare");
+            writeArguments(w, node, 0);
+            break;
+        case OPCODE_dcmpl:case OPCODE_dcmpg:
+            append(w, "Double.compare");
+            writeArguments(w, node, 0);
+            break;
+        case OPCODE_arraylength:
+            writeOperand(w, node->operands[0], PREC_PRIMARY);
+            append(w, ".length");
+            break;
+        case OPCODE_checkcast:
+            append(w, "(");
+            appendClass(w, node->index);
+            append(w, ") ");
+            writeOperand(w, node->operands[0], PREC_UNARY);
+            break;
+        case OPCODE_instanceof:
+            writeOperand(w, node->operands[0], PREC_RELATIONAL);
+            append(w, " instanceof ");
+            appendClass(w, node->index);
+            break;
+        case OPCODE_new:
+            append(w, "new ");
+            appendClass(w, node->index);
+            break;
+        case OPCODE_newarray:
+            append(w, "new %s[",
+                    node->constant >= 4 && node->constant <= 11
+                    ? primitives[node->constant - 4] : "?");
+            writeExpression(w, node->operands[0]);
+            append(w, "]");
+            break;
+        case OPCODE_anewarray:
+            append(w, "new ");
+            appendClass(w, node->index);
+            append(w, "[");
+            writeExpression(w, node->operands[0]);
+            append(w, "]");
+            break;
+        case OPCODE_multianewarray:
+            // the class is the array type, the counts fill its
+            // first brackets, e.g. "new int[v1][v2][]"
+            append(w, "new ");
+            dimensions = appendElementClass(w, node->index);
+            for (i = 0; i < node->operands_count; i++)
+            {
+                append(w, "[");
+                writeExpression(w, node->operands[i]);
+                append(w, "]");
+            }
+            for (; i < dimensions; i++)
+                append(w, "[]");
+            break;
+        default:
+            append(w, "/* %s */", node->op < 256
+                    ? opcode_table[node->op].mnemonic : "?");
+            break;
+    }
+}
+
+/*
+ * Condition of a branch, comparisons of longs and floating-point
+ * values written inline are folded into it. Java's operators are
+ * false on NaN but for !=, while fcmpl and dcmpl take NaN as less
+ * and fcmpg and dcmpg as greater, so a branch that is taken on NaN
+ * is written as the negation of the opposite relation.
+ */
+static void
+writeCondition(struct ExpressionWriter *w, struct IrNode *node)
+{
+    // pairs of opposite relations
+    static const char *relations[] = { "==", "!=", "<", ">=", ">", "<=" };
+    struct IrNode *compare;
+    const char *relation;
+    int kind, less;
+
+    if (node->op == OPCODE_ifnull || node->op == OPCODE_ifnonnull)
+    {
+        writeOperand(w, node->operands[0], PREC_EQUALITY);
+        append(w, node->op == OPCODE_ifnull ? " == null" : " != null");
+        return;
+    }
+    if (node->op >= OPCODE_if_acmpeq)
+        relation = relations[node->op - OPCODE_if_acmpeq];
+    else if (node->op >= OPCODE_if_icmpeq)
+        relation = relations[node->op - OPCODE_if_icmpeq];
+    else
+        relation = relations[node->op - OPCODE_ifeq];
+    if (node->operands_count == 2)
+    {
+        writeOperand(w, node->operands[0], PREC_RELATIONAL);
+        append(w, " %s ", relation);
+        writeOperand(w, node->operands[1], PREC_RELATIONAL);
+        return;
+    }
+    compare = node->operands[0];
+    if (w->inlined[compare->id]
+            && compare->op >= OPCODE_lcmp && compare->op <= OPCODE_dcmpg)
+    {
+        kind = node->op - OPCODE_ifeq;
+        less = compare->op == OPCODE_fcmpl || compare->op == OPCODE_dcmpl;
+        if (compare->op != OPCODE_lcmp && kind >= 2
+                && less == (kind == 2 || kind == 5))
+        {
+            append(w, "!(");
+            writeOperand(w, compare->operands[0], PREC_RELATIONAL);
+            append(w, " %s ", relations[kind ^ 1]);
+            writeOperand(w, compare->operands[1], PREC_RELATIONAL);
+            append(w, ")");
+            return;
+        }
+        writeOperand(w, compare->operands[0], PREC_RELATIONAL);
+        append(w, " %s ", relation);
+        writeOperand(w, compare->operands[1], PREC_RELATIONAL);
+        return;
+    }
+    writeOperand(w, compare, PREC_RELATIONAL);
+    append(w, " %s 0", relation);
+}
+
+// declared type of a value, from descriptors where there is one
+static void
+writeType(struct ExpressionWriter *w, struct IrNode *node)
+{
+    static const char *array_loads[] = {
+        "int", "long", "float", "double", "Object", "byte", "char", "short"
+    };
+    static const char *casts[] = { "byte", "char", "short" };
+    struct DescriptorToken tokens[256];
+    const_Utf8_data *name, *descriptor;
+    u2 owner;
+    int n;
+
+    if (node->op >= OPCODE_getstatic && node->op <= OPCODE_invokedynamic
+            && getMember(w->cf, node->index, &owner, &name, &descriptor) == 0)
+    {
+        n = scanDescriptor(isInvoke(node->op) ? SCAN_METHOD_DESCRIPTOR
+                : SCAN_FIELD_DESCRIPTOR, descriptor->length,
+                descriptor->bytes, tokens, 256);
+        if (n > 0)
+        {
+            appendToken(w, descriptor->bytes, &(tokens[n - 1]));
+            return;
+        }
+    }
+    if (node->op >= OPCODE_iaload && node->op <= OPCODE_saload)
+    {
+        append(w, "%s", array_loads[node->op - OPCODE_iaload]);
+        return;
+    }
+    if (node->op >= OPCODE_i2b && node->op <= OPCODE_i2s)
+    {
+        append(w, "%s", casts[node->op - OPCODE_i2b]);
+        return;
+    }
+    switch (node->op)
+    {
+        case OPCODE_new:case OPCODE_checkcast:case OPCODE_multianewarray:
+            appendClass(w, node->index);
+            return;
+        case OPCODE_anewarray:
+            appendClass(w, node->index);
+            append(w, "[]");
+            return;
+        case OPCODE_instanceof:
+            append(w, "boolean");
+            return;
+    }
+    switch (node->type)
+    {
+        case IR_LONG: append(w, "long"); break;
+        case IR_FLOAT: append(w, "float"); break;
+        case IR_DOUBLE: append(w, "double"); break;
+        case IR_REFERENCE: append(w, "Object"); break;
+        default: append(w, "int"); break;
+    }
+}
+
+/*
+ * Whether `node` can be written into `user`, which is known
+ * to be its only user and to come later in the same block
+ */
+static int
+canInline(struct ExpressionWriter *w, struct IrNode *node,
+        struct IrNode *user)
+{
+    struct IrNode *next;
+
+    if (isPure(w, node))
+        return 1;
+    for (next = node->next; next && next != user; next = next->next)
+        if (!isPure(w, next) && next->op != OPCODE_new
+                && w->roots[next->id] != w->roots[user->id])
+            return 0;
+    return next == user;
+}
+
+extern int
+initExpressionWriter(struct ExpressionWriter *w, ClassFile *cf,
+        method_info *method, struct IrMethod *ir)
+{
+    struct IrNode *node, *user, **nodes;
+    u4 count, i, j, depth;
+
+    memset(w, 0, sizeof (struct ExpressionWriter));
+    w->cf = cf;
+    w->ir = ir;
+    w->is_static = (method->access_flags & ACC_STATIC) != 0;
+    count = ir->nodes_count;
+    w->uses = (u4 *) arena_alloc(&(ir->arena), count * sizeof (u4));
+    w->users = (struct IrNode **) arena_alloc(&(ir->arena),
+            count * sizeof (struct IrNode *));
+    w->roots = (struct IrNode **) arena_alloc(&(ir->arena),
+            count * sizeof (struct IrNode *));
+    w->inlined = (u1 *) arena_alloc(&(ir->arena), count);
+    w->depths = (u1 *) arena_alloc(&(ir->arena), count);
+    // nodes of one block in reverse
+    nodes = (struct IrNode **) arena_alloc(&(ir->arena),
+            count * sizeof (struct IrNode *));
+    if (!w->uses || !w->users || !w->roots || !w->inlined || !w->depths
+            || !nodes)
+    {
+        logError("Fail to allocate expression writer of %u nodes!\r\n",
+                count);
+        return -1;
+    }
+
+    for (i = 0; i < ir->blocks_count; i++)
+        for (node = ir->blocks[i].first; node; node = node->next)
+            for (j = 0; j < node->operands_count; j++)
+            {
+                ++w->uses[node->operands[j]->id];
+                w->users[node->operands[j]->id] = node;
+            }
+
+    for (i = 0; i < ir->blocks_count; i++)
+    {
+        count = 0;
+        for (node = ir->blocks[i].first; node; node = node->next)
+            nodes[count++] = node;
+        while (count-- > 0)
+        {
+            node = nodes[count];
+            user = w->users[node->id];
+            w->roots[node->id] = node;
+            // monitorexit is a closing brace and writes no operand
+            if (w->uses[node->id] != 1 || user->block != node->block
+                    || user->op == IR_PHI || node->type == IR_VOID
+                    || user->op == OPCODE_monitorexit
+                    || isVariable(node) || node->op == OPCODE_new
+                    || !canInline(w, node, user))
+                continue;
+            w->inlined[node->id] = 1;
+            w->roots[node->id] = w->roots[user->id];
+        }
+        // operands come before their users
+        for (node = ir->blocks[i].first; node; node = node->next)
+        {
+            depth = 0;
+            for (j = 0; j < node->operands_count; j++)
+                if (w->inlined[node->operands[j]->id]
+                        && w->depths[node->operands[j]->id] > depth)
+                    depth = w->depths[node->operands[j]->id];
+            w->depths[node->id] = depth + 1;
+            if (w->inlined[node->id] && depth + 1 >= EXPR_MAX_DEPTH)
+            {
+                w->inlined[node->id] = 0;
+                w->depths[node->id] = 0;
+            }
+        }
+    }
+    for (i = 0; i < ir->nodes_count; i++)
+        if (!w->inlined[i])
+            w->roots[i] = (struct IrNode *) 0;
+    return 0;
+}
+
+extern int
+writeStatement(struct ExpressionWriter *w, struct IrNode *node,
+        char *out, size_t size)
+{
+    struct IrNode *created;
+    u2 op;
+
+    if (w->inlined[node->id] || isVariable(node) || node->op == OPCODE_new
+            || node->op == OPCODE_nop)
+        return 0;
+    w->out = out;
+    w->size = size;
+    w->length = 0;
+    // the root of the statement is written in full, not by name
+    w->roots[node->id] = node;
+    op = node->op;
+    if ((op >= OPCODE_ifeq && op <= OPCODE_if_acmpne)
+            || op == OPCODE_ifnull || op == OPCODE_ifnonnull)
+    {
+        append(w, "if (");
+        writeCondition(w, node);
+        append(w, ")");
+    }
+    else if (op == OPCODE_tableswitch || op == OPCODE_lookupswitch)
+    {
+        append(w, "switch (");
+        writeExpression(w, node->operands[0]);
+        append(w, ")");
+    }
+    else if (op >= OPCODE_ireturn && op <= OPCODE_return)
+    {
+        append(w, "return");
+        if (node->operands_count > 0)
+        {
+            append(w, " ");
+            writeExpression(w, node->operands[0]);
+        }
+        append(w, ";");
+    }
+    else if (op == OPCODE_athrow)
+    {
+        append(w, "throw ");
+        writeExpression(w, node->operands[0]);
+        append(w, ";");
+    }
+    else if (op == OPCODE_monitorenter)
+    {
+        append(w, "synchronized (");
+        writeExpression(w, node->operands[0]);
+        append(w, ") {");
+    }
+    else if (op == OPCODE_monitorexit)
+        append(w, "}");
+    else if (op == OPCODE_jsr || op == OPCODE_jsr_w || op == OPCODE_ret)
+        append(w, "/* %s */", opcode_table[op].mnemonic);
+    else if (op >= OPCODE_iastore && op <= OPCODE_sastore)
+    {
+        writeOperand(w, node->operands[0], PREC_PRIMARY);
+        append(w, "[");
+        writeExpression(w, node->operands[1]);
+        append(w, "] = ");
+        writeExpression(w, node->operands[2]);
+        append(w, ";");
+    }
+    else if (op == OPCODE_putfield || op == OPCODE_putstatic)
+    {
+        writeMember(w, node);
+        append(w, " = ");
+        writeExpression(w, node->operands[node->operands_count - 1]);
+        append(w, ";");
+    }
+    else if (isConstructorCall(node))
+    {
+        // named if the object is used after construction
+        created = node->operands[0];
+        if (w->uses[created->id] > 1)
+        {
+            writeType(w, created);
+            append(w, " ");
+            writeName(w, created);
+            append(w, " = ");
+        }
+        writeExpression(w, node);
+        append(w, ";");
+    }
+    else if (node->type == IR_VOID || (w->uses[node->id] == 0
+                && (isPure(w, node) || isInvoke(op))))
+    {
+        // results nobody uses only matter for their side effects,
+        // others that may throw are kept in a declaration below
+        if (isPure(w, node))
+        {
+            w->roots[node->id] = (struct IrNode *) 0;
+            return 0;
+        }
+        writeExpression(w, node);
+        append(w, ";");
+    }
+    else
+    {
+        writeType(w, node);
+        append(w, " ");
+        writeName(w, node);
+        append(w, " = ");
+        writeExpression(w, node);
+        append(w, ";");
+    }
+    w->roots[node->id] = (struct IrNode *) 0;
+    if (w->length >= size)
+        return -1;
+    return (int) w->length;
+}
@@ -0,0 +1,300 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "java.h"
+#include "handler.h"
+#include "log.h"
+#include "memory.h"
+
+/*
+ * Exception table index
+ *
+ * Entries are sorted by start_pc, then by descending end_pc, so an
+ * enclosing range always comes before the ranges it contains and
+ * one stack resolves the nesting. Ranges may also overlap without
+ * nesting, then the latest starting container is taken.
+ */
+
+extern void
+initHandlerIndex(struct HandlerIndex *index)
+{
+    memset(index, 0, sizeof (struct HandlerIndex));
+}
+
+extern void
+releaseHandlerIndex(struct HandlerIndex *index)
+{
+    freeMemory(index->boundaries);
+    freeMemory(index->cover_offsets);
+    freeMemory(index->covers);
+    freeMemory(index->start_offsets);
+    freeMemory(index->starts);
+    freeMemory(index->end_offsets);
+    freeMemory(index->ends);
+    freeMemory(index->enclosing);
+    freeMemory(index->keys);
+    freeMemory(index->stack);
+    initHandlerIndex(index);
+}
+
+static int
+reserveEntries(struct HandlerIndex *index, u4 entries)
+{
+    u4 boundaries;
+
+    if (entries <= index->entries_capacity)
+        return 0;
+    freeMemory(index->boundaries);
+    freeMemory(index->cover_offsets);
+    freeMemory(index->start_offsets);
+    freeMemory(index->starts);
+    freeMemory(index->end_offsets);
+    freeMemory(index->ends);
+    freeMemory(index->enclosing);
+    freeMemory(index->keys);
+    freeMemory(index->stack);
+    boundaries = 2 * entries;
+    index->boundaries = (u2 *) allocMemory(boundaries, sizeof (u2));
+    index->cover_offsets = (u4 *) allocMemory(boundaries, sizeof (u4));
+    index->start_offsets = (u4 *) allocMemory(boundaries + 1, sizeof (u4));
+    index->starts = (u2 *) allocMemory(entries, sizeof (u2));
+    index->end_offsets = (u4 *) allocMemory(boundaries + 1, sizeof (u4));
+    index->ends = (u2 *) allocMemory(entries, sizeof (u2));
+    index->enclosing = (u2 *) allocMemory(entries, sizeof (u2));
+    index->keys = (u8 *) allocMemory(entries, sizeof (u8));
+    index->stack = (u2 *) allocMemory(entries, sizeof (u2));
+    index->entries_capacity = entries;
+    if (!index->boundaries || !index->cover_offsets
+            || !index->start_offsets || !index->starts
+            || !index->end_offsets || !index->ends
+            || !index->enclosing || !index->keys || !index->stack)
+    {
+        index->entries_capacity = 0;
+        return -1;
+    }
+    return 0;
+}
+
+static int
+reserveCovers(struct HandlerIndex *index, u4 covers)
+{
+    if (covers <= index->covers_capacity)
+        return 0;
+    freeMemory(index->covers);
+    index->covers = (u2 *) allocMemory(covers, sizeof (u2));
+    index->covers_capacity = index->covers ? covers : 0;
+    return index->covers ? 0 : -1;
+}
+
+static int
+compareKeys(const void *a, const void *b)
+{
+    u8 x, y;
+
+    x = *(const u8 *) a;
+    y = *(const u8 *) b;
+    return x < y ? -1 : x > y;
+}
+
+static int
+comparePcs(const void *a, const void *b)
+{
+    return (int) *(const u2 *) a - (int) *(const u2 *) b;
+}
+
+// position of the last boundary not above `pc`, -1 if none
+static int64_t
+findBoundary(struct HandlerIndex *index, u4 pc)
+{
+    u4 low, high, middle;
+
+    low = 0;
+    high = index->boundaries_count;
+    while (low < high)
+    {
+        middle = (low + high) / 2;
+        if (index->boundaries[middle] <= pc)
+            low = middle + 1;
+        else
+            high = middle;
+    }
+    return (int64_t) low - 1;
+}
+
+static void
+resolveNesting(struct HandlerIndex *index, attr_Code_info *code)
+{
+    struct exception_table_entry *entry, *top;
+    u4 depth, i, j;
+    u2 current;
+
+    for (i = 0; i < index->entries_count; i++)
+        index->keys[i] = (u8) code->exception_table[i].start_pc << 32
+            | (u8) (0xffffu - code->exception_table[i].end_pc) << 16 | i;
+    qsort(index->keys, index->entries_count, sizeof (u8), compareKeys);
+
+    depth = 0;
+    for (i = 0; i < index->entries_count; i++)
+    {
+        current = (u2) index->keys[i];
+        entry = &(code->exception_table[current]);
+        index->enclosing[current] = NO_RANGE;
+        while (depth > 0 && code->exception_table[index->stack[depth - 1]]
+                .end_pc <= entry->start_pc)
+            --depth;
+        if (depth > 0)
+        {
+            top = &(code->exception_table[index->stack[depth - 1]]);
+            if (top->start_pc == entry->start_pc
+                    && top->end_pc == entry->end_pc)
+            {
+                index->enclosing[current] =
+                    index->enclosing[index->stack[depth - 1]];
+                continue;
+            }
+        }
+        // ranges left on the stack start no later than this one
+        for (j = depth; j > 0; j--)
+            if (code->exception_table[index->stack[j - 1]].end_pc
+                    >= entry->end_pc)
+            {
+                index->enclosing[current] = index->stack[j - 1];
+                break;
+            }
+        index->stack[depth++] = current;
+    }
+}
+
+extern int
+buildHandlerIndex(struct HandlerIndex *index, attr_Code_info *code)
+{
+    struct exception_table_entry *entry;
+    u8 covers;
+    u4 count, open, first, last, i, j;
+
+    index->entries_count = 0;
+    index->boundaries_count = 0;
+    count = code->exception_table_length;
+    for (i = 0; i < count; i++)
+    {
+        entry = &(code->exception_table[i]);
+        if (entry->start_pc >= entry->end_pc
+                || entry->end_pc > code->code_length)
+        {
+            logError("Invalid exception_table[%u]!\r\n", i);
+            return -1;
+        }
+    }
+    if (count == 0)
+        return 0;
+    if (reserveEntries(index, count) < 0)
+    {
+        logError("Fail to allocate index of %u exception table entries!\r\n",
+                count);
+        return -1;
+    }
+    index->entries_count = (u2) count;
+
+    for (i = 0; i < count; i++)
+    {
+        index->boundaries[2 * i] = code->exception_table[i].start_pc;
+        index->boundaries[2 * i + 1] = code->exception_table[i].end_pc;
+    }
+    qsort(index->boundaries, 2 * count, sizeof (u2), comparePcs);
+    for (i = 1, j = 1; i < 2 * count; i++)
+        if (index->boundaries[i] != index->boundaries[j - 1])
+            index->boundaries[j++] = index->boundaries[i];
+    index->boundaries_count = j;
+
+    // counts, turned into the end of each list, then filled backwards
+    // so each list ends at its start and is in table order
+    memset(index->cover_offsets, 0, j * sizeof (u4));
+    memset(index->start_offsets, 0, (j + 1) * sizeof (u4));
+    memset(index->end_offsets, 0, (j + 1) * sizeof (u4));
+    for (i = 0; i < count; i++)
+    {
+        entry = &(code->exception_table[i]);
+        first = (u4) findBoundary(index, entry->start_pc);
+        last = (u4) findBoundary(index, entry->end_pc);
+        ++index->start_offsets[first];
+        ++index->end_offsets[last];
+        // opened and closed, summed into the ranges open at a segment
+        ++index->cover_offsets[first];
+        --index->cover_offsets[last];
+    }
+    open = 0;
+    covers = 0;
+    for (i = 0; i < j; i++)
+    {
+        if (i > 0)
+        {
+            index->start_offsets[i] += index->start_offsets[i - 1];
+            index->end_offsets[i] += index->end_offsets[i - 1];
+        }
+        open += index->cover_offsets[i];
+        covers += open;
+        index->cover_offsets[i] = (u4) covers;
+    }
+    index->start_offsets[j] = count;
+    index->end_offsets[j] = count;
+    if (covers > 0xffffffffu || reserveCovers(index, (u4) covers) < 0)
+    {
+        logError("Fail to allocate %llu exception table covers!\r\n",
+                (unsigned long long) covers);
+        index->entries_count = 0;
+        index->boundaries_count = 0;
+        return -1;
+    }
+    for (i = count; i-- > 0;)
+    {
+        entry = &(code->exception_table[i]);
+        first = (u4) findBoundary(index, entry->start_pc);
+        last = (u4) findBoundary(index, entry->end_pc);
+        index->starts[--index->start_offsets[first]] = (u2) i;
+        index->ends[--index->end_offsets[last]] = (u2) i;
+        for (j = first; j < last; j++)
+            index->covers[--index->cover_offsets[j]] = (u2) i;
+    }
+    resolveNesting(index, code);
+    return 0;
+}
+
+extern u4
+getHandlersAt(struct HandlerIndex *index, u4 pc, u2 **entries)
+{
+    int64_t segment;
+
+    segment = findBoundary(index, pc);
+    if (segment < 0 || segment + 1 >= index->boundaries_count)
+        return 0;
+    *entries = &(index->covers[index->cover_offsets[segment]]);
+    return index->cover_offsets[segment + 1]
+        - index->cover_offsets[segment];
+}
+
+extern u4
+getRangesStartingAt(struct HandlerIndex *index, u4 pc, u2 **entries)
+{
+    int64_t boundary;
+
+    boundary = findBoundary(index, pc);
+    if (boundary < 0 || index->boundaries[boundary] != pc)
+        return 0;
+    *entries = &(index->starts[index->start_offsets[boundary]]);
+    return index->start_offsets[boundary + 1]
+        - index->start_offsets[boundary];
+}
+
+extern u4
+getRangesEndingAt(struct HandlerIndex *index, u4 pc, u2 **entries)
+{
+    int64_t boundary;
+
+    boundary = findBoundary(index, pc);
+    if (boundary < 0 || index->boundaries[boundary] != pc)
+        return 0;
+    *entries = &(index->ends[index->end_offsets[boundary]]);
+    return index->end_offsets[boundary + 1]
+        - index->end_offsets[boundary];
+}
@@ -0,0 +1,27 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+#include "java.h"
+
+/*
+ * Benchmarks behind the hidden --bench option
+ *
+ *     --bench=members:<count>
+ *     --bench=analysis:<a.jar:B.class...>
+ *     --bench=statements:<a.jar:B.class...>
+ */
+
+// duplicate member check over a class of `count` methods
+extern int benchMembers(u2);
+/*
+ * Control flow graph, dominator trees, loops, SSA form and
+ * statements of every method of the jars and classes given
+ */
+extern int benchAnalysis(int, char **);
+/*
+ * Same analysis, untimed, printing the statements of each method
+ * to stdout under its name, for the checks in check/
+ */
+extern int listStatements(int, char **);
+
+#endif /* BENCH_H */
@@ -0,0 +1,152 @@
+#ifndef BYTECODE_H
+#define BYTECODE_H
+
+#include "java.h"
+#include "opcode.h"
+
+// operand kinds
+#define OPK_NONE                0
+#define OPK_LOCAL               1   // u1 local variable index
+#define OPK_LOCAL_N             2   // local variable index in the opcode
+#define OPK_BRANCH              3   // s2 branch offset
+#define OPK_BRANCH_W            4   // s4 branch offset
+#define OPK_SWITCH              5   // tableswitch, lookupswitch
+#define OPK_WIDE                6
+#define OPK_CONSTANT            7   // u1 constant pool index
+#define OPK_CONSTANT_W          8   // u2 constant pool index
+#define OPK_INVALID             9
+
+// control flow after an instruction
+#define FLOW_NEXT               0
+#define FLOW_BRANCH             1   // branch or next instruction
+#define FLOW_GOTO               2
+#define FLOW_JSR                3
+#define FLOW_RET                4
+#define FLOW_SWITCH             5
+#define FLOW_RETURN             6
+#define FLOW_THROW              7
+
+// stack effect depends on the operands
+#define STACK_VARIES            0xff
+
+struct OpcodeInfo
+{
+    // null if the opcode may not appear in class files
+    const char *    mnemonic;
+    // total length, 0 if variable
+    u1              length;
+    u1              kind;
+    // OPK_LOCAL_N: implied local variable index
+    u1              local;
+    // local variable slots accessed
+    u1              slots;
+    // operand stack slots popped and pushed
+    u1              pops;
+    u1              pushes;
+    u1              flow;
+};
+
+extern const struct OpcodeInfo opcode_table[256];
+
+/*
+ * One decoded instruction.
+ * Jump tables of switches stay in the code,
+ * read them with getSwitchOffset and getSwitchKey.
+ */
+struct Instruction
+{
+    u4              pc;
+    u4              length;
+    // the modified opcode if `wide` is set
+    u1              opcode;
+    u1              wide;
+    const struct OpcodeInfo *info;
+    // local variable or constant pool index
+    u4              index;
+    // constant of bipush, sipush and iinc, type of newarray,
+    // count of invokeinterface, dimensions of multianewarray
+    int32_t         value;
+    // branch offset, default offset of switches
+    int32_t         offset;
+    // switches
+    int32_t         low;
+    u4              cases;
+    u1 *            table;
+};
+
+struct InstructionIterator
+{
+    u1 *            code;
+    u4              length;
+    u4              pc;
+};
+
+static inline u2
+readU2(u1 *p)
+{
+    return (u2) (p[0] << 8 | p[1]);
+}
+
+static inline int32_t
+readS4(u1 *p)
+{
+    return (int32_t) ((u4) p[0] << 24 | (u4) p[1] << 16
+            | (u4) p[2] << 8 | (u4) p[3]);
+}
+
+static inline int32_t
+getSwitchOffset(struct Instruction *insn, u4 i)
+{
+    if (insn->opcode == OPCODE_tableswitch)
+        return readS4(insn->table + i * 4);
+    return readS4(insn->table + i * 8 + 4);
+}
+
+static inline int32_t
+getSwitchKey(struct Instruction *insn, u4 i)
+{
+    if (insn->opcode == OPCODE_tableswitch)
+        return insn->low + (int32_t) i;
+    return readS4(insn->table + i * 8);
+}
+
+// where and why a method failed verification
+struct VerifyError
+{
+    u4              pc;
+    char            reason[160];
+};
+
+/*
+ * Instruction layout of one Code attribute.
+ * `bits` holds one bit per code byte, set where an instruction
+ * starts, followed by a scratch bitmap of the same size.
+ * The storage is reused between methods and only grows.
+ */
+struct CodeMap
+{
+    u4              code_length;
+    u4              instructions_count;
+    u8 *            bits;
+    u4              words_capacity;
+};
+
+static inline int
+isInstructionStart(struct CodeMap *map, u4 pc)
+{
+    return pc < map->code_length
+        && (map->bits[pc >> 6] >> (pc & 63) & 1);
+}
+
+extern void initCodeMap(struct CodeMap *);
+extern void releaseCodeMap(struct CodeMap *);
+extern int getInstructionLength(u1 *, u4, u4, u4 *);
+extern int canThrow(u1);
+extern void initInstructionIterator(struct InstructionIterator *,
+        u1 *, u4);
+extern int nextInstruction(struct InstructionIterator *,
+        struct Instruction *);
+extern int checkCodeStructure(ClassFile *, attr_Code_info *,
+        struct CodeMap *, struct VerifyError *);
+
+#endif /* BYTECODE_H */
@@ -0,0 +1,147 @@
+#ifndef CFG_H
+#define CFG_H
+
+#include "java.h"
+
+/*
+ * Control flow graph of one Code attribute
+ *
+ * Blocks, edges and predecessors are flat arrays indexed by block
+ * number, blocks are numbered in code order. Parallel edges are
+ * merged, a normal edge wins over an exceptional one.
+ * The storage is reused between methods and only grows.
+ */
+
+// edge kinds
+#define EDGE_NORMAL             0   // fall through, branch or switch
+#define EDGE_EXCEPTION          1   // to an exception handler
+
+struct ControlEdge
+{
+    // successor, or predecessor in `predecessors`
+    u4              block;
+    u4              kind;
+};
+
+struct BasicBlock
+{
+    u4              start_pc;
+    // exclusive
+    u4              end_pc;
+    // ranges of `edges` and `predecessors`
+    u4              first_edge;
+    u4              edges_count;
+    u4              first_predecessor;
+    u4              predecessors_count;
+};
+
+struct ControlFlowGraph
+{
+    u4              code_length;
+    u4              blocks_count;
+    struct BasicBlock *blocks;
+    u4              blocks_capacity;
+    u4              edges_count;
+    struct ControlEdge *edges;
+    struct ControlEdge *predecessors;
+    u4              edges_capacity;
+    // scratch, source block of each unsorted edge
+    u4 *            sources;
+    // one bit per code byte, set where a block starts
+    u8 *            leaders;
+    // leaders before each word of `leaders`
+    u4 *            ranks;
+    u4              words_capacity;
+    // scratch, one entry per block
+    u4 *            marks;
+};
+
+// block containing `pc`
+static inline u4
+getBlockAt(struct ControlFlowGraph *cfg, u4 pc)
+{
+    u8 word;
+
+    word = cfg->leaders[pc >> 6] & (((u8) 2 << (pc & 63)) - 1);
+    return cfg->ranks[pc >> 6] + __builtin_popcountll(word) - 1;
+}
+
+#define NO_BLOCK                0xffffffffu
+#define NO_LOOP                 0xffffffffu
+
+/*
+ * Dominator or post-dominator tree over the blocks of a graph.
+ * Post-dominators are rooted at a virtual exit numbered
+ * `blocks_count`, which follows every block without successors.
+ * Blocks the walk never reaches have no immediate dominator.
+ */
+struct DominatorTree
+{
+    u4              nodes_count;
+    u4              root;
+    u4              post;
+    // immediate dominator, the root's is itself, NO_BLOCK if unreached
+    u4 *            idom;
+    // reached nodes in preorder of the tree
+    u4 *            preorder;
+    u4              reached_count;
+    // position in `preorder`, and the last position of the subtree
+    u4 *            enter;
+    u4 *            leave;
+    u4              nodes_capacity;
+    u4 *            storage;
+    // blocks without successors
+    u4              exits_count;
+};
+
+// whether `a` dominates `b`, every reached node dominates itself
+static inline int
+isDominator(struct DominatorTree *tree, u4 a, u4 b)
+{
+    return tree->idom[a] != NO_BLOCK && tree->idom[b] != NO_BLOCK
+        && tree->enter[a] <= tree->enter[b]
+        && tree->enter[b] <= tree->leave[a];
+}
+
+// natural loops merged by header
+struct Loop
+{
+    u4              header;
+    // enclosing loop, NO_LOOP if outermost
+    u4              parent;
+    // 1 for outermost loops
+    u4              depth;
+    // including nested loops
+    u4              blocks_count;
+};
+
+/*
+ * Loops are numbered inner first, so a loop's parent
+ * always has a greater number than the loop itself.
+ */
+struct LoopForest
+{
+    u4              loops_count;
+    struct Loop *   loops;
+    // innermost loop of each block, NO_LOOP outside of loops
+    u4 *            loop_of;
+    u4 *            worklist;
+    u4              blocks_capacity;
+};
+
+extern void initControlFlowGraph(struct ControlFlowGraph *);
+extern void releaseControlFlowGraph(struct ControlFlowGraph *);
+extern int buildControlFlowGraph(struct ControlFlowGraph *,
+        attr_Code_info *);
+extern void initDominatorTree(struct DominatorTree *);
+extern void releaseDominatorTree(struct DominatorTree *);
+extern int computeDominators(struct ControlFlowGraph *,
+        struct DominatorTree *);
+extern int computePostDominators(struct ControlFlowGraph *,
+        struct DominatorTree *);
+extern void initLoopForest(struct LoopForest *);
+extern void releaseLoopForest(struct LoopForest *);
+extern int findLoops(struct ControlFlowGraph *, struct DominatorTree *,
+        struct LoopForest *);
+
+#endif /* CFG_H */
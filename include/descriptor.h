@@ -0,0 +1,62 @@
+#ifndef DESCRIPTOR_H
+#define DESCRIPTOR_H
+
+#include "java.h"
+
+/*
+ * Descriptor and signature scanning (JVMS 4.3, 4.7.9.1)
+ *
+ * One table-driven automaton validates a descriptor or signature
+ * and splits it into the types it is made of.
+ */
+
+// what to scan
+#define SCAN_FIELD_DESCRIPTOR   0
+#define SCAN_METHOD_DESCRIPTOR  1
+#define SCAN_FIELD_SIGNATURE    2
+#define SCAN_CLASS_SIGNATURE    3
+#define SCAN_METHOD_SIGNATURE   4
+
+// token roles
+#define TOKEN_FIELD             1
+#define TOKEN_PARAMETER         2
+#define TOKEN_RETURN            3
+#define TOKEN_THROWS            4
+#define TOKEN_SUPERTYPE         5   // superclass first, then interfaces
+
+/*
+ * One top-level type, types nested in
+ * type arguments or bounds are not reported.
+ */
+struct DescriptorToken
+{
+    u1              role;
+    // B C D F I J S Z V, L for classes, T for type variables
+    u1              type;
+    u1              dimensions;
+    // including leading '['
+    u2              offset;
+    u2              length;
+};
+
+// local variable slots taken by a value of this type
+static inline int
+getTokenSlots(struct DescriptorToken *token)
+{
+    if (token->dimensions > 0)
+        return 1;
+    switch (token->type)
+    {
+        case 'J':case 'D':
+            return 2;
+        case 'V':
+            return 0;
+        default:
+            return 1;
+    }
+}
+
+extern int scanDescriptor(int, u2, u1 *,
+        struct DescriptorToken *, int);
+
+#endif /* DESCRIPTOR_H */
@@ -0,0 +1,52 @@
+#ifndef EXPR_H
+#define EXPR_H
+
+#include "java.h"
+#include "ir.h"
+
+/*
+ * Java source of IR nodes
+ *
+ * A value used once, later in the same block, is written inline
+ * into its user unless that would move it across a side effect;
+ * every other value is declared as a local named after its id.
+ * Statements are rendered in one pass into a caller's buffer,
+ * nothing is allocated per instruction.
+ */
+
+// deepest expression written inline, deeper ones get declared
+#define EXPR_MAX_DEPTH          64
+
+struct ExpressionWriter
+{
+    ClassFile *     cf;
+    struct IrMethod *ir;
+    u1              is_static;
+    // indexed by node id, allocated in the arena of `ir`
+    u4 *            uses;
+    struct IrNode **users;
+    struct IrNode **roots;
+    u1 *            inlined;
+    u1 *            depths;
+    // output of the statement being written
+    char *          out;
+    size_t          size;
+    size_t          length;
+};
+
+/*
+ * Valid until the IR is rebuilt.
+ */
+extern int initExpressionWriter(struct ExpressionWriter *, ClassFile *,
+        method_info *, struct IrMethod *);
+/*
+ * Writes the statement starting at `node` without a trailing newline.
+ * Returns its length, 0 if the node is part of another statement
+ * or has no effect, -1 if it doesn't fit in `size` bytes.
+ * Branches and switches are written as their head, e.g. "if (v3 < v4)",
+ * monitorenter opens "synchronized (v2) {" and monitorexit closes it.
+ */
+extern int writeStatement(struct ExpressionWriter *, struct IrNode *,
+        char *, size_t);
+
+#endif /* EXPR_H */
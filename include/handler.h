@@ -0,0 +1,54 @@
+#ifndef HANDLER_H
+#define HANDLER_H
+
+#include "java.h"
+
+/*
+ * Interval index of one exception table
+ *
+ * The distinct start_pc and end_pc values split the code into
+ * segments, each segment lists the entries covering it in table
+ * order, which is the order handlers are tried in. Lookups are
+ * a binary search over the boundaries.
+ * The storage is reused between methods and only grows.
+ */
+
+#define NO_RANGE                0xffffu
+
+struct HandlerIndex
+{
+    u2              entries_count;
+    // distinct start_pc and end_pc values, ascending
+    u4              boundaries_count;
+    u2 *            boundaries;
+    // entries covering each segment, in `covers` from
+    // cover_offsets[i] to cover_offsets[i + 1]
+    u4 *            cover_offsets;
+    u2 *            covers;
+    u4              covers_capacity;
+    // entries starting and ending at each boundary, likewise
+    u4 *            start_offsets;
+    u2 *            starts;
+    u4 *            end_offsets;
+    u2 *            ends;
+    // entry whose range strictly contains this one, the innermost
+    // if ranges nest, NO_RANGE if none; equal ranges share it
+    u2 *            enclosing;
+    // scratch, entries sorted by range
+    u8 *            keys;
+    u2 *            stack;
+    u4              entries_capacity;
+};
+
+extern void initHandlerIndex(struct HandlerIndex *);
+extern void releaseHandlerIndex(struct HandlerIndex *);
+extern int buildHandlerIndex(struct HandlerIndex *, attr_Code_info *);
+/*
+ * Each returns the number of exception table entries found
+ * and points `entries` at their indexes, in table order.
+ */
+extern u4 getHandlersAt(struct HandlerIndex *, u4, u2 **);
+extern u4 getRangesStartingAt(struct HandlerIndex *, u4, u2 **);
+extern u4 getRangesEndingAt(struct HandlerIndex *, u4, u2 **);
+
+#endif /* HANDLER_H */
@@ -38,6 +38,22 @@ extern "C" {
     //extern struct Deque *findClassfile(const char *);
     //extern FILE *openFile(const char *, const char *);
 
+    // SHA-256 of every byte read through a BufferIO
+    struct ContentHash
+    {
+        u4 state[8];
+        // bytes of an incomplete 64-byte block
+        u1 block[64];
+        u8 length;
+    };
+
+    // SHA-256 of the content read so far
+    struct ContentDigest
+    {
+        u1 hash[32];
+        u8 length;
+    };
+
     struct BufferIO;
     typedef u1 *(*func_fillBuffer)(struct BufferIO *, int);
 
@@ -55,6 +71,7 @@ extern "C" {
         u1 more;
         FILE *f_out;
         FILE *f_err;
+        struct ContentHash hash;
     };
 
     extern int initWithFile(struct BufferIO *, const char *);
@@ -65,6 +82,8 @@ extern "C" {
     extern int ru4(u4 *, struct BufferIO *);
     extern int rbs(u1 *, struct BufferIO *, int);
     extern int skp(struct BufferIO *, int);
+    extern void getContentDigest(struct BufferIO *, struct ContentDigest *);
+    extern void hashContent(const u1 *, u8, struct ContentDigest *);
 #ifdef __cplusplus
 }
 #endif
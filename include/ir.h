@@ -0,0 +1,99 @@
+#ifndef IR_H
+#define IR_H
+
+#include "java.h"
+#include "memory.h"
+#include "cfg.h"
+
+/*
+ * SSA form of one method
+ *
+ * Stack and local variable traffic is resolved while the bytecode
+ * is simulated, so loads, stores, dup, swap and pop leave no node.
+ * Every other instruction becomes a node whose operands are the
+ * nodes computing its inputs. Joins get phi nodes, trivial ones
+ * are folded away. All nodes live in one arena.
+ */
+
+// operations beyond the opcodes
+#define IR_CONSTANT             0x100   // aconst_null to sipush
+#define IR_PARAMETER            0x101   // `index` is the local variable
+#define IR_PHI                  0x102   // one operand per predecessor,
+                                        // per throw of exceptional ones
+#define IR_CATCH                0x103   // exception caught by a handler
+
+// value types, after descriptors
+#define IR_VOID                 'V'
+#define IR_INT                  'I'     // boolean, byte, char, short, int
+#define IR_LONG                 'J'
+#define IR_FLOAT                'F'
+#define IR_DOUBLE               'D'
+#define IR_REFERENCE            'L'
+#define IR_RETURN_ADDRESS       'R'
+
+struct IrNode
+{
+    // opcode or IR_*
+    u2              op;
+    u1              type;
+    u4              id;
+    u4              pc;
+    u4              block;
+    // constant pool index, local variable, or the case count of switches
+    u4              index;
+    // constants, increment of iinc, dimensions of multianewarray,
+    // element type of newarray; fconst and dconst keep the integral value
+    int64_t         constant;
+    u4              operands_count;
+    struct IrNode **operands;
+    // next node of the block, phis first
+    struct IrNode * next;
+};
+
+// locals at a throwing instruction, newest first
+struct IrThrow
+{
+    struct IrNode **locals;
+    struct IrThrow *next;
+};
+
+struct IrBlock
+{
+    struct IrNode * first;
+    struct IrNode * last;
+    // values of locals then stack slots, at entry and exit,
+    // the second slot of a long or double is null
+    struct IrNode **entry;
+    struct IrNode **exit;
+    u2              entry_stack_size;
+    u2              exit_stack_size;
+    u1              reached;
+    // blocks covered by a handler keep the locals at every throwing
+    // instruction that sees them changed, those feed the handler phis
+    u4              throws_count;
+    struct IrThrow *throws;
+};
+
+struct IrMethod
+{
+    struct Arena    arena;
+    struct ControlFlowGraph *cfg;
+    u4              blocks_count;
+    struct IrBlock *blocks;
+    u4              nodes_count;
+    u2              max_locals;
+    u2              max_stack;
+};
+
+static inline int
+isCategory2Type(u1 type)
+{
+    return type == IR_LONG || type == IR_DOUBLE;
+}
+
+extern void initIrMethod(struct IrMethod *);
+extern void releaseIrMethod(struct IrMethod *);
+extern int buildIrMethod(struct IrMethod *, ClassFile *, method_info *,
+        attr_Code_info *, struct ControlFlowGraph *);
+
+#endif /* IR_H */
@@ -697,6 +697,27 @@ extern "C" {
     extern int disassembleCode(u4, u1 *);
 
     extern int parseClassfile(struct BufferIO *, struct AttributeFilter *);
+    extern int freeClassfile(ClassFile *);
+#ifdef	__cplusplus
+    class rt_Class;
+
+    /*
+     * Decodes a class file without verifying it. The class refers to
+     * `cf`, which is released by freeClassfile once the class is deleted,
+     * or right away if decoding fails.
+     */
+    extern rt_Class * rt_loadClass(struct BufferIO *, ClassFile *);
+
+    // called with each class and its file or entry name
+    typedef int (*func_visitClass)(void *, rt_Class *, ClassFile *,
+            const char *);
+    /*
+     * Decodes the class file at `path`, or every class of a jar or
+     * zip, and passes each one to `visit`. Classes of a jar that fail
+     * are skipped, a single class file fails with them.
+     */
+    extern int rt_loadClasses(const char *, func_visitClass, void *);
+#endif
 
     extern int compareVersion0(u2, u2, u2, u2);
     extern int compareVersion(u2, u2);
@@ -5,6 +5,7 @@
 extern "C" {
 #endif
 
+    extern void enableInfo(int);
     extern int logInfo(const char *, ...);
     extern int logError(const char *, ...);
     extern int flogError(FILE *, const char *, ...);
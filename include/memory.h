@@ -1,6 +1,8 @@
 #ifndef MEMORY_H
 #define MEMORY_H
 
+#include <stdint.h>
+
 extern void * allocMemory(size_t, size_t);
 extern void reallocMemory(void **, size_t);
 extern void freeMemory(void *);
@@ -9,29 +11,132 @@ extern void *trimMemory(void *);
 struct Deque;
 struct DequeEntry;
 
-struct Deque
-{
-    struct DequeEntry *first;
-    struct DequeEntry *last;
-};
-
 struct DequeEntry
 {
-    struct DequeEntry *prev;
-    struct DequeEntry *next;
     int size;
     void *value;
 };
 
+/*
+ * Growable ring buffer, entries are stored by value.
+ * An entry returned by a remove function lives in `removed`
+ * and stays valid until the next remove.
+ */
+struct Deque
+{
+    struct DequeEntry *entries;
+    int capacity;               // power of two
+    int head;
+    int count;
+    struct DequeEntry removed;
+};
+
 extern struct Deque *deque_createDeque();
+extern void deque_releaseDeque(struct Deque *);
 extern void deque_releaseEntry(struct DequeEntry *);
 
+extern int deque_size(struct Deque *);
+extern struct DequeEntry *deque_get(struct Deque *, int);
+
 extern int deque_addFirst(struct Deque *, int, void *);
 extern int deque_addLast(struct Deque *, int, void *);
+extern int deque_addAllLast(struct Deque *, int, struct DequeEntry *);
 extern int deque_push(struct Deque *, int, void *);
+extern int deque_pushAll(struct Deque *, int, struct DequeEntry *);
 
 extern struct DequeEntry *deque_removeFirst(struct Deque *);
 extern struct DequeEntry *deque_removeLast(struct Deque *);
 extern struct DequeEntry *deque_pop(struct Deque *);
 
+/*
+ * Bump allocator
+ *
+ * Blocks are carved out of chunks and freed all at once.
+ * A reset keeps the chunks for the next round of allocations.
+ */
+struct ArenaChunk;
+
+struct Arena
+{
+    struct ArenaChunk *first;
+    struct ArenaChunk *current;
+};
+
+extern void arena_init(struct Arena *);
+extern void arena_release(struct Arena *);
+extern void arena_reset(struct Arena *);
+// zero filled, aligned for any type
+extern void *arena_alloc(struct Arena *, size_t);
+
+/*
+ * Open-addressing hash maps
+ *
+ * Keys are byte strings of `length` bytes owned by the caller,
+ * they must stay alive and unchanged while they are in the map.
+ * Slots are probed linearly, the table is kept at most half full
+ * and entries can not be removed.
+ */
+struct HashEntry
+{
+    uint32_t hash;
+    int length;
+    const void *key;            // NULL for an empty slot
+    void *value;
+};
+
+struct HashMap
+{
+    uint32_t capacity;          // power of two
+    uint32_t size;
+    struct HashEntry *entries;
+};
+
+extern int hashmap_init(struct HashMap *, uint32_t);
+extern void hashmap_release(struct HashMap *);
+extern void *hashmap_get(struct HashMap *, int, const void *);
+extern int hashmap_put(struct HashMap *, int, const void *, void *, void **);
+// for keys whose hash is already known
+extern void *hashmap_getHashed(struct HashMap *, uint32_t, int, const void *);
+extern int hashmap_putHashed(struct HashMap *, uint32_t, int, const void *, void *, void **);
+
+/*
+ * Concurrent variant: lookups take no lock and never block,
+ * inserts are serialized by a mutex. Tables outgrown by a resize
+ * are kept until the map is released, since readers may
+ * still be probing them.
+ */
+struct ConcurrentHashTable;
+
+struct ConcurrentHashMap
+{
+    struct ConcurrentHashTable *table;
+    void *lock;
+};
+
+extern int chashmap_init(struct ConcurrentHashMap *, uint32_t);
+extern void chashmap_release(struct ConcurrentHashMap *);
+extern void *chashmap_get(struct ConcurrentHashMap *, int, const void *);
+extern int chashmap_put(struct ConcurrentHashMap *, int, const void *, void *, void **);
+
+/*
+ * Interned symbols
+ *
+ * Symbols are shared by every class loaded in the process
+ * and are never released. Equal byte strings intern to
+ * the same Symbol, so they compare equal by address.
+ * Interning is safe to call from several threads.
+ */
+struct Symbol
+{
+    struct Symbol *next;
+    uint32_t hash;
+    uint16_t length;
+    uint8_t bytes[];            // NUL terminated
+};
+
+extern uint32_t hash_bytes(int, uint8_t *);
+extern struct Symbol *symbol_intern(uint16_t, uint8_t *);
+extern struct Symbol *symbol_of(uint8_t *);
+extern uint32_t symbol_count();
+
 #endif /* MEMORY_H */
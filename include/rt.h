@@ -7,11 +7,10 @@
 #error C++ TOOLCHAIN IS NEEDED TO COMPILE CRUISER!
 #endif
 
-#define MAX_PARAMETERS_COUNT            128
-
 class rt_Class;
 class rt_Field;
 class rt_Method;
+class rt_ClassBuilder;
 
 typedef struct
 {
@@ -45,23 +44,82 @@ typedef struct
     u2              descriptor_index;
     u2              off_descriptor;
     u2              len_descriptor;
+    // verification type, one of ITEM_*
+    u1              tag;
+    // ITEM_Uninitialized: offset of the `new` instruction
+    u2              offset;
+    // ITEM_Object: class name or array descriptor
+    struct Symbol * type;
 }                                   rt_Value;
 
+/*
+ * Decoded method descriptor, shared by every method
+ * whose descriptor has the same bytes.
+ * `offsets` holds `parameters_count` parameter descriptor offsets
+ * followed by `parameters_length` entries mapping each local slot
+ * taken by the parameters to the index of its parameter.
+ */
 typedef struct
 {
     u2              off_return_descriptor;
     u1              parameters_count;
     u1              parameters_length;
-    u1              off_parameters  [MAX_PARAMETERS_COUNT];
-    rt_Parameter    parameters      [MAX_PARAMETERS_COUNT];
+    u2              offsets[];
 }                                   rt_Descriptor;
+
+static inline u2 *
+rt_getParameterOffsets(rt_Descriptor *md)
+{
+    return md->offsets;
+}
+
+static inline u2 *
+rt_getParameterSlots(rt_Descriptor *md)
+{
+    return md->offsets + md->parameters_count;
+}
+
+extern rt_Descriptor *  rt_internDescriptor(u2, u1 *);
+
+// number of distinct TAG_ATTR_* kinds
+#define ATTRIBUTE_KINDS_COUNT           23
+
+/*
+ * Attributes of a class, field or method.
+ * `attributes_mark` has the TAG_ATTR_* bit of every attribute present,
+ * `attributes_index` maps the bit position of a present tag
+ * to the index of its first occurrence in `attributes`.
+ */
 typedef struct
 {
     u2              attributes_count;
     attr_info *     attributes;
     u4              attributes_mark;
+    u2              attributes_index[ATTRIBUTE_KINDS_COUNT];
 }                                   rt_Attributes;
 
+/*
+ * Non-owning view over a contiguous run of run-time structures,
+ * usable with range-for
+ */
+template <typename T>
+class rt_Span
+{
+public:
+                    rt_Span()
+                        : data((T *) 0), count(0) {}
+                    rt_Span(T * data, u2 count)
+                        : data(data), count(count) {}
+    T *             begin() { return data; }
+    T *             end() { return data + count; }
+    u2              size() { return count; }
+    bool            empty() { return count == 0; }
+    T &             operator[](u2 index) { return data[index]; }
+private:
+    T *             data;
+    u2              count;
+};
+
 typedef struct
 {
     // NULL placeholder
@@ -76,20 +134,35 @@ typedef struct
     rt_Local *      locals;
     u2 *            stack_offset;
     rt_Value *      stack;
+    // verification types of the `max_locals` local slots,
+    // long and double take two slots, the second one is Top
+    rt_Value *      local_types;
+    u2              stack_size;
+    // FRAME_FLAG_*
+    u1              flags;
+    // offset of the instruction this frame applies to
+    u4              pc;
 }                                   rt_Frame;
 
+// `this` hasn't been initialized yet in <init>
+#define FRAME_FLAG_THIS_UNINIT          0x1
+
 
 class rt_Accessible
 {
+    friend class    rt_ClassBuilder;
 public:
     u2              getAccessFlags();
     rt_Attributes * getAttributes();
+    bool            hasAttribute(u4);
+    attr_info *     findAttribute(u4);
 protected:
-                    rt_Accessible(ClassFile *);
+                    rt_Accessible();
                     rt_Accessible(field_info *);
     attr_info *     getAttribute(u2);
     attr_info *     getAttribute(u2, u4);
 private:
+    void            indexAttributes(u2, attr_info *);
     u2              access_flags;
     rt_Attributes   attributes;
 };
@@ -100,12 +173,15 @@ private:
 class rt_Class :
     public rt_Accessible
 {
+    friend class    rt_ClassBuilder;
 public:
-                    rt_Class(ClassFile *);
+                    ~rt_Class();
     u2              getFieldsCount();
-    rt_Field **     getFields();
+    rt_Span<rt_Field>
+                    getFields();
     u2              getMethodsCount();
-    rt_Method **    getMethods();
+    rt_Span<rt_Method>
+                    getMethods();
 
     u1              getConstantTag(u2);
     const_Class_data *
@@ -143,25 +219,13 @@ private:
     u2              interfaces_count;
     u2 *            interfaces;
     u2              fields_count;
-    rt_Field **     fields;
+    rt_Field *      fields;
     u2              methods_count;
-    rt_Method **    methods;
-
-#if VER_CMP(45, 3)
-    u2 off_InnerClasses;
-#endif
-#if VER_CMP(49, 0)
-    u2 off_EnclosingMethod;
-    u2 off_RuntimeVisibleAnnotations;
-    u2 off_RuntimeInvisibleAnnotations;
-#endif
-#if VER_CMP(51, 0)
-    u2 off_BootstrapMethods;
-#endif
-#if VER_CMP(52, 0)
-    u2 off_RuntimeVisibleTypeAnnotations;
-    u2 off_RuntimeInvisibleTypeAnnotations;
-#endif
+    rt_Method *     methods;
+    // members constructed so far, in order,
+    // less than the counts if the load was aborted
+    u2              fields_built;
+    u2              methods_built;
 public:
     bool            isInterface();
     bool            isAnnotation();
@@ -175,6 +239,8 @@ public:
     u2              getInterfacesCount();
     const_Class_data **
                     getInterfaces(const_Class_data **);
+private:
+                    rt_Class();
 }; // rt_Class
 
 class rt_Member
@@ -199,48 +265,61 @@ class rt_Field :
 {
 public:
                     rt_Field(rt_Class *, field_info *);
-#if VER_CMP(45, 3)
-    u2              off_ConstantValue;
-#endif
-#if VER_CMP(49, 0)
-    u2              off_RuntimeVisibleAnnotations;
-    u2              off_RuntimeInvisibleAnnotations;
-#endif
-#if VER_CMP(52, 0)
-    u2              off_RuntimeVisibleTypeAnnotations;
-    u2              off_RuntimeInvisibleTypeAnnotations;
-#endif
 }; // rt_Field
 
 class rt_Method :
     public rt_Accessible,
     public rt_Member
 {
+    friend class    rt_ClassBuilder;
 private:
     attr_Code_info *getAttribute_Code();
+    int             indexLines();
+    int             indexLocals();
 public:
-                    rt_Method(rt_Class *, method_info *);
+                    rt_Method(rt_Class *, method_info *, rt_Descriptor *);
+                    ~rt_Method();
     void            initFrame(rt_Frame *);
     rt_Descriptor * getRuntimeDescriptor();
+    int             getLineNumber(u4);
+    u4              getLinePcs(u2, u2 *, u4);
+    u4              getLines(u4 **);
+    rt_Local *      getLocal(u2, u4);
+    u4              getLocals(u2, rt_Local **);
 private:
-    rt_Descriptor   descriptor;
-
-#if VER_CMP(45, 3)
-    u2              off_Code;
-    u2              off_Exceptions;
-#endif
-#if VER_CMP(49, 0)
-    u2              off_RuntimeVisibleParameterAnnotations;
-    u2              off_RuntimeInvisibleParameterAnnotations;
-    u2              off_AnnotationDefault;
-    u2              off_RuntimeVisibleAnnotations;
-    u2              off_RuntimeInvisibleAnnotations;
-#endif
-#if VER_CMP(52, 0)
-    u2              off_RuntimeVisibleTypeAnnotations;
-    u2              off_RuntimeInvisibleTypeAnnotations;
-#endif
+    rt_Descriptor * descriptor;
+    // entries of every LineNumberTable as start_pc << 16 | line_number,
+    // ascending, then the same as line_number << 16 | start_pc
+    u4              lines_count;
+    u4 *            lines;
+    // entries of every LocalVariableTable, with the signature of the
+    // matching LocalVariableTypeTable entry, by slot then start_pc
+    u4              locals_count;
+    rt_Local *      locals;
 }; // rt_Method
 
+/*
+ * Fills a rt_Class while its class file is being decoded.
+ * Each step is invoked by the loader right after the matching
+ * section has been read, so members are resolved while their
+ * data is still hot and no second walk over ClassFile is needed.
+ */
+class rt_ClassBuilder
+{
+public:
+                    rt_ClassBuilder(ClassFile *);
+                    ~rt_ClassBuilder();
+    int             buildHeader();
+    int             buildFields();
+    int             buildField(u2);
+    int             buildMethods();
+    int             buildMethod(u2);
+    int             buildAttributes();
+    rt_Class *      release();
+private:
+    ClassFile *     cf;
+    rt_Class *      rtc;
+}; // rt_ClassBuilder
+
 #endif	/* RT_H */
 
@@ -0,0 +1,36 @@
+#ifndef TC_H
+#define TC_H
+
+#include "rt.h"
+#include "bytecode.h"
+#include "handler.h"
+
+/*
+ * Type checking verifier (JVMS 4.10.1)
+ *
+ * Every method with a Code attribute is checked instruction by
+ * instruction against the frames declared in its StackMapTable.
+ */
+
+/*
+ * Frame and handler storage reused between methods,
+ * grown to the largest method checked so far.
+ */
+struct FramePool
+{
+    rt_Frame *      frames;
+    u4              frames_capacity;
+    rt_Value *      values;
+    u4              values_capacity;
+    struct HandlerIndex handlers;
+};
+
+extern void initFramePool(struct FramePool *);
+extern void releaseFramePool(struct FramePool *);
+/*
+ * Expects the code to have passed checkCodeStructure into `map`.
+ */
+extern int typecheckMethod(ClassFile *, method_info *, struct CodeMap *,
+        struct FramePool *, struct VerifyError *);
+
+#endif /* TC_H */
@@ -0,0 +1,117 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include "java.h"
+#include "memory.h"
+#include "rt.h"
+
+/*
+ * Stack frame symbolization
+ *
+ * Classes of a set of jars are decoded once into a compact index
+ * of method boundaries, line tables and source files, names point
+ * into the symbol table. Queries never touch class files again and
+ * the index is read only once built, so any number of connections
+ * may share it.
+ *
+ * One query per line, answered by one line in the same order:
+ *
+ *     <class> <method>[<descriptor>] <pc>
+ *     <class> <method>[<descriptor>] :<line>
+ *
+ * e.g. "java/lang/String indexOf(II)I 12" is answered with
+ * "java.lang.String.indexOf(String.java:1718)".
+ */
+
+// one line section entry of a SMAP (JSR 45)
+struct TraceLine
+{
+    u4              input_start;
+    u4              file;
+    u4              repeat;
+    u4              output_start;
+    u4              increment;
+};
+
+struct TraceFile
+{
+    u4              id;
+    u1 *            name;
+    u2              length;
+};
+
+// output lines [start, end) of a SMAP entry not hidden by a later one
+struct TraceRange
+{
+    u4              output_start;
+    u4              output_end;
+    struct TraceLine *line;
+    // null if the entry names no known file
+    struct TraceFile *file;
+};
+
+struct TraceMethod
+{
+    u1 *            name;
+    u1 *            descriptor;
+    u2              name_length;
+    u2              descriptor_length;
+    u4              code_length;
+    // start_pc << 16 | line_number, ascending
+    u4              lines_count;
+    u4 *            lines;
+};
+
+struct TraceClass
+{
+    u1 *            name;
+    u2              name_length;
+    // SourceFile, null if absent
+    u2              source_length;
+    u1 *            source;
+    // position in the input, the first of equal names wins
+    u4              order;
+    // sorted by name, then descriptor
+    u4              methods_count;
+    struct TraceMethod *methods;
+    // default stratum of SourceDebugExtension, by output line
+    u4              files_count;
+    struct TraceFile *files;
+    u4              smap_count;
+    struct TraceLine *smap;
+    // disjoint and ascending, built from `smap`
+    u4              ranges_count;
+    struct TraceRange *ranges;
+};
+
+struct TraceIndex
+{
+    struct Arena    arena;
+    u4              classes_count;
+    u4              classes_capacity;
+    struct TraceClass **classes;
+};
+
+extern void initTraceIndex(struct TraceIndex *);
+extern void releaseTraceIndex(struct TraceIndex *);
+extern int addTraceClass(struct TraceIndex *, rt_Class *);
+/*
+ * Adds every class of a jar, or a single class file.
+ * Classes that fail to decode are reported and skipped.
+ */
+extern int indexTraceFile(struct TraceIndex *, const char *);
+// to be called once every class is added
+extern void sortTraceIndex(struct TraceIndex *);
+/*
+ * Answers one query without its newline, returns the length
+ * of the answer, -1 if it doesn't fit in `size` bytes.
+ */
+extern int symbolizeFrame(struct TraceIndex *, char *, size_t,
+        char *, size_t);
+// answers queries from `in` on `out` until end of input
+extern int serveTraces(struct TraceIndex *, int, int);
+// answers connections on a Unix socket, TRACE_WORKERS at a time,
+// refuses to replace anything but a socket, never returns on success
+extern int serveTraceSocket(struct TraceIndex *, const char *);
+
+#endif /* TRACE_H */
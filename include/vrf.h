@@ -1,7 +1,28 @@
 #include "input.h"
 
+// verification levels, each one includes the checks of the previous ones
+#define VERIFY_NONE                 0
+// class file format and bytecode structure
+#define VERIFY_STRUCTURAL           1
+// type checking of method bodies
+#define VERIFY_FULL                 2
+
+struct VerifyStats
+{
+    u4      classes;
+    // classes decided by the verification cache alone
+    u4      cache_hits;
+    // seconds spent in each level
+    double  seconds[VERIFY_FULL + 1];
+};
+
 extern int checkMagic(u4);
 extern int validateConstantPool(ClassFile *);
 extern int validateFields(ClassFile *);
 extern int validateMethods(ClassFile *);
+extern void setVerifyThreads(int);
+extern void setVerifyLevel(int);
+extern int setVerifyCache(const char *);
+extern struct VerifyStats *getVerifyStats();
+extern int verifyClassfile(ClassFile *, struct BufferIO *);
 
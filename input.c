@@ -118,6 +118,8 @@ getWorkingDirectory()
     return ptr;
 }
 
+#define SCAN_BATCH_SIZE                 64
+
 static int
 scanDir(char *parent, int len_parent,
         int *nFiles, struct Deque *deque)
@@ -127,7 +129,13 @@ scanDir(char *parent, int len_parent,
     struct stat entry_stat;
     char *entry_name, *buffer;
     int len_entry_name, len_path;
+    // class files found in this directory, pushed to `deque`
+    // in bulk and before any subdirectory is scanned, so the
+    // order is the same as pushing them one by one
+    struct DequeEntry batch[SCAN_BATCH_SIZE];
+    int batch_size;
 
+    batch_size = 0;
     dir = opendir(parent);
     if (!dir)
     {
@@ -158,6 +166,9 @@ scanDir(char *parent, int len_parent,
         {
             if (parent[len_path - 1] != '/')
                 parent[len_path++] = '/';
+            if (deque_pushAll(deque, batch_size, batch) < 0)
+                goto close;
+            batch_size = 0;
             if (scanDir(parent, (const int) len_path, nFiles, deque) < 0)
                 goto close;
         }
@@ -169,13 +180,26 @@ scanDir(char *parent, int len_parent,
             if (!buffer)
                 goto close;
             memcpy(buffer, parent, len_path);
-            deque_push(deque, len_path, buffer);
+            batch[batch_size].size = len_path;
+            batch[batch_size].value = buffer;
+            if (++batch_size == SCAN_BATCH_SIZE)
+            {
+                if (deque_pushAll(deque, batch_size, batch) < 0)
+                    goto close;
+                batch_size = 0;
+            }
             ++*nFiles;
         }
     }
+    if (deque_pushAll(deque, batch_size, batch) < 0)
+        goto close;
+    closedir(dir);
 
     return 0;
 close:
+    // paths not handed to `deque` yet
+    while (batch_size > 0)
+        freeMemory(batch[--batch_size].value);
     closedir(dir);
     return -1;
 }
@@ -295,6 +319,142 @@ openFile(const char *path, const char *mode)
 }
 #endif
 
+/*
+ * Content hash
+ *
+ * SHA-256 (FIPS 180-4) of the bytes as they enter the buffer,
+ * so a digest can stand for the class file it was read from.
+ */
+static const u4 sha256_k[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5,
+    0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3,
+    0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc,
+    0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7,
+    0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13,
+    0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3,
+    0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5,
+    0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208,
+    0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+static inline u4
+rotateRight(u4 x, int r)
+{
+    return x >> r | x << (32 - r);
+}
+
+static void
+initContentHash(struct ContentHash *hash)
+{
+    static const u4 initial[8] = {
+        0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+        0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+    };
+
+    memcpy(hash->state, initial, sizeof (initial));
+    hash->length = 0;
+}
+
+static void
+compressBlock(u4 *state, const u1 *block)
+{
+    u4 w[64], v[8], s0, s1, t1, t2;
+    int i;
+
+    for (i = 0; i < 16; i++)
+        w[i] = (u4) block[4 * i] << 24 | (u4) block[4 * i + 1] << 16
+            | (u4) block[4 * i + 2] << 8 | (u4) block[4 * i + 3];
+    for (i = 16; i < 64; i++)
+    {
+        s0 = rotateRight(w[i - 15], 7) ^ rotateRight(w[i - 15], 18)
+            ^ w[i - 15] >> 3;
+        s1 = rotateRight(w[i - 2], 17) ^ rotateRight(w[i - 2], 19)
+            ^ w[i - 2] >> 10;
+        w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+    }
+    memcpy(v, state, sizeof (v));
+    for (i = 0; i < 64; i++)
+    {
+        t1 = v[7] + (rotateRight(v[4], 6) ^ rotateRight(v[4], 11)
+                ^ rotateRight(v[4], 25))
+            + ((v[4] & v[5]) ^ (~v[4] & v[6])) + sha256_k[i] + w[i];
+        t2 = (rotateRight(v[0], 2) ^ rotateRight(v[0], 13)
+                ^ rotateRight(v[0], 22))
+            + ((v[0] & v[1]) ^ (v[0] & v[2]) ^ (v[1] & v[2]));
+        memmove(v + 1, v, 7 * sizeof (u4));
+        v[4] += t1;
+        v[0] = t1 + t2;
+    }
+    for (i = 0; i < 8; i++)
+        state[i] += v[i];
+}
+
+static void
+updateContentHash(struct ContentHash *hash, const u1 *bytes, u8 len)
+{
+    u4 used, n;
+
+    while (len > 0)
+    {
+        used = (u4) (hash->length & 63);
+        n = 64 - used < len ? 64 - used : (u4) len;
+        memcpy(hash->block + used, bytes, n);
+        hash->length += n;
+        bytes += n;
+        len -= n;
+        if (!(hash->length & 63))
+            compressBlock(hash->state, hash->block);
+    }
+}
+
+static void
+finishContentHash(struct ContentHash *hash, struct ContentDigest *digest)
+{
+    u1 padding[72];
+    u8 bits;
+    u4 used, n;
+    int i;
+
+    digest->length = hash->length;
+    bits = hash->length * 8;
+    used = (u4) (hash->length & 63);
+    // 0x80, zeros, then the bit length, up to a block boundary
+    n = (used < 56 ? 56 : 120) - used;
+    memset(padding, 0, sizeof (padding));
+    padding[0] = 0x80;
+    for (i = 0; i < 8; i++)
+        padding[n + i] = (u1) (bits >> (56 - 8 * i));
+    updateContentHash(hash, padding, n + 8);
+    for (i = 0; i < 32; i++)
+        digest->hash[i] = (u1) (hash->state[i >> 2] >> (24 - 8 * (i & 3)));
+}
+
+extern void
+getContentDigest(struct BufferIO *io, struct ContentDigest *digest)
+{
+    struct ContentHash hash;
+
+    hash = io->hash;
+    finishContentHash(&hash, digest);
+}
+
+extern void
+hashContent(const u1 *bytes, u8 length, struct ContentDigest *digest)
+{
+    struct ContentHash hash;
+
+    initContentHash(&hash);
+    updateContentHash(&hash, bytes, length);
+    finishContentHash(&hash, digest);
+}
+
 static inline int
 initBufferIO(struct BufferIO *io)
 {
@@ -310,6 +470,7 @@ initBufferIO(struct BufferIO *io)
     io->more = 1;
     io->f_out = (FILE *) 0;
     io->f_err = (FILE *) 0;
+    initContentHash(&(io->hash));
 
     return 0;
 }
@@ -489,6 +650,8 @@ fillBuffer_f(struct BufferIO * input, int nbits)
             else if (rbit < cap)
                 input->more = 0;
 
+            updateContentHash(&(input->hash),
+                    &(input->buffer[buflen]), rbit);
             input->bufdst += rbit;
             if (input->bufdst < bufsize)
                 bzero(&(input->buffer[input->bufdst]), bufsize - input->bufdst);
@@ -546,6 +709,8 @@ fillBuffer_z(struct BufferIO * input, int nbits)
             else if (rbit < cap)
                 input->more = 0;
 
+            updateContentHash(&(input->hash),
+                    &(input->buffer[buflen]), rbit);
             input->bufdst += rbit;
             if (input->bufdst < bufsize)
                 bzero(&(input->buffer[input->bufdst]), bufsize - input->bufdst);
@@ -0,0 +1,940 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "java.h"
+#include "opcode.h"
+#include "bytecode.h"
+#include "descriptor.h"
+#include "cfg.h"
+#include "ir.h"
+#include "log.h"
+#include "memory.h"
+
+/*
+ * SSA construction
+ *
+ * Blocks are translated breadth first from the entry, so one
+ * predecessor of every block is done before it. A block with a
+ * single normal predecessor starts from that predecessor's exit
+ * state, any other block starts with a phi per live slot.
+ * Phi operands are filled once every block is done, then phis
+ * whose operands agree are replaced by that value until none is left.
+ *
+ * A handler phi takes, from each protected predecessor, the value
+ * of its slot at every throwing instruction of that block, so a
+ * local reassigned after a call still reaches the handler with
+ * both values.
+ */
+
+struct IrBuilder
+{
+    struct IrMethod *ir;
+    ClassFile *     cf;
+    attr_Code_info *code;
+    struct ControlFlowGraph *cfg;
+    struct IrBlock *block;
+    u4              block_index;
+    struct Instruction insn;
+    // locals then stack of the block being translated
+    struct IrNode **state;
+    u2              stack_size;
+    u4              slots;
+};
+
+extern void
+initIrMethod(struct IrMethod *ir)
+{
+    memset(ir, 0, sizeof (struct IrMethod));
+    arena_init(&(ir->arena));
+}
+
+extern void
+releaseIrMethod(struct IrMethod *ir)
+{
+    arena_release(&(ir->arena));
+    initIrMethod(ir);
+}
+
+static int
+fail(struct IrBuilder *b, const char *reason)
+{
+    logError("Fail to build IR @ pc %u: %s!\r\n", b->insn.pc, reason);
+    return -1;
+}
+
+static struct IrNode *
+newNode(struct IrBuilder *b, u2 op, u1 type, u4 operands_count)
+{
+    struct IrNode *node;
+
+    node = (struct IrNode *) arena_alloc(&(b->ir->arena),
+            sizeof (struct IrNode));
+    if (!node)
+        return (struct IrNode *) 0;
+    if (operands_count > 0)
+    {
+        node->operands = (struct IrNode **) arena_alloc(&(b->ir->arena),
+                operands_count * sizeof (struct IrNode *));
+        if (!node->operands)
+            return (struct IrNode *) 0;
+    }
+    node->op = op;
+    node->type = type;
+    node->id = b->ir->nodes_count++;
+    node->pc = b->insn.pc;
+    node->block = b->block_index;
+    node->operands_count = operands_count;
+    return node;
+}
+
+static void
+appendNode(struct IrBlock *block, struct IrNode *node)
+{
+    if (block->last)
+        block->last->next = node;
+    else
+        block->first = node;
+    block->last = node;
+}
+
+/*
+ * Operand stack, a long or double takes two slots
+ * and its second one is null
+ */
+static int
+push(struct IrBuilder *b, struct IrNode *node)
+{
+    struct IrNode **stack;
+    u2 n;
+
+    n = isCategory2Type(node->type) ? 2 : 1;
+    if (b->stack_size + n > b->code->max_stack)
+        return fail(b, "operand stack overflow");
+    stack = b->state + b->code->max_locals;
+    stack[b->stack_size++] = node;
+    if (n == 2)
+        stack[b->stack_size++] = (struct IrNode *) 0;
+    return 0;
+}
+
+static int
+pop(struct IrBuilder *b, struct IrNode **node)
+{
+    struct IrNode **stack;
+
+    stack = b->state + b->code->max_locals;
+    if (b->stack_size > 1 && !stack[b->stack_size - 1])
+        b->stack_size -= 2;
+    else if (b->stack_size > 0)
+        --b->stack_size;
+    else
+        return fail(b, "operand stack underflow");
+    *node = stack[b->stack_size];
+    if (!*node)
+        return fail(b, "operand stack holds half a long or double");
+    return 0;
+}
+
+// same contract as in the type checker, on nodes instead of types
+static int
+duplicate(struct IrBuilder *b, u2 count, u2 depth)
+{
+    struct IrNode **stack;
+    u2 size, i;
+
+    stack = b->state + b->code->max_locals;
+    size = b->stack_size;
+    if (size < count + depth)
+        return fail(b, "operand stack underflow");
+    if (size + count > b->code->max_stack)
+        return fail(b, "operand stack overflow");
+    for (i = size; i-- > size - count - depth;)
+        stack[i + count] = stack[i];
+    for (i = 0; i < count; i++)
+        stack[size - count - depth + i] = stack[size + i];
+    b->stack_size = size + count;
+    return 0;
+}
+
+// node of the current instruction taking the top `count` values
+static int
+emit(struct IrBuilder *b, u1 type, u4 count)
+{
+    struct IrNode *node;
+    u4 i;
+
+    node = newNode(b, b->insn.opcode, type, count);
+    if (!node)
+        return fail(b, "out of memory");
+    node->index = b->insn.index;
+    node->constant = b->insn.value;
+    for (i = count; i-- > 0;)
+        if (pop(b, &(node->operands[i])) < 0)
+            return -1;
+    appendNode(b->block, node);
+    if (type != IR_VOID)
+        return push(b, node);
+    return 0;
+}
+
+/*
+ * Pops the operands and pushes the result of an instruction,
+ * e.g. "LI>I" pops an int then a reference and pushes an int
+ */
+static int
+applyEffect(struct IrBuilder *b, const char *effect)
+{
+    const char *arrow;
+
+    arrow = strchr(effect, '>');
+    return emit(b, arrow[1] ? arrow[1] : IR_VOID, arrow - effect);
+}
+
+// stack effect of instructions whose operands are all typed by the opcode
+static const char *
+getEffect(u1 opcode)
+{
+    static const char *binary[] = { "II>I", "JJ>J", "FF>F", "DD>D" };
+    static const char *unary[] = { "I>I", "J>J", "F>F", "D>D" };
+    static const char *shift[] = { "II>I", "JI>J" };
+    static const char *conversion[] = {
+        "I>J", "I>F", "I>D", "J>I", "J>F", "J>D",
+        "F>I", "F>J", "F>D", "D>I", "D>J", "D>F",
+        "I>I", "I>I", "I>I"
+    };
+    static const char *array_load[] = {
+        "LI>I", "LI>J", "LI>F", "LI>D", "LI>L", "LI>I", "LI>I", "LI>I"
+    };
+    static const char *array_store[] = {
+        "LII>", "LIJ>", "LIF>", "LID>", "LIL>", "LII>", "LII>", "LII>"
+    };
+    static const char *value_return[] = { "I>", "J>", "F>", "D>", "L>" };
+
+    if (opcode >= OPCODE_iaload && opcode <= OPCODE_saload)
+        return array_load[opcode - OPCODE_iaload];
+    if (opcode >= OPCODE_iastore && opcode <= OPCODE_sastore)
+        return array_store[opcode - OPCODE_iastore];
+    if (opcode >= OPCODE_iadd && opcode <= OPCODE_drem)
+        return binary[(opcode - OPCODE_iadd) % 4];
+    if (opcode >= OPCODE_ineg && opcode <= OPCODE_dneg)
+        return unary[opcode - OPCODE_ineg];
+    if (opcode >= OPCODE_ishl && opcode <= OPCODE_lushr)
+        return shift[(opcode - OPCODE_ishl) % 2];
+    if (opcode >= OPCODE_iand && opcode <= OPCODE_lxor)
+        return binary[(opcode - OPCODE_iand) % 2];
+    if (opcode >= OPCODE_i2l && opcode <= OPCODE_i2s)
+        return conversion[opcode - OPCODE_i2l];
+    if (opcode >= OPCODE_ifeq && opcode <= OPCODE_ifle)
+        return "I>";
+    if (opcode >= OPCODE_if_icmpeq && opcode <= OPCODE_if_icmple)
+        return "II>";
+    if (opcode >= OPCODE_ireturn && opcode <= OPCODE_areturn)
+        return value_return[opcode - OPCODE_ireturn];
+    switch (opcode)
+    {
+        case OPCODE_lcmp:
+            return "JJ>I";
+        case OPCODE_fcmpl:case OPCODE_fcmpg:
+            return "FF>I";
+        case OPCODE_dcmpl:case OPCODE_dcmpg:
+            return "DD>I";
+        case OPCODE_if_acmpeq:case OPCODE_if_acmpne:
+            return "LL>";
+        case OPCODE_ifnull:case OPCODE_ifnonnull:
+        case OPCODE_athrow:
+        case OPCODE_monitorenter:case OPCODE_monitorexit:
+            return "L>";
+        case OPCODE_tableswitch:case OPCODE_lookupswitch:
+            return "I>";
+        case OPCODE_return:
+            return ">";
+        case OPCODE_new:
+            return ">L";
+        case OPCODE_newarray:case OPCODE_anewarray:
+            return "I>L";
+        case OPCODE_arraylength:
+            return "L>I";
+        case OPCODE_checkcast:
+            return "L>L";
+        case OPCODE_instanceof:
+            return "L>I";
+        case OPCODE_jsr:case OPCODE_jsr_w:
+            return ">R";
+        default:
+            return (const char *) 0;
+    }
+}
+
+static u1
+getTokenType(struct DescriptorToken *token)
+{
+    if (token->dimensions > 0)
+        return IR_REFERENCE;
+    switch (token->type)
+    {
+        case 'B':case 'C':case 'S':case 'Z':case 'I':
+            return IR_INT;
+        case 'J':case 'F':case 'D':case 'V':
+            return token->type;
+        default:
+            return IR_REFERENCE;
+    }
+}
+
+// descriptor of the field, method or call site at `index`
+static const_Utf8_data *
+getMemberDescriptor(ClassFile *cf, u2 index)
+{
+    cp_info *info;
+    u2 name_and_type_index;
+
+    info = getConstant(cf, index);
+    if (!info)
+        return (const_Utf8_data *) 0;
+    switch (info->tag)
+    {
+        case CONSTANT_Fieldref:
+        case CONSTANT_Methodref:
+        case CONSTANT_InterfaceMethodref:
+            name_and_type_index = info->info.cfd.name_and_type_index;
+            break;
+        case CONSTANT_InvokeDynamic:
+            name_and_type_index = info->info.cidd.name_and_type_index;
+            break;
+        default:
+            return (const_Utf8_data *) 0;
+    }
+    info = getConstant(cf, name_and_type_index);
+    if (!info || info->tag != CONSTANT_NameAndType)
+        return (const_Utf8_data *) 0;
+    return getConstant_Utf8(cf, info->info.cnd.descriptor_index);
+}
+
+static int
+translateMember(struct IrBuilder *b)
+{
+    struct DescriptorToken tokens[256];
+    const_Utf8_data *descriptor;
+    u4 receiver;
+    u1 opcode;
+    int kind, n;
+
+    opcode = b->insn.opcode;
+    descriptor = getMemberDescriptor(b->cf, b->insn.index);
+    if (!descriptor)
+        return fail(b, "invalid member reference");
+    kind = opcode >= OPCODE_invokevirtual
+        ? SCAN_METHOD_DESCRIPTOR : SCAN_FIELD_DESCRIPTOR;
+    n = scanDescriptor(kind, descriptor->length, descriptor->bytes,
+            tokens, 256);
+    if (n < 1)
+        return fail(b, "invalid member descriptor");
+    receiver = opcode != OPCODE_getstatic && opcode != OPCODE_putstatic
+        && opcode != OPCODE_invokestatic && opcode != OPCODE_invokedynamic;
+    switch (opcode)
+    {
+        case OPCODE_getstatic:case OPCODE_getfield:
+            return emit(b, getTokenType(&(tokens[0])), receiver);
+        case OPCODE_putstatic:case OPCODE_putfield:
+            return emit(b, IR_VOID, receiver + 1);
+        default:
+            // parameters, then the return type
+            return emit(b, getTokenType(&(tokens[n - 1])), receiver + n - 1);
+    }
+}
+
+static int
+translateConstant(struct IrBuilder *b)
+{
+    struct IrNode *node;
+    cp_info *info;
+    u1 opcode, type;
+    int64_t value;
+
+    opcode = b->insn.opcode;
+    switch (opcode)
+    {
+        case OPCODE_ldc:case OPCODE_ldc_w:case OPCODE_ldc2_w:
+            info = getConstant(b->cf, b->insn.index);
+            if (!info)
+                return fail(b, "invalid constant");
+            switch (info->tag)
+            {
+                case CONSTANT_Integer: type = IR_INT; break;
+                case CONSTANT_Float: type = IR_FLOAT; break;
+                case CONSTANT_Long: type = IR_LONG; break;
+                case CONSTANT_Double: type = IR_DOUBLE; break;
+                default: type = IR_REFERENCE; break;
+            }
+            node = newNode(b, opcode, type, 0);
+            if (!node)
+                return fail(b, "out of memory");
+            node->index = b->insn.index;
+            appendNode(b->block, node);
+            return push(b, node);
+        case OPCODE_aconst_null:
+            type = IR_REFERENCE;
+            value = 0;
+            break;
+        case OPCODE_lconst_0:case OPCODE_lconst_1:
+            type = IR_LONG;
+            value = opcode - OPCODE_lconst_0;
+            break;
+        case OPCODE_fconst_0:case OPCODE_fconst_1:case OPCODE_fconst_2:
+            type = IR_FLOAT;
+            value = opcode - OPCODE_fconst_0;
+            break;
+        case OPCODE_dconst_0:case OPCODE_dconst_1:
+            type = IR_DOUBLE;
+            value = opcode - OPCODE_dconst_0;
+            break;
+        case OPCODE_bipush:case OPCODE_sipush:
+            type = IR_INT;
+            value = b->insn.value;
+            break;
+        default:
+            type = IR_INT;
+            value = (int) opcode - OPCODE_iconst_0;
+            break;
+    }
+    node = newNode(b, IR_CONSTANT, type, 0);
+    if (!node)
+        return fail(b, "out of memory");
+    node->constant = value;
+    appendNode(b->block, node);
+    return push(b, node);
+}
+
+static int
+translateLocal(struct IrBuilder *b)
+{
+    struct IrNode *value, *node;
+    u4 index;
+    u1 opcode;
+
+    opcode = b->insn.opcode;
+    index = b->insn.index;
+    if (index + b->insn.info->slots > b->code->max_locals)
+        return fail(b, "local variable index exceeds max_locals");
+    if (opcode >= OPCODE_iload && opcode <= OPCODE_aload_3)
+    {
+        if (!b->state[index])
+            return fail(b, "local variable is unset");
+        return push(b, b->state[index]);
+    }
+    if (opcode == OPCODE_iinc || opcode == OPCODE_ret)
+    {
+        value = b->state[index];
+        if (!value)
+            return fail(b, "local variable is unset");
+        node = newNode(b, opcode,
+                opcode == OPCODE_iinc ? IR_INT : IR_VOID, 1);
+        if (!node)
+            return fail(b, "out of memory");
+        node->operands[0] = value;
+        node->index = index;
+        node->constant = b->insn.value;
+        appendNode(b->block, node);
+        if (opcode == OPCODE_iinc)
+            b->state[index] = node;
+        return 0;
+    }
+    // stores
+    if (pop(b, &value) < 0)
+        return -1;
+    if (index > 0 && b->state[index - 1]
+            && isCategory2Type(b->state[index - 1]->type))
+        b->state[index - 1] = (struct IrNode *) 0;
+    b->state[index] = value;
+    if (isCategory2Type(value->type))
+        b->state[index + 1] = (struct IrNode *) 0;
+    return 0;
+}
+
+static int
+translate(struct IrBuilder *b)
+{
+    struct IrNode **stack, *top;
+    const char *effect;
+    u1 opcode;
+
+    opcode = b->insn.opcode;
+    stack = b->state + b->code->max_locals;
+    switch (b->insn.info->kind)
+    {
+        case OPK_LOCAL:
+        case OPK_LOCAL_N:
+            return translateLocal(b);
+    }
+    if (opcode >= OPCODE_aconst_null && opcode <= OPCODE_ldc2_w)
+        return translateConstant(b);
+    if (opcode >= OPCODE_getstatic && opcode <= OPCODE_invokedynamic)
+        return translateMember(b);
+    switch (opcode)
+    {
+        case OPCODE_nop:
+        case OPCODE_goto:case OPCODE_goto_w:
+            return 0;
+        case OPCODE_pop:
+            if (b->stack_size < 1 || !stack[b->stack_size - 1])
+                return fail(b, "pop splits a long or double");
+            --b->stack_size;
+            return 0;
+        case OPCODE_pop2:
+            if (b->stack_size < 2)
+                return fail(b, "operand stack underflow");
+            b->stack_size -= 2;
+            return 0;
+        case OPCODE_dup: return duplicate(b, 1, 0);
+        case OPCODE_dup_x1: return duplicate(b, 1, 1);
+        case OPCODE_dup_x2: return duplicate(b, 1, 2);
+        case OPCODE_dup2: return duplicate(b, 2, 0);
+        case OPCODE_dup2_x1: return duplicate(b, 2, 1);
+        case OPCODE_dup2_x2: return duplicate(b, 2, 2);
+        case OPCODE_swap:
+            if (b->stack_size < 2)
+                return fail(b, "operand stack underflow");
+            top = stack[b->stack_size - 1];
+            stack[b->stack_size - 1] = stack[b->stack_size - 2];
+            stack[b->stack_size - 2] = top;
+            return 0;
+        case OPCODE_multianewarray:
+            return emit(b, IR_REFERENCE, b->insn.value);
+    }
+    effect = getEffect(opcode);
+    if (!effect)
+        return fail(b, "unsupported instruction");
+    return applyEffect(b, effect);
+}
+
+/*
+ * Block entry states
+ */
+static int
+isJoin(struct ControlFlowGraph *cfg, u4 index)
+{
+    struct BasicBlock *block;
+
+    block = &(cfg->blocks[index]);
+    if (index == 0)
+        return block->predecessors_count > 0;
+    return block->predecessors_count != 1
+        || cfg->predecessors[block->first_predecessor].kind != EDGE_NORMAL;
+}
+
+static int
+isHandler(struct ControlFlowGraph *cfg, u4 index)
+{
+    struct BasicBlock *block;
+    u4 i;
+
+    block = &(cfg->blocks[index]);
+    for (i = 0; i < block->predecessors_count; i++)
+        if (cfg->predecessors[block->first_predecessor + i].kind
+                == EDGE_EXCEPTION)
+            return 1;
+    return 0;
+}
+
+/*
+ * Starts block `index` with a phi for every slot set in `from`,
+ * operands are allocated once all predecessors are done.
+ */
+static int
+enterJoin(struct IrBuilder *b, u4 index, struct IrNode **from,
+        u2 stack_size)
+{
+    struct IrBlock *block;
+    struct IrNode *phi, *caught;
+    u4 slot;
+
+    block = &(b->ir->blocks[index]);
+    block->entry = (struct IrNode **) arena_alloc(&(b->ir->arena),
+            b->slots * sizeof (struct IrNode *));
+    if (!block->entry)
+        return fail(b, "out of memory");
+    b->block_index = index;
+    b->insn.pc = b->cfg->blocks[index].start_pc;
+    caught = (struct IrNode *) 0;
+    if (isHandler(b->cfg, index))
+    {
+        caught = newNode(b, IR_CATCH, IR_REFERENCE, 0);
+        if (!caught)
+            return fail(b, "out of memory");
+        block->entry[b->code->max_locals] = caught;
+        stack_size = 0;
+    }
+    for (slot = 0; slot < b->code->max_locals + stack_size; slot++)
+    {
+        if (!from[slot])
+            continue;
+        phi = newNode(b, IR_PHI, from[slot]->type, 0);
+        if (!phi)
+            return fail(b, "out of memory");
+        phi->index = slot;
+        block->entry[slot] = phi;
+        appendNode(block, phi);
+    }
+    block->entry_stack_size = stack_size;
+    if (caught)
+    {
+        appendNode(block, caught);
+        block->entry_stack_size = 1;
+    }
+    return 0;
+}
+
+static int
+enterBlock(struct IrBuilder *b, u4 index, u4 from)
+{
+    struct IrBlock *block, *pred;
+
+    block = &(b->ir->blocks[index]);
+    pred = &(b->ir->blocks[from]);
+    block->reached = 1;
+    if (isJoin(b->cfg, index))
+        return enterJoin(b, index, pred->exit, pred->exit_stack_size);
+    block->entry = pred->exit;
+    block->entry_stack_size = pred->exit_stack_size;
+    return 0;
+}
+
+static int
+isProtected(struct ControlFlowGraph *cfg, u4 index)
+{
+    struct BasicBlock *block;
+    u4 i;
+
+    block = &(cfg->blocks[index]);
+    for (i = 0; i < block->edges_count; i++)
+        if (cfg->edges[block->first_edge + i].kind == EDGE_EXCEPTION)
+            return 1;
+    return 0;
+}
+
+// keeps the locals seen by the handlers of the instruction about to run
+static int
+recordThrow(struct IrBuilder *b)
+{
+    struct IrBlock *block;
+    struct IrThrow *last;
+    size_t size;
+
+    block = b->block;
+    last = block->throws;
+    size = b->code->max_locals * sizeof (struct IrNode *);
+    if (last && !memcmp(last->locals, b->state, size))
+        return 0;
+    last = (struct IrThrow *) arena_alloc(&(b->ir->arena),
+            sizeof (struct IrThrow));
+    if (!last)
+        return fail(b, "out of memory");
+    last->locals = (struct IrNode **) arena_alloc(&(b->ir->arena),
+            size > 0 ? size : 1);
+    if (!last->locals)
+        return fail(b, "out of memory");
+    memcpy(last->locals, b->state, size);
+    last->next = block->throws;
+    block->throws = last;
+    block->throws_count++;
+    return 0;
+}
+
+static int
+translateBlock(struct IrBuilder *b, u4 index)
+{
+    struct InstructionIterator it;
+    struct BasicBlock *bb;
+    struct IrBlock *block;
+    int result, covered;
+
+    bb = &(b->cfg->blocks[index]);
+    block = &(b->ir->blocks[index]);
+    b->block = block;
+    b->block_index = index;
+    memcpy(b->state, block->entry, b->slots * sizeof (struct IrNode *));
+    b->stack_size = block->entry_stack_size;
+    covered = isProtected(b->cfg, index);
+
+    initInstructionIterator(&it, b->code->code, b->code->code_length);
+    it.pc = bb->start_pc;
+    while (it.pc < bb->end_pc)
+    {
+        result = nextInstruction(&it, &(b->insn));
+        if (result <= 0)
+            return fail(b, "invalid instruction");
+        if (covered && canThrow(b->insn.opcode) && recordThrow(b) < 0)
+            return -1;
+        if (translate(b) < 0)
+            return -1;
+    }
+
+    block->exit = (struct IrNode **) arena_alloc(&(b->ir->arena),
+            b->slots * sizeof (struct IrNode *));
+    if (!block->exit)
+        return fail(b, "out of memory");
+    memcpy(block->exit, b->state, b->slots * sizeof (struct IrNode *));
+    block->exit_stack_size = b->stack_size;
+    return 0;
+}
+
+static int
+initParameters(struct IrBuilder *b, method_info *method,
+        struct IrNode **state)
+{
+    struct DescriptorToken tokens[256];
+    const_Utf8_data *descriptor;
+    struct IrNode *node;
+    u4 slot;
+    int count, i;
+
+    descriptor = getConstant_Utf8(b->cf, method->descriptor_index);
+    if (!descriptor)
+        return fail(b, "method has no descriptor");
+    count = scanDescriptor(SCAN_METHOD_DESCRIPTOR, descriptor->length,
+            descriptor->bytes, tokens, 256);
+    if (count < 1)
+        return fail(b, "invalid method descriptor");
+    slot = 0;
+    // the receiver comes first, the return type last
+    for (i = (method->access_flags & ACC_STATIC) ? 0 : -1;
+            i < count - 1; i++)
+    {
+        node = newNode(b, IR_PARAMETER,
+                i < 0 ? IR_REFERENCE : getTokenType(&(tokens[i])), 0);
+        if (!node)
+            return fail(b, "out of memory");
+        if (slot + isCategory2Type(node->type) >= b->code->max_locals)
+            return fail(b, "parameters exceed max_locals");
+        node->index = slot;
+        state[slot] = node;
+        slot += isCategory2Type(node->type) ? 2 : 1;
+    }
+    return 0;
+}
+
+/*
+ * Phis
+ */
+static inline struct IrNode *
+resolve(struct IrNode *node)
+{
+    // a folded phi has no type and forwards to its first operand
+    while (node && node->op == IR_PHI && node->type == IR_VOID)
+        node = node->operands[0];
+    return node;
+}
+
+/*
+ * One operand per normal predecessor and one per recorded throw
+ * of exceptional ones, the entry block adds the parameters.
+ */
+static int
+fillPhis(struct IrBuilder *b, u4 index, struct IrNode **parameters)
+{
+    struct BasicBlock *bb;
+    struct ControlEdge *edge;
+    struct IrBlock *pred;
+    struct IrThrow *thrown;
+    struct IrNode *phi;
+    u4 operands, i, j;
+
+    bb = &(b->cfg->blocks[index]);
+    operands = index == 0;
+    for (i = 0; i < bb->predecessors_count; i++)
+    {
+        edge = &(b->cfg->predecessors[bb->first_predecessor + i]);
+        operands += edge->kind == EDGE_EXCEPTION
+            ? b->ir->blocks[edge->block].throws_count : 1;
+    }
+    for (phi = b->ir->blocks[index].first;
+            phi && phi->op == IR_PHI; phi = phi->next)
+    {
+        // foldPhi writes the first operand even if there is none
+        phi->operands = (struct IrNode **) arena_alloc(&(b->ir->arena),
+                (operands > 0 ? operands : 1) * sizeof (struct IrNode *));
+        if (!phi->operands)
+            return fail(b, "out of memory");
+        phi->operands_count = operands;
+        j = 0;
+        for (i = 0; i < bb->predecessors_count; i++)
+        {
+            edge = &(b->cfg->predecessors[bb->first_predecessor + i]);
+            pred = &(b->ir->blocks[edge->block]);
+            if (edge->kind == EDGE_EXCEPTION)
+            {
+                for (thrown = pred->throws; thrown; thrown = thrown->next)
+                    phi->operands[j++] = phi->index < b->code->max_locals
+                        ? thrown->locals[phi->index] : phi;
+                continue;
+            }
+            // edges from dead code don't count
+            phi->operands[j++] = pred->reached ? pred->exit[phi->index] : phi;
+        }
+        if (index == 0)
+            phi->operands[j] = parameters[phi->index];
+    }
+    return 0;
+}
+
+// folds a phi whose operands agree, returns whether it did
+static int
+foldPhi(struct IrNode *phi)
+{
+    struct IrNode *value, *unique;
+    u4 i;
+
+    unique = (struct IrNode *) 0;
+    for (i = 0; i < phi->operands_count; i++)
+    {
+        value = resolve(phi->operands[i]);
+        if (value == phi)
+            continue;
+        // a slot unset or of another type on one path is dead here
+        if (!value || value->type != phi->type)
+        {
+            unique = (struct IrNode *) 0;
+            break;
+        }
+        if (unique && value != unique)
+            return 0;
+        unique = value;
+    }
+    phi->type = IR_VOID;
+    phi->operands[0] = unique;
+    return 1;
+}
+
+static void
+foldPhis(struct IrMethod *ir)
+{
+    struct IrNode *phi;
+    u4 i;
+    int changed;
+
+    do
+    {
+        changed = 0;
+        for (i = 0; i < ir->blocks_count; i++)
+            for (phi = ir->blocks[i].first;
+                    phi && phi->op == IR_PHI; phi = phi->next)
+                if (phi->type != IR_VOID && foldPhi(phi))
+                    changed = 1;
+    } while (changed);
+}
+
+// replaces folded phis everywhere they are used
+static int
+rewriteOperands(struct IrBuilder *b)
+{
+    struct IrBlock *block;
+    struct IrNode *node, **link;
+    u4 i, j;
+
+    for (i = 0; i < b->ir->blocks_count; i++)
+    {
+        block = &(b->ir->blocks[i]);
+        if (!block->reached)
+            continue;
+        block->last = (struct IrNode *) 0;
+        for (link = &(block->first); (node = *link);)
+        {
+            if (node->op == IR_PHI && node->type == IR_VOID)
+            {
+                *link = node->next;
+                continue;
+            }
+            for (j = 0; j < node->operands_count; j++)
+            {
+                node->operands[j] = resolve(node->operands[j]);
+                if (!node->operands[j])
+                {
+                    b->insn.pc = node->pc;
+                    return fail(b, "value is unset on some path");
+                }
+            }
+            block->last = node;
+            link = &(node->next);
+        }
+        for (j = 0; j < b->slots; j++)
+        {
+            block->entry[j] = resolve(block->entry[j]);
+            block->exit[j] = resolve(block->exit[j]);
+        }
+    }
+    return 0;
+}
+
+extern int
+buildIrMethod(struct IrMethod *ir, ClassFile *cf, method_info *method,
+        attr_Code_info *code, struct ControlFlowGraph *cfg)
+{
+    struct IrBuilder b;
+    struct IrNode **parameters;
+    struct ControlEdge *edge;
+    struct BasicBlock *bb;
+    u4 *queue, head, tail, index, i;
+
+    arena_reset(&(ir->arena));
+    ir->cfg = cfg;
+    ir->blocks_count = 0;
+    ir->nodes_count = 0;
+    ir->max_locals = code->max_locals;
+    ir->max_stack = code->max_stack;
+    memset(&b, 0, sizeof (struct IrBuilder));
+    b.ir = ir;
+    b.cf = cf;
+    b.code = code;
+    b.cfg = cfg;
+    b.slots = code->max_locals + code->max_stack;
+    if (cfg->blocks_count == 0 || cfg->code_length != code->code_length)
+        return fail(&b, "control flow graph doesn't match the code");
+
+    ir->blocks = (struct IrBlock *) arena_alloc(&(ir->arena),
+            cfg->blocks_count * sizeof (struct IrBlock));
+    b.state = (struct IrNode **) arena_alloc(&(ir->arena),
+            b.slots * sizeof (struct IrNode *));
+    parameters = (struct IrNode **) arena_alloc(&(ir->arena),
+            b.slots * sizeof (struct IrNode *));
+    queue = (u4 *) arena_alloc(&(ir->arena),
+            cfg->blocks_count * sizeof (u4));
+    if (!ir->blocks || !b.state || !parameters || !queue)
+        return fail(&b, "out of memory");
+    ir->blocks_count = cfg->blocks_count;
+    if (initParameters(&b, method, parameters) < 0)
+        return -1;
+
+    ir->blocks[0].reached = 1;
+    if (isJoin(cfg, 0))
+    {
+        if (enterJoin(&b, 0, parameters, 0) < 0)
+            return -1;
+    }
+    else
+        ir->blocks[0].entry = parameters;
+    head = tail = 0;
+    queue[tail++] = 0;
+    while (head < tail)
+    {
+        index = queue[head++];
+        if (translateBlock(&b, index) < 0)
+            return -1;
+        bb = &(cfg->blocks[index]);
+        for (i = 0; i < bb->edges_count; i++)
+        {
+            edge = &(cfg->edges[bb->first_edge + i]);
+            if (ir->blocks[edge->block].reached)
+                continue;
+            if (enterBlock(&b, edge->block, index) < 0)
+                return -1;
+            queue[tail++] = edge->block;
+        }
+    }
+
+    for (i = 0; i < ir->blocks_count; i++)
+        if (ir->blocks[i].reached && isJoin(cfg, i)
+                && fillPhis(&b, i, parameters) < 0)
+            return -1;
+    foldPhis(ir);
+    return rewriteOperands(&b);
+}
@@ -2,15 +2,14 @@
 #include <stdio.h>
 #include <string.h>
 #include <ctype.h>
+#include <zip.h>
 
 #include "java.h"
 #include "log.h"
 #include "memory.h"
 #include "rt.h"
 #include "vrf.h"
-
-static int
-freeClassfile(ClassFile *);
+#include "descriptor.h"
 
 static int
 loadConstantPool(struct BufferIO *, ClassFile *);
@@ -19,10 +18,10 @@ static int
 loadInterfaces(struct BufferIO *, ClassFile *);
 
 static int
-loadFields(struct BufferIO *, ClassFile *);
+loadFields(struct BufferIO *, ClassFile *, rt_ClassBuilder *);
 
 static int
-loadMethods(struct BufferIO *, ClassFile *);
+loadMethods(struct BufferIO *, ClassFile *, rt_ClassBuilder *);
 
 static u1 *
 convertAccessFlags_field(u2, u2);
@@ -39,13 +38,15 @@ logFields(rt_Class *);
 static int
 logMethods(rt_Class *);
 
-extern int
-parseClassfile(struct BufferIO * input,
-        struct AttributeFilter *attr_filter)
+/*
+ * Reads a class file into `cf`, the run-time model
+ * is filled through `builder` while it is decoded
+ */
+static int
+decodeClassfile(struct BufferIO *input, ClassFile *cf,
+        rt_ClassBuilder *builder)
 {
     u4 magic;
-    ClassFile cf;
-    rt_Class *rtc;
 
     if (!input)
     {
@@ -62,49 +63,64 @@ parseClassfile(struct BufferIO * input,
     if (checkMagic(magic) < 0)
         return -1;
     // initialize ClassFile
-    memset(&cf, 0, sizeof (ClassFile));
+    memset(cf, 0, sizeof (ClassFile));
     // retrieve version
-    if (ru2(&(cf.minor_version), input) < 0)
+    if (ru2(&(cf->minor_version), input) < 0)
         return -1;
-    if (ru2(&(cf.major_version), input) < 0)
+    if (ru2(&(cf->major_version), input) < 0)
         return -1;
 #ifndef DEBUG
     // check compatibility
-    if (compareVersion(cf.major_version, cf.minor_version) > 0)
+    if (compareVersion(cf->major_version, cf->minor_version) > 0)
     {
         logError("Class file version is higher than this implementation!\r\n");
         return -1;
     }
 #endif
 
-    if (loadConstantPool(input, &cf) < 0)
+    if (loadConstantPool(input, cf) < 0)
         return -1;
 
-    if (ru2(&(cf.access_flags), input) < 0)
+    if (ru2(&(cf->access_flags), input) < 0)
         return -1;
-    if (ru2(&(cf.this_class), input) < 0)
+    if (ru2(&(cf->this_class), input) < 0)
         return -1;
-    if (ru2(&(cf.super_class), input) < 0)
+    if (ru2(&(cf->super_class), input) < 0)
         return -1;
-    if (loadInterfaces(input, &cf) < 0)
+    if (loadInterfaces(input, cf) < 0)
         return -1;
-    if (loadFields(input, &cf) < 0)
+    // the run-time model is filled while the rest of the
+    // class file is decoded
+    if (builder->buildHeader() < 0)
         return -1;
-    if (loadMethods(input, &cf) < 0)
+    if (loadFields(input, cf, builder) < 0)
+        return -1;
+    if (loadMethods(input, cf, builder) < 0)
         return -1;
 
-    if (loadAttributes_class(&cf, input,
-                &(cf.attributes_count), &(cf.attributes)) < 0)
+    if (loadAttributes_class(cf, input,
+                &(cf->attributes_count), &(cf->attributes)) < 0)
         return -1;
-    // constant pool validation
-    if (validateConstantPool(&cf) < 0)
+    if (builder->buildAttributes() < 0)
         return -1;
-    if (validateFields(&cf) < 0)
+
+    return 0;
+}
+
+extern int
+parseClassfile(struct BufferIO * input,
+        struct AttributeFilter *attr_filter)
+{
+    ClassFile cf;
+    rt_ClassBuilder builder(&cf);
+    rt_Class *rtc;
+
+    if (decodeClassfile(input, &cf, &builder) < 0)
         return -1;
-    if (validateMethods(&cf) < 0)
+    if (verifyClassfile(&cf, input) < 0)
         return -1;
 
-    rtc = new rt_Class(&cf);
+    rtc = builder.release();
     //if (linkClass(&cf, rtc) < 0)                   return -1;
     //if (logClassHeader(rtc) < 0)                   return -1;
     //if (logFields(rtc) < 0)                        return -1;
@@ -115,11 +131,103 @@ parseClassfile(struct BufferIO * input,
     return 0;
 }
 
+extern rt_Class *
+rt_loadClass(struct BufferIO *input, ClassFile *cf)
+{
+    rt_ClassBuilder builder(cf);
+
+    memset(cf, 0, sizeof (ClassFile));
+    if (decodeClassfile(input, cf, &builder) < 0)
+        return (rt_Class *) 0;
+    return builder.release();
+}
+
 static int
+visitClass(struct BufferIO *input, const char *name,
+        func_visitClass visit, void *arg)
+{
+    ClassFile cf;
+    rt_Class *rtc;
+    int res;
+
+    rtc = rt_loadClass(input, &cf);
+    if (!rtc)
+    {
+        logError("Fail to decode class '%s'!\r\n", name);
+        freeClassfile(&cf);
+        return -1;
+    }
+    res = visit(arg, rtc, &cf, name);
+    delete rtc;
+    freeClassfile(&cf);
+    return res;
+}
+
+static int
+visitJar(const char *path, func_visitClass visit, void *arg)
+{
+    struct zip *z;
+    struct zip_file *zf;
+    struct BufferIO input;
+    zip_int64_t count, i;
+    const char *name;
+    size_t len;
+    int error;
+
+    z = zip_open(path, 0, &error);
+    if (!z)
+    {
+        logError("Fail to open jar '%s', libzip error %i!\r\n", path, error);
+        return -1;
+    }
+    count = zip_get_num_entries(z, 0);
+    for (i = 0; i < count; i++)
+    {
+        name = zip_get_name(z, i, 0);
+        len = name ? strlen(name) : 0;
+        if (len < 6 || strcmp(name + len - 6, ".class"))
+            continue;
+        memset(&input, 0, sizeof (struct BufferIO));
+        zf = zip_fopen_index(z, i, 0);
+        if (!zf)
+        {
+            logError("Fail to open '%s' in '%s'!\r\n", name, path);
+            continue;
+        }
+        // broken classes are skipped, the rest of the jar is still useful
+        if (initWithZipEntry(&input, zf) == 0)
+            visitClass(&input, name, visit, arg);
+        free(input.buffer);
+        zip_fclose(zf);
+    }
+    zip_close(z);
+    return 0;
+}
+
+extern int
+rt_loadClasses(const char *path, func_visitClass visit, void *arg)
+{
+    struct BufferIO input;
+    size_t len;
+    int res;
+
+    len = strlen(path);
+    if (len > 4 && (!strcmp(path + len - 4, ".jar")
+                || !strcmp(path + len - 4, ".zip")))
+        return visitJar(path, visit, arg);
+    memset(&input, 0, sizeof (struct BufferIO));
+    if (initWithFile(&input, path) < 0)
+        return -1;
+    res = visitClass(&input, path, visit, arg);
+    free(input.buffer);
+    fclose(input.file);
+    return res;
+}
+
+extern int
 freeClassfile(ClassFile *cf)
 {
     u2 i;
-    cp_info *cp;
 
     logInfo("Releasing ClassFile memory...\r\n");
     if (cf->interfaces)
@@ -129,29 +237,33 @@ freeClassfile(ClassFile *cf)
     }
     if (cf->fields)
     {
-        freeAttributes_field(cf, cf->fields->attributes_count, cf->fields->attributes);
+        for (i = 0; i < cf->fields_count; i++)
+        {
+            freeAttributes_field(cf, cf->fields[i].attributes_count,
+                    cf->fields[i].attributes);
+            freeMemory(cf->fields[i].attributes);
+        }
         freeMemory(cf->fields);
         cf->fields = (field_info *) 0;
     }
     if (cf->methods)
     {
-        freeAttributes_method(cf, cf->methods->attributes_count, cf->methods->attributes);
+        for (i = 0; i < cf->methods_count; i++)
+        {
+            freeAttributes_method(cf, cf->methods[i].attributes_count,
+                    cf->methods[i].attributes);
+            freeMemory(cf->methods[i].attributes);
+        }
         freeMemory(cf->methods);
         cf->methods = (method_info *) 0;
     }
     freeAttributes_class(cf, cf->attributes_count, cf->attributes);
+    freeMemory(cf->attributes);
+    cf->attributes = (attr_info *) 0;
     // free constant pool at last
     if (cf->constant_pool)
     {
-        for (i = 1u; i < cf->constant_pool_count; i++)
-        {
-            cp = &(cf->constant_pool[i]);
-            if (cp->tag == CONSTANT_Utf8)
-            {
-                freeMemory(cp->info.cud.bytes);
-                cp->info.cud.bytes = (u1 *) 0;
-            }
-        }
+        // Utf8 bytes belong to the symbol table
         freeMemory(cf->constant_pool);
         cf->constant_pool = (cp_info *) 0;
     }
@@ -705,34 +817,8 @@ compareVersion(u2 major_version, u2 minor_version)
 
 extern int isFieldDescriptor(u2 len, u1 *str)
 {
-    u2 i;
-    
-    if (len == 1)
-    {
-        switch (str[0])
-        {
-            case 'B':case 'C':
-            case 'D':case 'F':
-            case 'I':case 'J':
-            case 'S':case 'Z':
-                return 1;
-            default:
-                return 0;
-        }
-    }
-    if (str[0] == '[')
-        return isFieldDescriptor(len - 1, str + 1);
-    else if (str[0] == 'L' && str[len - 1] == ';')
-    {
-        for (i = 1; i < len - 1; i++)
-            if (str[i] != '/' && str[i] != '$'
-                    && (str[i] < 'a' || str[i] > 'z')
-                    && (str[i] < 'A' || str[i] > 'Z')
-                    && (str[i] < '0' || str[i] > '9'))
-                return 0;
-        return 1;
-    }
-    return 0;
+    return scanDescriptor(SCAN_FIELD_DESCRIPTOR, len, str,
+            (struct DescriptorToken *) 0, 0) == 1;
 }
 
 static int
@@ -769,29 +855,107 @@ getConstantLength(u1 tag)
     return 0;
 }
 
+/*
+ * `str` is a scratch buffer of `capacity` bytes,
+ * grown as long strings are met and kept for the whole pool
+ */
 static int
-loadConstant(struct BufferIO *input, cp_info *info)
+loadConstant(struct BufferIO *input, cp_info *info,
+        u1 **str, u4 *capacity)
 {
     u1      tag;
     int     length;
     u2      len;
-    u1 *    str;
+    struct Symbol *
+            sym;
+    u4      high_bytes, low_bytes;
+    u8      bits;
 
     if (ru1(&tag, input) < 0)                       return -1;
 
     if (tag == CONSTANT_Utf8)
     {
         if (ru2(&len, input) < 0)                   return -1;
-        str = (u1 *) allocMemory(sizeof (u1), len);
-        if (!str)                                   return -1;
-        if (rbs(str, input, len) < 0)               return -1;
+        if (!*str || len > *capacity)
+        {
+            freeMemory(*str);
+            *capacity = 0;
+            *str = (u1 *) allocMemory(len, sizeof (u1));
+            if (!*str)                              return -1;
+            *capacity = len;
+        }
+        if (rbs(*str, input, len) < 0)              return -1;
+        // equal strings of all classes share one copy
+        sym = symbol_intern(len, *str);
+        if (!sym)                                   return -1;
         info->info.cud.length = len;
-        info->info.cud.bytes = str;
+        info->info.cud.bytes = sym->bytes;
+        length = len;
     }
     else
     {
+        // items are big-endian and the structures
+        // may be padded, so each item is read on its own
         length = getConstantLength(tag);
-        if (rbs((u1 *) &(info->info), input, length) < 0)  return -1;
+        switch (tag)
+        {
+            case CONSTANT_Class:
+                if (ru2(&(info->info.ccd.name_index), input) < 0)
+                    return -1;
+                break;
+            case CONSTANT_String:
+                if (ru2(&(info->info.csd.string_index), input) < 0)
+                    return -1;
+                break;
+            case CONSTANT_MethodType:
+                if (ru2(&(info->info.cmtd.descriptor_index), input) < 0)
+                    return -1;
+                break;
+            case CONSTANT_Fieldref:
+            case CONSTANT_Methodref:
+            case CONSTANT_InterfaceMethodref:
+                if (ru2(&(info->info.cfd.class_index), input) < 0)
+                    return -1;
+                if (ru2(&(info->info.cfd.name_and_type_index), input) < 0)
+                    return -1;
+                break;
+            case CONSTANT_NameAndType:
+                if (ru2(&(info->info.cnd.name_index), input) < 0)
+                    return -1;
+                if (ru2(&(info->info.cnd.descriptor_index), input) < 0)
+                    return -1;
+                break;
+            case CONSTANT_Integer:
+            case CONSTANT_Float:
+                if (ru4(&(info->info.cid.bytes), input) < 0)
+                    return -1;
+                break;
+            case CONSTANT_Long:
+            case CONSTANT_Double:
+                if (ru4(&high_bytes, input) < 0)
+                    return -1;
+                if (ru4(&low_bytes, input) < 0)
+                    return -1;
+                bits = ((u8) high_bytes << 32) | low_bytes;
+                memcpy(&(info->info.cld.long_value), &bits, sizeof (u8));
+                break;
+            case CONSTANT_MethodHandle:
+                if (ru1(&(info->info.cmhd.reference_kind), input) < 0)
+                    return -1;
+                if (ru2(&(info->info.cmhd.reference_index), input) < 0)
+                    return -1;
+                break;
+            case CONSTANT_InvokeDynamic:
+                if (ru2(&(info->info.cidd.bootstrap_method_attr_index),
+                            input) < 0)
+                    return -1;
+                if (ru2(&(info->info.cidd.name_and_type_index), input) < 0)
+                    return -1;
+                break;
+            default:
+                logError("Unknown constant pool tag [%i]!\r\n", tag);
+                return -1;
+        }
     }
 
     info->tag = tag;
@@ -804,6 +968,9 @@ loadConstantPool(struct BufferIO *input, ClassFile *cf)
 {
     u2 i;
     cp_info *                       info;
+    u1 *                            str;
+    u4                              capacity;
+    int                             res;
     
     // retrieve constant pool size
     if (ru2(&(cf->constant_pool_count), input) < 0)
@@ -816,13 +983,35 @@ loadConstantPool(struct BufferIO *input, ClassFile *cf)
         cf->constant_pool = (cp_info *) allocMemory(cf->constant_pool_count, sizeof (cp_info));
         if (!cf->constant_pool) return -1;
 
+        str = (u1 *) 0;
+        capacity = 0;
+        res = 0;
         // jvms7 says "The constant_pool table is indexed
         // from 1 to constant_pool_count - 1
         for (i = 1u; i < cf->constant_pool_count; i++)
         { // LOOP
             info = &(cf->constant_pool[i]);
-            if (loadConstant(input, info) < 0) return -1;
+            if (loadConstant(input, info, &str, &capacity) < 0)
+            {
+                res = -1;
+                break;
+            }
+            // 8-byte constants take up two entries,
+            // the second one is left unusable
+            if (info->tag == CONSTANT_Long
+                    || info->tag == CONSTANT_Double)
+            {
+                if (++i >= cf->constant_pool_count)
+                {
+                    logError("8-byte constant @ the last entry "
+                            "of constant pool!\r\n");
+                    res = -1;
+                    break;
+                }
+            }
         } // LOOP
+        freeMemory(str);
+        return res;
     }
     
     return 0;
@@ -856,7 +1045,8 @@ loadInterfaces(struct BufferIO *input, ClassFile *cf)
 }
 
 static int
-loadFields(struct BufferIO *input, ClassFile *cf)
+loadFields(struct BufferIO *input, ClassFile *cf,
+        rt_ClassBuilder *builder)
 {
     u2 i;
     
@@ -869,6 +1059,7 @@ loadFields(struct BufferIO *input, ClassFile *cf)
     {
         cf->fields = (field_info *) allocMemory(cf->fields_count, sizeof (field_info));
         if (!cf->fields) return -1;
+        if (builder->buildFields() < 0) return -1;
         for (i = 0u; i < cf->fields_count; i++)
         {
             if (ru2(&(cf->fields[i].access_flags), input) < 0)
@@ -886,8 +1077,11 @@ loadFields(struct BufferIO *input, ClassFile *cf)
                 logError("IO exception in function %s!\r\n", __func__);
                 return -1;
             }
-            loadAttributes_field(cf, input, &(cf->fields[i]),
-                    &(cf->fields[i].attributes_count), &(cf->fields[i].attributes));
+            if (loadAttributes_field(cf, input, &(cf->fields[i]),
+                    &(cf->fields[i].attributes_count), &(cf->fields[i].attributes)) < 0)
+                return -1;
+            if (builder->buildField(i) < 0)
+                return -1;
         }
     }
     
@@ -895,7 +1089,8 @@ loadFields(struct BufferIO *input, ClassFile *cf)
 }
 
 static int
-loadMethods(struct BufferIO *input, ClassFile *cf)
+loadMethods(struct BufferIO *input, ClassFile *cf,
+        rt_ClassBuilder *builder)
 {
     u2 i;
     
@@ -908,6 +1103,7 @@ loadMethods(struct BufferIO *input, ClassFile *cf)
     {
         cf->methods = (method_info *) allocMemory(cf->methods_count, sizeof (method_info));
         if (!cf->methods) return -1;
+        if (builder->buildMethods() < 0) return -1;
         for (i = 0u; i < cf->methods_count; i++)
         {
             if (ru2(&(cf->methods[i].access_flags), input) < 0)
@@ -925,8 +1121,11 @@ loadMethods(struct BufferIO *input, ClassFile *cf)
                 logError("IO exception in function %s!\r\n", __func__);
                 return -1;
             }
-            loadAttributes_method(cf, input, &(cf->methods[i]),
-                    &(cf->methods[i].attributes_count), &(cf->methods[i].attributes));
+            if (loadAttributes_method(cf, input, &(cf->methods[i]),
+                    &(cf->methods[i].attributes_count), &(cf->methods[i].attributes)) < 0)
+                return -1;
+            if (builder->buildMethod(i) < 0)
+                return -1;
         }
     }
     
@@ -1084,66 +1283,75 @@ error:
     return -1;
 }
 
+// Java source form of one type of a descriptor
 static int
-writeFieldDescriptor(char *out, u2 len, u1 *str)
+writeType(char *out, u1 *str, struct DescriptorToken *token)
 {
-    u2 i, j, m, n;
+    char *src;
+    int i, n;
 
-    if (len == 1)
-    {
-        switch (str[0])
-        {
-            case 'B':
-                return sprintf(out, "byte");
-            case 'C':
-                return sprintf(out, "char");
-            case 'D':
-                return sprintf(out, "double");
-            case 'F':
-                return sprintf(out, "float");
-            case 'I':
-                return sprintf(out, "int");
-            case 'J':
-                return sprintf(out, "long");
-            case 'S':
-                return sprintf(out, "short");
-            case 'Z':
-                return sprintf(out, "boolean");
-            // return type only
-            case 'V':
-                return sprintf(out, "void");
-            default:
-                return -1;
-        }
-    }
-    else
+    src = out;
+    switch (token->type)
     {
-        if (str[0] == '[')
-        {
-            for (i = 1; i < len; i++)
-                if (str[i] != '[')
-                    break;
-            m = writeFieldDescriptor(out, len - i, str + i);
-            if (m < 0) return -1;
-            for (j = 0; j < i; j++)
-            {
-                n = sprintf(out + m + j * 2, "[]");
-                if (n != 2) return -1;
-            }
-            return m + i * 2;
-        }
-        else if (str[0] == 'L')
-        {
-            len -= 2;
-            ++str;
-            m = sprintf(out, "%.*s", len, str);
-            if (m != len) return -1;
-            for (i = 0; i < len; i++)
+        case 'B':
+            n = sprintf(out, "byte");
+            break;
+        case 'C':
+            n = sprintf(out, "char");
+            break;
+        case 'D':
+            n = sprintf(out, "double");
+            break;
+        case 'F':
+            n = sprintf(out, "float");
+            break;
+        case 'I':
+            n = sprintf(out, "int");
+            break;
+        case 'J':
+            n = sprintf(out, "long");
+            break;
+        case 'S':
+            n = sprintf(out, "short");
+            break;
+        case 'Z':
+            n = sprintf(out, "boolean");
+            break;
+        // return type only
+        case 'V':
+            n = sprintf(out, "void");
+            break;
+        case 'L':
+            // strip 'L' and ';'
+            n = sprintf(out, "%.*s",
+                    token->length - token->dimensions - 2,
+                    str + token->offset + token->dimensions + 1);
+            for (i = 0; i < n; i++)
                 if (out[i] == '/')
                     out[i] = '.';
-            return m;
-        }
+            break;
+        default:
+            return -1;
     }
+    if (n < 0) return -1;
+    out += n;
+    for (i = 0; i < token->dimensions; i++)
+    {
+        n = sprintf(out, "[]");
+        if (n != 2) return -1;
+        out += n;
+    }
+    return out - src;
+}
+
+static int
+writeFieldDescriptor(char *out, u2 len, u1 *str)
+{
+    struct DescriptorToken token;
+
+    if (scanDescriptor(SCAN_FIELD_DESCRIPTOR, len, str, &token, 1) != 1)
+        return -1;
+    return writeType(out, str, &token);
 }
 
 static int
@@ -1181,14 +1389,13 @@ logFields(rt_Class *rtc)
 {
 #if (defined DEBUG && defined LOG_INFO)
     char buf[1024], *ptr;
-    u2 i, j;
+    u2 i;
     u2 fields_count;
-    rt_Field **fields, *field;
+    rt_Span<rt_Field> fields;
+    rt_Field *field;
     u2 access_flags;
     u2 name_index;
     u2 descriptor_index;
-    u2 attributes_count;
-    attr_info *attributes;
     attr_info *attribute;
     size_t n;
     const_Utf8_data *name, *descriptor;
@@ -1208,15 +1415,12 @@ logFields(rt_Class *rtc)
 
     for (i = 0; i < fields_count; i++)
     {
-        field = fields[i];
+        field = &(fields[i]);
 
         access_flags = field->getAccessFlags();
         name = field->getName();
         descriptor = field->getDescriptor();
 
-        attributes_count = field->getAttributes()->attributes_count;
-        attributes = field->getAttributes()->attributes;
-
         n = sprintf(ptr, "\t");
         if (n < 0) return -1;
         ptr += n;
@@ -1289,13 +1493,11 @@ logFields(rt_Class *rtc)
 
         if ((access_flags & ACC_FINAL) && !(access_flags & ACC_ENUM))
         {
-            // retrieve constant value
-            for (j = 0; j < attributes_count; j++)
+            // retrieve constant value,
+            // there's at most one ConstantValue attribute
+            attribute = field->findAttribute(TAG_ATTR_CONSTANTVALUE);
+            if (attribute)
             {
-                attribute = &(attributes[j]);
-                if (attribute->tag != TAG_ATTR_CONSTANTVALUE)
-                    continue;
-
                 n = sprintf(ptr, " = ");
                 if (n < 0) return -1;
                 ptr += n;
@@ -1348,10 +1550,6 @@ logFields(rt_Class *rtc)
                         ptr += n;
                         break;
                 }
-
-                // exit the loop coz there's
-                // at most one ConstantValue attribute
-                break;
             }
         }
         n = sprintf(ptr, ";\r\n");
@@ -1372,43 +1570,24 @@ struct ParameterTable
 
 static int
 writeParameterTable(char *out,
-        rt_Method *method,
-        u2 len, u1 *str)
+        rt_Method *method, u1 *str,
+        struct DescriptorToken *tokens, int count)
 {
     char *src;
-    size_t n;
-    u2 i, j;
-    u2 m;
-    u1 *p;
-    u2 count;
-    u2 access_flags;
-    u1 parameter_type;
+    int i, n;
+    u2 index;
 
     src = out;
     *out++ = '(';
-    --len;
-    ++str;
 
     // instance methods start with 'this' parameter
-    access_flags = method->getAccessFlags();
-    if (access_flags & ACC_STATIC)
-        count = 0;
+    if (method->getAccessFlags() & ACC_STATIC)
+        index = 0;
     else
-        count = 1;
+        index = 1;
 
-    for (i = 0; i < len; i++)
+    for (i = 0; i < count; i++)
     {
-        if (str[i] == ')')
-        {
-            // remove " {\r\n" coz some methods
-            // with ACC_NATIVE, ACC_ABSTRACT flags
-            // end with ';'
-            n = sprintf(out, ")");
-            if (n < 0) return -1;
-            out += n;
-            break;
-        }
-
         if (i > 0)
         {
             n = sprintf(out, ", ");
@@ -1416,51 +1595,22 @@ writeParameterTable(char *out,
             out += n;
         }
 
-        j = i;
-        parameter_type = 1;
-        // Object parameter
-        if (str[i] == 'L')
-        {
-            for (++j; j < len; j++)
-                if (str[j] == ';')
-                    break;
-            m = j + 1 - i;
-        }
-        // Array parameter
-        else if (str[i] == '[')
-        {
-            for (++j; j < len; j++)
-                if (str[j] != '[')
-                    break;
-            if (str[j] == 'L')
-                for (++j; j < len; j++)
-                    if (str[j] == ';')
-                        break;
-            m = j + 1 - i;
-        }
-        // Primitive parameter
-        else
-        {
-            m = 1;
-            // detect long/double parameter
-            if (str[i] == 'J'
-                    || str[i] == 'D')
-                parameter_type = 2;
-        }
-        p = str + i;
-        i = j;
-
-        n = writeFieldDescriptor(out, m, p);
+        n = writeType(out, str, &(tokens[i]));
         if (n < 0) return -1;
         out += n;
 
         // parameter name
-        n = sprintf(out, " param%i", count++);
+        n = sprintf(out, " param%i", index++);
         if (n < 0) return -1;
         out += n;
     }
 
-    //method->parameters_count = count;
+    // remove " {\r\n" coz some methods
+    // with ACC_NATIVE, ACC_ABSTRACT flags
+    // end with ';'
+    n = sprintf(out, ")");
+    if (n < 0) return -1;
+    out += n;
 
     return out - src;
 }
@@ -1534,10 +1684,10 @@ logMethods(rt_Class *rtc)
     size_t n;
     u2 i, j;
     u2 methods_count;
-    rt_Method **methods, *method;
+    rt_Span<rt_Method> methods;
+    rt_Method *method;
     u2 access_flags, name_index, descriptor_index;
-    u2 attributes_count;
-    attr_info *attributes, *attribute;
+    attr_info *attribute;
     const_Utf8_data *class_name;
     const_Utf8_data *name, *descriptor;
     attr_Code_info *code;
@@ -1547,6 +1697,8 @@ logMethods(rt_Class *rtc)
     int has_method_body;
     const_Class_data *cci;
     const_Utf8_data *cui;
+    struct DescriptorToken tokens[256];
+    int tokens_count;
 
     memset(buf, 0, sizeof (buf));
     methods_count = rtc->getMethodsCount();
@@ -1557,15 +1709,12 @@ logMethods(rt_Class *rtc)
 
     for (i = 0; i < methods_count; i++)
     {
-        method = methods[i];
+        method = &(methods[i]);
 
         access_flags = method->getAccessFlags();
         name = method->getName();
         descriptor = method->getDescriptor();
 
-        attributes_count = method->getAttributes()->attributes_count;
-        attributes = method->getAttributes()->attributes;
-
         // note ACC_NATIVE, ACC_VARARGS
         // initialize Code attribute & Exceptions attribute
         code = (attr_Code_info *) 0;
@@ -1647,6 +1796,11 @@ logMethods(rt_Class *rtc)
             ptr += n;
         }
 
+        // parameters and return type, the last token
+        tokens_count = scanDescriptor(SCAN_METHOD_DESCRIPTOR,
+                descriptor->length, descriptor->bytes, tokens, 256);
+        if (tokens_count < 1 || tokens_count > 256) return -1;
+
         // write method name
         // static initializer has no name
         if (strncmp("<clinit>",
@@ -1666,24 +1820,13 @@ logMethods(rt_Class *rtc)
             else
             {
                 // return type
-                for (j = descriptor->length - 1;
-                        j > 0; j--)
-                {
-                    if (descriptor->bytes[j] != ')')
-                        continue;
-
-                    ++j;
-                    n = writeFieldDescriptor(ptr,
-                            descriptor->length - j,
-                            descriptor->bytes + j);
-                    if (n < 0) return -1;
-                    ptr += n;
-                    n = sprintf(ptr, " ");
-                    if (n < 0) return -1;
-                    ptr += n;
-
-                    break;
-                }
+                n = writeType(ptr, descriptor->bytes,
+                        &(tokens[tokens_count - 1]));
+                if (n < 0) return -1;
+                ptr += n;
+                n = sprintf(ptr, " ");
+                if (n < 0) return -1;
+                ptr += n;
 
                 // method name
                 n = sprintf(ptr, "%.*s",
@@ -1696,8 +1839,8 @@ logMethods(rt_Class *rtc)
             // parameter table
             n = writeParameterTable(ptr,
                     method,
-                    descriptor->length,
-                    descriptor->bytes);
+                    descriptor->bytes,
+                    tokens, tokens_count - 1);
             if (n < 0) return -1;
             ptr += n;
         }
@@ -1708,27 +1851,17 @@ logMethods(rt_Class *rtc)
 
         has_method_body = !(access_flags & (ACC_NATIVE | ACC_ABSTRACT));
 
-        for (j = 0; j < attributes_count; j++)
-        {
-            attribute = &(attributes[j]);
-
-            if (attribute->tag != TAG_ATTR_EXCEPTIONS)
-                continue;
+        attribute = method->findAttribute(TAG_ATTR_EXCEPTIONS);
+        if (attribute)
             exceptions = (attr_Exceptions_info *)
                 attribute->data;
-            break;
-        }
         if (has_method_body)
-            for (j = 0; j < attributes_count; j++)
-            {
-                attribute = &(attributes[j]);
-
-                if (attribute->tag != TAG_ATTR_CODE)
-                    continue;
+        {
+            attribute = method->findAttribute(TAG_ATTR_CODE);
+            if (attribute)
                 code = (attr_Code_info *)
                     attribute->data;
-                break;
-            }
+        }
 
         // analyze Exceptions attribute
         if (exceptions)
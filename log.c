@@ -6,6 +6,15 @@
 #include "input.h"
 #include "log.h"
 
+static int info_enabled = 1;
+
+// modes answering on stdout keep it clean
+extern void
+enableInfo(int enabled)
+{
+    info_enabled = enabled;
+}
+
 extern int
 logInfo(const char *format, ...)
 {
@@ -13,6 +22,8 @@ logInfo(const char *format, ...)
     int res;
     va_list vl;
 
+    if (!info_enabled)
+        return 0;
     va_start(vl, format);
     res = vfprintf(stdout, format, vl);
     va_end(vl);
@@ -5,6 +5,9 @@
 #include <signal.h>
 
 #include "java.h"
+#include "vrf.h"
+#include "trace.h"
+#include "bench.h"
 #include "memory.h"
 #include "log.h"
 
@@ -14,6 +17,17 @@
 #define OPTION_FIELD_FILTER     "--field_filter"
 #define OPTION_METHOD_FILTER    "--method_filter"
 #define OPTION_CODE_FILTER      "--code_filter"
+#define OPTION_VERIFY_THREADS   "--verify_threads="
+#define OPTION_VERIFY           "--verify="
+#define OPTION_VERIFY_CACHE     "--verify_cache="
+#define OPTION_SYMBOLIZE        "--symbolize="
+#define OPTION_SYMBOLIZE_SOCKET "--symbolize_socket="
+#define OPTION_BENCH            "--bench="
+#define BENCH_MEMBERS           "members:"
+#define BENCH_ANALYSIS          "analysis:"
+#define BENCH_STATEMENTS        "statements:"
+
+#define SEPERATOR_CLASSPATH     ':'
 
 #define OPTION_DISASSEMBLE      "-a"
 #define MARK_DISASSEMBLE        0x0001
@@ -23,9 +37,15 @@
 static void generateFilter(struct AttributeFilter *, int, char *);
 static void interpreteFilter(struct AttributeFilter *, int, char **);
 static int interpreteFlags(int, char **);
+static int interpreteVerifyLevel(const char *);
+static void logVerifyStats();
+static int symbolize(int, char **);
+static int benchPaths(char *, int (*)(int, char **));
+static int bench(char *);
 
 /*
- * ./cruise [-a] [-c] [--class_filter=<filterA|filterB>] [--field_filter=<filterC>] [--method_filter=<filterD>] [--code_filter=<filterE>]
+ * ./cruise [-a] [-c] [--class_filter=<filterA|filterB>] [--field_filter=<filterC>] [--method_filter=<filterD>] [--code_filter=<filterE>] [--verify=<none|structural|full>] [--verify_threads=<n>] [--verify_cache=<dir>]
+ * ./cruise --symbolize=<a.jar:b.jar:C.class> [--symbolize_socket=<path>]
  */
 int
 main(int argc, char** argv)
@@ -36,7 +56,18 @@ main(int argc, char** argv)
     time_t t;
     int flags;
     int result;
+    int i;
 
+    for (i = 1; i < argc; i++)
+    {
+        if (strncmp(argv[i], OPTION_SYMBOLIZE,
+                    sizeof (OPTION_SYMBOLIZE) - 1) == 0)
+            return symbolize(argc, argv);
+        // not in the usage, benchmarks are for development
+        if (strncmp(argv[i], OPTION_BENCH,
+                    sizeof (OPTION_BENCH) - 1) == 0)
+            return bench(argv[i] + sizeof (OPTION_BENCH) - 1);
+    }
     if (argc < 2)
     {
         logError("Usage: %s <classfile_absolute_path>\r\n", argv[0]);
@@ -49,6 +80,8 @@ main(int argc, char** argv)
     time(&t);
 
     flags = interpreteFlags(argc, argv);
+    if (flags < 0)
+        return -1;
     interpreteFilter(&filter, argc, argv);
     logInfo("Classfile '%s'...\r\n", path);
 
@@ -66,17 +99,143 @@ main(int argc, char** argv)
 good_end:
     logInfo("Succeed! Time used: %.2f seconds.\r\n",
             difftime(time(0), t));
+    logVerifyStats();
     return 0;
 bad_end:
     logInfo("Fail! Time used: %.2f seconds.\r\n",
             difftime(time(0), t));
+    logVerifyStats();
+    return -1;
+}
+
+/*
+ * Indexes the jars and classes given, then answers stack frames
+ * from stdin, or from clients of a Unix socket, see trace.h
+ */
+static int
+symbolize(int argc, char **argv)
+{
+    struct TraceIndex index;
+    char *paths, *path, *next, *socket;
+    int i, result;
+
+    paths = (char *) 0;
+    socket = (char *) 0;
+    for (i = 1; i < argc; i++)
+    {
+        if (strncmp(argv[i], OPTION_SYMBOLIZE,
+                    sizeof (OPTION_SYMBOLIZE) - 1) == 0)
+            paths = argv[i] + sizeof (OPTION_SYMBOLIZE) - 1;
+        else if (strncmp(argv[i], OPTION_SYMBOLIZE_SOCKET,
+                    sizeof (OPTION_SYMBOLIZE_SOCKET) - 1) == 0)
+            socket = argv[i] + sizeof (OPTION_SYMBOLIZE_SOCKET) - 1;
+    }
+    // answers go to stdout
+    enableInfo(0);
+    initTraceIndex(&index);
+    for (path = paths; path && *path; path = next)
+    {
+        next = strchr(path, SEPERATOR_CLASSPATH);
+        if (next)
+            *next++ = '\0';
+        if (*path && indexTraceFile(&index, path) < 0)
+            logError("Fail to index '%s'!\r\n", path);
+    }
+    sortTraceIndex(&index);
+    flogError(stderr, "Indexed %u class(es).\r\n", index.classes_count);
+    if (socket)
+        result = serveTraceSocket(&index, socket);
+    else
+        result = serveTraces(&index, 0, 1);
+    releaseTraceIndex(&index);
+    return result;
+}
+
+// runs `run` over the paths of a ':' separated list
+static int
+benchPaths(char *list, int (*run)(int, char **))
+{
+    char **paths, *path, *next;
+    long count;
+    int result;
+
+    count = 1;
+    for (path = list; *path; path++)
+        count += *path == SEPERATOR_CLASSPATH;
+    paths = (char **) allocMemory(count, sizeof (char *));
+    if (!paths)
+        return -1;
+    count = 0;
+    for (path = list; path; path = next)
+    {
+        next = strchr(path, SEPERATOR_CLASSPATH);
+        if (next)
+            *next++ = '\0';
+        if (*path)
+            paths[count++] = path;
+    }
+    result = run((int) count, paths);
+    freeMemory(paths);
+    return result;
+}
+
+static int
+bench(char *name)
+{
+    long count;
+
+    if (strncmp(name, BENCH_ANALYSIS, sizeof (BENCH_ANALYSIS) - 1) == 0)
+        return benchPaths(name + sizeof (BENCH_ANALYSIS) - 1, benchAnalysis);
+    if (strncmp(name, BENCH_STATEMENTS, sizeof (BENCH_STATEMENTS) - 1) == 0)
+        return benchPaths(name + sizeof (BENCH_STATEMENTS) - 1,
+                listStatements);
+    if (strncmp(name, BENCH_MEMBERS, sizeof (BENCH_MEMBERS) - 1) == 0)
+    {
+        count = strtol(name + sizeof (BENCH_MEMBERS) - 1, (char **) 0, 10);
+        if (count < 1 || count > 0xfffd)
+        {
+            logError("Member count should be in [1, 65533]!\r\n");
+            return -1;
+        }
+        return benchMembers((u2) count);
+    }
+    logError("Unknown benchmark '%s'!\r\n", name);
+    return -1;
+}
+
+static void
+logVerifyStats()
+{
+    struct VerifyStats *stats;
+
+    stats = getVerifyStats();
+    if (!stats->classes)
+        return;
+    logInfo("Verified %u class(es), %u from cache: "
+            "structural %.3f ms, full %.3f ms.\r\n",
+            stats->classes, stats->cache_hits,
+            stats->seconds[VERIFY_STRUCTURAL] * 1e3,
+            stats->seconds[VERIFY_FULL] * 1e3);
+}
+
+static int
+interpreteVerifyLevel(const char *level)
+{
+    if (strcmp(level, "none") == 0)
+        return VERIFY_NONE;
+    if (strcmp(level, "structural") == 0)
+        return VERIFY_STRUCTURAL;
+    if (strcmp(level, "full") == 0)
+        return VERIFY_FULL;
+    logError("Unknown verification level '%s', "
+            "expected none, structural or full!\r\n", level);
     return -1;
 }
 
 static int
 interpreteFlags(int argc, char **argv)
 {
-    int i, res;
+    int i, res, level;
 
     res = 0;
     for (i = 1; i < argc - 1; i++)
@@ -89,6 +248,30 @@ interpreteFlags(int argc, char **argv)
         {
             res |= MARK_DECOMPILE;
         }
+        else if (strncmp(argv[i], OPTION_VERIFY_THREADS,
+                    sizeof (OPTION_VERIFY_THREADS) - 1) == 0)
+        {
+            // method bodies are verified by this many threads
+            setVerifyThreads(atoi(argv[i]
+                        + sizeof (OPTION_VERIFY_THREADS) - 1));
+        }
+        else if (strncmp(argv[i], OPTION_VERIFY,
+                    sizeof (OPTION_VERIFY) - 1) == 0)
+        {
+            level = interpreteVerifyLevel(argv[i]
+                    + sizeof (OPTION_VERIFY) - 1);
+            if (level < 0)
+                return -1;
+            setVerifyLevel(level);
+        }
+        else if (strncmp(argv[i], OPTION_VERIFY_CACHE,
+                    sizeof (OPTION_VERIFY_CACHE) - 1) == 0)
+        {
+            // results are reused for identical class files
+            if (setVerifyCache(argv[i]
+                        + sizeof (OPTION_VERIFY_CACHE) - 1) < 0)
+                return -1;
+        }
     }
 
     return res;
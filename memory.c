@@ -1,5 +1,7 @@
 #include <stdlib.h>
+#include <stddef.h>
 #include <string.h>
+#include <pthread.h>
 
 #include "memory.h"
 #include "java.h"
@@ -60,6 +62,8 @@ trimMemory(void *mem)
     return res;
 }
 
+#define DEQUE_INITIAL_CAPACITY          16
+
 extern struct Deque *
 deque_createDeque()
 {
@@ -67,53 +71,115 @@ deque_createDeque()
 
     deque = (struct Deque *) allocMemory(1, sizeof (struct Deque));
     if (!deque) return (struct Deque *) 0;
-    deque->first = deque->last = (struct DequeEntry *) 0;
+    deque->entries = (struct DequeEntry *) 0;
+    deque->capacity = deque->head = deque->count = 0;
 
     return deque;
 }
 
+extern void
+deque_releaseDeque(struct Deque *deque)
+{
+    if (!deque)
+        return;
+    freeMemory(deque->entries);
+    freeMemory(deque);
+}
+
 extern void
 deque_releaseEntry(struct DequeEntry *entry)
 {
-    freeMemory(entry);
+    // entries are owned by their deque
+    (void) entry;
+}
+
+extern int
+deque_size(struct Deque *deque)
+{
+    return deque ? deque->count : 0;
 }
 
+/*
+ * Returns the entry at `index`, counting from the first one
+ */
 extern struct DequeEntry *
-deque_removeFirst(struct Deque *deque)
+deque_get(struct Deque *deque, int index)
 {
-    struct DequeEntry *first;
+    if (!deque || index < 0 || index >= deque->count)
+        return (struct DequeEntry *) 0;
+
+    return &(deque->entries[(deque->head + index) & (deque->capacity - 1)]);
+}
 
+/*
+ * Makes room for at least `count` entries,
+ * entries are moved to the start of the new buffer
+ */
+static int
+deque_reserve(struct Deque *deque, int count)
+{
+    struct DequeEntry *entries;
+    int capacity, n;
+
+    if (count <= deque->capacity)
+        return 0;
+    capacity = deque->capacity ? deque->capacity : DEQUE_INITIAL_CAPACITY;
+    while (capacity < count)
+        capacity <<= 1;
+    entries = (struct DequeEntry *)
+        allocMemory(capacity, sizeof (struct DequeEntry));
+    if (!entries) return -1;
+    if (deque->count > 0)
+    {
+        // copy the run up to the end of the buffer, then the wrapped run
+        n = deque->capacity - deque->head;
+        if (n > deque->count)
+            n = deque->count;
+        memcpy(entries, &(deque->entries[deque->head]),
+                n * sizeof (struct DequeEntry));
+        memcpy(&(entries[n]), deque->entries,
+                (deque->count - n) * sizeof (struct DequeEntry));
+    }
+    freeMemory(deque->entries);
+    deque->entries = entries;
+    deque->capacity = capacity;
+    deque->head = 0;
+
+    return 0;
+}
+
+extern struct DequeEntry *
+deque_removeFirst(struct Deque *deque)
+{
     if (!deque)
     {
         logError("Parameter 'deque' is NULL in method %s!\r\n", __func__);
         return (struct DequeEntry *) 0;
     }
-    if (first = deque->first)
-        if (deque->first = first->next)
-            deque->first->prev = first->prev = first->next = (struct DequeEntry *) 0;
-        else
-            deque->last = (struct DequeEntry *) 0;
+    if (deque->count == 0)
+        return (struct DequeEntry *) 0;
+    deque->removed = deque->entries[deque->head];
+    deque->head = (deque->head + 1) & (deque->capacity - 1);
+    --deque->count;
 
-    return first;
+    return &(deque->removed);
 }
 
 extern struct DequeEntry *
 deque_removeLast(struct Deque *deque)
 {
-    struct DequeEntry *last;
-
     if (!deque)
     {
         logError("Parameter 'deque' is NULL in method %s!\r\n", __func__);
         return (struct DequeEntry *) 0;
     }
-    if (last = deque->last)
-        if (deque->last = last->prev)
-            deque->last->next = last->prev = last->next = (struct DequeEntry *) 0;
-        else
-            deque->first = (struct DequeEntry *) 0;
+    if (deque->count == 0)
+        return (struct DequeEntry *) 0;
+    --deque->count;
+    deque->removed = deque->entries[
+        (deque->head + deque->count) & (deque->capacity - 1)];
 
-    return last;
+    return &(deque->removed);
 }
 
 extern struct DequeEntry *
@@ -132,17 +198,13 @@ deque_addFirst(struct Deque *deque, int size, void *value)
         logError("Parameter 'deque' is NULL in method %s!\r\n", __func__);
         return -1;
     }
-    entry = (struct DequeEntry *) allocMemory(1, sizeof (struct DequeEntry));
-    if (!entry) return -1;
+    if (deque_reserve(deque, deque->count + 1) < 0)
+        return -1;
+    deque->head = (deque->head - 1) & (deque->capacity - 1);
+    entry = &(deque->entries[deque->head]);
     entry->size = size;
     entry->value = value;
-    entry->prev = (struct DequeEntry *) 0;
-    entry->next = deque->first;
-    if (deque->first)
-        deque->first->prev = entry;
-    else // deque was empty
-        deque->last = entry;
-    deque->first = entry;
+    ++deque->count;
 
     return 0;
 }
@@ -157,17 +219,44 @@ deque_addLast(struct Deque *deque, int size, void *value)
         logError("Parameter 'deque' is NULL in method %s!\r\n", __func__);
         return -1;
     }
-    entry = (struct DequeEntry *) allocMemory(1, sizeof (struct DequeEntry));
-    if (!entry) return -1;
+    if (deque_reserve(deque, deque->count + 1) < 0)
+        return -1;
+    entry = &(deque->entries[
+            (deque->head + deque->count) & (deque->capacity - 1)]);
     entry->size = size;
     entry->value = value;
-    entry->prev = deque->last;
-    entry->next = (struct DequeEntry *) 0;
-    if (deque->last)
-        deque->last->next = entry;
-    else // deque is empty
-        deque->first = entry;
-    deque->last = entry;
+    ++deque->count;
+
+    return 0;
+}
+
+/*
+ * Appends `count` entries at once,
+ * growing the buffer at most once
+ */
+extern int
+deque_addAllLast(struct Deque *deque, int count, struct DequeEntry *entries)
+{
+    int tail, n;
+
+    if (!deque)
+    {
+        logError("Parameter 'deque' is NULL in method %s!\r\n", __func__);
+        return -1;
+    }
+    if (count <= 0)
+        return 0;
+    if (deque_reserve(deque, deque->count + count) < 0)
+        return -1;
+    tail = (deque->head + deque->count) & (deque->capacity - 1);
+    n = deque->capacity - tail;
+    if (n > count)
+        n = count;
+    memcpy(&(deque->entries[tail]), entries,
+            n * sizeof (struct DequeEntry));
+    memcpy(deque->entries, &(entries[n]),
+            (count - n) * sizeof (struct DequeEntry));
+    deque->count += count;
 
     return 0;
 }
@@ -178,16 +267,580 @@ deque_push(struct Deque *deque, int size, void *value)
     return deque_addFirst(deque, size, value);
 }
 
+/*
+ * Pushes `count` entries in order, as many calls to deque_push
+ * would, so the last one ends up first; grows at most once
+ */
+extern int
+deque_pushAll(struct Deque *deque, int count, struct DequeEntry *entries)
+{
+    int i;
+
+    if (!deque)
+    {
+        logError("Parameter 'deque' is NULL in method %s!\r\n", __func__);
+        return -1;
+    }
+    if (count <= 0)
+        return 0;
+    if (deque_reserve(deque, deque->count + count) < 0)
+        return -1;
+    for (i = 0; i < count; i++)
+    {
+        deque->head = (deque->head - 1) & (deque->capacity - 1);
+        deque->entries[deque->head] = entries[i];
+    }
+    deque->count += count;
+
+    return 0;
+}
+
+/*
+ * Bump allocator
+ */
+#define ARENA_CHUNK_SIZE                65536
+#define ARENA_ALIGNMENT                 8
+
+struct ArenaChunk
+{
+    struct ArenaChunk *next;
+    size_t size;
+    size_t used;
+    u1 bytes[] __attribute__((aligned(ARENA_ALIGNMENT)));
+};
+
+extern void
+arena_init(struct Arena *arena)
+{
+    arena->first = arena->current = (struct ArenaChunk *) 0;
+}
+
+extern void
+arena_release(struct Arena *arena)
+{
+    struct ArenaChunk *chunk, *next;
+
+    for (chunk = arena->first; chunk; chunk = next)
+    {
+        next = chunk->next;
+        freeMemory(chunk);
+    }
+    arena_init(arena);
+}
+
+extern void
+arena_reset(struct Arena *arena)
+{
+    struct ArenaChunk *chunk;
+
+    for (chunk = arena->first; chunk; chunk = chunk->next)
+        chunk->used = 0;
+    arena->current = arena->first;
+}
+
+extern void *
+arena_alloc(struct Arena *arena, size_t size)
+{
+    struct ArenaChunk *chunk;
+    size_t capacity;
+    void *ptr;
+
+    size = (size + ARENA_ALIGNMENT - 1) & ~(size_t) (ARENA_ALIGNMENT - 1);
+    chunk = arena->current;
+    // chunks kept by a reset are reused in order
+    while (chunk && chunk->size - chunk->used < size && chunk->next)
+        chunk = arena->current = chunk->next;
+    if (!chunk || chunk->size - chunk->used < size)
+    {
+        capacity = size > ARENA_CHUNK_SIZE ? size : ARENA_CHUNK_SIZE;
+        chunk = (struct ArenaChunk *)
+            allocMemory(1, sizeof (struct ArenaChunk) + capacity);
+        if (!chunk)
+            return (void *) 0;
+        chunk->size = capacity;
+        if (arena->current)
+            arena->current->next = chunk;
+        else
+            arena->first = chunk;
+        arena->current = chunk;
+    }
+    ptr = chunk->bytes + chunk->used;
+    chunk->used += size;
+    memset(ptr, 0, size);
+    return ptr;
+}
+
 // Horner's hash method
-static int hash_str(int m, int len, u1 *str)
+extern u4
+hash_bytes(int len, u1 *str)
 {
-    int h, i;
-    
+    u4 h;
+    int i;
+
     h = 0;
     for (i = 0; i < len; i++)
         h = str[i] + (31 * h);
-    h &= 0x7fffffff;
-    h %= m;
-    
+
     return h;
 }
+
+/*
+ * Symbol table
+ *
+ * Symbols are spread over independently locked shards,
+ * picked by the top bits of the hash once mixed, so threads
+ * loading different classes rarely contend on the same lock.
+ * Short strings only fill the low bits of the hash and the low
+ * bits already pick the bucket, hence the multiplicative mix.
+ * Each shard is a chained table whose bucket count is
+ * a power of two, doubled whenever the load exceeds 1.
+ */
+#define SYMBOL_SHARDS_BITS              6
+#define SYMBOL_SHARDS_COUNT             (1 << SYMBOL_SHARDS_BITS)
+#define SYMBOL_SHARD_INITIAL_CAPACITY   256
+#define SYMBOL_SHARD_MIX                0x9e3779b1u
+
+struct SymbolShard
+{
+    pthread_mutex_t lock;
+    u4 capacity;
+    u4 size;
+    struct Symbol **buckets;
+};
+
+static struct SymbolShard symbol_shards[SYMBOL_SHARDS_COUNT];
+static pthread_once_t symbol_once = PTHREAD_ONCE_INIT;
+
+static void
+initSymbolShards()
+{
+    int i;
+
+    for (i = 0; i < SYMBOL_SHARDS_COUNT; i++)
+        pthread_mutex_init(&(symbol_shards[i].lock), NULL);
+}
+
+static int
+growSymbolShard(struct SymbolShard *shard)
+{
+    struct Symbol **buckets, *sym, *next;
+    u4 capacity, i, j;
+
+    capacity = shard->capacity
+        ? shard->capacity << 1
+        : SYMBOL_SHARD_INITIAL_CAPACITY;
+    buckets = (struct Symbol **)
+        allocMemory(capacity, sizeof (struct Symbol *));
+    if (!buckets)
+        return -1;
+    for (i = 0; i < shard->capacity; i++)
+    {
+        for (sym = shard->buckets[i]; sym; sym = next)
+        {
+            next = sym->next;
+            j = sym->hash & (capacity - 1);
+            sym->next = buckets[j];
+            buckets[j] = sym;
+        }
+    }
+    freeMemory(shard->buckets);
+    shard->buckets = buckets;
+    shard->capacity = capacity;
+
+    return 0;
+}
+
+extern struct Symbol *
+symbol_intern(u2 len, u1 *str)
+{
+    struct SymbolShard *shard;
+    struct Symbol *sym;
+    u4 hash, i;
+
+    pthread_once(&symbol_once, initSymbolShards);
+    hash = hash_bytes(len, str);
+    shard = &(symbol_shards[(u4) (hash * SYMBOL_SHARD_MIX)
+        >> (32 - SYMBOL_SHARDS_BITS)]);
+
+    pthread_mutex_lock(&(shard->lock));
+    if (shard->capacity)
+        for (sym = shard->buckets[hash & (shard->capacity - 1)];
+                sym; sym = sym->next)
+            if (sym->hash == hash
+                    && sym->length == len
+                    && !memcmp(sym->bytes, str, len))
+                goto unlock;
+    if (shard->size >= shard->capacity
+            && growSymbolShard(shard) < 0)
+    {
+        sym = (struct Symbol *) 0;
+        goto unlock;
+    }
+    sym = (struct Symbol *)
+        allocMemory(1, sizeof (struct Symbol) + len + 1);
+    if (!sym)
+        goto unlock;
+    sym->hash = hash;
+    sym->length = len;
+    memcpy(sym->bytes, str, len);
+    i = hash & (shard->capacity - 1);
+    sym->next = shard->buckets[i];
+    shard->buckets[i] = sym;
+    ++shard->size;
+unlock:
+    pthread_mutex_unlock(&(shard->lock));
+
+    return sym;
+}
+
+/*
+ * Returns the symbol owning `bytes`,
+ * which must come from a Symbol
+ */
+extern struct Symbol *
+symbol_of(u1 *bytes)
+{
+    return (struct Symbol *) (bytes - offsetof(struct Symbol, bytes));
+}
+
+extern u4
+symbol_count()
+{
+    u4 count;
+    int i;
+
+    count = 0;
+    for (i = 0; i < SYMBOL_SHARDS_COUNT; i++)
+    {
+        pthread_mutex_lock(&(symbol_shards[i].lock));
+        count += symbol_shards[i].size;
+        pthread_mutex_unlock(&(symbol_shards[i].lock));
+    }
+
+    return count;
+}
+
+/*
+ * Open-addressing hash map
+ */
+#define HASHMAP_MIN_CAPACITY            16
+
+static uint32_t
+getHashMapCapacity(uint32_t expected)
+{
+    uint32_t capacity;
+
+    // keep the load factor at or below 1/2
+    capacity = HASHMAP_MIN_CAPACITY;
+    while (capacity < expected * 2)
+        capacity <<= 1;
+
+    return capacity;
+}
+
+extern int
+hashmap_init(struct HashMap *map, uint32_t expected)
+{
+    map->capacity = getHashMapCapacity(expected);
+    map->size = 0;
+    map->entries = (struct HashEntry *)
+        allocMemory(map->capacity, sizeof (struct HashEntry));
+    if (!map->entries)
+        return -1;
+
+    return 0;
+}
+
+extern void
+hashmap_release(struct HashMap *map)
+{
+    freeMemory(map->entries);
+    map->entries = (struct HashEntry *) 0;
+    map->capacity = map->size = 0;
+}
+
+/*
+ * Returns the slot holding `key`,
+ * or the empty slot where it would be inserted
+ */
+static struct HashEntry *
+probeHashMap(struct HashEntry *entries, uint32_t capacity,
+        uint32_t hash, int len, const void *key)
+{
+    struct HashEntry *entry;
+    uint32_t i;
+
+    for (i = hash & (capacity - 1); ; i = (i + 1) & (capacity - 1))
+    {
+        entry = &(entries[i]);
+        if (!entry->key)
+            return entry;
+        if (entry->hash == hash
+                && entry->length == len
+                && !memcmp(entry->key, key, len))
+            return entry;
+    }
+}
+
+static int
+growHashMap(struct HashMap *map)
+{
+    struct HashEntry *entries, *entry;
+    uint32_t capacity, i;
+
+    capacity = map->capacity << 1;
+    entries = (struct HashEntry *)
+        allocMemory(capacity, sizeof (struct HashEntry));
+    if (!entries)
+        return -1;
+    for (i = 0; i < map->capacity; i++)
+    {
+        entry = &(map->entries[i]);
+        if (entry->key)
+            *probeHashMap(entries, capacity, entry->hash,
+                    entry->length, entry->key) = *entry;
+    }
+    freeMemory(map->entries);
+    map->entries = entries;
+    map->capacity = capacity;
+
+    return 0;
+}
+
+extern void *
+hashmap_get(struct HashMap *map, int len, const void *key)
+{
+    return hashmap_getHashed(map, hash_bytes(len, (u1 *) key), len, key);
+}
+
+extern void *
+hashmap_getHashed(struct HashMap *map, uint32_t hash,
+        int len, const void *key)
+{
+    struct HashEntry *entry;
+
+    entry = probeHashMap(map->entries, map->capacity, hash, len, key);
+
+    return entry->key ? entry->value : (void *) 0;
+}
+
+extern int
+hashmap_put(struct HashMap *map, int len, const void *key,
+        void *value, void **existing)
+{
+    return hashmap_putHashed(map, hash_bytes(len, (u1 *) key),
+            len, key, value, existing);
+}
+
+/*
+ * Associates `value` with `key` unless it is already mapped.
+ * Returns 1 if `key` is inserted, 0 if it is present,
+ * in which case its value is stored in `existing` if not NULL,
+ * or -1 on failure.
+ * Keys are compared byte-wise only when their hashes are equal.
+ */
+extern int
+hashmap_putHashed(struct HashMap *map, uint32_t hash, int len,
+        const void *key, void *value, void **existing)
+{
+    struct HashEntry *entry;
+
+    entry = probeHashMap(map->entries, map->capacity, hash, len, key);
+    if (entry->key)
+    {
+        if (existing)
+            *existing = entry->value;
+        return 0;
+    }
+    if ((map->size + 1) * 2 > map->capacity)
+    {
+        if (growHashMap(map) < 0)
+            return -1;
+        entry = probeHashMap(map->entries, map->capacity, hash, len, key);
+    }
+    entry->hash = hash;
+    entry->length = len;
+    entry->key = key;
+    entry->value = value;
+    ++map->size;
+
+    return 1;
+}
+
+/*
+ * Concurrent hash map
+ *
+ * A slot is published by storing its key with release semantics
+ * after hash, length and value are written, readers load the key
+ * with acquire semantics. A resize publishes the new table the
+ * same way and chains the old one to it, to be freed on release.
+ */
+struct ConcurrentHashTable
+{
+    struct ConcurrentHashTable *retired;
+    uint32_t capacity;
+    uint32_t size;
+    struct HashEntry entries[];
+};
+
+static struct ConcurrentHashTable *
+createConcurrentHashTable(uint32_t capacity)
+{
+    struct ConcurrentHashTable *table;
+
+    table = (struct ConcurrentHashTable *)
+        allocMemory(1, sizeof (struct ConcurrentHashTable)
+                + capacity * sizeof (struct HashEntry));
+    if (!table)
+        return (struct ConcurrentHashTable *) 0;
+    table->capacity = capacity;
+
+    return table;
+}
+
+static struct HashEntry *
+probeConcurrentHashTable(struct ConcurrentHashTable *table,
+        uint32_t hash, int len, const void *key)
+{
+    struct HashEntry *entry;
+    const void *k;
+    uint32_t i, mask;
+
+    mask = table->capacity - 1;
+    for (i = hash & mask; ; i = (i + 1) & mask)
+    {
+        entry = &(table->entries[i]);
+        k = __atomic_load_n(&(entry->key), __ATOMIC_ACQUIRE);
+        if (!k)
+            return entry;
+        if (entry->hash == hash
+                && entry->length == len
+                && !memcmp(k, key, len))
+            return entry;
+    }
+}
+
+extern int
+chashmap_init(struct ConcurrentHashMap *map, uint32_t expected)
+{
+    pthread_mutex_t *lock;
+
+    lock = (pthread_mutex_t *) allocMemory(1, sizeof (pthread_mutex_t));
+    if (!lock)
+        return -1;
+    pthread_mutex_init(lock, NULL);
+    map->table = createConcurrentHashTable(getHashMapCapacity(expected));
+    if (!map->table)
+    {
+        freeMemory(lock);
+        return -1;
+    }
+    map->lock = lock;
+
+    return 0;
+}
+
+extern void
+chashmap_release(struct ConcurrentHashMap *map)
+{
+    struct ConcurrentHashTable *table, *retired;
+
+    for (table = map->table; table; table = retired)
+    {
+        retired = table->retired;
+        freeMemory(table);
+    }
+    map->table = (struct ConcurrentHashTable *) 0;
+    if (map->lock)
+    {
+        pthread_mutex_destroy((pthread_mutex_t *) map->lock);
+        freeMemory(map->lock);
+        map->lock = (void *) 0;
+    }
+}
+
+extern void *
+chashmap_get(struct ConcurrentHashMap *map, int len, const void *key)
+{
+    struct ConcurrentHashTable *table;
+    struct HashEntry *entry;
+
+    table = __atomic_load_n(&(map->table), __ATOMIC_ACQUIRE);
+    entry = probeConcurrentHashTable(table,
+            hash_bytes(len, (u1 *) key), len, key);
+    if (!__atomic_load_n(&(entry->key), __ATOMIC_ACQUIRE))
+        return (void *) 0;
+
+    return entry->value;
+}
+
+static struct ConcurrentHashTable *
+growConcurrentHashTable(struct ConcurrentHashTable *table)
+{
+    struct ConcurrentHashTable *grown;
+    struct HashEntry *entry;
+    uint32_t i;
+
+    grown = createConcurrentHashTable(table->capacity << 1);
+    if (!grown)
+        return (struct ConcurrentHashTable *) 0;
+    // the new table is private until published,
+    // plain stores are enough here
+    for (i = 0; i < table->capacity; i++)
+    {
+        entry = &(table->entries[i]);
+        if (entry->key)
+            *probeHashMap(grown->entries, grown->capacity, entry->hash,
+                    entry->length, entry->key) = *entry;
+    }
+    grown->size = table->size;
+    grown->retired = table;
+
+    return grown;
+}
+
+/*
+ * Same contract as hashmap_put
+ */
+extern int
+chashmap_put(struct ConcurrentHashMap *map, int len, const void *key,
+        void *value, void **existing)
+{
+    struct ConcurrentHashTable *table;
+    struct HashEntry *entry;
+    uint32_t hash;
+    int res;
+
+    hash = hash_bytes(len, (u1 *) key);
+    pthread_mutex_lock((pthread_mutex_t *) map->lock);
+    table = map->table;
+    entry = probeConcurrentHashTable(table, hash, len, key);
+    if (entry->key)
+    {
+        if (existing)
+            *existing = entry->value;
+        res = 0;
+        goto unlock;
+    }
+    if ((table->size + 1) * 2 > table->capacity)
+    {
+        table = growConcurrentHashTable(table);
+        if (!table)
+        {
+            res = -1;
+            goto unlock;
+        }
+        __atomic_store_n(&(map->table), table, __ATOMIC_RELEASE);
+        entry = probeConcurrentHashTable(table, hash, len, key);
+    }
+    entry->hash = hash;
+    entry->length = len;
+    entry->value = value;
+    __atomic_store_n(&(entry->key), key, __ATOMIC_RELEASE);
+    ++table->size;
+    res = 1;
+unlock:
+    pthread_mutex_unlock((pthread_mutex_t *) map->lock);
+
+    return res;
+}
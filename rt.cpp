@@ -1,6 +1,13 @@
+#include <new>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
 #include "java.h"
 #include "rt.h"
 #include "memory.h"
+#include "log.h"
+#include "descriptor.h"
 
 u2
 rt_Accessible::getAccessFlags()
@@ -25,7 +32,7 @@ rt_Accessible::getAttribute(u2 index, u4 tag)
 {
     attr_info *info;
 
-    if (index < 0 || index > attributes.attributes_count)
+    if (index >= attributes.attributes_count)
         return (attr_info *) 0;
     info = &(attributes.attributes[index]);
     if (tag == 0)
@@ -35,16 +42,59 @@ rt_Accessible::getAttribute(u2 index, u4 tag)
     return (attr_info *) 0;
 }
 
+bool
+rt_Accessible::hasAttribute(u4 tag)
+{
+    return (attributes.attributes_mark & tag) != 0;
+}
+
+/*
+ * Returns the first attribute tagged with TAG_ATTR_* `tag`,
+ * or NULL if there is none
+ */
+attr_info *
+rt_Accessible::findAttribute(u4 tag)
+{
+    // `tag` must be exactly one of the TAG_ATTR_* bits
+    if (!(attributes.attributes_mark & tag) || (tag & (tag - 1)))
+        return (attr_info *) 0;
+    return &(attributes.attributes[
+            attributes.attributes_index[__builtin_ctz(tag)]]);
+}
+
+void
+rt_Accessible::indexAttributes(u2 attributes_count, attr_info *attributes)
+{
+    rt_Attributes *attrsp;
+    u4 tag, mark;
+    u2 i;
+
+    attrsp = &(this->attributes);
+    attrsp->attributes_count = attributes_count;
+    attrsp->attributes = attributes;
+    mark = 0;
+    for (i = 0; i < attributes_count; i++)
+    {
+        tag = attributes[i].tag;
+        // unknown attributes carry no tag
+        if (tag == 0 || (mark & tag))
+            continue;
+        mark |= tag;
+        attrsp->attributes_index[__builtin_ctz(tag)] = i;
+    }
+    attrsp->attributes_mark = mark;
+}
+
 u2
 rt_Class::getFieldsCount()
 {
     return fields_count;
 }
 
-rt_Field **
+rt_Span<rt_Field>
 rt_Class::getFields()
 {
-    return fields;
+    return rt_Span<rt_Field>(fields, fields_count);
 }
 
 u2
@@ -53,10 +103,10 @@ rt_Class::getMethodsCount()
     return methods_count;
 }
 
-rt_Method **
+rt_Span<rt_Method>
 rt_Class::getMethods()
 {
-    return methods;
+    return rt_Span<rt_Method>(methods, methods_count);
 }
 
 u1
@@ -75,12 +125,12 @@ rt_getConstant(u2 index, u2 cp_count, cp_info *cp)
     cp_info * info;
 
     if (index < 1 ||
-            index > cp_count)
+            index >= cp_count)
         return (rt_info *) NULL;
     info = &(cp[index]);
     if (info->tag != tag)
         return (rt_info *) NULL;
-    return (rt_info *) info;
+    return (rt_info *) &(info->info);
 }
 
 const_Class_data *
@@ -297,7 +347,7 @@ rt_Method::getAttribute_Code()
     attr_info *info;
     u2 index;
 
-    info = getAttribute(off_Code, TAG_ATTR_CODE);
+    info = findAttribute(TAG_ATTR_CODE);
     if (!info)
         return (attr_Code_info *) 0;
     return (attr_Code_info *) info->data;
@@ -308,300 +358,595 @@ rt_Member::rt_Member(rt_Class *rtc)
     this->def_class = rtc;
 }
 
-rt_Accessible::rt_Accessible(ClassFile *classfile)
+rt_Accessible::rt_Accessible()
 {
-    rt_Attributes *attrsp;
-
-    access_flags = classfile->access_flags;
-    attrsp->attributes_count = classfile->attributes_count;
-    attrsp->attributes = classfile->attributes;
-    attrsp->attributes_mark = 0;
+    access_flags = 0;
+    indexAttributes(0, (attr_info *) 0);
 }
 
 rt_Accessible::rt_Accessible(field_info *info)
 {
-    rt_Attributes *attrsp;
-
     access_flags = info->access_flags;
-
-    attrsp = &attributes;
-    attrsp->attributes_count = info->attributes_count;
-    attrsp->attributes = info->attributes;
-    attrsp->attributes_mark = 0;
+    indexAttributes(info->attributes_count, info->attributes);
 }
 
-rt_Method::rt_Method(rt_Class *rtc, method_info *minfo)
+rt_Method::rt_Method(rt_Class *rtc, method_info *minfo,
+        rt_Descriptor *md)
     : rt_Member(rtc), rt_Accessible(minfo)
 {
-    attr_info *         attributes;
-    u2                  attributes_count;
-    u2                  i;
-    attr_info *         attribute;
-    const_Utf8_data *   descriptor;
-    u1                  state;
-    u2                  len_descriptor;
-    u1 *                str_descriptor;
-    u1 *                end_descriptor;
-    u2                  len;
-    u1 *                str;
-    u1                  plen;
-    rt_Descriptor *     md;
-    rt_Parameter *      parameter;
-
-    // analyze method attributes
-    attributes = minfo->attributes;
-    attributes_count = minfo->attributes_count;
-    for (i = 0; i < attributes_count; i++)
-    {
-        attribute = &(attributes[i]);
-        switch (attribute->tag)
-        {
-#if VER_CMP(45, 3)
-            case TAG_ATTR_CODE:
-                off_Code = i;
-                break;
-            case TAG_ATTR_EXCEPTIONS:
-                off_Exceptions = i;
-                break;
-#endif
-#if VER_CMP(49, 0)
-            case TAG_ATTR_RUNTIMEVISIBLEPARAMETERANNOTATIONS:
-                off_RuntimeVisibleParameterAnnotations = i;
-                break;
-            case TAG_ATTR_RUNTIMEINVISIBLEPARAMETERANNOTATIONS:
-                off_RuntimeInvisibleParameterAnnotations = i;
-                break;
-            case TAG_ATTR_ANNOTATIONDEFAULT:
-                off_AnnotationDefault = i;
-                break;
-            case TAG_ATTR_RUNTIMEVISIBLEANNOTATIONS:
-                off_RuntimeVisibleAnnotations = i;
-                break;
-            case TAG_ATTR_RUNTIMEINVISIBLEANNOTATIONS:
-                off_RuntimeInvisibleAnnotations = i;
-                break;
-#endif
-#if VER_CMP(52, 0)
-            case TAG_ATTR_RUNTIMEVISIBLETYPEANNOTATIONS:
-                off_RuntimeVisibleTypeAnnotations = i;
-                break;
-            case TAG_ATTR_RUNTIMEINVISIBLETYPEANNOTATIONS:
-                off_RuntimeInvisibleTypeAnnotations = i;
-                break;
-#endif
-        }
-    }
-
     name_index = minfo->name_index;
     descriptor_index = minfo->descriptor_index;
-    // analyze method descriptor
-    descriptor = rtc->getConstant_Utf8(descriptor_index);
-    len_descriptor = descriptor->length;
-    str_descriptor = descriptor->bytes;
-    end_descriptor = str_descriptor + len_descriptor;
-    state = 0;
-    md = &(this->descriptor);
-    md->parameters_count = 0;
-    md->parameters_length = 0;
-    if (!md->parameters)
-        throw -1;
-    /*
-     * | State | Description             |
-     * |-------|-------------------------|
-     * |     0 | '(' is not detected     |
-     * |     1 | '(' is detected         |
-     * |     2 | ')' is detected         |
-     * |     4 | descriptor ends         |
-     * |     8 | '[' is detected         |
-     */
-    str = str_descriptor;
-    while (str < end_descriptor)
+    descriptor = md;
+    lines_count = 0;
+    lines = (u4 *) 0;
+    locals_count = 0;
+    locals = (rt_Local *) 0;
+}
+
+rt_Method::~rt_Method()
+{
+    freeMemory(lines);
+    freeMemory(locals);
+}
+
+rt_Class::rt_Class()
+{
+    hash = 0;
+    constant_pool_count = 0;
+    constant_pool = (cp_info *) 0;
+    this_class = 0;
+    super_class = 0;
+    interfaces_count = 0;
+    interfaces = (u2 *) 0;
+    fields_count = 0;
+    fields = (rt_Field *) 0;
+    methods_count = 0;
+    methods = (rt_Method *) 0;
+    fields_built = 0;
+    methods_built = 0;
+}
+
+rt_Class::~rt_Class()
+{
+    u2 i;
+
+    // members live in one block each, those constructed
+    // are destroyed in place before the block is released
+    for (i = 0; i < fields_built; i++)
+        fields[i].~rt_Field();
+    for (i = 0; i < methods_built; i++)
+        methods[i].~rt_Method();
+    freeMemory(fields);
+    freeMemory(methods);
+}
+
+rt_ClassBuilder::rt_ClassBuilder(ClassFile *cf)
+{
+    this->cf = cf;
+    this->rtc = new rt_Class();
+}
+
+rt_ClassBuilder::~rt_ClassBuilder()
+{
+    // the class is only handed out by `release`,
+    // anything left here belongs to an aborted load
+    delete rtc;
+}
+
+/*
+ * Invoked once the constant pool, access flags,
+ * this_class, super_class and interfaces are loaded
+ */
+int
+rt_ClassBuilder::buildHeader()
+{
+    if (!rtc)
+        return -1;
+    rtc->access_flags = cf->access_flags;
+    rtc->constant_pool_count = cf->constant_pool_count;
+    rtc->constant_pool = cf->constant_pool;
+    rtc->this_class = cf->this_class;
+    rtc->super_class = cf->super_class;
+    rtc->interfaces_count = cf->interfaces_count;
+    rtc->interfaces = cf->interfaces;
+
+    return 0;
+}
+
+/*
+ * Invoked once `fields_count` is known,
+ * before any field is loaded
+ */
+int
+rt_ClassBuilder::buildFields()
+{
+    u2 count;
+
+    if (!rtc)
+        return -1;
+    count = cf->fields_count;
+    rtc->fields_count = count;
+    if (count == 0)
+        return 0;
+    rtc->fields = (rt_Field *)
+        allocMemory(count, sizeof (rt_Field));
+    if (!rtc->fields)
+        return -1;
+
+    return 0;
+}
+
+/*
+ * Invoked right after field #index and its attributes are loaded
+ */
+int
+rt_ClassBuilder::buildField(u2 index)
+{
+    rt_Field *field;
+
+    // fields are built in order, so the constructed ones are a prefix
+    if (!rtc || index >= rtc->fields_count || index != rtc->fields_built)
+        return -1;
+    field = &(rtc->fields[index]);
+    new (field) rt_Field(rtc, &(cf->fields[index]));
+    ++rtc->fields_built;
+
+    return 0;
+}
+
+/*
+ * Invoked once `methods_count` is known,
+ * before any method is loaded
+ */
+int
+rt_ClassBuilder::buildMethods()
+{
+    u2 count;
+
+    if (!rtc)
+        return -1;
+    count = cf->methods_count;
+    rtc->methods_count = count;
+    if (count == 0)
+        return 0;
+    rtc->methods = (rt_Method *)
+        allocMemory(count, sizeof (rt_Method));
+    if (!rtc->methods)
+        return -1;
+
+    return 0;
+}
+
+/*
+ * Invoked right after method #index and its attributes are loaded
+ */
+int
+rt_ClassBuilder::buildMethod(u2 index)
+{
+    rt_Method *method;
+    method_info *minfo;
+    const_Utf8_data *cui;
+    rt_Descriptor *md;
+
+    if (!rtc || index >= rtc->methods_count || index != rtc->methods_built)
+        return -1;
+    minfo = &(cf->methods[index]);
+    cui = rtc->getConstant_Utf8(minfo->descriptor_index);
+    if (!cui)
+        return -1;
+    md = rt_internDescriptor(cui->length, cui->bytes);
+    if (!md)
+        return -1;
+    method = &(rtc->methods[index]);
+    new (method) rt_Method(rtc, minfo, md);
+    ++rtc->methods_built;
+    if (method->indexLines() < 0)
+        return -1;
+    if (method->indexLocals() < 0)
+        return -1;
+
+    return 0;
+}
+
+/*
+ * Invoked once class attributes are loaded
+ */
+int
+rt_ClassBuilder::buildAttributes()
+{
+    if (!rtc)
+        return -1;
+    rtc->indexAttributes(cf->attributes_count, cf->attributes);
+
+    return 0;
+}
+
+rt_Class *
+rt_ClassBuilder::release()
+{
+    rt_Class *res;
+
+    res = rtc;
+    rtc = (rt_Class *) 0;
+    return res;
+}
+
+rt_Field::rt_Field(rt_Class *rtc, field_info *finfo)
+    : rt_Member(rtc), rt_Accessible(finfo)
+{
+    name_index = finfo->name_index;
+    descriptor_index = finfo->descriptor_index;
+}
+
+rt_Descriptor *
+rt_Method::getRuntimeDescriptor()
+{
+    return descriptor;
+}
+
+/*
+ * Line numbers
+ *
+ * A method may have any number of LineNumberTable attributes in
+ * any order, their entries are merged into two sorted arrays
+ * so either direction is one binary search.
+ */
+static int
+compareLines(const void *a, const void *b)
+{
+    u4 x, y;
+
+    x = *(const u4 *) a;
+    y = *(const u4 *) b;
+    return x < y ? -1 : x > y;
+}
+
+int
+rt_Method::indexLines()
+{
+    attr_Code_info *code;
+    attr_LineNumberTable_info *table;
+    struct line_number_table_entry *entry;
+    u4 count, i, j, k;
+
+    code = getAttribute_Code();
+    if (!code)
+        return 0;
+    count = 0;
+    for (i = 0; i < code->attributes_count; i++)
+        if (code->attributes[i].tag == TAG_ATTR_LINENUMBERTABLE)
+            count += ((attr_LineNumberTable_info *) code->attributes[i].data)
+                ->line_number_table_length;
+    if (count == 0)
+        return 0;
+    lines = (u4 *) allocMemory(2 * count, sizeof (u4));
+    if (!lines)
+        return -1;
+    k = 0;
+    for (i = 0; i < code->attributes_count; i++)
     {
-        if (state & 8)
-            state &= 7;
-        else
-            len = 0;
-        switch (*str)
-        {
-            case '(':
-                state = 1;
-                ++str;
-                continue;
-            case ')':
-                state |= 2;
-                ++str;
-                continue;
-            case 'L':
-                while (str < end_descriptor
-                        && str[++len] != ';');
-                if (state & 2)
-                    state |= 4;
-                plen = 1;
-                break;
-            case '[':
-                state |= 8;
-                while (str < end_descriptor
-                        && str[len++] == '[');
-                plen = 1;
-                break;
-            case 'B':
-            case 'C':
-            case 'D':
-            case 'F':
-            case 'I':
-            case 'J':
-            case 'S':
-            case 'Z':
-                ++len;
-                if (state & 2)
-                    state |= 4;
-                if (*str == 'J'
-                        || *str == 'D')
-                    plen = 2;
-                else
-                    plen = 1;
-                break;
-            case 'V':
-                state |= 4;
-                len = 1;
-                break;
-        }
-        // return type
-        if (state & 4)
-        {
-            md->off_return_descriptor = str - str_descriptor;
-            break;
-        }
-        // array type needs second parsing
-        if (state & 8)
+        if (code->attributes[i].tag != TAG_ATTR_LINENUMBERTABLE)
             continue;
-        // intact parameter descriptor
-        else
+        table = (attr_LineNumberTable_info *) code->attributes[i].data;
+        for (j = 0; j < table->line_number_table_length; j++)
         {
-            str += len;
-            md->off_parameters[md->parameters_length]
-                = md->parameters_count;
-            parameter = &(md->parameters[md->parameters_count]);
-            parameter->off_parameter_descriptor = str - str_descriptor;
-#if VER_CMP(52, 0)
-            // TODO JVM 52.0 is not implemented
-#else
-            parameter->access_flags = 0;
-            parameter->name_index = 0;
-#endif
-            md->parameters_count++;
-            md->parameters_length += plen;
+            entry = &(table->line_number_table[j]);
+            lines[k] = (u4) entry->start_pc << 16 | entry->line_number;
+            lines[count + k] = (u4) entry->line_number << 16 | entry->start_pc;
+            ++k;
         }
     }
-}
-
-rt_Class::rt_Class(ClassFile *cf)
-    : rt_Accessible(cf)
-{
-    u2          i;
-    u2          attributes_count;
-    attr_info * attributes;
-    attr_info * attribute;
-
-    constant_pool_count = cf->constant_pool_count;
-    constant_pool = cf->constant_pool;
-    this_class = cf->this_class;
-    super_class = cf->super_class;
-    interfaces_count = cf->interfaces_count;
-    interfaces = cf->interfaces;
-    fields_count = cf->fields_count;
-    fields = (rt_Field **)
-        allocMemory(fields_count, sizeof (rt_Field *));
-    for (i = 0; i < fields_count; i++)
-        fields[i] = new rt_Field(this, &(cf->fields[i]));
-    methods_count = cf->methods_count;
-    methods = (rt_Method **)
-        allocMemory(methods_count, sizeof (rt_Method *));
-    for (i = 0; i < methods_count; i++)
-        methods[i] = new rt_Method(this, &(cf->methods[i]));
-    // resolve attributes
-    attributes_count = cf->attributes_count;
-    attributes = cf->attributes;
-    for (i = 0; i < attributes_count; i++)
+    qsort(lines, count, sizeof (u4), compareLines);
+    qsort(lines + count, count, sizeof (u4), compareLines);
+    lines_count = count;
+    return 0;
+}
+
+/*
+ * Line of the instruction at `pc`, -1 if unknown.
+ * Where several entries start at the same pc the greatest line wins.
+ */
+int
+rt_Method::getLineNumber(u4 pc)
+{
+    attr_Code_info *code;
+    u4 low, high, middle;
+
+    code = getAttribute_Code();
+    if (!code || pc >= code->code_length)
+        return -1;
+    // first entry starting after `pc`
+    low = 0;
+    high = lines_count;
+    while (low < high)
     {
-        attribute = &(attributes[i]);
-        switch (attribute->tag)
-        {
-#if VER_CMP(45, 3)
-            case TAG_ATTR_INNERCLASSES:
-                off_InnerClasses = i;
-                break;
-#endif
-#if VER_CMP(49, 0)
-            case TAG_ATTR_ENCLOSINGMETHOD:
-                off_EnclosingMethod = i;
-                break;
-            case TAG_ATTR_RUNTIMEVISIBLEANNOTATIONS:
-                off_RuntimeVisibleAnnotations = i;
-                break;
-            case TAG_ATTR_RUNTIMEINVISIBLEANNOTATIONS:
-                off_RuntimeInvisibleAnnotations = i;
-                break;
-#endif
-#if VER_CMP(51, 0)
-            case TAG_ATTR_BOOTSTRAPMETHODS:
-                off_BootstrapMethods = i;
-                break;
-#endif
-#if VER_CMP(52, 0)
-            case TAG_ATTR_RUNTIMEVISIBLETYPEANNOTATIONS:
-                off_RuntimeVisibleTypeAnnotations = i;
-                break;
-            case TAG_ATTR_RUNTIMEINVISIBLETYPEANNOTATIONS:
-                off_RuntimeInvisibleTypeAnnotations = i;
-                break;
-#endif
-        }
+        middle = (low + high) / 2;
+        if (lines[middle] >> 16 <= pc)
+            low = middle + 1;
+        else
+            high = middle;
     }
+    if (low == 0)
+        return -1;
+    return lines[low - 1] & 0xffff;
 }
 
-rt_Field::rt_Field(rt_Class *rtc, field_info *finfo)
-    : rt_Member(rtc), rt_Accessible(finfo)
+/*
+ * Every entry as start_pc << 16 | line_number, ascending
+ */
+u4
+rt_Method::getLines(u4 **entries)
 {
-    u2          i;
-    u2          attributes_count;
-    attr_info * attributes;
-    attr_info * attribute;
+    *entries = lines;
+    return lines_count;
+}
 
-    attributes_count = finfo->attributes_count;
-    attributes = finfo->attributes;
-    for (i = 0; i < attributes_count; i++)
+/*
+ * Start offsets of the code of `line`, ascending.
+ * Returns how many there are, at most `capacity` are stored.
+ */
+u4
+rt_Method::getLinePcs(u2 line, u2 *pcs, u4 capacity)
+{
+    u4 *by_line;
+    u4 low, high, middle, i;
+
+    by_line = lines + lines_count;
+    low = 0;
+    high = lines_count;
+    while (low < high)
     {
-        attribute = &(attributes[i]);
-        switch (attribute->tag)
+        middle = (low + high) / 2;
+        if (by_line[middle] >> 16 < line)
+            low = middle + 1;
+        else
+            high = middle;
+    }
+    for (i = low; i < lines_count && by_line[i] >> 16 == line; i++)
+        if (i - low < capacity)
+            pcs[i - low] = (u2) by_line[i];
+    return i - low;
+}
+
+/*
+ * Local variables
+ *
+ * A LocalVariableTypeTable entry describes the same variable as the
+ * LocalVariableTable entry of equal slot, start_pc and length, it
+ * only adds the generic signature. Both are merged into one array
+ * sorted by slot then start_pc, so the variable of a slot at some pc
+ * is one binary search.
+ */
+static int
+compareLocals(const void *a, const void *b)
+{
+    const rt_Local *x, *y;
+
+    x = (const rt_Local *) a;
+    y = (const rt_Local *) b;
+    if (x->index != y->index)
+        return (int) x->index - (int) y->index;
+    if (x->start_pc != y->start_pc)
+        return (int) x->start_pc - (int) y->start_pc;
+    return (int) x->length - (int) y->length;
+}
+
+int
+rt_Method::indexLocals()
+{
+    attr_Code_info *code;
+    attr_LocalVariableTable_info *lvt;
+    attr_LocalVariableTypeTable_info *lvtt;
+    struct local_variable_table_entry *entry;
+    struct local_variable_type_table_entry *type;
+    rt_Local key, *local;
+    u4 count, typed, i, j, k;
+
+    code = getAttribute_Code();
+    if (!code)
+        return 0;
+    count = 0;
+    typed = 0;
+    for (i = 0; i < code->attributes_count; i++)
+        if (code->attributes[i].tag == TAG_ATTR_LOCALVARIABLETABLE)
+            count += ((attr_LocalVariableTable_info *)
+                    code->attributes[i].data)->local_variable_table_length;
+        else if (code->attributes[i].tag == TAG_ATTR_LOCALVARIABLETYPETABLE)
+            typed += ((attr_LocalVariableTypeTable_info *)
+                    code->attributes[i].data)
+                ->local_variable_type_table_length;
+    if (count + typed == 0)
+        return 0;
+    locals = (rt_Local *) allocMemory(count + typed, sizeof (rt_Local));
+    if (!locals)
+        return -1;
+    k = 0;
+    for (i = 0; i < code->attributes_count; i++)
+    {
+        if (code->attributes[i].tag != TAG_ATTR_LOCALVARIABLETABLE)
+            continue;
+        lvt = (attr_LocalVariableTable_info *) code->attributes[i].data;
+        for (j = 0; j < lvt->local_variable_table_length; j++)
         {
-#if VER_CMP(45, 3)
-            case TAG_ATTR_CONSTANTVALUE:
-                off_ConstantValue = i;
-                break;
-#endif
-#if VER_CMP(49, 0)
-            case TAG_ATTR_RUNTIMEVISIBLEANNOTATIONS:
-                off_RuntimeVisibleAnnotations = i;
-                break;
-            case TAG_ATTR_RUNTIMEINVISIBLEANNOTATIONS:
-                off_RuntimeInvisibleAnnotations = i;
-                break;
-#endif
-#if VER_CMP(52, 0)
-            case TAG_ATTR_RUNTIMEVISIBLETYPEANNOTATIONS:
-                off_RuntimeVisibleTypeAnnotations = i;
-                break;
-            case TAG_ATTR_RUNTIMEINVISIBLETYPEANNOTATIONS:
-                off_RuntimeInvisibleTypeAnnotations = i;
-                break;
-#endif
+            entry = &(lvt->local_variable_table[j]);
+            locals[k].start_pc = entry->start_pc;
+            locals[k].length = entry->length;
+            locals[k].name_index = entry->name_index;
+            locals[k].descriptor_index = entry->descriptor_index;
+            locals[k].index = entry->index;
+            ++k;
         }
     }
-}
+    qsort(locals, count, sizeof (rt_Local), compareLocals);
+    for (i = 0; i < code->attributes_count; i++)
+    {
+        if (code->attributes[i].tag != TAG_ATTR_LOCALVARIABLETYPETABLE)
+            continue;
+        lvtt = (attr_LocalVariableTypeTable_info *) code->attributes[i].data;
+        for (j = 0; j < lvtt->local_variable_type_table_length; j++)
+        {
+            type = &(lvtt->local_variable_type_table[j]);
+            key.start_pc = type->start_pc;
+            key.length = type->length;
+            key.index = type->index;
+            local = (rt_Local *) bsearch(&key, locals, count,
+                    sizeof (rt_Local), compareLocals);
+            if (!local)
+            {
+                // no LocalVariableTable entry, keep it without descriptor
+                local = &(locals[k++]);
+                local->start_pc = type->start_pc;
+                local->length = type->length;
+                local->name_index = type->name_index;
+                local->index = type->index;
+            }
+            local->signature_index = type->signature_index;
+        }
+    }
+    if (k > count)
+        qsort(locals, k, sizeof (rt_Local), compareLocals);
+    locals_count = k;
+    return 0;
+}
+
+/*
+ * Variable held by `slot` at `pc`, null if none is declared.
+ * javac never overlaps the scopes of one slot, where they do
+ * the latest starting scope is the only one considered.
+ */
+rt_Local *
+rt_Method::getLocal(u2 slot, u4 pc)
+{
+    rt_Local *local;
+    u4 low, high, middle;
+
+    // first entry after (slot, pc)
+    low = 0;
+    high = locals_count;
+    while (low < high)
+    {
+        middle = (low + high) / 2;
+        if (locals[middle].index < slot
+                || (locals[middle].index == slot
+                    && locals[middle].start_pc <= pc))
+            low = middle + 1;
+        else
+            high = middle;
+    }
+    if (low == 0)
+        return (rt_Local *) 0;
+    local = &(locals[low - 1]);
+    if (local->index != slot
+            || pc >= (u4) local->start_pc + local->length)
+        return (rt_Local *) 0;
+    return local;
+}
+
+/*
+ * Every scope of `slot`, by start_pc
+ */
+u4
+rt_Method::getLocals(u2 slot, rt_Local **entries)
+{
+    u4 low, high, middle, i;
+
+    low = 0;
+    high = locals_count;
+    while (low < high)
+    {
+        middle = (low + high) / 2;
+        if (locals[middle].index < slot)
+            low = middle + 1;
+        else
+            high = middle;
+    }
+    *entries = locals + low;
+    for (i = low; i < locals_count && locals[i].index == slot; i++)
+        ;
+    return i - low;
+}
+
+/*
+ * Descriptor cache
+ *
+ * Every distinct method descriptor is decoded once and kept
+ * for the lifetime of the process, keyed by its bytes, so methods
+ * of all loaded classes share a single rt_Descriptor per descriptor.
+ * Lookups take no lock, so verifier threads may share the cache.
+ */
+#define DESCRIPTOR_CACHE_INITIAL_CAPACITY   1024
+
+static struct ConcurrentHashMap descriptor_cache;
+static pthread_once_t descriptor_cache_once = PTHREAD_ONCE_INIT;
+static int descriptor_cache_ready;
+
+static void
+initDescriptorCache()
+{
+    descriptor_cache_ready = chashmap_init(&descriptor_cache,
+            DESCRIPTOR_CACHE_INITIAL_CAPACITY) == 0;
+}
+
+extern rt_Descriptor *
+rt_internDescriptor(u2 len, u1 *str)
+{
+    rt_Descriptor *md;
+    void *existing;
+    struct DescriptorToken tokens[256];
+    u2 *offset, *slot;
+    u1 *bytes;
+    u4 size;
+    int count, slots, i;
+
+    pthread_once(&descriptor_cache_once, initDescriptorCache);
+    if (!descriptor_cache_ready)
+        return (rt_Descriptor *) 0;
+    md = (rt_Descriptor *) chashmap_get(&descriptor_cache, len, str);
+    if (md)
+        return md;
+
+    // the last token is the return type
+    count = scanDescriptor(SCAN_METHOD_DESCRIPTOR, len, str, tokens, 256);
+    slots = 0;
+    for (i = 0; i < count - 1 && i < 255; i++)
+        slots += getTokenSlots(&(tokens[i]));
+    if (count < 1 || count > 256 || slots > 255)
+    {
+        logError("Invalid method descriptor \"%.*s\"!\r\n", len, str);
+        return (rt_Descriptor *) 0;
+    }
+    --count;
+
+    // descriptor and a copy of the key share one allocation
+    size = sizeof (rt_Descriptor) + (count + slots) * sizeof (u2);
+    md = (rt_Descriptor *) allocMemory(1, size + len);
+    if (!md)
+        return (rt_Descriptor *) 0;
+    md->off_return_descriptor = tokens[count].offset;
+    md->parameters_count = (u1) count;
+    md->parameters_length = (u1) slots;
+    offset = rt_getParameterOffsets(md);
+    slot = rt_getParameterSlots(md);
+    for (i = 0; i < count; i++)
+    {
+        *offset++ = tokens[i].offset;
+        *slot++ = i;
+        if (getTokenSlots(&(tokens[i])) == 2)
+            *slot++ = i;
+    }
+    bytes = ((u1 *) md) + size;
+    memcpy(bytes, str, len);
 
-rt_Descriptor *
-rt_Method::getRuntimeDescriptor()
-{
-    return &descriptor;
+    // another thread may have interned the same descriptor meanwhile
+    switch (chashmap_put(&descriptor_cache, len, bytes, md, &existing))
+    {
+        case 1:
+            return md;
+        case 0:
+            freeMemory(md);
+            return (rt_Descriptor *) existing;
+        default:
+            freeMemory(md);
+            return (rt_Descriptor *) 0;
+    }
 }
@@ -0,0 +1,1796 @@
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+
+#include "java.h"
+#include "opcode.h"
+#include "rt.h"
+#include "bytecode.h"
+#include "tc.h"
+#include "log.h"
+#include "memory.h"
+
+/*
+ * Type checking verifier (JVMS 4.10.1)
+ *
+ * The code is walked once in offset order. The frame before each
+ * instruction is the frame after the previous one, or the stack map
+ * frame declared at its offset, to which the incoming frame must be
+ * assignable. Branch and exception handler targets must carry a
+ * stack map frame the current frame is assignable to.
+ *
+ * No class other than the one being checked is loaded, so any class
+ * type is taken as assignable to any other non-array class type.
+ * Array, primitive and uninitialized types are checked exactly.
+ */
+
+struct TypeChecker
+{
+    ClassFile *         cf;
+    attr_Code_info *    code;
+    // instruction starts, from checkCodeStructure
+    struct CodeMap *    map;
+    struct VerifyError *error;
+    // offset of the current instruction
+    u4                  pc;
+    struct Instruction  insn;
+    // frame before the current instruction
+    rt_Frame            frame;
+    // stack map frames, in offset order
+    rt_Frame *          frames;
+    u2                  frames_count;
+    struct HandlerIndex *handlers;
+    rt_Descriptor *     md;
+    const_Utf8_data *   descriptor;
+    u1                  is_init;
+    struct Symbol *     this_class;
+    struct Symbol *     java_lang_Object;
+    struct Symbol *     java_lang_String;
+    struct Symbol *     java_lang_Class;
+    struct Symbol *     java_lang_Throwable;
+    struct Symbol *     java_lang_Cloneable;
+    struct Symbol *     java_io_Serializable;
+    struct Symbol *     java_lang_invoke_MethodType;
+    struct Symbol *     java_lang_invoke_MethodHandle;
+};
+
+static int
+fail(struct TypeChecker *tc, const char *format, ...)
+{
+    va_list args;
+
+    tc->error->pc = tc->pc;
+    va_start(args, format);
+    vsnprintf(tc->error->reason, sizeof (tc->error->reason),
+            format, args);
+    va_end(args);
+    return -1;
+}
+
+static struct Symbol *
+internName(const char *name)
+{
+    return symbol_intern((u2) strlen(name), (u1 *) name);
+}
+
+/*
+ * Verification types
+ */
+static rt_Value
+makeValue(u1 tag)
+{
+    rt_Value value;
+
+    memset(&value, 0, sizeof (rt_Value));
+    value.tag = tag;
+    return value;
+}
+
+static rt_Value
+makeObject(struct Symbol *type)
+{
+    rt_Value value;
+
+    value = makeValue(ITEM_Object);
+    value.type = type;
+    return value;
+}
+
+static inline int
+isCategory2(rt_Value *value)
+{
+    return value->tag == ITEM_Long || value->tag == ITEM_Double;
+}
+
+static inline int
+isReference(rt_Value *value)
+{
+    return value->tag >= ITEM_Null && value->tag <= ITEM_Uninitialized;
+}
+
+static inline int
+isInitialized(rt_Value *value)
+{
+    return value->tag == ITEM_Null || value->tag == ITEM_Object;
+}
+
+static inline int
+isArray(struct Symbol *type)
+{
+    return type->bytes[0] == '[';
+}
+
+static int
+isSameValue(rt_Value *value, rt_Value *other)
+{
+    if (value->tag != other->tag)
+        return 0;
+    if (value->tag == ITEM_Object)
+        return value->type == other->type;
+    if (value->tag == ITEM_Uninitialized)
+        return value->offset == other->offset;
+    return 1;
+}
+
+static const char *
+describeValue(rt_Value *value, char *buf, size_t size)
+{
+    switch (value->tag)
+    {
+        case ITEM_Top:
+            return "top";
+        case ITEM_Integer:
+            return "int";
+        case ITEM_Float:
+            return "float";
+        case ITEM_Long:
+            return "long";
+        case ITEM_Double:
+            return "double";
+        case ITEM_Null:
+            return "null";
+        case ITEM_UninitializedThis:
+            return "uninitializedThis";
+        case ITEM_Object:
+            snprintf(buf, size, "%.*s",
+                    value->type->length, (char *) value->type->bytes);
+            return buf;
+        case ITEM_Uninitialized:
+            snprintf(buf, size, "uninitialized(%i)", value->offset);
+            return buf;
+        default:
+            return "?";
+    }
+}
+
+// element type of an array of references
+static struct Symbol *
+getComponentType(struct Symbol *type)
+{
+    if (type->bytes[1] == 'L')
+        return symbol_intern(type->length - 3, type->bytes + 2);
+    return symbol_intern(type->length - 1, type->bytes + 1);
+}
+
+static int
+isAssignableType(struct TypeChecker *tc,
+        struct Symbol *from, struct Symbol *to)
+{
+    struct Symbol *component, *component1;
+
+    if (from == to || to == tc->java_lang_Object)
+        return 1;
+    if (!isArray(to))
+    {
+        if (!isArray(from))
+            return 1;
+        return to == tc->java_lang_Cloneable
+            || to == tc->java_io_Serializable;
+    }
+    if (!isArray(from))
+        return 0;
+    // arrays of different primitive types
+    if (from->bytes[1] != 'L' && from->bytes[1] != '['
+            || to->bytes[1] != 'L' && to->bytes[1] != '[')
+        return 0;
+    component = getComponentType(from);
+    component1 = getComponentType(to);
+    if (!component || !component1)
+        return 0;
+    return isAssignableType(tc, component, component1);
+}
+
+static int
+isAssignable(struct TypeChecker *tc, rt_Value *from, rt_Value *to)
+{
+    switch (to->tag)
+    {
+        case ITEM_Top:
+            return 1;
+        case ITEM_Object:
+            if (from->tag == ITEM_Null)
+                return 1;
+            if (from->tag != ITEM_Object)
+                return 0;
+            return isAssignableType(tc, from->type, to->type);
+        default:
+            return isSameValue(from, to);
+    }
+}
+
+/*
+ * Constant pool lookups
+ */
+static struct Symbol *
+getClassType(struct TypeChecker *tc, u2 index)
+{
+    cp_info *info;
+    struct Symbol *type;
+
+    info = getConstant(tc->cf, index);
+    if (!info || info->tag != CONSTANT_Class)
+    {
+        fail(tc, "constant #%i is not a class", index);
+        return (struct Symbol *) 0;
+    }
+    info = getConstant(tc->cf, info->info.ccd.name_index);
+    if (!info || info->tag != CONSTANT_Utf8)
+    {
+        fail(tc, "class #%i has no name", index);
+        return (struct Symbol *) 0;
+    }
+    type = symbol_of(info->info.cud.bytes);
+    if (!type)
+        fail(tc, "class name of #%i isn't interned", index);
+    return type;
+}
+
+/*
+ * Resolves the name and descriptor of a field, method
+ * or call site reference, and the class of the first two.
+ */
+static int
+getMemberRef(struct TypeChecker *tc, u2 index, u1 tag, u1 tag1,
+        struct Symbol **owner, const_Utf8_data **name,
+        const_Utf8_data **descriptor)
+{
+    cp_info *info;
+    u2 name_and_type_index;
+
+    info = getConstant(tc->cf, index);
+    if (!info || info->tag != tag && info->tag != tag1)
+        return fail(tc, "constant #%i is not a CONSTANT_%s", index,
+                get_cp_name(tag));
+    if (tag == CONSTANT_InvokeDynamic)
+    {
+        name_and_type_index = info->info.cidd.name_and_type_index;
+    }
+    else
+    {
+        name_and_type_index = info->info.cfd.name_and_type_index;
+        *owner = getClassType(tc, info->info.cfd.class_index);
+        if (!*owner)
+            return -1;
+    }
+    info = getConstant(tc->cf, name_and_type_index);
+    if (!info || info->tag != CONSTANT_NameAndType)
+        return fail(tc, "constant #%i has no name and type", index);
+    *name = getConstant_Utf8(tc->cf, info->info.cnd.name_index);
+    *descriptor = getConstant_Utf8(tc->cf, info->info.cnd.descriptor_index);
+    if (!*name || !*descriptor)
+        return fail(tc, "constant #%i has no name and type", index);
+    return 0;
+}
+
+// verification type of the field descriptor `str`
+static int
+getDescriptorValue(struct TypeChecker *tc, u2 len, u1 *str,
+        rt_Value *value)
+{
+    struct Symbol *type;
+
+    switch (len > 0 ? str[0] : 0)
+    {
+        case 'B':case 'C':case 'I':case 'S':case 'Z':
+            *value = makeValue(ITEM_Integer);
+            return 0;
+        case 'F':
+            *value = makeValue(ITEM_Float);
+            return 0;
+        case 'J':
+            *value = makeValue(ITEM_Long);
+            return 0;
+        case 'D':
+            *value = makeValue(ITEM_Double);
+            return 0;
+        case 'L':
+            type = len > 2 ? symbol_intern(len - 2, str + 1)
+                : (struct Symbol *) 0;
+            break;
+        case '[':
+            type = symbol_intern(len, str);
+            break;
+        default:
+            return fail(tc, "invalid field descriptor \"%.*s\"", len, str);
+    }
+    if (!type)
+        return fail(tc, "invalid field descriptor \"%.*s\"", len, str);
+    *value = makeObject(type);
+    return 0;
+}
+
+/*
+ * Operand stack
+ */
+static int
+push(struct TypeChecker *tc, rt_Value *value)
+{
+    rt_Frame *frame;
+    u2 n;
+
+    frame = &(tc->frame);
+    n = isCategory2(value) ? 2 : 1;
+    if (frame->stack_size + n > tc->code->max_stack)
+        return fail(tc, "operand stack overflow");
+    frame->stack[frame->stack_size++] = *value;
+    if (n == 2)
+        frame->stack[frame->stack_size++] = makeValue(ITEM_Top);
+    return 0;
+}
+
+static int
+pushTag(struct TypeChecker *tc, u1 tag)
+{
+    rt_Value value;
+
+    value = makeValue(tag);
+    return push(tc, &value);
+}
+
+static int
+pushObject(struct TypeChecker *tc, struct Symbol *type)
+{
+    rt_Value value;
+
+    if (!type)
+        return fail(tc, "fail to intern class name");
+    value = makeObject(type);
+    return push(tc, &value);
+}
+
+// pops a value assignable to `expected`
+static int
+pop(struct TypeChecker *tc, rt_Value *expected, rt_Value *actual)
+{
+    rt_Frame *frame;
+    rt_Value *value;
+    char buf[128], buf1[128];
+
+    frame = &(tc->frame);
+    if (isCategory2(expected))
+    {
+        if (frame->stack_size < 2)
+            return fail(tc, "operand stack underflow");
+        value = &(frame->stack[frame->stack_size - 2]);
+        if (frame->stack[frame->stack_size - 1].tag != ITEM_Top
+                || value->tag != expected->tag)
+            return fail(tc, "expected %s on operand stack",
+                    describeValue(expected, buf, sizeof (buf)));
+        frame->stack_size -= 2;
+    }
+    else
+    {
+        if (frame->stack_size < 1)
+            return fail(tc, "operand stack underflow");
+        value = &(frame->stack[frame->stack_size - 1]);
+        if (!isAssignable(tc, value, expected))
+            return fail(tc, "expected %s on operand stack, found %s",
+                    describeValue(expected, buf, sizeof (buf)),
+                    describeValue(value, buf1, sizeof (buf1)));
+        frame->stack_size -= 1;
+    }
+    if (actual)
+        *actual = *value;
+    return 0;
+}
+
+static int
+popTag(struct TypeChecker *tc, u1 tag)
+{
+    rt_Value value;
+
+    value = makeValue(tag);
+    return pop(tc, &value, (rt_Value *) 0);
+}
+
+// pops any reference, initialized or not
+static int
+popReference(struct TypeChecker *tc, rt_Value *actual)
+{
+    rt_Frame *frame;
+    rt_Value *value;
+    char buf[128];
+
+    frame = &(tc->frame);
+    if (frame->stack_size < 1)
+        return fail(tc, "operand stack underflow");
+    value = &(frame->stack[frame->stack_size - 1]);
+    if (!isReference(value))
+        return fail(tc, "expected reference on operand stack, found %s",
+                describeValue(value, buf, sizeof (buf)));
+    --frame->stack_size;
+    *actual = *value;
+    return 0;
+}
+
+static int
+popInitialized(struct TypeChecker *tc, rt_Value *actual)
+{
+    char buf[128];
+
+    if (popReference(tc, actual) < 0)
+        return -1;
+    if (!isInitialized(actual))
+        return fail(tc, "%s used before initialization",
+                describeValue(actual, buf, sizeof (buf)));
+    return 0;
+}
+
+static int
+popArray(struct TypeChecker *tc, rt_Value *actual)
+{
+    char buf[128];
+
+    if (popInitialized(tc, actual) < 0)
+        return -1;
+    if (actual->tag == ITEM_Object && !isArray(actual->type))
+        return fail(tc, "expected array on operand stack, found %s",
+                describeValue(actual, buf, sizeof (buf)));
+    return 0;
+}
+
+/*
+ * Pops then pushes values of primitive types,
+ * e.g. "JI>J" pops an int then a long and pushes a long.
+ */
+static int
+applyEffect(struct TypeChecker *tc, const char *effect)
+{
+    const char *p, *q;
+    u1 tag;
+
+    q = strchr(effect, '>');
+    for (p = q; p-- > effect;)
+    {
+        switch (*p)
+        {
+            case 'I': tag = ITEM_Integer; break;
+            case 'F': tag = ITEM_Float; break;
+            case 'J': tag = ITEM_Long; break;
+            default: tag = ITEM_Double; break;
+        }
+        if (popTag(tc, tag) < 0)
+            return -1;
+    }
+    for (p = q + 1; *p; p++)
+    {
+        switch (*p)
+        {
+            case 'I': tag = ITEM_Integer; break;
+            case 'F': tag = ITEM_Float; break;
+            case 'J': tag = ITEM_Long; break;
+            default: tag = ITEM_Double; break;
+        }
+        if (pushTag(tc, tag) < 0)
+            return -1;
+    }
+    return 0;
+}
+
+/*
+ * Inserts a copy of the top `count` slots
+ * below the `depth` slots under them, as the dup* family does.
+ * Neither boundary may split a long or double.
+ */
+static int
+duplicate(struct TypeChecker *tc, u2 count, u2 depth)
+{
+    rt_Frame *frame;
+    rt_Value *stack;
+    u2 size, i;
+
+    frame = &(tc->frame);
+    stack = frame->stack;
+    size = frame->stack_size;
+    if (size < count + depth)
+        return fail(tc, "operand stack underflow");
+    if (size + count > tc->code->max_stack)
+        return fail(tc, "operand stack overflow");
+    if (stack[size - count].tag == ITEM_Top
+            || depth > 0 && stack[size - count - depth].tag == ITEM_Top)
+        return fail(tc, "instruction splits a long or double");
+    for (i = size; i-- > size - count - depth;)
+        stack[i + count] = stack[i];
+    for (i = 0; i < count; i++)
+        stack[size - count - depth + i] = stack[size + i];
+    frame->stack_size = size + count;
+    return 0;
+}
+
+static int
+discard(struct TypeChecker *tc, u2 count)
+{
+    rt_Frame *frame;
+
+    frame = &(tc->frame);
+    if (frame->stack_size < count)
+        return fail(tc, "operand stack underflow");
+    if (frame->stack[frame->stack_size - count].tag == ITEM_Top)
+        return fail(tc, "instruction splits a long or double");
+    frame->stack_size -= count;
+    return 0;
+}
+
+/*
+ * Local variables
+ */
+static int
+loadLocal(struct TypeChecker *tc, u4 index, u1 tag)
+{
+    rt_Value *value;
+    u4 n;
+    char buf[128];
+
+    n = (tag == ITEM_Long || tag == ITEM_Double) ? 2 : 1;
+    if (index + n > tc->code->max_locals)
+        return fail(tc, "local variable %i out of range", index);
+    value = &(tc->frame.local_types[index]);
+    // aload may load uninitialized references
+    if (tag == ITEM_Object ? !isReference(value) : value->tag != tag)
+        return fail(tc, "local variable %i holds %s", index,
+                describeValue(value, buf, sizeof (buf)));
+    return push(tc, value);
+}
+
+static int
+storeLocal(struct TypeChecker *tc, u4 index, rt_Value *value)
+{
+    rt_Value *locals;
+    u4 n;
+
+    n = isCategory2(value) ? 2 : 1;
+    if (index + n > tc->code->max_locals)
+        return fail(tc, "local variable %i out of range", index);
+    locals = tc->frame.local_types;
+    // overwriting the second half of a long or double invalidates it
+    if (index > 0 && isCategory2(&(locals[index - 1])))
+        locals[index - 1] = makeValue(ITEM_Top);
+    locals[index] = *value;
+    if (n == 2)
+        locals[index + 1] = makeValue(ITEM_Top);
+    return 0;
+}
+
+static int
+store(struct TypeChecker *tc, u4 index, u1 tag)
+{
+    rt_Value value;
+
+    if (tag == ITEM_Object)
+    {
+        if (popReference(tc, &value) < 0)
+            return -1;
+    }
+    else if (popTag(tc, tag) < 0)
+        return -1;
+    else
+        value = makeValue(tag);
+    return storeLocal(tc, index, &value);
+}
+
+/*
+ * Stack map frames
+ */
+static rt_Frame *
+findFrame(struct TypeChecker *tc, u4 pc)
+{
+    u2 low, high, mid;
+
+    low = 0;
+    high = tc->frames_count;
+    while (low < high)
+    {
+        mid = low + (high - low) / 2;
+        if (tc->frames[mid].pc < pc)
+            low = mid + 1;
+        else
+            high = mid;
+    }
+    if (low < tc->frames_count && tc->frames[low].pc == pc)
+        return &(tc->frames[low]);
+    return (rt_Frame *) 0;
+}
+
+static int
+checkFrame(struct TypeChecker *tc, rt_Frame *from, rt_Frame *to)
+{
+    u2 i;
+    char buf[128], buf1[128];
+
+    if (from->stack_size != to->stack_size)
+        return fail(tc, "stack size %i doesn't match "
+                "stack map frame @ %i (%i)",
+                from->stack_size, to->pc, to->stack_size);
+    for (i = 0; i < tc->code->max_locals; i++)
+        if (!isAssignable(tc, &(from->local_types[i]),
+                    &(to->local_types[i])))
+            return fail(tc, "local variable %i: %s doesn't match "
+                    "%s in stack map frame @ %i", i,
+                    describeValue(&(from->local_types[i]), buf, sizeof (buf)),
+                    describeValue(&(to->local_types[i]), buf1, sizeof (buf1)),
+                    to->pc);
+    for (i = 0; i < from->stack_size; i++)
+        if (!isAssignable(tc, &(from->stack[i]), &(to->stack[i])))
+            return fail(tc, "stack slot %i: %s doesn't match "
+                    "%s in stack map frame @ %i", i,
+                    describeValue(&(from->stack[i]), buf, sizeof (buf)),
+                    describeValue(&(to->stack[i]), buf1, sizeof (buf1)),
+                    to->pc);
+    if ((from->flags & FRAME_FLAG_THIS_UNINIT)
+            && !(to->flags & FRAME_FLAG_THIS_UNINIT))
+        return fail(tc, "this is uninitialized, but not in "
+                "stack map frame @ %i", to->pc);
+    return 0;
+}
+
+static void
+copyFrame(struct TypeChecker *tc, rt_Frame *to, rt_Frame *from)
+{
+    memcpy(to->local_types, from->local_types,
+            tc->code->max_locals * sizeof (rt_Value));
+    memcpy(to->stack, from->stack,
+            from->stack_size * sizeof (rt_Value));
+    to->stack_size = from->stack_size;
+    to->flags = from->flags;
+}
+
+static int
+branchTo(struct TypeChecker *tc, int64_t offset)
+{
+    rt_Frame *frame;
+    int64_t target;
+
+    target = (int64_t) tc->pc + offset;
+    if (target < 0 || target >= tc->code->code_length)
+        return fail(tc, "branch target %lli out of code", (long long) target);
+    frame = findFrame(tc, (u4) target);
+    if (!frame)
+        return fail(tc, "no stack map frame @ branch target %lli",
+                (long long) target);
+    return checkFrame(tc, &(tc->frame), frame);
+}
+
+// checks the current locals against every handler covering `pc`
+static int
+checkHandlers(struct TypeChecker *tc)
+{
+    struct exception_table_entry *entry;
+    rt_Frame *frame;
+    rt_Value exception;
+    struct Symbol *type;
+    u2 *entries;
+    u4 count, i;
+    u2 j;
+    char buf[128], buf1[128];
+
+    count = getHandlersAt(tc->handlers, tc->pc, &entries);
+    for (i = 0; i < count; i++)
+    {
+        entry = &(tc->code->exception_table[entries[i]]);
+        frame = findFrame(tc, entry->handler_pc);
+        if (!frame)
+            return fail(tc, "no stack map frame @ exception handler %i",
+                    entry->handler_pc);
+        type = entry->catch_type
+            ? getClassType(tc, entry->catch_type)
+            : tc->java_lang_Throwable;
+        if (!type)
+            return -1;
+        exception = makeObject(type);
+        if (frame->stack_size != 1
+                || !isAssignable(tc, &exception, &(frame->stack[0])))
+            return fail(tc, "stack map frame @ exception handler %i "
+                    "doesn't hold %s", entry->handler_pc,
+                    describeValue(&exception, buf, sizeof (buf)));
+        for (j = 0; j < tc->code->max_locals; j++)
+            if (!isAssignable(tc, &(tc->frame.local_types[j]),
+                        &(frame->local_types[j])))
+                return fail(tc, "local variable %i: %s doesn't match "
+                        "%s in exception handler %i", j,
+                        describeValue(&(tc->frame.local_types[j]), buf, sizeof (buf)),
+                        describeValue(&(frame->local_types[j]), buf1, sizeof (buf1)),
+                        entry->handler_pc);
+        if ((tc->frame.flags & FRAME_FLAG_THIS_UNINIT)
+                && !(frame->flags & FRAME_FLAG_THIS_UNINIT))
+            return fail(tc, "this is uninitialized, but not in "
+                    "exception handler %i", entry->handler_pc);
+    }
+    return 0;
+}
+
+static int
+decodeItem(struct TypeChecker *tc,
+        union verification_type_info *item, rt_Value *value)
+{
+    struct Symbol *type;
+    u2 offset;
+
+    switch (item->Top_variable_info.tag)
+    {
+        case ITEM_Top:
+        case ITEM_Integer:
+        case ITEM_Float:
+        case ITEM_Long:
+        case ITEM_Double:
+        case ITEM_Null:
+        case ITEM_UninitializedThis:
+            *value = makeValue(item->Top_variable_info.tag);
+            return 0;
+        case ITEM_Object:
+            type = getClassType(tc, item->Object_variable_info.cpool_index);
+            if (!type)
+                return -1;
+            *value = makeObject(type);
+            return 0;
+        case ITEM_Uninitialized:
+            offset = item->Uninitialized_variable_info.offset;
+            if (!isInstructionStart(tc->map, offset)
+                    || tc->code->code[offset] != OPCODE_new)
+                return fail(tc, "uninitialized(%i) doesn't refer to "
+                        "a new instruction", offset);
+            *value = makeValue(ITEM_Uninitialized);
+            value->offset = offset;
+            return 0;
+        default:
+            return fail(tc, "unknown verification type %i",
+                    item->Top_variable_info.tag);
+    }
+}
+
+static int
+appendLocal(struct TypeChecker *tc, rt_Frame *frame, u2 *count,
+        union verification_type_info *item)
+{
+    rt_Value value;
+    u2 n;
+
+    if (decodeItem(tc, item, &value) < 0)
+        return -1;
+    n = isCategory2(&value) ? 2 : 1;
+    if (*count + n > tc->code->max_locals)
+        return fail(tc, "stack map frame exceeds max_locals");
+    frame->local_types[(*count)++] = value;
+    if (n == 2)
+        frame->local_types[(*count)++] = makeValue(ITEM_Top);
+    return 0;
+}
+
+static int
+appendStack(struct TypeChecker *tc, rt_Frame *frame,
+        union verification_type_info *item)
+{
+    rt_Value value;
+    u2 n;
+
+    if (decodeItem(tc, item, &value) < 0)
+        return -1;
+    n = isCategory2(&value) ? 2 : 1;
+    if (frame->stack_size + n > tc->code->max_stack)
+        return fail(tc, "stack map frame exceeds max_stack");
+    frame->stack[frame->stack_size++] = value;
+    if (n == 2)
+        frame->stack[frame->stack_size++] = makeValue(ITEM_Top);
+    return 0;
+}
+
+/*
+ * Expands the compressed StackMapTable entries into
+ * full frames, each one based on the previous frame.
+ */
+static int
+loadFrames(struct TypeChecker *tc, attr_StackMapTable_info *smt,
+        rt_Value *values, u2 count)
+{
+    union stack_map_frame *entry;
+    rt_Frame *frame;
+    rt_Value *previous;
+    u4 slots, offset;
+    u2 i, j, delta;
+    u1 type;
+
+    slots = tc->code->max_locals + tc->code->max_stack;
+    previous = tc->frame.local_types;
+    offset = 0;
+    for (i = 0; i < tc->frames_count; i++)
+    {
+        entry = &(smt->entries[i]);
+        frame = &(tc->frames[i]);
+        frame->local_types = values + i * slots;
+        frame->stack = frame->local_types + tc->code->max_locals;
+        frame->stack_size = 0;
+        frame->flags = 0;
+        memcpy(frame->local_types, previous,
+                tc->code->max_locals * sizeof (rt_Value));
+
+        type = entry->same_frame.frame_type;
+        if (type <= SMF_SAME_MAX)
+            delta = type;
+        else if (type <= SMF_SL1SI_MAX)
+            delta = type - SMF_SL1SI_MIN;
+        else if (type >= SMF_SL1SIE)
+            // every frame type from 247 on has offset_delta
+            // at the same place
+            delta = entry->chop_frame.offset_delta;
+        else
+            return fail(tc, "unknown stack map frame type %i", type);
+        offset = i == 0 ? delta : offset + delta + 1;
+        tc->pc = offset;
+        if (offset >= tc->code->code_length)
+            return fail(tc, "stack map frame out of code");
+        frame->pc = offset;
+
+        if (type >= SMF_SL1SI_MIN && type <= SMF_SL1SI_MAX)
+        {
+            if (appendStack(tc, frame,
+                        &(entry->same_locals_1_stack_item_frame.stack)) < 0)
+                return -1;
+        }
+        else if (type == SMF_SL1SIE)
+        {
+            if (appendStack(tc, frame,
+                        &(entry->same_locals_1_stack_item_frame_extended.stack)) < 0)
+                return -1;
+        }
+        else if (type >= SMF_CHOP_MIN && type <= SMF_CHOP_MAX)
+        {
+            for (j = SMF_SAMEE - type; j > 0; j--)
+            {
+                if (count == 0)
+                    return fail(tc, "chop frame removes too many locals");
+                if (count >= 2
+                        && frame->local_types[count - 1].tag == ITEM_Top
+                        && isCategory2(&(frame->local_types[count - 2])))
+                    frame->local_types[--count] = makeValue(ITEM_Top);
+                frame->local_types[--count] = makeValue(ITEM_Top);
+            }
+        }
+        else if (type >= SMF_APPEND_MIN && type <= SMF_APPEND_MAX)
+        {
+            for (j = 0; j < type - SMF_SAMEE; j++)
+                if (appendLocal(tc, frame, &count,
+                            &(entry->append_frame.stack[j])) < 0)
+                    return -1;
+        }
+        else if (type == SMF_FULL)
+        {
+            for (j = 0; j < tc->code->max_locals; j++)
+                frame->local_types[j] = makeValue(ITEM_Top);
+            count = 0;
+            for (j = 0; j < entry->full_frame.number_of_locals; j++)
+                if (appendLocal(tc, frame, &count,
+                            &(entry->full_frame.locals[j])) < 0)
+                    return -1;
+            for (j = 0; j < entry->full_frame.number_of_stack_items; j++)
+                if (appendStack(tc, frame,
+                            &(entry->full_frame.stack[j])) < 0)
+                    return -1;
+        }
+
+        for (j = 0; j < tc->code->max_locals; j++)
+            if (frame->local_types[j].tag == ITEM_UninitializedThis)
+                frame->flags |= FRAME_FLAG_THIS_UNINIT;
+        for (j = 0; j < frame->stack_size; j++)
+            if (frame->stack[j].tag == ITEM_UninitializedThis)
+                frame->flags |= FRAME_FLAG_THIS_UNINIT;
+        previous = frame->local_types;
+    }
+    return 0;
+}
+
+/*
+ * Implicit frame at offset 0 built from the method descriptor,
+ * returns the number of local slots taken by `this` and the parameters.
+ */
+static int
+initFrame(struct TypeChecker *tc, method_info *method)
+{
+    rt_Frame *frame;
+    rt_Value value;
+    u2 *offsets;
+    u2 i, count, end;
+
+    frame = &(tc->frame);
+    for (i = 0; i < tc->code->max_locals; i++)
+        frame->local_types[i] = makeValue(ITEM_Top);
+    frame->stack_size = 0;
+    frame->flags = 0;
+    frame->pc = 0;
+    count = 0;
+    if (!(method->access_flags & ACC_STATIC))
+    {
+        if (tc->is_init && tc->this_class != tc->java_lang_Object)
+        {
+            value = makeValue(ITEM_UninitializedThis);
+            frame->flags |= FRAME_FLAG_THIS_UNINIT;
+        }
+        else
+            value = makeObject(tc->this_class);
+        if (storeLocal(tc, count++, &value) < 0)
+            return -1;
+    }
+    offsets = rt_getParameterOffsets(tc->md);
+    for (i = 0; i < tc->md->parameters_count; i++)
+    {
+        end = i + 1 < tc->md->parameters_count
+            ? offsets[i + 1] : tc->md->off_return_descriptor - 1;
+        if (getDescriptorValue(tc, end - offsets[i],
+                    tc->descriptor->bytes + offsets[i], &value) < 0)
+            return -1;
+        if (storeLocal(tc, count, &value) < 0)
+            return fail(tc, "parameters exceed max_locals");
+        count += isCategory2(&value) ? 2 : 1;
+    }
+    return count;
+}
+
+/*
+ * Instructions
+ */
+static int
+pushConstant(struct TypeChecker *tc, u2 index, u1 is_wide)
+{
+    cp_info *info;
+
+    info = getConstant(tc->cf, index);
+    if (!info)
+        return fail(tc, "constant #%i out of range", index);
+    if (is_wide)
+    {
+        if (info->tag == CONSTANT_Long)
+            return pushTag(tc, ITEM_Long);
+        if (info->tag == CONSTANT_Double)
+            return pushTag(tc, ITEM_Double);
+    }
+    else
+    {
+        switch (info->tag)
+        {
+            case CONSTANT_Integer:
+                return pushTag(tc, ITEM_Integer);
+            case CONSTANT_Float:
+                return pushTag(tc, ITEM_Float);
+            case CONSTANT_String:
+                return pushObject(tc, tc->java_lang_String);
+            case CONSTANT_Class:
+                return pushObject(tc, tc->java_lang_Class);
+            case CONSTANT_MethodType:
+                if (tc->cf->major_version >= 51)
+                    return pushObject(tc, tc->java_lang_invoke_MethodType);
+                break;
+            case CONSTANT_MethodHandle:
+                if (tc->cf->major_version >= 51)
+                    return pushObject(tc, tc->java_lang_invoke_MethodHandle);
+                break;
+        }
+    }
+    return fail(tc, "constant #%i can't be loaded by ldc%s",
+            index, is_wide ? "2_w" : "");
+}
+
+static int
+loadArrayElement(struct TypeChecker *tc, char component)
+{
+    rt_Value array;
+    char c;
+
+    if (popTag(tc, ITEM_Integer) < 0 || popArray(tc, &array) < 0)
+        return -1;
+    if (array.tag == ITEM_Object)
+    {
+        c = array.type->bytes[1];
+        if (component == 'L' ? c != 'L' && c != '['
+                : component == 'B' ? c != 'B' && c != 'Z'
+                : c != component)
+            return fail(tc, "wrong array type %.*s",
+                    array.type->length, (char *) array.type->bytes);
+    }
+    switch (component)
+    {
+        case 'L':
+            if (array.tag == ITEM_Null)
+                return pushTag(tc, ITEM_Null);
+            return pushObject(tc, getComponentType(array.type));
+        case 'F':
+            return pushTag(tc, ITEM_Float);
+        case 'J':
+            return pushTag(tc, ITEM_Long);
+        case 'D':
+            return pushTag(tc, ITEM_Double);
+        default:
+            return pushTag(tc, ITEM_Integer);
+    }
+}
+
+static int
+storeArrayElement(struct TypeChecker *tc, char component)
+{
+    rt_Value array, value;
+    char c;
+
+    switch (component)
+    {
+        case 'L':
+            if (popInitialized(tc, &value) < 0)
+                return -1;
+            break;
+        case 'F':
+            if (popTag(tc, ITEM_Float) < 0)
+                return -1;
+            break;
+        case 'J':
+            if (popTag(tc, ITEM_Long) < 0)
+                return -1;
+            break;
+        case 'D':
+            if (popTag(tc, ITEM_Double) < 0)
+                return -1;
+            break;
+        default:
+            if (popTag(tc, ITEM_Integer) < 0)
+                return -1;
+            break;
+    }
+    if (popTag(tc, ITEM_Integer) < 0 || popArray(tc, &array) < 0)
+        return -1;
+    if (array.tag == ITEM_Object)
+    {
+        c = array.type->bytes[1];
+        if (component == 'L' ? c != 'L' && c != '['
+                : component == 'B' ? c != 'B' && c != 'Z'
+                : c != component)
+            return fail(tc, "wrong array type %.*s",
+                    array.type->length, (char *) array.type->bytes);
+    }
+    return 0;
+}
+
+static int
+accessField(struct TypeChecker *tc, u1 opcode, u2 index)
+{
+    struct Symbol *owner;
+    const_Utf8_data *name, *descriptor;
+    rt_Value value, receiver;
+
+    if (getMemberRef(tc, index, CONSTANT_Fieldref, CONSTANT_Fieldref,
+                &owner, &name, &descriptor) < 0)
+        return -1;
+    if (getDescriptorValue(tc, descriptor->length, descriptor->bytes,
+                &value) < 0)
+        return -1;
+    switch (opcode)
+    {
+        case OPCODE_getstatic:
+            return push(tc, &value);
+        case OPCODE_putstatic:
+            return pop(tc, &value, (rt_Value *) 0);
+        case OPCODE_getfield:
+            if (popInitialized(tc, &receiver) < 0)
+                return -1;
+            return push(tc, &value);
+        default:
+            if (pop(tc, &value, (rt_Value *) 0) < 0
+                    || popReference(tc, &receiver) < 0)
+                return -1;
+            // <init> may set fields of its own class before super()
+            if (receiver.tag == ITEM_UninitializedThis
+                    && owner == tc->this_class)
+                return 0;
+            if (!isInitialized(&receiver))
+                return fail(tc, "putfield on an uninitialized object");
+            return 0;
+    }
+}
+
+// replaces every occurrence of `from` in the current frame with `to`
+static void
+initializeValue(struct TypeChecker *tc, rt_Value *from, rt_Value *to)
+{
+    rt_Frame *frame;
+    u2 i;
+
+    frame = &(tc->frame);
+    for (i = 0; i < tc->code->max_locals; i++)
+        if (isSameValue(&(frame->local_types[i]), from))
+            frame->local_types[i] = *to;
+    for (i = 0; i < frame->stack_size; i++)
+        if (isSameValue(&(frame->stack[i]), from))
+            frame->stack[i] = *to;
+}
+
+static int
+invokeMethod(struct TypeChecker *tc, u1 opcode, u2 index)
+{
+    struct Symbol *owner, *type;
+    const_Utf8_data *name, *descriptor;
+    rt_Descriptor *md;
+    rt_Value value, receiver;
+    u2 *offsets;
+    u2 i, end;
+    u1 *code, is_init;
+    char buf[128];
+
+    switch (opcode)
+    {
+        case OPCODE_invokevirtual:
+            if (getMemberRef(tc, index, CONSTANT_Methodref,
+                        CONSTANT_Methodref, &owner, &name, &descriptor) < 0)
+                return -1;
+            break;
+        case OPCODE_invokeinterface:
+            if (getMemberRef(tc, index, CONSTANT_InterfaceMethodref,
+                        CONSTANT_InterfaceMethodref,
+                        &owner, &name, &descriptor) < 0)
+                return -1;
+            break;
+        case OPCODE_invokedynamic:
+            if (getMemberRef(tc, index, CONSTANT_InvokeDynamic,
+                        CONSTANT_InvokeDynamic,
+                        &owner, &name, &descriptor) < 0)
+                return -1;
+            break;
+        default:
+            if (getMemberRef(tc, index, CONSTANT_Methodref,
+                        CONSTANT_InterfaceMethodref,
+                        &owner, &name, &descriptor) < 0)
+                return -1;
+            break;
+    }
+    md = rt_internDescriptor(descriptor->length, descriptor->bytes);
+    if (!md)
+        return fail(tc, "invalid method descriptor \"%.*s\"",
+                descriptor->length, descriptor->bytes);
+    is_init = name->length == 6
+        && !memcmp(name->bytes, "<init>", 6);
+    if (name->length > 0 && name->bytes[0] == '<'
+            && (!is_init || opcode != OPCODE_invokespecial))
+        return fail(tc, "%.*s can't be invoked by this instruction",
+                name->length, name->bytes);
+    code = tc->code->code + tc->pc;
+    if (opcode == OPCODE_invokeinterface
+            && (tc->insn.value != 1 + md->parameters_length
+                || code[4] != 0))
+        return fail(tc, "invokeinterface count doesn't match descriptor");
+
+    // arguments are popped last to first
+    offsets = rt_getParameterOffsets(md);
+    for (i = md->parameters_count; i-- > 0;)
+    {
+        end = i + 1 < md->parameters_count
+            ? offsets[i + 1] : md->off_return_descriptor - 1;
+        if (getDescriptorValue(tc, end - offsets[i],
+                    descriptor->bytes + offsets[i], &value) < 0
+                || pop(tc, &value, (rt_Value *) 0) < 0)
+            return -1;
+    }
+
+    if (opcode != OPCODE_invokestatic && opcode != OPCODE_invokedynamic)
+    {
+        if (!is_init)
+        {
+            if (popInitialized(tc, &receiver) < 0)
+                return -1;
+        }
+        else
+        {
+            if (popReference(tc, &receiver) < 0)
+                return -1;
+            if (receiver.tag == ITEM_UninitializedThis)
+            {
+                type = tc->this_class;
+                tc->frame.flags &= ~FRAME_FLAG_THIS_UNINIT;
+            }
+            else if (receiver.tag == ITEM_Uninitialized)
+            {
+                type = getClassType(tc, readU2(tc->code->code
+                            + receiver.offset + 1));
+                if (!type)
+                    return -1;
+                if (type != owner)
+                    return fail(tc, "<init> of %.*s invoked on "
+                            "uninitialized %.*s",
+                            owner->length, (char *) owner->bytes,
+                            type->length, (char *) type->bytes);
+            }
+            else
+                return fail(tc, "<init> invoked on initialized %s",
+                        describeValue(&receiver, buf, sizeof (buf)));
+            value = makeObject(type);
+            initializeValue(tc, &receiver, &value);
+        }
+    }
+
+    if (descriptor->bytes[md->off_return_descriptor] == 'V')
+        return 0;
+    if (getDescriptorValue(tc,
+                descriptor->length - md->off_return_descriptor,
+                descriptor->bytes + md->off_return_descriptor, &value) < 0)
+        return -1;
+    return push(tc, &value);
+}
+
+static int
+returnValue(struct TypeChecker *tc, u1 opcode)
+{
+    u1 *str;
+    u2 len;
+    rt_Value value;
+
+    str = tc->descriptor->bytes + tc->md->off_return_descriptor;
+    len = tc->descriptor->length - tc->md->off_return_descriptor;
+    if (opcode == OPCODE_return)
+    {
+        if (str[0] != 'V')
+            return fail(tc, "return in a method returning %.*s", len, str);
+        if (tc->frame.flags & FRAME_FLAG_THIS_UNINIT)
+            return fail(tc, "<init> returns before this is initialized");
+        return 0;
+    }
+    if (str[0] == 'V')
+        return fail(tc, "value returned from a void method");
+    if (getDescriptorValue(tc, len, str, &value) < 0)
+        return -1;
+    if (opcode == OPCODE_areturn ? value.tag != ITEM_Object
+            : opcode == OPCODE_ireturn ? value.tag != ITEM_Integer
+            : opcode == OPCODE_lreturn ? value.tag != ITEM_Long
+            : opcode == OPCODE_freturn ? value.tag != ITEM_Float
+            : value.tag != ITEM_Double)
+        return fail(tc, "return type doesn't match %.*s", len, str);
+    return pop(tc, &value, (rt_Value *) 0);
+}
+
+static int
+createArray(struct TypeChecker *tc, u1 opcode)
+{
+    static const char *primitive_arrays[] = {
+        "[Z", "[C", "[F", "[D", "[B", "[S", "[I", "[J"
+    };
+    struct Instruction *insn;
+    struct Symbol *type;
+    u1 dimensions, buf[256], *name;
+    u2 i, len;
+
+    insn = &(tc->insn);
+    switch (opcode)
+    {
+        case OPCODE_newarray:
+            if (insn->value < 4 || insn->value > 11)
+                return fail(tc, "invalid newarray type %i", insn->value);
+            if (popTag(tc, ITEM_Integer) < 0)
+                return -1;
+            return pushObject(tc,
+                    internName(primitive_arrays[insn->value - 4]));
+        case OPCODE_anewarray:
+            type = getClassType(tc, insn->index);
+            if (!type || popTag(tc, ITEM_Integer) < 0)
+                return -1;
+            len = type->length + (isArray(type) ? 1 : 3);
+            if (len < type->length)
+                return fail(tc, "array type too long");
+            name = len <= sizeof (buf) ? buf
+                : (u1 *) allocMemory(len, sizeof (u1));
+            if (!name)
+                return fail(tc, "fail to allocate memory");
+            name[0] = '[';
+            if (isArray(type))
+                memcpy(name + 1, type->bytes, type->length);
+            else
+            {
+                name[1] = 'L';
+                memcpy(name + 2, type->bytes, type->length);
+                name[len - 1] = ';';
+            }
+            type = symbol_intern(len, name);
+            if (name != buf)
+                freeMemory(name);
+            return pushObject(tc, type);
+        default:
+            type = getClassType(tc, insn->index);
+            if (!type)
+                return -1;
+            dimensions = (u1) insn->value;
+            for (i = 0; i < type->length && type->bytes[i] == '['; i++)
+                ;
+            if (dimensions == 0 || dimensions > i)
+                return fail(tc, "multianewarray of %i dimensions "
+                        "creates %.*s", dimensions,
+                        type->length, (char *) type->bytes);
+            for (i = 0; i < dimensions; i++)
+                if (popTag(tc, ITEM_Integer) < 0)
+                    return -1;
+            return pushObject(tc, type);
+    }
+}
+
+static int
+checkSwitch(struct TypeChecker *tc)
+{
+    struct Instruction *insn;
+    u4 i;
+
+    if (popTag(tc, ITEM_Integer) < 0)
+        return -1;
+    insn = &(tc->insn);
+    if (branchTo(tc, insn->offset) < 0)
+        return -1;
+    for (i = 0; i < insn->cases; i++)
+        if (branchTo(tc, getSwitchOffset(insn, i)) < 0)
+            return -1;
+    return 0;
+}
+
+// loads or stores through the wide form or the short form
+static int
+accessLocal(struct TypeChecker *tc, u1 opcode, u4 index)
+{
+    switch (opcode)
+    {
+        case OPCODE_iload: return loadLocal(tc, index, ITEM_Integer);
+        case OPCODE_lload: return loadLocal(tc, index, ITEM_Long);
+        case OPCODE_fload: return loadLocal(tc, index, ITEM_Float);
+        case OPCODE_dload: return loadLocal(tc, index, ITEM_Double);
+        case OPCODE_aload: return loadLocal(tc, index, ITEM_Object);
+        case OPCODE_istore: return store(tc, index, ITEM_Integer);
+        case OPCODE_lstore: return store(tc, index, ITEM_Long);
+        case OPCODE_fstore: return store(tc, index, ITEM_Float);
+        case OPCODE_dstore: return store(tc, index, ITEM_Double);
+        case OPCODE_astore: return store(tc, index, ITEM_Object);
+        case OPCODE_iinc:
+            if (index >= tc->code->max_locals)
+                return fail(tc, "local variable %i out of range", index);
+            if (tc->frame.local_types[index].tag != ITEM_Integer)
+                return fail(tc, "iinc of non-int local variable %i", index);
+            return 0;
+        default:
+            return fail(tc, "jsr and ret aren't allowed "
+                    "with StackMapTable");
+    }
+}
+
+/*
+ * Applies the instruction at `tc->pc` to the current frame,
+ * `fallthrough` is cleared after unconditional control transfers.
+ */
+static int
+execute(struct TypeChecker *tc, u1 *fallthrough)
+{
+    struct Instruction *insn;
+    const char *effect;
+    rt_Value value, value1;
+    rt_Frame *frame;
+    struct Symbol *type;
+    u2 i;
+    u1 opcode;
+
+    insn = &(tc->insn);
+    opcode = insn->opcode;
+    frame = &(tc->frame);
+    effect = (const char *) 0;
+    *fallthrough = 1;
+    // wide instructions are decoded as the opcode they modify
+    if (insn->wide && insn->info->kind != OPK_LOCAL)
+        return fail(tc, "invalid wide opcode 0x%X", opcode);
+    switch (opcode)
+    {
+        case OPCODE_nop:
+            return 0;
+        case OPCODE_aconst_null:
+            return pushTag(tc, ITEM_Null);
+        case OPCODE_iconst_m1:case OPCODE_iconst_0:case OPCODE_iconst_1:
+        case OPCODE_iconst_2:case OPCODE_iconst_3:case OPCODE_iconst_4:
+        case OPCODE_iconst_5:case OPCODE_bipush:case OPCODE_sipush:
+            effect = ">I";
+            break;
+        case OPCODE_lconst_0:case OPCODE_lconst_1:
+            effect = ">J";
+            break;
+        case OPCODE_fconst_0:case OPCODE_fconst_1:case OPCODE_fconst_2:
+            effect = ">F";
+            break;
+        case OPCODE_dconst_0:case OPCODE_dconst_1:
+            effect = ">D";
+            break;
+        case OPCODE_ldc:case OPCODE_ldc_w:
+            return pushConstant(tc, insn->index, 0);
+        case OPCODE_ldc2_w:
+            return pushConstant(tc, insn->index, 1);
+
+        case OPCODE_iload:case OPCODE_lload:case OPCODE_fload:
+        case OPCODE_dload:case OPCODE_aload:
+        case OPCODE_istore:case OPCODE_lstore:case OPCODE_fstore:
+        case OPCODE_dstore:case OPCODE_astore:
+        case OPCODE_ret:
+            return accessLocal(tc, opcode, insn->index);
+        case OPCODE_iload_0:case OPCODE_iload_1:
+        case OPCODE_iload_2:case OPCODE_iload_3:
+            return loadLocal(tc, opcode - OPCODE_iload_0, ITEM_Integer);
+        case OPCODE_lload_0:case OPCODE_lload_1:
+        case OPCODE_lload_2:case OPCODE_lload_3:
+            return loadLocal(tc, opcode - OPCODE_lload_0, ITEM_Long);
+        case OPCODE_fload_0:case OPCODE_fload_1:
+        case OPCODE_fload_2:case OPCODE_fload_3:
+            return loadLocal(tc, opcode - OPCODE_fload_0, ITEM_Float);
+        case OPCODE_dload_0:case OPCODE_dload_1:
+        case OPCODE_dload_2:case OPCODE_dload_3:
+            return loadLocal(tc, opcode - OPCODE_dload_0, ITEM_Double);
+        case OPCODE_aload_0:case OPCODE_aload_1:
+        case OPCODE_aload_2:case OPCODE_aload_3:
+            return loadLocal(tc, opcode - OPCODE_aload_0, ITEM_Object);
+        case OPCODE_istore_0:case OPCODE_istore_1:
+        case OPCODE_istore_2:case OPCODE_istore_3:
+            return store(tc, opcode - OPCODE_istore_0, ITEM_Integer);
+        case OPCODE_lstore_0:case OPCODE_lstore_1:
+        case OPCODE_lstore_2:case OPCODE_lstore_3:
+            return store(tc, opcode - OPCODE_lstore_0, ITEM_Long);
+        case OPCODE_fstore_0:case OPCODE_fstore_1:
+        case OPCODE_fstore_2:case OPCODE_fstore_3:
+            return store(tc, opcode - OPCODE_fstore_0, ITEM_Float);
+        case OPCODE_dstore_0:case OPCODE_dstore_1:
+        case OPCODE_dstore_2:case OPCODE_dstore_3:
+            return store(tc, opcode - OPCODE_dstore_0, ITEM_Double);
+        case OPCODE_astore_0:case OPCODE_astore_1:
+        case OPCODE_astore_2:case OPCODE_astore_3:
+            return store(tc, opcode - OPCODE_astore_0, ITEM_Object);
+
+        case OPCODE_iaload: return loadArrayElement(tc, 'I');
+        case OPCODE_laload: return loadArrayElement(tc, 'J');
+        case OPCODE_faload: return loadArrayElement(tc, 'F');
+        case OPCODE_daload: return loadArrayElement(tc, 'D');
+        case OPCODE_aaload: return loadArrayElement(tc, 'L');
+        case OPCODE_baload: return loadArrayElement(tc, 'B');
+        case OPCODE_caload: return loadArrayElement(tc, 'C');
+        case OPCODE_saload: return loadArrayElement(tc, 'S');
+        case OPCODE_iastore: return storeArrayElement(tc, 'I');
+        case OPCODE_lastore: return storeArrayElement(tc, 'J');
+        case OPCODE_fastore: return storeArrayElement(tc, 'F');
+        case OPCODE_dastore: return storeArrayElement(tc, 'D');
+        case OPCODE_aastore: return storeArrayElement(tc, 'L');
+        case OPCODE_bastore: return storeArrayElement(tc, 'B');
+        case OPCODE_castore: return storeArrayElement(tc, 'C');
+        case OPCODE_sastore: return storeArrayElement(tc, 'S');
+
+        case OPCODE_pop: return discard(tc, 1);
+        case OPCODE_pop2: return discard(tc, 2);
+        case OPCODE_dup: return duplicate(tc, 1, 0);
+        case OPCODE_dup_x1: return duplicate(tc, 1, 1);
+        case OPCODE_dup_x2: return duplicate(tc, 1, 2);
+        case OPCODE_dup2: return duplicate(tc, 2, 0);
+        case OPCODE_dup2_x1: return duplicate(tc, 2, 1);
+        case OPCODE_dup2_x2: return duplicate(tc, 2, 2);
+        case OPCODE_swap:
+            if (frame->stack_size < 2)
+                return fail(tc, "operand stack underflow");
+            value = frame->stack[frame->stack_size - 1];
+            value1 = frame->stack[frame->stack_size - 2];
+            if (value.tag == ITEM_Top || value1.tag == ITEM_Top)
+                return fail(tc, "instruction splits a long or double");
+            frame->stack[frame->stack_size - 1] = value1;
+            frame->stack[frame->stack_size - 2] = value;
+            return 0;
+
+        case OPCODE_iadd:case OPCODE_isub:case OPCODE_imul:
+        case OPCODE_idiv:case OPCODE_irem:case OPCODE_ishl:
+        case OPCODE_ishr:case OPCODE_iushr:case OPCODE_iand:
+        case OPCODE_ior:case OPCODE_ixor:
+            effect = "II>I";
+            break;
+        case OPCODE_ladd:case OPCODE_lsub:case OPCODE_lmul:
+        case OPCODE_ldiv:case OPCODE_lrem:case OPCODE_land:
+        case OPCODE_lor:case OPCODE_lxor:
+            effect = "JJ>J";
+            break;
+        case OPCODE_lshl:case OPCODE_lshr:case OPCODE_lushr:
+            effect = "JI>J";
+            break;
+        case OPCODE_fadd:case OPCODE_fsub:case OPCODE_fmul:
+        case OPCODE_fdiv:case OPCODE_frem:
+            effect = "FF>F";
+            break;
+        case OPCODE_dadd:case OPCODE_dsub:case OPCODE_dmul:
+        case OPCODE_ddiv:case OPCODE_drem:
+            effect = "DD>D";
+            break;
+        case OPCODE_ineg:case OPCODE_i2b:case OPCODE_i2c:case OPCODE_i2s:
+            effect = "I>I";
+            break;
+        case OPCODE_lneg: effect = "J>J"; break;
+        case OPCODE_fneg: effect = "F>F"; break;
+        case OPCODE_dneg: effect = "D>D"; break;
+        case OPCODE_iinc:
+            return accessLocal(tc, opcode, insn->index);
+        case OPCODE_i2l: effect = "I>J"; break;
+        case OPCODE_i2f: effect = "I>F"; break;
+        case OPCODE_i2d: effect = "I>D"; break;
+        case OPCODE_l2i: effect = "J>I"; break;
+        case OPCODE_l2f: effect = "J>F"; break;
+        case OPCODE_l2d: effect = "J>D"; break;
+        case OPCODE_f2i: effect = "F>I"; break;
+        case OPCODE_f2l: effect = "F>J"; break;
+        case OPCODE_f2d: effect = "F>D"; break;
+        case OPCODE_d2i: effect = "D>I"; break;
+        case OPCODE_d2l: effect = "D>J"; break;
+        case OPCODE_d2f: effect = "D>F"; break;
+        case OPCODE_lcmp: effect = "JJ>I"; break;
+        case OPCODE_fcmpl:case OPCODE_fcmpg: effect = "FF>I"; break;
+        case OPCODE_dcmpl:case OPCODE_dcmpg: effect = "DD>I"; break;
+
+        case OPCODE_ifeq:case OPCODE_ifne:case OPCODE_iflt:
+        case OPCODE_ifge:case OPCODE_ifgt:case OPCODE_ifle:
+            if (popTag(tc, ITEM_Integer) < 0)
+                return -1;
+            return branchTo(tc, insn->offset);
+        case OPCODE_if_icmpeq:case OPCODE_if_icmpne:case OPCODE_if_icmplt:
+        case OPCODE_if_icmpge:case OPCODE_if_icmpgt:case OPCODE_if_icmple:
+            if (popTag(tc, ITEM_Integer) < 0
+                    || popTag(tc, ITEM_Integer) < 0)
+                return -1;
+            return branchTo(tc, insn->offset);
+        case OPCODE_if_acmpeq:case OPCODE_if_acmpne:
+            if (popReference(tc, &value) < 0
+                    || popReference(tc, &value1) < 0)
+                return -1;
+            return branchTo(tc, insn->offset);
+        case OPCODE_ifnull:case OPCODE_ifnonnull:
+            if (popReference(tc, &value) < 0)
+                return -1;
+            return branchTo(tc, insn->offset);
+        case OPCODE_goto:
+            *fallthrough = 0;
+            return branchTo(tc, insn->offset);
+        case OPCODE_goto_w:
+            *fallthrough = 0;
+            return branchTo(tc, insn->offset);
+        case OPCODE_jsr:case OPCODE_jsr_w:
+            return accessLocal(tc, opcode, 0);
+        case OPCODE_tableswitch:case OPCODE_lookupswitch:
+            *fallthrough = 0;
+            return checkSwitch(tc);
+        case OPCODE_ireturn:case OPCODE_lreturn:case OPCODE_freturn:
+        case OPCODE_dreturn:case OPCODE_areturn:case OPCODE_return:
+            *fallthrough = 0;
+            return returnValue(tc, opcode);
+
+        case OPCODE_getstatic:case OPCODE_putstatic:
+        case OPCODE_getfield:case OPCODE_putfield:
+            return accessField(tc, opcode, insn->index);
+        case OPCODE_invokevirtual:case OPCODE_invokespecial:
+        case OPCODE_invokestatic:case OPCODE_invokeinterface:
+        case OPCODE_invokedynamic:
+            return invokeMethod(tc, opcode, insn->index);
+        case OPCODE_new:
+            type = getClassType(tc, insn->index);
+            if (!type)
+                return -1;
+            if (isArray(type))
+                return fail(tc, "new of array type %.*s",
+                        type->length, (char *) type->bytes);
+            value = makeValue(ITEM_Uninitialized);
+            value.offset = (u2) tc->pc;
+            for (i = 0; i < frame->stack_size; i++)
+                if (isSameValue(&(frame->stack[i]), &value))
+                    return fail(tc, "uninitialized(%i) is already "
+                            "on the operand stack", value.offset);
+            value1 = makeValue(ITEM_Top);
+            initializeValue(tc, &value, &value1);
+            return push(tc, &value);
+        case OPCODE_newarray:case OPCODE_anewarray:
+        case OPCODE_multianewarray:
+            return createArray(tc, opcode);
+        case OPCODE_arraylength:
+            if (popArray(tc, &value) < 0)
+                return -1;
+            return pushTag(tc, ITEM_Integer);
+        case OPCODE_athrow:
+            *fallthrough = 0;
+            if (popInitialized(tc, &value) < 0)
+                return -1;
+            if (value.tag == ITEM_Object && isArray(value.type))
+                return fail(tc, "athrow of an array");
+            return 0;
+        case OPCODE_checkcast:
+            type = getClassType(tc, insn->index);
+            if (!type || popInitialized(tc, &value) < 0)
+                return -1;
+            return pushObject(tc, type);
+        case OPCODE_instanceof:
+            if (!getClassType(tc, insn->index)
+                    || popInitialized(tc, &value) < 0)
+                return -1;
+            return pushTag(tc, ITEM_Integer);
+        case OPCODE_monitorenter:case OPCODE_monitorexit:
+            return popInitialized(tc, &value);
+        default:
+            return fail(tc, "invalid opcode 0x%X", opcode);
+    }
+    return applyEffect(tc, effect);
+}
+
+static int
+checkCode(struct TypeChecker *tc)
+{
+    struct InstructionIterator it;
+    rt_Frame *frame;
+    u4 pc;
+    u2 frame_index;
+    u1 fallthrough;
+    int result;
+
+    frame_index = 0;
+    fallthrough = 1;
+    initInstructionIterator(&it, tc->code->code, tc->code->code_length);
+    while ((result = nextInstruction(&it, &(tc->insn))) != 0)
+    {
+        pc = tc->insn.pc;
+        tc->pc = pc;
+        frame = frame_index < tc->frames_count
+            ? &(tc->frames[frame_index]) : (rt_Frame *) 0;
+        if (frame && frame->pc < pc)
+        {
+            tc->pc = frame->pc;
+            return fail(tc, "stack map frame isn't at an instruction");
+        }
+        if (frame && frame->pc == pc)
+        {
+            if (fallthrough && checkFrame(tc, &(tc->frame), frame) < 0)
+                return -1;
+            copyFrame(tc, &(tc->frame), frame);
+            ++frame_index;
+        }
+        else if (!fallthrough)
+            return fail(tc, "no stack map frame after "
+                    "an unconditional branch");
+        if (result < 0)
+            return fail(tc, "truncated or invalid instruction 0x%X",
+                    tc->code->code[pc]);
+        if (checkHandlers(tc) < 0 || execute(tc, &fallthrough) < 0)
+            return -1;
+    }
+    if (frame_index < tc->frames_count)
+    {
+        tc->pc = tc->frames[frame_index].pc;
+        return fail(tc, "stack map frame isn't at an instruction");
+    }
+    if (fallthrough)
+        return fail(tc, "execution falls off the end of code");
+    return 0;
+}
+
+/*
+ * Frame pool
+ */
+extern void
+initFramePool(struct FramePool *pool)
+{
+    memset(pool, 0, sizeof (struct FramePool));
+    initHandlerIndex(&(pool->handlers));
+}
+
+extern void
+releaseFramePool(struct FramePool *pool)
+{
+    freeMemory(pool->frames);
+    freeMemory(pool->values);
+    releaseHandlerIndex(&(pool->handlers));
+    initFramePool(pool);
+}
+
+static int
+reserveFramePool(struct FramePool *pool, u4 frames, u4 values)
+{
+    if (frames > pool->frames_capacity)
+    {
+        freeMemory(pool->frames);
+        pool->frames = (rt_Frame *) allocMemory(frames, sizeof (rt_Frame));
+        pool->frames_capacity = pool->frames ? frames : 0;
+        if (!pool->frames)
+            return -1;
+    }
+    if (values > pool->values_capacity)
+    {
+        freeMemory(pool->values);
+        pool->values = (rt_Value *) allocMemory(values, sizeof (rt_Value));
+        pool->values_capacity = pool->values ? values : 0;
+        if (!pool->values)
+            return -1;
+    }
+    return 0;
+}
+
+extern int
+typecheckMethod(ClassFile *cf, method_info *method, struct CodeMap *map,
+        struct FramePool *pool, struct VerifyError *error)
+{
+    struct TypeChecker tc;
+    attr_info *attribute;
+    attr_StackMapTable_info *smt;
+    const_Utf8_data *name;
+    u4 slots;
+    u2 i;
+    int count;
+
+    memset(&tc, 0, sizeof (struct TypeChecker));
+    tc.cf = cf;
+    tc.map = map;
+    tc.error = error;
+    error->pc = 0;
+    error->reason[0] = '\0';
+    for (i = 0; i < method->attributes_count; i++)
+        if (method->attributes[i].tag == TAG_ATTR_CODE)
+            tc.code = (attr_Code_info *) method->attributes[i].data;
+    if (!tc.code)
+        return 0;
+    smt = (attr_StackMapTable_info *) 0;
+    for (i = 0; i < tc.code->attributes_count; i++)
+    {
+        attribute = &(tc.code->attributes[i]);
+        if (attribute->tag != TAG_ATTR_STACKMAPTABLE)
+            continue;
+        if (smt)
+            return fail(&tc, "more than one StackMapTable");
+        smt = (attr_StackMapTable_info *) attribute->data;
+    }
+    tc.frames_count = smt ? smt->number_of_entries : 0;
+    if (tc.code->code_length == 0)
+        return fail(&tc, "empty code");
+    if (map->code_length != tc.code->code_length)
+        return fail(&tc, "code structure wasn't checked");
+
+    name = getConstant_Utf8(cf, method->name_index);
+    tc.descriptor = getConstant_Utf8(cf, method->descriptor_index);
+    if (!name || !tc.descriptor)
+        return fail(&tc, "method has no name or descriptor");
+    tc.md = rt_internDescriptor(tc.descriptor->length,
+            tc.descriptor->bytes);
+    if (!tc.md)
+        return fail(&tc, "invalid method descriptor");
+    tc.is_init = name->length == 6 && !memcmp(name->bytes, "<init>", 6);
+    tc.this_class = getClassType(&tc, cf->this_class);
+    if (!tc.this_class)
+        return -1;
+    tc.java_lang_Object = internName("java/lang/Object");
+    tc.java_lang_String = internName("java/lang/String");
+    tc.java_lang_Class = internName("java/lang/Class");
+    tc.java_lang_Throwable = internName("java/lang/Throwable");
+    tc.java_lang_Cloneable = internName("java/lang/Cloneable");
+    tc.java_io_Serializable = internName("java/io/Serializable");
+    tc.java_lang_invoke_MethodType = internName("java/lang/invoke/MethodType");
+    tc.java_lang_invoke_MethodHandle = internName("java/lang/invoke/MethodHandle");
+
+    // the current frame takes the slots after the stack map frames
+    slots = tc.code->max_locals + tc.code->max_stack;
+    if (reserveFramePool(pool, tc.frames_count,
+                (tc.frames_count + 1) * slots) < 0)
+        return fail(&tc, "fail to allocate frames");
+    tc.frames = pool->frames;
+    tc.frame.local_types = pool->values + tc.frames_count * slots;
+    tc.frame.stack = tc.frame.local_types + tc.code->max_locals;
+    if (buildHandlerIndex(&(pool->handlers), tc.code) < 0)
+        return fail(&tc, "invalid exception table");
+    tc.handlers = &(pool->handlers);
+
+    count = initFrame(&tc, method);
+    if (count < 0)
+        return -1;
+    if (smt && loadFrames(&tc, smt, pool->values, (u2) count) < 0)
+        return -1;
+    return checkCode(&tc);
+}
@@ -0,0 +1,839 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+#include "java.h"
+#include "rt.h"
+#include "trace.h"
+#include "log.h"
+#include "memory.h"
+
+#define TRACE_BUFFER_SIZE           65536
+// room kept in the output buffer before an answer is written
+#define TRACE_ANSWER_SIZE           4096
+// connections served at once, later ones wait in the backlog
+#define TRACE_WORKERS               16
+
+struct TraceServer
+{
+    struct TraceIndex *index;
+    const char *    path;
+    int             fd;
+};
+
+extern void
+initTraceIndex(struct TraceIndex *index)
+{
+    memset(index, 0, sizeof (struct TraceIndex));
+    arena_init(&(index->arena));
+}
+
+extern void
+releaseTraceIndex(struct TraceIndex *index)
+{
+    arena_release(&(index->arena));
+    freeMemory(index->classes);
+    memset(index, 0, sizeof (struct TraceIndex));
+}
+
+static int
+compareBytes(u1 *a, u2 alen, u1 *b, u2 blen)
+{
+    int res;
+
+    res = memcmp(a, b, alen < blen ? alen : blen);
+    if (res)
+        return res;
+    return (int) alen - (int) blen;
+}
+
+static int
+compareMethods(const void *a, const void *b)
+{
+    struct TraceMethod *x, *y;
+    int res;
+
+    x = (struct TraceMethod *) a;
+    y = (struct TraceMethod *) b;
+    res = compareBytes(x->name, x->name_length, y->name, y->name_length);
+    if (res)
+        return res;
+    return compareBytes(x->descriptor, x->descriptor_length,
+            y->descriptor, y->descriptor_length);
+}
+
+static int
+compareClasses(const void *a, const void *b)
+{
+    struct TraceClass *x, *y;
+    int res;
+
+    x = *(struct TraceClass **) a;
+    y = *(struct TraceClass **) b;
+    res = compareBytes(x->name, x->name_length, y->name, y->name_length);
+    if (res)
+        return res;
+    return x->order < y->order ? -1 : x->order > y->order;
+}
+
+static int
+compareSmapLines(const void *a, const void *b)
+{
+    u4 x, y;
+
+    x = ((struct TraceLine *) a)->output_start;
+    y = ((struct TraceLine *) b)->output_start;
+    return x < y ? -1 : x > y;
+}
+
+// first output line after the entry, an increment of 0 maps one line
+static u4
+getSmapEnd(struct TraceLine *tl)
+{
+    u8 end;
+
+    if (tl->increment == 0)
+        end = (u8) tl->output_start + 1;
+    else
+        end = (u8) tl->output_start + (u8) tl->repeat * tl->increment;
+    return end > 0xffffffffu ? 0xffffffffu : (u4) end;
+}
+
+static void
+addSmapRange(struct TraceClass *cls, u4 start, u4 end,
+        struct TraceLine *tl)
+{
+    struct TraceRange *range;
+    u4 i;
+
+    range = &(cls->ranges[cls->ranges_count++]);
+    range->output_start = start;
+    range->output_end = end;
+    range->line = tl;
+    range->file = (struct TraceFile *) 0;
+    for (i = 0; i < cls->files_count; i++)
+        if (cls->files[i].id == tl->file)
+        {
+            range->file = &(cls->files[i]);
+            break;
+        }
+}
+
+/*
+ * Splits the sorted entries into disjoint ranges, where entries
+ * overlap the one starting last wins. Entries still open are kept
+ * on a stack, the top one owns the lines up to the next start.
+ */
+static int
+buildSmapRanges(struct TraceIndex *index, struct TraceClass *cls)
+{
+    struct TraceLine **stack, *top;
+    u4 depth, i, cursor, next, end;
+
+    if (cls->smap_count == 0)
+        return 0;
+    stack = (struct TraceLine **) arena_alloc(&(index->arena),
+            cls->smap_count * sizeof (struct TraceLine *));
+    // every entry adds one range, and one more when it resumes
+    cls->ranges = (struct TraceRange *) arena_alloc(&(index->arena),
+            2 * cls->smap_count * sizeof (struct TraceRange));
+    if (!stack || !cls->ranges)
+        return -1;
+    depth = 0;
+    cursor = 0;
+    for (i = 0; i <= cls->smap_count; i++)
+    {
+        next = i < cls->smap_count ? cls->smap[i].output_start : 0xffffffffu;
+        while (depth > 0 && cursor < next)
+        {
+            top = stack[depth - 1];
+            end = getSmapEnd(top);
+            if (end <= cursor)
+            {
+                --depth;
+                continue;
+            }
+            if (end > next)
+                end = next;
+            addSmapRange(cls, cursor, end, top);
+            cursor = end;
+        }
+        if (i < cls->smap_count)
+        {
+            cursor = next;
+            stack[depth++] = &(cls->smap[i]);
+        }
+    }
+    return 0;
+}
+
+/*
+ * SourceDebugExtension (JSR 45)
+ *
+ * Only the file and line sections of the default stratum
+ * are kept, which is where Kotlin maps inlined code and JSP
+ * compilers map template lines.
+ */
+static int
+parseSmap(struct TraceIndex *index, struct TraceClass *cls,
+        u1 *data, u4 length)
+{
+    char *text, *line, *next, *end;
+    char *stratum;
+    u4 lines, number, file, repeat, output, increment;
+    u1 in_stratum, section, has_path;
+    struct TraceFile *tf;
+    struct TraceLine *tl;
+
+    text = (char *) arena_alloc(&(index->arena), length + 1);
+    if (!text)
+        return -1;
+    memcpy(text, data, length);
+    lines = 1;
+    for (end = text; end < text + length; end++)
+        if (*end == '\n')
+            ++lines;
+    cls->files = (struct TraceFile *)
+        arena_alloc(&(index->arena), lines * sizeof (struct TraceFile));
+    cls->smap = (struct TraceLine *)
+        arena_alloc(&(index->arena), lines * sizeof (struct TraceLine));
+    if (!cls->files || !cls->smap)
+        return -1;
+
+    number = 0;
+    stratum = (char *) 0;
+    in_stratum = 0;
+    section = 0;
+    file = 0;
+    has_path = 0;
+    for (line = text; line < text + length; line = next)
+    {
+        next = strchr(line, '\n');
+        if (next)
+            *next++ = '\0';
+        else
+            next = text + length;
+        end = line + strlen(line);
+        if (end > line && end[-1] == '\r')
+            end[-1] = '\0';
+        // SMAP, output file name and default stratum come first
+        if (number++ < 3)
+        {
+            if (number == 1 && strcmp(line, "SMAP"))
+                return 0;
+            if (number == 3)
+                stratum = line;
+            continue;
+        }
+        if (line[0] == '*')
+        {
+            section = line[1];
+            if (section == 'S')
+                in_stratum = !strcmp(line + 2 + (line[2] == ' '), stratum);
+            if (section == 'E')
+                break;
+            continue;
+        }
+        if (!in_stratum)
+            continue;
+        if (section == 'F')
+        {
+            // "+ id name" is followed by the path of the file
+            if (has_path)
+            {
+                has_path = 0;
+                continue;
+            }
+            if (line[0] == '+')
+            {
+                has_path = 1;
+                ++line;
+            }
+            while (*line == ' ')
+                ++line;
+            if (*line < '0' || *line > '9')
+                continue;
+            tf = &(cls->files[cls->files_count++]);
+            tf->id = (u4) strtoul(line, &end, 10);
+            while (*end == ' ')
+                ++end;
+            tf->name = (u1 *) end;
+            tf->length = (u2) strlen(end);
+        }
+        else if (section == 'L')
+        {
+            // input[#file][,repeat]:output[,increment]
+            if (*line < '0' || *line > '9')
+                continue;
+            tl = &(cls->smap[cls->smap_count]);
+            tl->input_start = (u4) strtoul(line, &end, 10);
+            if (*end == '#')
+                file = (u4) strtoul(end + 1, &end, 10);
+            repeat = 1;
+            if (*end == ',')
+                repeat = (u4) strtoul(end + 1, &end, 10);
+            if (*end != ':')
+                continue;
+            output = (u4) strtoul(end + 1, &end, 10);
+            increment = 1;
+            if (*end == ',')
+                increment = (u4) strtoul(end + 1, &end, 10);
+            tl->file = file;
+            tl->repeat = repeat;
+            tl->output_start = output;
+            tl->increment = increment;
+            ++cls->smap_count;
+        }
+    }
+    qsort(cls->smap, cls->smap_count, sizeof (struct TraceLine),
+            compareSmapLines);
+    return buildSmapRanges(index, cls);
+}
+
+extern int
+addTraceClass(struct TraceIndex *index, rt_Class *rtc)
+{
+    struct TraceClass *cls, **classes;
+    struct TraceMethod *tm;
+    const_Class_data *this_class;
+    const_Utf8_data *name, *descriptor;
+    attr_info *info;
+    u4 *lines;
+    u4 capacity, count;
+
+    this_class = rtc->getThisClass();
+    name = this_class ? rtc->getConstant_Utf8(this_class->name_index)
+        : (const_Utf8_data *) 0;
+    if (!name)
+    {
+        logError("Class has no name!\r\n");
+        return -1;
+    }
+    if (index->classes_count == index->classes_capacity)
+    {
+        capacity = index->classes_capacity ? 2 * index->classes_capacity : 256;
+        classes = (struct TraceClass **)
+            allocMemory(capacity, sizeof (struct TraceClass *));
+        if (!classes)
+        {
+            logError("Fail to grow index to %u classes!\r\n", capacity);
+            return -1;
+        }
+        if (index->classes_count > 0)
+            memcpy(classes, index->classes,
+                    index->classes_count * sizeof (struct TraceClass *));
+        freeMemory(index->classes);
+        index->classes = classes;
+        index->classes_capacity = capacity;
+    }
+    cls = (struct TraceClass *)
+        arena_alloc(&(index->arena), sizeof (struct TraceClass));
+    if (!cls)
+        return -1;
+    // constant pool strings are interned, they outlive the class
+    cls->name = name->bytes;
+    cls->name_length = name->length;
+    cls->order = index->classes_count;
+    info = rtc->findAttribute(TAG_ATTR_SOURCEFILE);
+    name = info ? rtc->getConstant_Utf8(
+            ((attr_SourceFile_info *) info->data)->sourcefile_index)
+        : (const_Utf8_data *) 0;
+    if (name)
+    {
+        cls->source = name->bytes;
+        cls->source_length = name->length;
+    }
+
+    cls->methods = (struct TraceMethod *) arena_alloc(&(index->arena),
+            rtc->getMethodsCount() * sizeof (struct TraceMethod));
+    if (!cls->methods && rtc->getMethodsCount() > 0)
+        return -1;
+    for (rt_Method &method : rtc->getMethods())
+    {
+        name = method.getName();
+        descriptor = method.getDescriptor();
+        if (!name || !descriptor)
+            continue;
+        tm = &(cls->methods[cls->methods_count++]);
+        tm->name = name->bytes;
+        tm->name_length = name->length;
+        tm->descriptor = descriptor->bytes;
+        tm->descriptor_length = descriptor->length;
+        info = method.findAttribute(TAG_ATTR_CODE);
+        if (info)
+            tm->code_length = ((attr_Code_info *) info->data)->code_length;
+        count = method.getLines(&lines);
+        if (count == 0)
+            continue;
+        tm->lines = (u4 *) arena_alloc(&(index->arena), count * sizeof (u4));
+        if (!tm->lines)
+            return -1;
+        memcpy(tm->lines, lines, count * sizeof (u4));
+        tm->lines_count = count;
+    }
+    qsort(cls->methods, cls->methods_count, sizeof (struct TraceMethod),
+            compareMethods);
+
+    info = rtc->findAttribute(TAG_ATTR_SOURCEDEBUGEXTENSION);
+    if (info && parseSmap(index, cls, (u1 *) info->data,
+                info->attribute_length) < 0)
+        return -1;
+
+    index->classes[index->classes_count++] = cls;
+    return 0;
+}
+
+static int
+indexClass(void *arg, rt_Class *rtc, ClassFile *cf, const char *name)
+{
+    (void) cf;
+    (void) name;
+    return addTraceClass((struct TraceIndex *) arg, rtc);
+}
+
+extern int
+indexTraceFile(struct TraceIndex *index, const char *path)
+{
+    return rt_loadClasses(path, indexClass, index);
+}
+
+extern void
+sortTraceIndex(struct TraceIndex *index)
+{
+    qsort(index->classes, index->classes_count,
+            sizeof (struct TraceClass *), compareClasses);
+}
+
+// compares a class name to a query, which may use '.' for '/'
+static int
+compareClassName(struct TraceClass *cls, const char *name, size_t len)
+{
+    size_t i, n;
+    u1 c;
+
+    n = cls->name_length < len ? cls->name_length : len;
+    for (i = 0; i < n; i++)
+    {
+        c = name[i] == '.' ? '/' : (u1) name[i];
+        if (cls->name[i] != c)
+            return (int) cls->name[i] - (int) c;
+    }
+    return cls->name_length < len ? -1 : cls->name_length > len;
+}
+
+static struct TraceClass *
+findTraceClass(struct TraceIndex *index, const char *name, size_t len)
+{
+    u4 low, high, middle;
+
+    // first of equal names, in input order
+    low = 0;
+    high = index->classes_count;
+    while (low < high)
+    {
+        middle = (low + high) / 2;
+        if (compareClassName(index->classes[middle], name, len) < 0)
+            low = middle + 1;
+        else
+            high = middle;
+    }
+    if (low < index->classes_count
+            && compareClassName(index->classes[low], name, len) == 0)
+        return index->classes[low];
+    return (struct TraceClass *) 0;
+}
+
+/*
+ * Method named `name`, the one whose code holds `pc` among
+ * overloads when no descriptor is given
+ */
+static struct TraceMethod *
+findTraceMethod(struct TraceClass *cls, const char *name, size_t len,
+        const char *descriptor, size_t descriptor_length, int64_t pc)
+{
+    struct TraceMethod *tm, *found;
+    u4 low, high, middle;
+
+    low = 0;
+    high = cls->methods_count;
+    while (low < high)
+    {
+        middle = (low + high) / 2;
+        if (compareBytes(cls->methods[middle].name,
+                    cls->methods[middle].name_length,
+                    (u1 *) name, (u2) len) < 0)
+            low = middle + 1;
+        else
+            high = middle;
+    }
+    found = (struct TraceMethod *) 0;
+    for (; low < cls->methods_count; low++)
+    {
+        tm = &(cls->methods[low]);
+        if (compareBytes(tm->name, tm->name_length, (u1 *) name, (u2) len))
+            break;
+        if (descriptor_length > 0)
+        {
+            if (!compareBytes(tm->descriptor, tm->descriptor_length,
+                        (u1 *) descriptor, (u2) descriptor_length))
+                return tm;
+            continue;
+        }
+        if (pc >= 0 && pc < tm->code_length)
+            return tm;
+        if (!found)
+            found = tm;
+    }
+    return descriptor_length > 0 ? (struct TraceMethod *) 0 : found;
+}
+
+static int64_t
+getTraceLine(struct TraceMethod *tm, u4 pc)
+{
+    u4 low, high, middle;
+
+    if (pc >= tm->code_length)
+        return -1;
+    low = 0;
+    high = tm->lines_count;
+    while (low < high)
+    {
+        middle = (low + high) / 2;
+        if (tm->lines[middle] >> 16 <= pc)
+            low = middle + 1;
+        else
+            high = middle;
+    }
+    return low > 0 ? (int64_t) (tm->lines[low - 1] & 0xffff) : -1;
+}
+
+// maps an output line through the SMAP, false if it isn't covered
+static int
+mapSmapLine(struct TraceClass *cls, u4 line,
+        struct TraceFile **file, u4 *input)
+{
+    struct TraceRange *range;
+    struct TraceLine *tl;
+    u4 low, high, middle;
+
+    low = 0;
+    high = cls->ranges_count;
+    while (low < high)
+    {
+        middle = (low + high) / 2;
+        if (cls->ranges[middle].output_start <= line)
+            low = middle + 1;
+        else
+            high = middle;
+    }
+    if (low == 0)
+        return 0;
+    range = &(cls->ranges[low - 1]);
+    if (line >= range->output_end || !range->file)
+        return 0;
+    tl = range->line;
+    *file = range->file;
+    *input = tl->input_start
+        + (tl->increment ? (line - tl->output_start) / tl->increment : 0);
+    return 1;
+}
+
+static void
+append(char *out, size_t size, size_t *length, const char *format, ...)
+{
+    va_list args;
+    int n;
+
+    va_start(args, format);
+    if (*length < size)
+        n = vsnprintf(out + *length, size - *length, format, args);
+    else
+        n = vsnprintf((char *) 0, 0, format, args);
+    va_end(args);
+    if (n > 0)
+        *length += n;
+}
+
+// next space separated token of a query
+static char *
+nextToken(char **query, char *end, size_t *len)
+{
+    char *token;
+
+    while (*query < end && (**query == ' ' || **query == '\t'))
+        ++*query;
+    token = *query;
+    while (*query < end && **query != ' ' && **query != '\t')
+        ++*query;
+    *len = *query - token;
+    return token;
+}
+
+extern int
+symbolizeFrame(struct TraceIndex *index, char *query, size_t len,
+        char *out, size_t size)
+{
+    struct TraceClass *cls;
+    struct TraceMethod *tm;
+    struct TraceFile *file;
+    char *end, *class_name, *method, *descriptor, *position, *last;
+    size_t class_length, method_length, descriptor_length, position_length;
+    size_t length, i;
+    int64_t pc, line;
+    u4 input;
+
+    end = query + len;
+    class_name = nextToken(&query, end, &class_length);
+    method = nextToken(&query, end, &method_length);
+    position = nextToken(&query, end, &position_length);
+    length = 0;
+    if (class_length == 0 || method_length == 0 || position_length == 0)
+    {
+        append(out, size, &length, "?");
+        return length < size ? (int) length : -1;
+    }
+    descriptor = (char *) memchr(method, '(', method_length);
+    descriptor_length = 0;
+    if (descriptor)
+    {
+        descriptor_length = method + method_length - descriptor;
+        method_length = descriptor - method;
+    }
+    pc = -1;
+    line = -1;
+    if (position[0] == ':')
+        line = strtoll(position + 1, &last, 10);
+    else
+        pc = strtoll(position, &last, 10);
+    if (last != position + position_length
+            || position_length == (size_t) (position[0] == ':')
+            || pc > 0xffff || line > 0xffff)
+        pc = line = -1;
+
+    cls = findTraceClass(index, class_name, class_length);
+    tm = cls ? findTraceMethod(cls, method, method_length,
+            descriptor, descriptor_length, pc) : (struct TraceMethod *) 0;
+    if (tm && pc >= 0)
+        line = getTraceLine(tm, (u4) pc);
+
+    for (i = 0; i < class_length; i++)
+        append(out, size, &length, "%c",
+                class_name[i] == '/' ? '.' : class_name[i]);
+    append(out, size, &length, ".%.*s(", (int) method_length, method);
+    if (cls && line >= 0 && cls->ranges_count > 0
+            && mapSmapLine(cls, (u4) line, &file, &input))
+        append(out, size, &length, "%.*s:%u)", file->length, file->name,
+                input);
+    else if (!cls || !tm || !cls->source)
+        append(out, size, &length, "Unknown Source)");
+    else if (line >= 0)
+        append(out, size, &length, "%.*s:%lli)", cls->source_length,
+                cls->source, (long long) line);
+    else
+        append(out, size, &length, "%.*s)", cls->source_length,
+                cls->source);
+    return length < size ? (int) length : -1;
+}
+
+static int
+writeFully(int fd, char *buf, size_t len)
+{
+    ssize_t n;
+
+    while (len > 0)
+    {
+        n = write(fd, buf, len);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return -1;
+        buf += n;
+        len -= n;
+    }
+    return 0;
+}
+
+/*
+ * Answers every complete line read so far and flushes before
+ * reading again, so a client sending a batch gets it answered
+ * in one write and a client sending single lines isn't kept waiting.
+ */
+extern int
+serveTraces(struct TraceIndex *index, int in, int out)
+{
+    char *input, *output, *line, *newline;
+    size_t filled, written, consumed;
+    ssize_t n;
+    u1 skipping, done;
+    int length;
+
+    input = (char *) allocMemory(2, TRACE_BUFFER_SIZE);
+    if (!input)
+        return -1;
+    output = input + TRACE_BUFFER_SIZE;
+    filled = 0;
+    skipping = 0;
+    done = 0;
+    while (!done)
+    {
+        n = read(in, input + filled, TRACE_BUFFER_SIZE - filled);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+        {
+            // a last line may come without its newline
+            done = 1;
+            if (filled > 0 || skipping)
+                input[filled++] = '\n';
+        }
+        else
+            filled += n;
+
+        written = 0;
+        consumed = 0;
+        while ((newline = (char *) memchr(input + consumed, '\n',
+                        filled - consumed)))
+        {
+            line = input + consumed;
+            consumed = newline + 1 - input;
+            if (newline > line && newline[-1] == '\r')
+                --newline;
+            if (TRACE_BUFFER_SIZE - written < TRACE_ANSWER_SIZE)
+            {
+                if (writeFully(out, output, written) < 0)
+                    goto close;
+                written = 0;
+            }
+            length = -1;
+            if (!skipping)
+                length = symbolizeFrame(index, line, newline - line,
+                        output + written, TRACE_BUFFER_SIZE - written - 1);
+            // very long names get the whole buffer
+            if (length < 0 && !skipping && written > 0)
+            {
+                if (writeFully(out, output, written) < 0)
+                    goto close;
+                written = 0;
+                length = symbolizeFrame(index, line, newline - line,
+                        output, TRACE_BUFFER_SIZE - 1);
+            }
+            skipping = 0;
+            if (length < 0)
+            {
+                output[written] = '?';
+                length = 1;
+            }
+            written += length;
+            output[written++] = '\n';
+        }
+        if (written > 0 && writeFully(out, output, written) < 0)
+            goto close;
+        memmove(input, input + consumed, filled - consumed);
+        filled -= consumed;
+        // a line longer than the buffer is answered with '?'
+        if (filled == TRACE_BUFFER_SIZE)
+        {
+            skipping = 1;
+            filled = 0;
+        }
+    }
+    freeMemory(input);
+    return 0;
+close:
+    freeMemory(input);
+    return -1;
+}
+
+// each worker accepts and serves one connection at a time
+static void *
+runTraceWorker(void *arg)
+{
+    struct TraceServer *server;
+    int client;
+
+    server = (struct TraceServer *) arg;
+    for (;;)
+    {
+        client = accept(server->fd, (struct sockaddr *) 0, (socklen_t *) 0);
+        if (client < 0)
+        {
+            if (errno == EINTR || errno == ECONNABORTED)
+                continue;
+            logError("Fail to accept on '%s': %s!\r\n", server->path,
+                    strerror(errno));
+            return (void *) 0;
+        }
+        serveTraces(server->index, client, client);
+        close(client);
+    }
+}
+
+extern int
+serveTraceSocket(struct TraceIndex *index, const char *path)
+{
+    struct sockaddr_un address;
+    struct TraceServer server;
+    struct stat st;
+    pthread_t workers[TRACE_WORKERS];
+    int count, i;
+
+    if (strlen(path) >= sizeof (address.sun_path))
+    {
+        logError("Socket path '%s' is too long!\r\n", path);
+        return -1;
+    }
+    // only a socket left by an earlier run is replaced
+    if (lstat(path, &st) == 0)
+    {
+        if (!S_ISSOCK(st.st_mode))
+        {
+            logError("'%s' exists and is not a socket!\r\n", path);
+            return -1;
+        }
+        unlink(path);
+    }
+    else if (errno != ENOENT)
+    {
+        logError("Fail to stat '%s': %s!\r\n", path, strerror(errno));
+        return -1;
+    }
+    memset(&address, 0, sizeof (address));
+    address.sun_family = AF_UNIX;
+    strcpy(address.sun_path, path);
+    server.index = index;
+    server.path = path;
+    server.fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (server.fd < 0)
+    {
+        logError("Fail to create socket: %s!\r\n", strerror(errno));
+        return -1;
+    }
+    if (bind(server.fd, (struct sockaddr *) &address, sizeof (address)) < 0
+            || listen(server.fd, SOMAXCONN) < 0)
+    {
+        logError("Fail to listen on '%s': %s!\r\n", path, strerror(errno));
+        close(server.fd);
+        return -1;
+    }
+    // a client leaving early must not take the server down
+    signal(SIGPIPE, SIG_IGN);
+    count = 0;
+    for (i = 0; i < TRACE_WORKERS; i++)
+        if (pthread_create(&(workers[count]), (pthread_attr_t *) 0,
+                    runTraceWorker, &server) == 0)
+            ++count;
+    if (count == 0)
+        logError("Fail to start any worker on '%s'!\r\n", path);
+    for (i = 0; i < count; i++)
+        pthread_join(workers[i], (void **) 0);
+    close(server.fd);
+    return -1;
+}
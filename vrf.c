@@ -1,17 +1,31 @@
+#include <stdio.h>
 #include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#if defined __x86_64__ || defined __i386__
+#include <immintrin.h>
+#endif
 
 #include "java.h"
 #include "vrf.h"
 #include "log.h"
+#include "memory.h"
+#include "bytecode.h"
+#include "tc.h"
+#include "descriptor.h"
 
-static int validateConstantPoolEntry(ClassFile *, u2, u1 *, u1);
 static int validateFieldDescriptor(u2, u1 *);
 static int validateMethodDescriptor(u2, u1 *);
 static int validateAttributes_class(ClassFile *, u2, attr_info *);
 static int validateAttributes_field(ClassFile *, field_info *);
 static int validateAttributes_method(ClassFile *, method_info *);
 static int validateAttributes_code(ClassFile *, attr_Code_info *);
-static int validateJavaTypeSignature(u2, u1 *);
+static int validateSignature(int, u2, u1 *);
+static int validateMethodBodies(ClassFile *, int);
 
 extern int
 checkMagic(u4 magic)
@@ -25,400 +39,667 @@ checkMagic(u4 magic)
     return -1;
 }
 
+/*
+ * Constant pool validation
+ *
+ * The pool is checked in two linear passes without recursion:
+ * the first one collects the tag of every entry into one array,
+ * the second one checks each reference of each entry against
+ * the set of tags it may point to, looked up in that array.
+ * Every invalid entry is reported, not only the first one.
+ */
+#define CP_BIT(tag)             (1u << (tag))
+// second slot of an 8-byte constant
+#define CP_TAG_UNUSABLE         0
+
+#define CP_KNOWN_TAGS   (CP_BIT(CONSTANT_Utf8)\
+        | CP_BIT(CONSTANT_Integer)\
+        | CP_BIT(CONSTANT_Float)\
+        | CP_BIT(CONSTANT_Long)\
+        | CP_BIT(CONSTANT_Double)\
+        | CP_BIT(CONSTANT_Class)\
+        | CP_BIT(CONSTANT_String)\
+        | CP_BIT(CONSTANT_Fieldref)\
+        | CP_BIT(CONSTANT_Methodref)\
+        | CP_BIT(CONSTANT_InterfaceMethodref)\
+        | CP_BIT(CONSTANT_NameAndType)\
+        | CP_BIT(CONSTANT_MethodHandle)\
+        | CP_BIT(CONSTANT_MethodType)\
+        | CP_BIT(CONSTANT_InvokeDynamic))
+
+// tags a bootstrap method argument may have
+#define CP_LOADABLE_TAGS    (CP_BIT(CONSTANT_Integer)\
+        | CP_BIT(CONSTANT_Float)\
+        | CP_BIT(CONSTANT_Long)\
+        | CP_BIT(CONSTANT_Double)\
+        | CP_BIT(CONSTANT_Class)\
+        | CP_BIT(CONSTANT_String)\
+        | CP_BIT(CONSTANT_MethodHandle)\
+        | CP_BIT(CONSTANT_MethodType))
+
+#define CP_MAX_REFERENCES       2
+
+/*
+ * For each referencing kind, the tags each of
+ * its references may point to, in item order
+ */
+static const u4 cp_references[CONSTANT_InvokeDynamic + 1][CP_MAX_REFERENCES] =
+{
+    /*  0 */ { 0, 0 },
+    /*  1 CONSTANT_Utf8 */ { 0, 0 },
+    /*  2 */ { 0, 0 },
+    /*  3 CONSTANT_Integer */ { 0, 0 },
+    /*  4 CONSTANT_Float */ { 0, 0 },
+    /*  5 CONSTANT_Long */ { 0, 0 },
+    /*  6 CONSTANT_Double */ { 0, 0 },
+    /*  7 CONSTANT_Class */
+    { CP_BIT(CONSTANT_Utf8), 0 },
+    /*  8 CONSTANT_String */
+    { CP_BIT(CONSTANT_Utf8), 0 },
+    /*  9 CONSTANT_Fieldref */
+    { CP_BIT(CONSTANT_Class), CP_BIT(CONSTANT_NameAndType) },
+    /* 10 CONSTANT_Methodref */
+    { CP_BIT(CONSTANT_Class), CP_BIT(CONSTANT_NameAndType) },
+    /* 11 CONSTANT_InterfaceMethodref */
+    { CP_BIT(CONSTANT_Class), CP_BIT(CONSTANT_NameAndType) },
+    /* 12 CONSTANT_NameAndType */
+    { CP_BIT(CONSTANT_Utf8), CP_BIT(CONSTANT_Utf8) },
+    /* 13 */ { 0, 0 },
+    /* 14 */ { 0, 0 },
+    // depends on reference kind, see below
+    /* 15 CONSTANT_MethodHandle */ { 0, 0 },
+    /* 16 CONSTANT_MethodType */
+    { CP_BIT(CONSTANT_Utf8), 0 },
+    /* 17 */ { 0, 0 },
+    /* 18 CONSTANT_InvokeDynamic */
+    { 0, CP_BIT(CONSTANT_NameAndType) },
+};
+
+/*
+ * Tags the reference of a CONSTANT_MethodHandle may point to,
+ * indexed by reference kind, for class files before 52.0
+ */
+static const u4 cp_methodhandle_references[REF_invokeInterface + 1] =
+{
+    /* 0 */ 0,
+    /* 1 REF_getField */            CP_BIT(CONSTANT_Fieldref),
+    /* 2 REF_getStatic */           CP_BIT(CONSTANT_Fieldref),
+    /* 3 REF_putField */            CP_BIT(CONSTANT_Fieldref),
+    /* 4 REF_putStatic */           CP_BIT(CONSTANT_Fieldref),
+    /* 5 REF_invokeVirtual */       CP_BIT(CONSTANT_Methodref),
+    /* 6 REF_invokeStatic */        CP_BIT(CONSTANT_Methodref),
+    /* 7 REF_invokeSpecial */       CP_BIT(CONSTANT_Methodref),
+    /* 8 REF_newInvokeSpecial */    CP_BIT(CONSTANT_Methodref),
+    /* 9 REF_invokeInterface */     CP_BIT(CONSTANT_InterfaceMethodref),
+};
+
+static u1
+getConstantReferences(cp_info *info, u2 *refs)
+{
+    switch (info->tag)
+    {
+        case CONSTANT_Class:
+            refs[0] = info->info.ccd.name_index;
+            return 1;
+        case CONSTANT_Fieldref:
+        case CONSTANT_Methodref:
+        case CONSTANT_InterfaceMethodref:
+            refs[0] = info->info.cfd.class_index;
+            refs[1] = info->info.cfd.name_and_type_index;
+            return 2;
+        case CONSTANT_String:
+            refs[0] = info->info.csd.string_index;
+            return 1;
+        case CONSTANT_NameAndType:
+            refs[0] = info->info.cnd.name_index;
+            refs[1] = info->info.cnd.descriptor_index;
+            return 2;
+        case CONSTANT_MethodType:
+            refs[0] = info->info.cmtd.descriptor_index;
+            return 1;
+        case CONSTANT_InvokeDynamic:
+            // bootstrap_method_attr_index is not a pool index
+            refs[0] = 0;
+            refs[1] = info->info.cidd.name_and_type_index;
+            return 2;
+        default:
+            return 0;
+    }
+}
+
+/*
+ * Returns whether entry `index` exists and has one of `accept` tags
+ */
 static int
-validateConstantPoolEntry(ClassFile *cf, u2 i, u1 *bul, u1 tag)
+isConstantOf(u2 count, u1 *tags, u2 index, u4 accept)
 {
-    cp_info *info;
-    const_Class_data *cci;
-    const_Fieldref_data *cfi;
-    const_Methodref_data *cmi;
-    const_String_data *csi;
+    return index > 0 && index < count
+        && tags[index] <= CONSTANT_InvokeDynamic
+        && (CP_BIT(tags[index]) & accept & ~CP_BIT(CP_TAG_UNUSABLE));
+}
+
+/*
+ * Modified UTF-8 validation
+ *
+ * Class file strings are mostly ASCII, so runs of bytes in
+ * [0x01, 0x7f] are skipped with the widest vector unit available,
+ * picked once at run time, and only multi-byte sequences are
+ * decoded one by one.
+ */
+typedef u4 (*SkipAsciiFunc)(u1 *, u4);
+
+static u4
+skipAscii_scalar(u1 *str, u4 len)
+{
+    u4 i;
+
+    for (i = 0; i < len; i++)
+        if (str[i] == 0 || str[i] >= 0x80)
+            break;
+
+    return i;
+}
+
+#if defined __x86_64__ || defined __i386__
+__attribute__((target("sse2")))
+static u4
+skipAscii_sse2(u1 *str, u4 len)
+{
+    __m128i v, zero;
+    u4 i, mask;
+
+    zero = _mm_setzero_si128();
+    for (i = 0; i + 16 <= len; i += 16)
+    {
+        v = _mm_loadu_si128((__m128i *) (str + i));
+        // high bit set or zero byte
+        mask = _mm_movemask_epi8(v)
+            | _mm_movemask_epi8(_mm_cmpeq_epi8(v, zero));
+        if (mask)
+            return i + __builtin_ctz(mask);
+    }
+
+    return i + skipAscii_scalar(str + i, len - i);
+}
+
+__attribute__((target("avx2")))
+static u4
+skipAscii_avx2(u1 *str, u4 len)
+{
+    __m256i v, zero;
+    u4 i, mask;
+
+    zero = _mm256_setzero_si256();
+    for (i = 0; i + 32 <= len; i += 32)
+    {
+        v = _mm256_loadu_si256((__m256i *) (str + i));
+        mask = (u4) _mm256_movemask_epi8(v)
+            | (u4) _mm256_movemask_epi8(_mm256_cmpeq_epi8(v, zero));
+        if (mask)
+            return i + __builtin_ctz(mask);
+    }
+
+    return i + skipAscii_sse2(str + i, len - i);
+}
+#endif
+
+static SkipAsciiFunc skipAscii;
+
+static SkipAsciiFunc
+getSkipAscii()
+{
+    SkipAsciiFunc func;
+
+    func = __atomic_load_n(&skipAscii, __ATOMIC_RELAXED);
+    if (func)
+        return func;
+#if defined __x86_64__ || defined __i386__
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+        func = skipAscii_avx2;
+    else if (__builtin_cpu_supports("sse2"))
+        func = skipAscii_sse2;
+    else
+#endif
+        func = skipAscii_scalar;
+    __atomic_store_n(&skipAscii, func, __ATOMIC_RELAXED);
+
+    return func;
+}
+
+/*
+ * Rejects 0x00 and 0xf0-0xff bytes, stray continuation bytes
+ * and truncated 2- or 3-byte sequences
+ */
+static int
+validateModifiedUtf8(u4 len, u1 *str)
+{
+    SkipAsciiFunc skip;
+    u4 i, n;
+    u1 c;
+
+    skip = getSkipAscii();
+    for (i = 0; ; i += n)
+    {
+        i += (*skip)(str + i, len - i);
+        if (i >= len)
+            return 0;
+        c = str[i];
+        if (c >= 0xf0)
+            return -1;
+        else if (c >= 0xe0)
+            n = 3;
+        else if (c >= 0xc0)
+            n = 2;
+        else // 0x00 or continuation byte
+            return -1;
+        if (len - i < n)
+            return -1;
+        if ((str[i + 1] & 0xc0) != 0x80)
+            return -1;
+        if (n == 3 && (str[i + 2] & 0xc0) != 0x80)
+            return -1;
+    }
+}
+
+static int
+validateConstant_Utf8(const_Utf8_data *cui)
+{
+    if (!cui->bytes)
+        return -1;
+
+    return validateModifiedUtf8(cui->length, cui->bytes);
+}
+
+static int
+isSpecialMethodName(const_Utf8_data *cui)
+{
+    return cui->length > 0 && cui->bytes[0] == '<';
+}
+
+static int
+matchesName(const_Utf8_data *cui, const char *name)
+{
+    return cui->length == strlen(name)
+        && !strncmp((char *) cui->bytes, name, cui->length);
+}
+
+/*
+ * Checks what an entry means once all its references
+ * are known to point to entries of the right kind
+ */
+static int
+validateConstantSemantics(ClassFile *cf, u1 *tags, u2 i,
+        attr_BootstrapMethods_info *bms)
+{
+    cp_info *info, *ref;
     const_NameAndType_data *cni;
-    const_Utf8_data *cui;
+    const_Utf8_data *name, *descriptor;
     const_MethodHandle_data *cmhi;
-    const_MethodType_data *cmti;
-    const_InvokeDynamic_data *cidi;
-    u2 j;
+    u2 count, j;
+    u4 accept;
 #if VER_CMP(51, 0)
-    attr_BootstrapMethods_info *dataBootstrapMethods;
     struct bootstrap_method *bm;
+    const_InvokeDynamic_data *cidi;
 #endif
 
+    count = cf->constant_pool_count;
     info = &(cf->constant_pool[i]);
-    if (i == 0)
-    {
-        logError("Pointing to null entry!\r\n");
-        return -1;
-    }
-    if (tag != 0 && info->tag != tag)
-    {
-        logError("Assertion error: constant pool[%i] is not CONSTANT_%s_info!\r\n", info->tag, get_cp_name(info->tag));
-        return -1;
-    }
-    if (bul[i])
-        return 0;
     switch (info->tag)
     {
-        case CONSTANT_Class:
-            cci = (const_Class_data *) info;
-            if (validateConstantPoolEntry(cf,
-                        cci->name_index,
-                        bul, CONSTANT_Utf8) < 0)
+        case CONSTANT_Utf8:
+            if (validateConstant_Utf8(&(info->info.cud)) < 0)
+            {
+                logError("Constant pool entry[%i] is not "
+                        "a valid modified UTF-8 string!\r\n", i);
                 return -1;
+            }
             break;
         case CONSTANT_Fieldref:
         case CONSTANT_Methodref:
         case CONSTANT_InterfaceMethodref:
-            cfi = (const_Fieldref_data *) info;
-            if (validateConstantPoolEntry(cf,
-                        cfi->class_index, bul, CONSTANT_Class) < 0)
-                return -1;
-            if (validateConstantPoolEntry(cf,
-                        cfi->name_and_type_index,
-                        bul, CONSTANT_NameAndType) < 0)
+            cni = &(cf->constant_pool[
+                    info->info.cfd.name_and_type_index].info.cnd);
+            if (!isConstantOf(count, tags, cni->name_index,
+                        CP_BIT(CONSTANT_Utf8))
+                    || !isConstantOf(count, tags, cni->descriptor_index,
+                        CP_BIT(CONSTANT_Utf8)))
                 return -1;
-            cni = (const_NameAndType_data *)
-                getConstant(cf, cfi->name_and_type_index);
-            cui = (const_Utf8_data *)
-                getConstant(cf, cni->descriptor_index);
+            name = &(cf->constant_pool[cni->name_index].info.cud);
+            descriptor = &(cf->constant_pool[
+                    cni->descriptor_index].info.cud);
             if (info->tag == CONSTANT_Fieldref)
             {
-                if (validateFieldDescriptor(cui->length,
-                            cui->bytes) < 0)
+                if (validateFieldDescriptor(descriptor->length,
+                            descriptor->bytes) < 0)
                     return -1;
+                break;
             }
-            else
+            if (validateMethodDescriptor(descriptor->length,
+                        descriptor->bytes) < 0)
+                return -1;
+            if (isSpecialMethodName(name))
             {
-                if (info->tag == CONSTANT_Methodref
-                        && cui->bytes[0] == '<')
+                // only constructors may be referenced,
+                // and they return void
+                if (info->tag != CONSTANT_Methodref
+                        || !matchesName(name, "<init>")
+                        || descriptor->bytes[descriptor->length - 1] != 'V')
                 {
-                    // return type must be void
-                    for (j = 0; j < cui->length;)
-                        if (cui->bytes[j++] == ')')
-                            break;
-                    if (cui->bytes[j++] != 'V'
-                            || cui->length != j)
-                        return -1;
-                    // special method name for constructors
-                    cui = (const_Utf8_data *)
-                        getConstant(cf, cni->name_index);
-                    if (strncmp((char *) cui->bytes,
-                                "<init>", cui->length)
-                            && strncmp((char *) cui->bytes,
-                                "<clinit>", cui->length))
-                        return -1;
-                    break;
-                }
-                if (validateMethodDescriptor(cui->length,
-                        cui->bytes) < 0)
+                    logError("Constant pool entry[%i] refers to "
+                            "special method \"%.*s%.*s\"!\r\n", i,
+                            name->length, name->bytes,
+                            descriptor->length, descriptor->bytes);
                     return -1;
+                }
             }
             break;
-        case CONSTANT_String:
-            csi = (const_String_data *) info;
-            if (validateConstantPoolEntry(cf,
-                        csi->string_index,
-                        bul, CONSTANT_Utf8) < 0)
-                return -1;
-            break;
-        case CONSTANT_Long:
-        case CONSTANT_Double:
-            bul[i + 1] = 1;
-            break;
-        case CONSTANT_NameAndType:
-            cni = (const_NameAndType_data *) info;
-            if (validateConstantPoolEntry(cf,
-                        cni->name_index,
-                        bul, CONSTANT_Utf8) < 0)
-                return -1;
-            if (validateConstantPoolEntry(cf,
-                        cni->descriptor_index,
-                        bul, CONSTANT_Utf8) < 0)
+        case CONSTANT_MethodType:
+            descriptor = &(cf->constant_pool[
+                    info->info.cmtd.descriptor_index].info.cud);
+            if (validateMethodDescriptor(descriptor->length,
+                        descriptor->bytes) < 0)
                 return -1;
-            // `const_NameAndType_data` is never used directly
-            // which means Cruiser validates its items in:
-            //      `const_Fieldref_data`,
-            //      `const_Methodref_data`,
-            //      and `const_InterfaceMethodref_data`
             break;
-        case CONSTANT_Utf8:
-            cui = (const_Utf8_data *) info;
-            if (!cui->bytes)
+        case CONSTANT_MethodHandle:
+            cmhi = &(info->info.cmhd);
+            if (cmhi->reference_kind < REF_getField
+                    || cmhi->reference_kind > REF_invokeInterface)
             {
-                logError("Invalid const_Utf8_data!\r\n");
+                logError("Constant pool entry[%i] has invalid "
+                        "reference kind[%i]!\r\n",
+                        i, cmhi->reference_kind);
                 return -1;
             }
-            for (j = 0; j < cui->length; j++)
-                if (cui->bytes[j] == 0
-                        || cui->bytes[j] >= 0xf0
-                        && cui->bytes[j] <= 0xff)
-                    return -1;
-            break;
-        case CONSTANT_MethodHandle:
-            cmhi = (const_MethodHandle_data *) info;
-            switch (cmhi->reference_kind)
+            accept = cp_methodhandle_references[cmhi->reference_kind];
+            if ((cmhi->reference_kind == REF_invokeStatic
+                        || cmhi->reference_kind == REF_invokeSpecial)
+                    && compareVersion0(cf->major_version,
+                        cf->minor_version, 52, 0) >= 0)
+                accept |= CP_BIT(CONSTANT_InterfaceMethodref);
+            if (!isConstantOf(count, tags,
+                        cmhi->reference_index, accept))
             {
-                case REF_getField:
-                case REF_getStatic:
-                case REF_putField:
-                case REF_putStatic:
-                    if (validateConstantPoolEntry(cf,
-                                cmhi->reference_index,
-                                bul, CONSTANT_Fieldref) < 0)
-                        return -1;
-                    break;
-                case REF_invokeVirtual:
-                case REF_newInvokeSpecial:
-                    if (validateConstantPoolEntry(cf,
-                                cmhi->reference_index,
-                                bul, CONSTANT_Methodref) < 0)
-                        return -1;
-                case REF_invokeStatic:
-                case REF_invokeSpecial:
-                    if (compareVersion0(cf->major_version,
-                                cf->minor_version,
-                                52, 0) >= 0)
-                    {
-                        if (validateConstantPoolEntry(cf,
-                                    cmhi->reference_index,
-                                    bul, CONSTANT_Methodref) < 0
-                                && validateConstantPoolEntry(cf,
-                                    cmhi->reference_index,
-                                    bul, CONSTANT_InterfaceMethodref) < 0)
-                        return -1;
-                    }
-                    else if (validateConstantPoolEntry(cf,
-                                cmhi->reference_index,
-                                bul, CONSTANT_Methodref) < 0)
-                        return -1;
-                    break;
-                case REF_invokeInterface:
-                    if (validateConstantPoolEntry(cf,
-                                cmhi->reference_index,
-                                bul, CONSTANT_InterfaceMethodref) < 0)
-                        return -1;
-                    break;
-                default:
-                    logError("Constant pool entry[%i] has invalid reference kind[%i] as const_MethodHandle_data!\r\n",
-                            i, cmhi->reference_kind);
-                    return -1;
+                logError("Constant pool entry[%i] refers to "
+                        "entry[%i] of wrong kind for reference "
+                        "kind[%i]!\r\n",
+                        i, cmhi->reference_index,
+                        cmhi->reference_kind);
+                return -1;
             }
-            cfi = (const_Fieldref_data *)
-                &(cf->constant_pool[cmhi->reference_index]);
-            cni = (const_NameAndType_data *)
-                &(cf->constant_pool[cfi->name_and_type_index]);
-            cui = (const_Utf8_data *)
-                &(cf->constant_pool[cni->name_index]);
-            switch (cmhi->reference_kind)
+            // the referenced entry is checked on its own, it may
+            // be broken, errors are gathered over the whole pool
+            ref = &(cf->constant_pool[cmhi->reference_index]);
+            if (!isConstantOf(count, tags,
+                        ref->info.cfd.name_and_type_index,
+                        CP_BIT(CONSTANT_NameAndType)))
             {
-                case REF_invokeVirtual:
-                case REF_invokeStatic:
-                case REF_invokeSpecial:
-                case REF_invokeInterface:
-                    if (!strncmp((char *) cui->bytes,
-                                "<init>", cui->length))
-                    {
-                        logError("Method name '<init>' is invalid "
-                                "because MethodHandle reference kind "
-                                "is %i!\r\n",
-                                cmhi->reference_kind);
-                        return -1;
-                    }
-                    else if (!strncmp((char *) cui->bytes,
-                                "<clinit>", cui->length))
-                    {
-                        logError("Method name '<clinit>' is invalid "
-                                "because MethodHandle reference kind "
-                                "is %i!\r\n",
-                                cmhi->reference_kind);
-                        return -1;
-                    }
-                    break;
-                case REF_newInvokeSpecial:
-                    if (strncmp((char *) cui->bytes,
-                                "<init>", cui->length))
-                    {
-                        logError("Method name '%.*s' is invalid "
-                                "because MethodHandle reference kind "
-                                "is %i!\r\n",
-                                cui->length,
-                                (char *) cui->bytes,
-                                cmhi->reference_kind);
-                        return -1;
-                    }
-                    break;
+                logError("Constant pool entry[%i] refers to "
+                        "entry[%i] without a valid "
+                        "CONSTANT_NameAndType!\r\n",
+                        i, cmhi->reference_index);
+                return -1;
             }
-            break;
-        case CONSTANT_MethodType:
-            cmti = (const_MethodType_data *) info;
-            if (validateConstantPoolEntry(cf,
-                        cmti->descriptor_index,
-                        bul, CONSTANT_Utf8) < 0)
+            cni = &(cf->constant_pool[
+                    ref->info.cfd.name_and_type_index].info.cnd);
+            if (!isConstantOf(count, tags, cni->name_index,
+                        CP_BIT(CONSTANT_Utf8)))
                 return -1;
-            cui = (const_Utf8_data *)
-                getConstant(cf, cmti->descriptor_index);
-            if (validateMethodDescriptor(cui->length,
-                        cui->bytes) < 0)
+            name = &(cf->constant_pool[cni->name_index].info.cud);
+            if (cmhi->reference_kind == REF_newInvokeSpecial
+                    ? !matchesName(name, "<init>")
+                    : cmhi->reference_kind >= REF_invokeVirtual
+                        && isSpecialMethodName(name))
+            {
+                logError("Method name '%.*s' is invalid "
+                        "because MethodHandle reference kind "
+                        "is %i!\r\n",
+                        name->length, name->bytes,
+                        cmhi->reference_kind);
                 return -1;
+            }
             break;
 #if VER_CMP(51, 0)
         case CONSTANT_InvokeDynamic:
-            cidi = (const_InvokeDynamic_data *) info;
-            if (validateConstantPoolEntry(cf,
-                        cidi->name_and_type_index,
-                        bul, CONSTANT_NameAndType) < 0)
+            cidi = &(info->info.cidd);
+            cni = &(cf->constant_pool[
+                    cidi->name_and_type_index].info.cnd);
+            if (!isConstantOf(count, tags, cni->descriptor_index,
+                        CP_BIT(CONSTANT_Utf8)))
                 return -1;
-            cni = (const_NameAndType_data *)
-                getConstant(cf, cidi->name_and_type_index);
-            cui = (const_Utf8_data *)
-                getConstant(cf, cni->descriptor_index);
-            if (validateMethodDescriptor(cui->length,
-                        cui->bytes) < 0)
+            descriptor = &(cf->constant_pool[
+                    cni->descriptor_index].info.cud);
+            if (validateMethodDescriptor(descriptor->length,
+                        descriptor->bytes) < 0)
                 return -1;
-            if (!cf->attributes)
+            if (!bms)
             {
-                logError("Class attributes ain't loaded!\r\n");
+                logError("Attribute BootstrapMethods is not found!\r\n");
                 return -1;
             }
-            dataBootstrapMethods =
-                (attr_BootstrapMethods_info *) 0;
-            for (j = 0; j < cf->attributes_count; j++)
-            {
-                if (cf->attributes[j].tag !=
-                        TAG_ATTR_BOOTSTRAPMETHODS)
-                    continue;
-                dataBootstrapMethods =
-                    (attr_BootstrapMethods_info *)
-                        cf->attributes[j].data;
-                break;
-            }
-            if (!dataBootstrapMethods)
+            if (cidi->bootstrap_method_attr_index
+                    >= bms->num_bootstrap_methods)
             {
-                logError("Attribute BootstrapMethods is not found!\r\n");
+                logError("Constant pool entry[%i] refers to "
+                        "bootstrap method #%i out of bounds!\r\n",
+                        i, cidi->bootstrap_method_attr_index);
                 return -1;
             }
-            bm = &(dataBootstrapMethods->bootstrap_methods[
+            bm = &(bms->bootstrap_methods[
                     cidi->bootstrap_method_attr_index]);
-            cmhi = (const_MethodHandle_data *)
-                    &(cf->constant_pool[bm->bootstrap_method_ref]);
-            switch (cmhi->reference_kind)
+            if (!isConstantOf(count, tags, bm->bootstrap_method_ref,
+                        CP_BIT(CONSTANT_MethodHandle)))
             {
-                case REF_invokeStatic:      // 6
-                case REF_newInvokeSpecial:  // 8
-                    break;
-                default:
-                    logError("Invalid reference_kind [%i]!\r\n",
-                            cmhi->reference_kind);
-                    return -1;
-            }
-            cmi = (const_Methodref_data *)
-                    &(cf->constant_pool[
-                            cmhi->reference_index]);
-            cni = (const_NameAndType_data *)
-                    &(cf->constant_pool[
-                            cmi->name_and_type_index]);
-            cui = (const_Utf8_data *)
-                    &(cf->constant_pool[
-                            cni->descriptor_index]);
-            if (strncmp((char *) cui->bytes,
-                    "(Ljava/lang/invoke/MethodHandles$Lookup;"
-                    "Ljava/lang/String;"
-                    "Ljava/lang/invoke/MethodType;)",
-                    88))
-            {
-                logError("Invalid bootstrap method arguments [%.*s]!\r\n",
-                        cui->length, cui->bytes);
+                logError("Bootstrap method is not "
+                        "a CONSTANT_MethodHandle!\r\n");
                 return -1;
             }
             for (j = 0; j < bm->num_bootstrap_arguments; j++)
-            {
-                if (validateConstantPoolEntry(cf,
-                            bm->bootstrap_arguments[j],
-                            bul, CONSTANT_String) < 0
-                        && validateConstantPoolEntry(cf,
-                            bm->bootstrap_arguments[j],
-                            bul, CONSTANT_Class) < 0
-                        && validateConstantPoolEntry(cf,
+                if (!isConstantOf(count, tags,
                             bm->bootstrap_arguments[j],
-                            bul, CONSTANT_Integer) < 0
-                        && validateConstantPoolEntry(cf,
-                            bm->bootstrap_arguments[j],
-                            bul, CONSTANT_Long) < 0
-                        && validateConstantPoolEntry(cf,
-                            bm->bootstrap_arguments[j],
-                            bul, CONSTANT_Float) < 0
-                        && validateConstantPoolEntry(cf,
-                            bm->bootstrap_arguments[j],
-                            bul, CONSTANT_Double) < 0
-                        && validateConstantPoolEntry(cf,
-                            bm->bootstrap_arguments[j],
-                            bul, CONSTANT_MethodHandle) < 0
-                        && validateConstantPoolEntry(cf,
-                            bm->bootstrap_arguments[j],
-                            bul, CONSTANT_MethodType) < 0)
+                            CP_LOADABLE_TAGS))
                 {
                     logError("Invalid bootstrap method argument type!\r\n");
                     return -1;
                 }
-            }
             break;
 #endif
-        default:
-            break;
     }
 
-    bul[i] = 1;
     return 0;
 }
 
 extern int
 validateConstantPool(ClassFile *cf)
 {
-    u1 bul[cf->constant_pool_count];
-    u2 i;
+    u1 *tags;
+    u2 count, i, j;
+    u2 refs[CP_MAX_REFERENCES];
+    u1 tag, nrefs;
+    u4 unknown;
+    int errors;
+    cp_info *info;
+    attr_BootstrapMethods_info *bms;
+
+    count = cf->constant_pool_count;
+    if (count == 0)
+        return 0;
+    tags = (u1 *) allocMemory(count, sizeof (u1));
+    if (!tags)
+        return -1;
+    errors = 0;
 
-    bzero(bul, cf->constant_pool_count);
-    for (i = 1u; i < cf->constant_pool_count; i++)
-        if (validateConstantPoolEntry(cf, i, bul, 0) < 0)
+    // first pass: gather tags,
+    // 8-byte constants leave their second entry unusable
+    unknown = 0;
+    for (i = 1; i < count; i++)
+    {
+        tag = cf->constant_pool[i].tag;
+        tags[i] = tag;
+        if (tag == CONSTANT_Long || tag == CONSTANT_Double)
+            ++i;
+        else
+            unknown |= tag > CONSTANT_InvokeDynamic
+                || !(CP_BIT(tag) & CP_KNOWN_TAGS);
+    }
+    if (unknown)
+        for (i = 1; i < count; i++)
         {
-            logError("Constant pool is invalid[%i]!\r\n", i);
-            return -1;
+            tag = tags[i];
+            if (tag > CONSTANT_InvokeDynamic
+                    || !(CP_BIT(tag) & CP_KNOWN_TAGS))
+            {
+                logError("Constant pool entry[%i] has "
+                        "unknown tag[%i]!\r\n", i, tag);
+                ++errors;
+            }
+            if (tag == CONSTANT_Long || tag == CONSTANT_Double)
+                ++i;
         }
 
+    bms = (attr_BootstrapMethods_info *) 0;
+    for (j = 0; j < cf->attributes_count; j++)
+        if (cf->attributes[j].tag == TAG_ATTR_BOOTSTRAPMETHODS)
+        {
+            bms = (attr_BootstrapMethods_info *)
+                cf->attributes[j].data;
+            break;
+        }
+
+    // second pass: check references against the tag table,
+    // then what each well-formed entry means
+    for (i = 1; i < count; i++)
+    {
+        info = &(cf->constant_pool[i]);
+        tag = tags[i];
+        if (tag > CONSTANT_InvokeDynamic
+                || !(CP_BIT(tag) & CP_KNOWN_TAGS))
+            continue;
+        nrefs = getConstantReferences(info, refs);
+        for (j = 0; j < nrefs; j++)
+        {
+            if (!cp_references[tag][j])
+                continue;
+            if (!isConstantOf(count, tags, refs[j],
+                        cp_references[tag][j]))
+            {
+                logError("Constant pool entry[%i] (CONSTANT_%s) "
+                        "refers to invalid entry[%i]!\r\n",
+                        i, get_cp_name(tag), refs[j]);
+                break;
+            }
+        }
+        if (j < nrefs)
+            ++errors;
+        else if (validateConstantSemantics(cf, tags, i, bms) < 0)
+        {
+            logError("Constant pool entry[%i] (CONSTANT_%s) "
+                    "is invalid!\r\n", i, get_cp_name(tag));
+            ++errors;
+        }
+        if (tag == CONSTANT_Long || tag == CONSTANT_Double)
+            ++i;
+    }
+
+    freeMemory(tags);
+    if (errors)
+    {
+        logError("Constant pool has %i invalid entries!\r\n", errors);
+        return -1;
+    }
+
     return 0;
 }
 
+struct MemberKey
+{
+    u1 *name;
+    u1 *descriptor;
+};
+
+/*
+ * No two fields or methods in one `class` file may have
+ * the same name and descriptor.
+ * Utf8 constants are interned, so a pair of byte pointers
+ * identifies a name and descriptor, and the pair is hashed
+ * from the hashes their symbols already carry.
+ * Members are checked in a single pass.
+ */
+static int
+validateMemberUniqueness(ClassFile *cf, const char *kind,
+        u2 count, field_info *members)
+{
+    struct HashMap map;
+    struct MemberKey *keys, *key;
+    const_Utf8_data *name, *descriptor;
+    void *existing;
+    u4 hash;
+    u2 i;
+    int res;
+
+    if (count < 2)
+        return 0;
+    keys = (struct MemberKey *)
+        allocMemory(count, sizeof (struct MemberKey));
+    if (!keys)
+        return -1;
+    if (hashmap_init(&map, count) < 0)
+    {
+        freeMemory(keys);
+        return -1;
+    }
+    res = 0;
+    for (i = 0; i < count; i++)
+    {
+        name = getConstant_Utf8(cf, members[i].name_index);
+        descriptor = getConstant_Utf8(cf, members[i].descriptor_index);
+        if (!name || !descriptor)
+        {
+            res = -1;
+            break;
+        }
+        key = &(keys[i]);
+        key->name = name->bytes;
+        key->descriptor = descriptor->bytes;
+        hash = symbol_of(key->name)->hash * 31
+            + symbol_of(key->descriptor)->hash;
+        res = hashmap_putHashed(&map, hash, sizeof (struct MemberKey),
+                key, (void *) key, &existing);
+        if (res < 0)
+            break;
+        if (res == 0)
+        {
+            logError("Duplicate %.*s%.*s detected @ cf->%s[%i] "
+                    "and cf->%s[%i]!\r\n",
+                    name->length, name->bytes,
+                    descriptor->length, descriptor->bytes,
+                    kind, (int) ((struct MemberKey *) existing - keys),
+                    kind, i);
+            res = -1;
+            break;
+        }
+        res = 0;
+    }
+    hashmap_release(&map);
+    freeMemory(keys);
+
+    return res;
+}
+
 extern int
 validateFields(ClassFile *cf)
 {
     u2 i, j, fields_count;
-    field_info *field, *field1;
+    field_info *field;
     u2 flags;
     u1 is_public, is_protected, is_private;
     u1 is_final, is_volatile;
-    const_Utf8_data *cui, *cui1;
+    const_Utf8_data *cui;
     
     fields_count = cf->fields_count;
-    // No two fields in one `class` file may have
-    // the same name and descriptor
-    for (i = 0; i < fields_count;)
-    {
-        field = &(cf->fields[i]);
-        cui = getConstant_Utf8(cf, field->name_index);
-        if (!cui) return -1;
-        for (j = ++i; j < fields_count; j++)
-        {
-            field1 = &(cf->fields[j]);
-            cui1 = getConstant_Utf8(cf, field1->name_index);
-            if (!cui1) return -1;
-            if (cui->length != cui1->length)
-                continue;
-            if (strncmp((char *) cui->bytes,
-                        (char *) cui1->bytes,
-                        cui->length) == 0)
-                return -1;
-        }
-    }
+    if (validateMemberUniqueness(cf, "fields",
+                fields_count, cf->fields) < 0)
+        return -1;
 
     for (i = 0; i < fields_count; i++)
     {
@@ -501,42 +782,378 @@ validateFields(ClassFile *cf)
     return 0;
 }
 
+/*
+ * Method bodies
+ *
+ * Each method body is verified on its own, so they are spread over
+ * `verify_threads` workers claiming methods in order. Results are
+ * kept per method and reported in method order, so the output
+ * doesn't depend on the number of threads.
+ */
+static int verify_threads = 1;
+static int verify_level = VERIFY_FULL;
+static struct VerifyStats verify_stats;
+
+struct MethodResult
+{
+    int                 result;
+    const char *        stage;
+    struct VerifyError  error;
+};
+
+struct MethodWorkers
+{
+    ClassFile *         cf;
+    struct MethodResult *results;
+    // VERIFY_STRUCTURAL or VERIFY_FULL
+    int                 level;
+    // index of the next method to verify
+    u4                  next;
+};
+
+extern void
+setVerifyThreads(int count)
+{
+    verify_threads = count > 0 ? count : 1;
+}
+
+extern void
+setVerifyLevel(int level)
+{
+    verify_level = level;
+}
+
+extern struct VerifyStats *
+getVerifyStats()
+{
+    return &verify_stats;
+}
+
+static double
+getElapsedTime(struct timespec *start)
+{
+    struct timespec end;
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    return (end.tv_sec - start->tv_sec)
+        + (end.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+/*
+ * Verification cache
+ *
+ * The result of each level is kept in one small file per class,
+ * named after the SHA-256 of the class file content. Entries live
+ * in a subdirectory named after VERIFY_BUILD_ID, which the makefile
+ * derives from the sources, so results of another build of the
+ * verifier are left behind.
+ */
+#define VERIFY_CACHE_MAGIC          0x43525643  // CRVC
+
+// without the makefile, every compile of this file is a new build
+#ifndef VERIFY_BUILD_ID
+#define VERIFY_BUILD_ID             __DATE__ " " __TIME__
+#endif
+
+// states of each level in a cache entry
+#define CACHED_UNKNOWN              0
+#define CACHED_PASS                 1
+#define CACHED_FAIL                 2
+
+struct VerifyCacheEntry
+{
+    u4      magic;
+    // size of the class file, checked along with the digest
+    u8      length;
+    u1      results[VERIFY_FULL + 1];
+};
+
+static char *verify_cache_dir;
+
+static int
+makeDirectory(const char *path)
+{
+    if (mkdir(path, S_IRWXU) < 0 && errno != EEXIST)
+    {
+        logError("Fail to create cache directory '%s'!\r\n", path);
+        return -1;
+    }
+    return 0;
+}
+
 extern int
-validateMethods(ClassFile *cf)
+setVerifyCache(const char *dir)
 {
-    u2 i, j, flags;
-    method_info *method, *method1;
-    u1 is_public, is_protected, is_private;
-    u1 is_final, is_abstract;
-    const_Utf8_data *cui, *cui1, *cui2, *cui3;
+    struct ContentDigest build;
+    char format[20];
+    char *path;
+    size_t len;
+    int i;
 
-    for (i = 0; i < cf->methods_count;)
+    hashContent((const u1 *) VERIFY_BUILD_ID, strlen(VERIFY_BUILD_ID),
+            &build);
+    format[0] = 'b';
+    for (i = 0; i < 8; i++)
+        sprintf(format + 1 + 2 * i, "%02x", build.hash[i]);
+    len = strlen(dir) + 1 + strlen(format);
+    // room for the entry name and a temporary suffix
+    if (len + 1 + 64 + 16 >= PATH_MAX)
     {
-        method = &(cf->methods[i]);
-        cui = getConstant_Utf8(cf, method->name_index);
-        if (!cui) return -1;
-        cui1 = getConstant_Utf8(cf, method->descriptor_index);
-        if (!cui1) return -1;
-        for (j = ++i; j < cf->methods_count; j++)
+        logError("Cache directory path '%s' is too long!\r\n", dir);
+        return -1;
+    }
+    path = (char *) allocMemory(len + 1, sizeof (char));
+    if (!path)
+        return -1;
+    sprintf(path, "%s/%s", dir, format);
+    if (makeDirectory(dir) < 0 || makeDirectory(path) < 0)
+    {
+        freeMemory(path);
+        return -1;
+    }
+    if (verify_cache_dir)
+        freeMemory(verify_cache_dir);
+    verify_cache_dir = path;
+    return 0;
+}
+
+static void
+getCacheEntryPath(char *path, struct ContentDigest *digest)
+{
+    int length, i;
+
+    length = sprintf(path, "%s/", verify_cache_dir);
+    for (i = 0; i < 32; i++)
+        length += sprintf(path + length, "%02x", digest->hash[i]);
+}
+
+static int
+loadCacheEntry(struct ContentDigest *digest,
+        struct VerifyCacheEntry *entry)
+{
+    char path[PATH_MAX];
+    FILE *file;
+    size_t n;
+
+    getCacheEntryPath(path, digest);
+    file = fopen(path, "rb");
+    if (!file)
+        return -1;
+    n = fread(entry, sizeof (struct VerifyCacheEntry), 1, file);
+    fclose(file);
+    if (n != 1 || entry->magic != VERIFY_CACHE_MAGIC
+            || entry->length != digest->length)
+        return -1;
+    return 0;
+}
+
+/*
+ * Write to a temporary file first, so that concurrent runs
+ * sharing the cache never read a partial entry
+ */
+static void
+storeCacheEntry(struct ContentDigest *digest,
+        struct VerifyCacheEntry *entry)
+{
+    char path[PATH_MAX], temp[PATH_MAX];
+    FILE *file;
+    size_t n;
+    int length;
+
+    getCacheEntryPath(path, digest);
+    length = snprintf(temp, PATH_MAX, "%s.%ld", path, (long) getpid());
+    // a truncated name could clash with another entry
+    if (length < 0 || length >= PATH_MAX)
+        return;
+    file = fopen(temp, "wb");
+    if (!file)
+        return;
+    n = fwrite(entry, sizeof (struct VerifyCacheEntry), 1, file);
+    if (fclose(file) != 0 || n != 1 || rename(temp, path) < 0)
+        remove(temp);
+}
+
+/*
+ * Runs the checks of every level up to `verify_level`,
+ * adding the time spent in each level to `verify_stats`.
+ * Levels already decided for the same content in an earlier run
+ * are taken from the cache.
+ */
+extern int
+verifyClassfile(ClassFile *cf, struct BufferIO *input)
+{
+    struct timespec start;
+    struct ContentDigest digest;
+    struct VerifyCacheEntry entry;
+    int level, result, updated;
+
+    if (verify_level == VERIFY_NONE)
+        return 0;
+    ++verify_stats.classes;
+    memset(&entry, 0, sizeof (entry));
+    if (verify_cache_dir)
+    {
+        getContentDigest(input, &digest);
+        if (loadCacheEntry(&digest, &entry) < 0)
         {
-            method1 = &(cf->methods[j]);
-            cui2 = getConstant_Utf8(cf, method1->name_index);
-            if (!cui2) return -1;
-            cui3 = getConstant_Utf8(cf, method1->descriptor_index);
-            if (!cui3) return -1;
-            if (cui != cui2)
-                continue;
-            if (strncmp((char *) cui->bytes,
-                        (char *) cui2->bytes,
-                        cui->length) != 0)
-                continue;
-            if (strncmp((char *) cui1->bytes,
-                        (char *) cui3->bytes,
-                        cui1->length) == 0)
-                return -1;
+            memset(&entry, 0, sizeof (entry));
+            entry.magic = VERIFY_CACHE_MAGIC;
+            entry.length = digest.length;
         }
     }
 
+    result = 0;
+    updated = 0;
+    for (level = VERIFY_STRUCTURAL; level <= verify_level; level++)
+    {
+        if (entry.results[level] == CACHED_PASS)
+            continue;
+        if (entry.results[level] == CACHED_FAIL)
+        {
+            logError("Class file failed %s verification "
+                    "in an earlier run!\r\n",
+                    level == VERIFY_FULL ? "full" : "structural");
+            result = -1;
+            break;
+        }
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        if (level == VERIFY_STRUCTURAL)
+            result = validateConstantPool(cf) < 0
+                || validateFields(cf) < 0
+                || validateMethods(cf) < 0 ? -1 : 0;
+        else
+            result = validateMethodBodies(cf, VERIFY_FULL);
+        verify_stats.seconds[level] += getElapsedTime(&start);
+        entry.results[level] = result < 0 ? CACHED_FAIL : CACHED_PASS;
+        updated = 1;
+        if (result < 0)
+            break;
+    }
+
+    if (!updated)
+        ++verify_stats.cache_hits;
+    else if (verify_cache_dir)
+        storeCacheEntry(&digest, &entry);
+    return result;
+}
+
+// structural checks, then type checking for VERIFY_FULL
+static void
+verifyMethodBody(ClassFile *cf, method_info *method, int level,
+        struct CodeMap *map, struct FramePool *pool,
+        struct MethodResult *result)
+{
+    u2 i;
+
+    result->result = 0;
+    for (i = 0; i < method->attributes_count; i++)
+    {
+        if (method->attributes[i].tag != TAG_ATTR_CODE)
+            continue;
+        if (checkCodeStructure(cf, (attr_Code_info *)
+                    method->attributes[i].data, map,
+                    &(result->error)) < 0)
+        {
+            result->result = -1;
+            result->stage = "Invalid code";
+            return;
+        }
+    }
+#if VER_CMP(50, 0)
+    // type checking takes over from inference since 50.0,
+    // older classes get the structural checks only
+    if (level == VERIFY_FULL && cf->major_version >= 50
+            && typecheckMethod(cf, method, map, pool, &(result->error)) < 0)
+    {
+        result->result = -1;
+        result->stage = "Type checking failed";
+    }
+#endif
+}
+
+static void *
+runMethodWorker(void *arg)
+{
+    struct MethodWorkers *workers;
+    struct CodeMap map;
+    struct FramePool pool;
+    u4 i;
+
+    workers = (struct MethodWorkers *) arg;
+    initCodeMap(&map);
+    initFramePool(&pool);
+    while ((i = __atomic_fetch_add(&(workers->next), 1,
+                    __ATOMIC_RELAXED)) < workers->cf->methods_count)
+        verifyMethodBody(workers->cf, &(workers->cf->methods[i]),
+                workers->level, &map, &pool, &(workers->results[i]));
+    releaseFramePool(&pool);
+    releaseCodeMap(&map);
+    return (void *) 0;
+}
+
+static int
+validateMethodBodies(ClassFile *cf, int level)
+{
+    struct MethodWorkers workers;
+    struct MethodResult *result;
+    pthread_t *threads;
+    int count, started, i, res;
+
+    if (cf->methods_count == 0)
+        return 0;
+    workers.cf = cf;
+    workers.level = level;
+    workers.next = 0;
+    workers.results = (struct MethodResult *)
+        allocMemory(cf->methods_count, sizeof (struct MethodResult));
+    if (!workers.results)
+        return -1;
+    count = verify_threads < cf->methods_count
+        ? verify_threads : cf->methods_count;
+    threads = (pthread_t *) 0;
+    if (count > 1)
+        threads = (pthread_t *) allocMemory(count - 1, sizeof (pthread_t));
+    started = 0;
+    for (i = 0; threads && i < count - 1; i++, started++)
+        if (pthread_create(&(threads[i]), (pthread_attr_t *) 0,
+                    runMethodWorker, &workers) != 0)
+            break;
+    // the calling thread takes its share, and whatever
+    // is left if some worker couldn't be started
+    runMethodWorker(&workers);
+    for (i = 0; i < started; i++)
+        pthread_join(threads[i], (void **) 0);
+
+    res = 0;
+    for (i = 0; i < cf->methods_count; i++)
+    {
+        result = &(workers.results[i]);
+        if (result->result < 0)
+        {
+            logError("%s @ cf->methods[%i], pc %u: %s!\r\n",
+                    result->stage, i, result->error.pc,
+                    result->error.reason);
+            res = -1;
+        }
+    }
+    freeMemory(threads);
+    freeMemory(workers.results);
+    return res;
+}
+
+extern int
+validateMethods(ClassFile *cf)
+{
+    u2 i, flags;
+    method_info *method;
+    u1 is_public, is_protected, is_private;
+    u1 is_final, is_abstract;
+    const_Utf8_data *cui;
+
+    if (validateMemberUniqueness(cf, "methods",
+                cf->methods_count, cf->methods) < 0)
+        return -1;
+
     for (i = 0; i < cf->methods_count; i++)
     {
         method = &(cf->methods[i]);
@@ -635,115 +1252,49 @@ validateMethods(ClassFile *cf)
             return -1;
         }
     }
+
+    return validateMethodBodies(cf, VERIFY_STRUCTURAL);
 }
 
 static int
 validateFieldDescriptor(u2 len, u1 *str)
 {
-    u2 i;
-    
     logInfo("Validating FIELD descriptor \"%i: %.*s\"...\r\n",
             len, len, str);
-    if (len == 1)
-    {
-        switch (str[0])
-        {
-            case 'B':case 'C':case 'D':case 'F':
-            case 'I':case 'J':case 'S':case 'Z':
-                return 0;
-            default:
-                logError("Invalid field descriptor \"%.*s\"!\r\n",
-                        len, str);
-                return -1;
-        }
-    }
-    else if (len > 1)
+    if (scanDescriptor(SCAN_FIELD_DESCRIPTOR, len, str,
+                (struct DescriptorToken *) 0, 0) < 0)
     {
-        switch (str[0])
-        {
-            case '[':
-                for (i = 0; i < len;)
-                    if (str[++i] != '[')
-                        break;
-                if (i > 255)
-                {
-                    logError("Invalid array dimension: %i!\r\n", i);
-                    return -1;
-                }
-                return validateFieldDescriptor(len - i, str + i);
-            default:
-                if (str[0] != 'L')
-                {
-                    logError("Binary name doesn't begin with 'L'!\r\n");
-                    return -1;
-                }
-                if (str[len - 1] != ';')
-                {
-                    logError("Binary name doesn't end with ';'!\r\n");
-                    return -1;
-                }
-                return 0;
-        }
+        logError("Invalid field descriptor \"%.*s\"!\r\n", len, str);
+        return -1;
     }
-    return -1;
+    return 0;
 }
 
 static int
 validateMethodDescriptor(u2 len, u1 *str)
 {
-    u2 i, j, count;
+    struct DescriptorToken tokens[256];
+    int count, i, slots;
 
     logInfo("Validating METHOD descriptor \"%i: %.*s\"...\r\n",
             len, len, str);
-    if (str[0] != '(')
+    count = scanDescriptor(SCAN_METHOD_DESCRIPTOR, len, str, tokens, 256);
+    if (count < 0 || count > 256)
+    {
+        logError("Invalid method descriptor \"%.*s\"!\r\n", len, str);
         return -1;
-    i = j = 1;
-    for (; i < len; i++)
+    }
+    // parameters take at most 255 local variable slots
+    slots = 0;
+    for (i = 0; i < count - 1; i++)
+        slots += getTokenSlots(&(tokens[i]));
+    if (slots > 255)
     {
-        if (str[i] == ';' || str[i] == ')')
-        {
-            if (i - j > 0 &&
-                    validateFieldDescriptor(i - j + 1, str + j) < 0)
-                return -1;
-            j = i + 1;
-        }
-        if (str[i] == ')')
-            break;
+        logError("Too many parameters in method descriptor "
+                "\"%.*s\"!\r\n", len, str);
+        return -1;
     }
-ret:
-    ++i;
-    len -= i;
-    str += i;
-    logInfo("Validating RETURN descriptor \"%i: %.*s\"...\r\n",
-            len, len, str);
-    if (len == 1)
-        switch (str[0])
-        {
-            case 'B':case 'C':case 'D':
-            case 'F':case 'I':case 'J':
-            case 'S':case 'Z':case 'V':
-                return 0;
-            default:
-                return -1;
-        }
-    else if (len > 1)
-        switch (str[0])
-        {
-            case '[':
-                for (i = 0; i < len;)
-                    if (str[++i] != '[')
-                        break;
-                if (i > 255)
-                    return -1;
-                return validateFieldDescriptor(len - i, str + i);
-            default:
-                if (str[0] != 'L')
-                    return -1;
-                if (str[len - 1] != ';')
-                    return -1;
-                return 0;
-        }
-    return -1;
+    return 0;
 }
 
 static int
@@ -876,6 +1427,9 @@ validateAttributes_class(ClassFile *cf, u2 len, attr_info *attributes)
                 cui = getConstant_Utf8(cf, asig->signature_index);
                 if (!cui)
                     return -1;
+                if (validateSignature(SCAN_CLASS_SIGNATURE,
+                            cui->length, cui->bytes) < 0)
+                    return -1;
                 break;
             case TAG_ATTR_RUNTIMEVISIBLEANNOTATIONS:
                 break;
@@ -983,6 +1537,9 @@ validateAttributes_field(ClassFile *cf, field_info *field)
                 cui = getConstant_Utf8(cf, asig->signature_index);
                 if (!cui)
                     return -1;
+                if (validateSignature(SCAN_FIELD_SIGNATURE,
+                            cui->length, cui->bytes) < 0)
+                    return -1;
                 break;
             case TAG_ATTR_RUNTIMEVISIBLEANNOTATIONS:
                 break;
@@ -1129,6 +1686,9 @@ validateAttributes_method(ClassFile *cf, method_info *method)
                 cui = getConstant_Utf8(cf, asig->signature_index);
                 if (!cui)
                     return -1;
+                if (validateSignature(SCAN_METHOD_SIGNATURE,
+                            cui->length, cui->bytes) < 0)
+                    return -1;
                 break;
             case TAG_ATTR_RUNTIMEVISIBLEANNOTATIONS:
                 break;
@@ -1269,30 +1829,15 @@ validateAttributes_code(ClassFile *cf, attr_Code_info *code)
 
 // @see jvms8:p121
 static int
-validateJavaTypeSignature(u2 len, u1 *str)
+validateSignature(int kind, u2 len, u1 *str)
 {
-    u2 i, j;
-
-    if (len == 1)
+    if (scanDescriptor(kind, len, str,
+                (struct DescriptorToken *) 0, 0) < 0)
     {
-        switch (str[0])
-        {
-            case 'B':case 'C':case 'D':case 'F':
-            case 'I':case 'J':case 'S':case 'Z':
-                return 0;
-            default:
-                return -1;
-        }
-    }
-    else if (len > 1)
-    {
-        switch (str[0])
-        {
-            case 'L':
-                break;
-        }
+        logError("Invalid signature \"%.*s\"!\r\n", len, str);
+        return -1;
     }
-    return -1;
+    return 0;
 }
 
 